@@ -0,0 +1,1055 @@
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <getopt.h>
+#include <math.h>
+
+#define MAX_LIST 64
+#define MAX_FIELDS 32
+#define MAX_EXTRA_ARGUMENTS 64
+#define MAX_ROUNDS 64
+#define MAX_NAME 64
+
+/**
+ * The columns of a result row after the scenario, in output order. The ones up to
+ * recipe_max come from the kitchen's --summary line. They are followed by blocked_reduction_pct,
+ * which is computed against the round-robin run with --policies, and the ones measured by wait4.
+ */
+const char* summaryColumns[] = {
+	"recipes", "ramsied", "wall_s", "simulated_s", "throughput", "blocked_s", "timeouts", "busy",
+	"restock_depth_max", "restock_lag_mean_ms", "restock_lag_max_ms", "supply_per_s", "consumed", "stockouts",
+	"shelves", "storage_wait_s", "storage_wait_p99", "stash_hit_rate", "storage_visits_saved", "stash_reclaimed",
+	"prefetch_hidden_s", "prefetch_exposed_s", "orders", "orders_shed", "orders_per_s", "order_queue_p99", "order_p99",
+	"deadline_miss_rate", "order_p99_priority0",
+	"recipe_p50", "recipe_p99", "recipe_p999", "recipe_max"
+};
+const int summaryColumnCount = sizeof(summaryColumns) / sizeof(summaryColumns[0]);
+
+/**
+ * @struct listStruct
+ * @brief A comma-separated command line list, split into its items.
+ */
+struct listStruct {
+	int count;
+	char* items[MAX_LIST];
+};
+
+/**
+ * @struct benchSettingsStruct
+ * @brief The scenario matrix and output options selected on the command line.
+ *
+ * @var benchSettingsStruct::kitchens
+ * Kitchen files given to --kitchen, where "default" means the compiled-in kitchen.
+ *
+ * @var benchSettingsStruct::supplies
+ * Supply schedules given to --supply, each run in inventory mode; empty to run without.
+ *
+ * @var benchSettingsStruct::shelves
+ * Shelf counts given to --shelves, where 0 keeps the storage areas whole; empty to run without.
+ *
+ * @var benchSettingsStruct::policies
+ * Recipe policies given to --policies, with round-robin first as the reference; empty to run without.
+ *
+ * @var benchSettingsStruct::extraArguments
+ * Arguments after -- that are passed to every run of the kitchen unchanged.
+ *
+ * @var benchSettingsStruct::gatePath
+ * The baseline to compare the gate scenarios against, or NULL.
+ *
+ * @var benchSettingsStruct::baselinePath
+ * Where to write the gate scenarios' results as a new baseline, or NULL.
+ *
+ * @var benchSettingsStruct::warmup
+ * Rounds each gate scenario runs before the measured ones.
+ *
+ * @var benchSettingsStruct::repetitions
+ * Measured rounds of each gate scenario.
+ *
+ * @var benchSettingsStruct::threshold
+ * The smallest change, in percent of the baseline, that the gate reports as a regression.
+ */
+struct benchSettingsStruct {
+	const char* program;
+	struct listStruct bakers;
+	struct listStruct backends;
+	struct listStruct engines;
+	struct listStruct kitchens;
+	struct listStruct supplies;
+	struct listStruct shelves;
+	struct listStruct policies;
+	const char* dilation;
+	const char* seed;
+	int json;
+	char* extraArguments[MAX_EXTRA_ARGUMENTS];
+	int extraArgumentCount;
+	const char* gatePath;
+	const char* baselinePath;
+	int warmup;
+	int repetitions;
+	double threshold;
+};
+
+struct benchSettingsStruct benchSettings;
+
+/**
+ * @struct summaryStruct
+ * @brief The --summary line of one round.
+ *
+ * @var summaryStruct::keys
+ * The keys of the line, pointing into line.
+ *
+ * @var summaryStruct::values
+ * The values of the line, pointing into line.
+ */
+struct summaryStruct {
+	char line[1024];
+	const char* keys[MAX_FIELDS];
+	const char* values[MAX_FIELDS];
+	int fieldCount;
+};
+
+/**
+ * @struct runStruct
+ * @brief What one run of the kitchen reported and cost.
+ *
+ * @var runStruct::summaries
+ * The summary of each round, in order.
+ *
+ * @var runStruct::usage
+ * The resource usage of the kitchen process, from wait4.
+ */
+struct runStruct {
+	struct summaryStruct summaries[MAX_ROUNDS];
+	int roundCount;
+	int status;
+	struct rusage usage;
+};
+
+int rowsPrinted;
+
+/**
+ * @brief Splits a comma-separated list in place.
+ *
+ * @param list The list to fill.
+ * @param text The text to split, which is modified.
+ */
+void splitList(struct listStruct* list, char* text) {
+	list->count = 0;
+
+	for (char* item = strtok(text, ","); item != NULL; item = strtok(NULL, ",")) {
+		if (list->count == MAX_LIST) {
+			fprintf(stderr, "A list can have at most %d items\n", MAX_LIST);
+			exit(1);
+		}
+
+		list->items[list->count++] = item;
+	}
+}
+
+/**
+ * @brief Returns the value of a --summary key, or NULL if the round did not report it.
+ *
+ * @param summary The round's summary, or NULL if there is none.
+ * @param key The key to look up.
+ * @return The value.
+ */
+const char* findValue(const struct summaryStruct* summary, const char* key) {
+	if (summary == NULL) {
+		return NULL;
+	}
+
+	for (int i = 0; i < summary->fieldCount; i++) {
+		if (strcmp(summary->keys[i], key) == 0) {
+			return summary->values[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Splits a --summary line into its key=value fields.
+ *
+ * @param summary The summary whose line is split in place.
+ */
+void parseSummary(struct summaryStruct* summary) {
+	char* saved;
+	summary->fieldCount = 0;
+
+	strtok_r(summary->line, " \n", &saved);
+
+	for (char* field = strtok_r(NULL, " \n", &saved); field != NULL && summary->fieldCount < MAX_FIELDS; field = strtok_r(NULL, " \n", &saved)) {
+		char* equals = strchr(field, '=');
+
+		if (equals == NULL) {
+			continue;
+		}
+
+		*equals = '\0';
+		summary->keys[summary->fieldCount] = field;
+		summary->values[summary->fieldCount] = equals + 1;
+		summary->fieldCount++;
+	}
+}
+
+/**
+ * @brief Runs the kitchen non-interactively and collects the summary of every round and its resource usage.
+ *
+ * @param run Where to store the outcome.
+ * @param engine The engine to run.
+ * @param backend The synchronization backend, or NULL to leave it to the engine.
+ * @param kitchen The kitchen file, or NULL for the compiled-in kitchen.
+ * @param bakers The number of bakers.
+ * @param rounds The number of rounds, at most MAX_ROUNDS.
+ * @param options Extra kitchen options ending with NULL, or NULL for none.
+ */
+void runKitchen(struct runStruct* run, const char* engine, const char* backend, const char* kitchen, const char* bakers, int rounds, const char* const options[]) {
+	char* arguments[40 + MAX_EXTRA_ARGUMENTS];
+	char roundsText[16];
+	int count = 0;
+
+	snprintf(roundsText, sizeof(roundsText), "%d", rounds);
+
+	arguments[count++] = (char*)benchSettings.program;
+	arguments[count++] = "--bakers";
+	arguments[count++] = (char*)bakers;
+	arguments[count++] = "--rounds";
+	arguments[count++] = roundsText;
+	arguments[count++] = "--verbosity";
+	arguments[count++] = "0";
+	arguments[count++] = "--dilation";
+	arguments[count++] = (char*)benchSettings.dilation;
+	arguments[count++] = "--seed";
+	arguments[count++] = (char*)benchSettings.seed;
+	arguments[count++] = "--engine";
+	arguments[count++] = (char*)engine;
+	arguments[count++] = "--summary";
+
+	if (strcmp(engine, "des") != 0) {
+		arguments[count++] = "--latency";
+	}
+
+	if (backend != NULL) {
+		arguments[count++] = "--backend";
+		arguments[count++] = (char*)backend;
+	}
+
+	if (kitchen != NULL) {
+		arguments[count++] = "--kitchen";
+		arguments[count++] = (char*)kitchen;
+	}
+
+	for (int i = 0; options != NULL && options[i] != NULL && count < 32; i++) {
+		arguments[count++] = (char*)options[i];
+	}
+
+	for (int i = 0; i < benchSettings.extraArgumentCount; i++) {
+		arguments[count++] = benchSettings.extraArguments[i];
+	}
+
+	arguments[count] = NULL;
+
+	int output[2];
+	if (pipe(output) == -1) {
+		perror("Unable to create a pipe");
+		exit(1);
+	}
+
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		perror("Unable to fork");
+		exit(1);
+	}
+
+	if (pid == 0) {
+		int input = open("/dev/null", O_RDONLY);
+
+		dup2(input, STDIN_FILENO);
+		dup2(output[1], STDOUT_FILENO);
+		close(output[0]);
+		close(output[1]);
+
+		execv(benchSettings.program, arguments);
+		perror(benchSettings.program);
+		_exit(127);
+	}
+
+	close(output[1]);
+
+	FILE* stream = fdopen(output[0], "r");
+	char line[sizeof(run->summaries[0].line)];
+
+	run->roundCount = 0;
+
+	while (fgets(line, sizeof(line), stream) != NULL) {
+		if (strncmp(line, "summary ", 8) == 0 && run->roundCount < MAX_ROUNDS) {
+			struct summaryStruct* summary = &run->summaries[run->roundCount++];
+
+			memcpy(summary->line, line, sizeof(line));
+			parseSummary(summary);
+		}
+	}
+
+	fclose(stream);
+
+	if (wait4(pid, &run->status, 0, &run->usage) == -1) {
+		perror("Unable to wait for the kitchen");
+		exit(1);
+	}
+}
+
+/**
+ * @brief Returns the summary of a run's last round.
+ *
+ * @param run The run.
+ * @return The summary, or NULL if the run did not complete a round.
+ */
+const struct summaryStruct* lastSummary(const struct runStruct* run) {
+	return run->roundCount > 0 ? &run->summaries[run->roundCount - 1] : NULL;
+}
+
+/**
+ * @brief Describes how a run ended.
+ *
+ * @param run The run.
+ * @param text Where to write the description.
+ * @param size The size of text.
+ */
+void describeStatus(const struct runStruct* run, char* text, size_t size) {
+	if (WIFEXITED(run->status) && WEXITSTATUS(run->status) == 0 && run->roundCount > 0) {
+		snprintf(text, size, "ok");
+	}
+	else if (WIFSIGNALED(run->status)) {
+		snprintf(text, size, "signal %d", WTERMSIG(run->status));
+	}
+	else {
+		snprintf(text, size, "exit %d", WEXITSTATUS(run->status));
+	}
+}
+
+/**
+ * @brief Prints the CSV header, or opens the JSON array.
+ */
+void printHeader() {
+	if (benchSettings.json) {
+		printf("[\n");
+		return;
+	}
+
+	printf("engine,backend,policy,kitchen,bakers,status");
+	for (int i = 0; i < summaryColumnCount; i++) {
+		printf(",%s", summaryColumns[i]);
+	}
+	printf(",blocked_reduction_pct,user_cpu_s,system_cpu_s,voluntary_switches,involuntary_switches,max_rss_kb\n");
+}
+
+/**
+ * @brief Prints one result row as a CSV line or a JSON object.
+ *
+ * Values the run did not report are left empty in CSV and are null in JSON.
+ *
+ * @param run The run.
+ * @param kitchen The kitchen file, or NULL for the compiled-in kitchen.
+ * @param bakers The number of bakers.
+ * @param blockedReduction How much less time the run spent blocked than the round-robin run of the
+ * same scenario, in percent, or NAN when there is none to compare with.
+ */
+void printRow(const struct runStruct* run, const char* kitchen, const char* bakers, double blockedReduction) {
+	char status[32];
+	describeStatus(run, status, sizeof(status));
+
+	const struct summaryStruct* summary = lastSummary(run);
+	const char* engine = findValue(summary, "engine");
+	const char* backend = findValue(summary, "backend");
+	const char* policy = findValue(summary, "policy");
+	double userSeconds = run->usage.ru_utime.tv_sec + run->usage.ru_utime.tv_usec / 1e6;
+	double systemSeconds = run->usage.ru_stime.tv_sec + run->usage.ru_stime.tv_usec / 1e6;
+
+	if (!benchSettings.json) {
+		printf("%s,%s,%s,%s,%s,%s", engine ? engine : "", backend ? backend : "", policy ? policy : "", kitchen ? kitchen : "default", bakers, status);
+
+		for (int i = 0; i < summaryColumnCount; i++) {
+			const char* value = findValue(summary, summaryColumns[i]);
+			printf(",%s", value ? value : "");
+		}
+
+		if (isnan(blockedReduction)) {
+			printf(",");
+		}
+		else {
+			printf(",%.3f", blockedReduction);
+		}
+
+		printf(",%.6f,%.6f,%ld,%ld,%ld\n", userSeconds, systemSeconds,
+			run->usage.ru_nvcsw, run->usage.ru_nivcsw, run->usage.ru_maxrss);
+		fflush(stdout);
+		return;
+	}
+
+	printf("%s  {\"engine\": \"%s\", \"backend\": \"%s\", \"policy\": \"%s\", \"kitchen\": \"%s\", \"bakers\": %s, \"status\": \"%s\"",
+		rowsPrinted > 0 ? ",\n" : "", engine ? engine : "", backend ? backend : "", policy ? policy : "", kitchen ? kitchen : "default", bakers, status);
+
+	for (int i = 0; i < summaryColumnCount; i++) {
+		const char* value = findValue(summary, summaryColumns[i]);
+		printf(", \"%s\": %s", summaryColumns[i], value ? value : "null");
+	}
+
+	if (isnan(blockedReduction)) {
+		printf(", \"blocked_reduction_pct\": null");
+	}
+	else {
+		printf(", \"blocked_reduction_pct\": %.3f", blockedReduction);
+	}
+
+	printf(", \"user_cpu_s\": %.6f, \"system_cpu_s\": %.6f, \"voluntary_switches\": %ld, \"involuntary_switches\": %ld, \"max_rss_kb\": %ld}",
+		userSeconds, systemSeconds, run->usage.ru_nvcsw, run->usage.ru_nivcsw, run->usage.ru_maxrss);
+	fflush(stdout);
+	rowsPrinted++;
+}
+
+/**
+ * @brief A fixed, seeded kitchen scenario checked by --gate.
+ *
+ * @var gateScenario::options
+ * Extra kitchen options, ending with NULL.
+ */
+typedef struct {
+	const char* name;
+	const char* engine;
+	const char* backend;
+	const char* bakers;
+	const char* options[4];
+} gateScenario;
+
+/**
+ * The scenarios a baseline covers. Changing them invalidates checked-in baselines,
+ * so add new scenarios under new names rather than editing existing ones.
+ */
+const gateScenario gateScenarios[] = {
+	{ "threads-sysv-8", "threads", "sysv", "8", { NULL } },
+	{ "threads-futex-32", "threads", "futex", "32", { NULL } },
+	{ "threads-posix-32-batched", "threads", "posix", "32", { "--batched", NULL } },
+	{ "threads-futex-32-oven-racks", "threads", "futex", "32", { "--oven-racks", "2", NULL } },
+	{ "coroutines-64", "coroutines", NULL, "64", { NULL } },
+	{ "des-256", "des", NULL, "256", { NULL } }
+};
+const int gateScenarioCount = sizeof(gateScenarios) / sizeof(gateScenarios[0]);
+
+/**
+ * @brief The mean of a metric over the repetitions and the half-width of its 95% confidence interval.
+ *
+ * @var estimateStruct::present
+ * Set when the metric was reported; des runs report no latency.
+ */
+struct estimateStruct {
+	int present;
+	double mean;
+	double interval;
+};
+
+/**
+ * @brief A scenario's estimates, measured now or read from a baseline.
+ */
+struct scenarioResultStruct {
+	char name[MAX_NAME];
+	struct estimateStruct throughput;
+	struct estimateStruct p99;
+};
+
+/**
+ * @brief Returns the two-sided 95% Student t quantile for a number of degrees of freedom.
+ *
+ * @param degrees The degrees of freedom, at least 1.
+ * @return The quantile.
+ */
+double studentT95(int degrees) {
+	static const double quantiles[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+	};
+
+	return degrees <= 30 ? quantiles[degrees - 1] : 1.960;
+}
+
+/**
+ * @brief Estimates the mean of a metric from the measured rounds of a run.
+ *
+ * @param estimate Where to store the estimate.
+ * @param run The run.
+ * @param first The first round after the warm-up rounds.
+ * @param key The --summary key of the metric.
+ */
+void estimate(struct estimateStruct* estimate, const struct runStruct* run, int first, const char* key) {
+	double sum = 0;
+	double squares = 0;
+	int count = 0;
+
+	for (int i = first; i < run->roundCount; i++) {
+		const char* value = findValue(&run->summaries[i], key);
+
+		if (value != NULL) {
+			double x = strtod(value, NULL);
+			sum += x;
+			squares += x * x;
+			count++;
+		}
+	}
+
+	estimate->present = count > 0;
+	estimate->mean = count > 0 ? sum / count : 0;
+	estimate->interval = 0;
+
+	if (count > 1) {
+		double variance = (squares - sum * sum / count) / (count - 1);
+		estimate->interval = studentT95(count - 1) * sqrt(variance > 0 ? variance : 0) / sqrt(count);
+	}
+}
+
+/**
+ * @brief Runs every gate scenario with warm-up and measured rounds.
+ *
+ * @param results Where to store one result per scenario.
+ * @param run Scratch space for the runs.
+ * @return 0 if every run completed all its rounds, otherwise -1.
+ */
+int runGateScenarios(struct scenarioResultStruct results[], struct runStruct* run) {
+	int rounds = benchSettings.warmup + benchSettings.repetitions;
+	int failed = 0;
+
+	for (int i = 0; i < gateScenarioCount; i++) {
+		const gateScenario* scenario = &gateScenarios[i];
+
+		fprintf(stderr, "Running %s (%d warm-up and %d measured rounds)\n", scenario->name, benchSettings.warmup, benchSettings.repetitions);
+		runKitchen(run, scenario->engine, scenario->backend, NULL, scenario->bakers, rounds, scenario->options);
+
+		snprintf(results[i].name, MAX_NAME, "%s", scenario->name);
+		estimate(&results[i].throughput, run, benchSettings.warmup, "throughput");
+		estimate(&results[i].p99, run, benchSettings.warmup, "recipe_p99");
+
+		if (run->roundCount != rounds) {
+			char status[32];
+			describeStatus(run, status, sizeof(status));
+			fprintf(stderr, "%s completed %d of %d rounds (%s)\n", scenario->name, run->roundCount, rounds, status);
+			failed = 1;
+		}
+	}
+
+	return failed ? -1 : 0;
+}
+
+/**
+ * @brief Prints a JSON number, or null for a metric that was not reported.
+ *
+ * @param out The stream to print to.
+ * @param present Whether the metric was reported.
+ * @param value The value.
+ */
+void printJsonNumber(FILE* out, int present, double value) {
+	if (present) {
+		fprintf(out, "%.6g", value);
+	}
+	else {
+		fprintf(out, "null");
+	}
+}
+
+/**
+ * @brief Writes the measured estimates as a baseline file.
+ *
+ * @param path The file to write.
+ * @param results One result per gate scenario.
+ */
+void writeBaseline(const char* path, const struct scenarioResultStruct results[]) {
+	FILE* out = fopen(path, "w");
+
+	if (out == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	fprintf(out, "{\n  \"version\": 1,\n  \"dilation\": %s,\n  \"seed\": %s,\n  \"warmup\": %d,\n  \"repetitions\": %d,\n  \"scenarios\": [\n",
+		benchSettings.dilation, benchSettings.seed, benchSettings.warmup, benchSettings.repetitions);
+
+	for (int i = 0; i < gateScenarioCount; i++) {
+		fprintf(out, "    {\"name\": \"%s\", \"throughput_mean\": ", results[i].name);
+		printJsonNumber(out, results[i].throughput.present, results[i].throughput.mean);
+		fprintf(out, ", \"throughput_ci\": ");
+		printJsonNumber(out, results[i].throughput.present, results[i].throughput.interval);
+		fprintf(out, ", \"p99_mean\": ");
+		printJsonNumber(out, results[i].p99.present, results[i].p99.mean);
+		fprintf(out, ", \"p99_ci\": ");
+		printJsonNumber(out, results[i].p99.present, results[i].p99.interval);
+		fprintf(out, "}%s\n", i + 1 < gateScenarioCount ? "," : "");
+	}
+
+	fprintf(out, "  ]\n}\n");
+	fclose(out);
+}
+
+/**
+ * @brief Reads a number that follows a JSON key on a line.
+ *
+ * @param line The line.
+ * @param key The key, without quotes.
+ * @param value Where to store the number.
+ * @return 1 if the key is on the line with a number, 0 if it is missing or null.
+ */
+int readJsonNumber(const char* line, const char* key, double* value) {
+	char quoted[MAX_NAME + 4];
+	snprintf(quoted, sizeof(quoted), "\"%s\":", key);
+
+	const char* found = strstr(line, quoted);
+	if (found == NULL) {
+		return 0;
+	}
+
+	char* end;
+	*value = strtod(found + strlen(quoted), &end);
+	return end != found + strlen(quoted);
+}
+
+/**
+ * @brief Reads a baseline file written by --write-baseline.
+ *
+ * Only that layout is understood: one scenario object per line. Exits the program
+ * if the file cannot be read or was measured with another dilation.
+ *
+ * @param path The file to read.
+ * @param results Where to store the scenarios, at least gateScenarioCount entries.
+ * @return The number of scenarios read.
+ */
+int readBaseline(const char* path, struct scenarioResultStruct results[]) {
+	FILE* in = fopen(path, "r");
+
+	if (in == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	char line[1024];
+	int count = 0;
+	double number;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		if (readJsonNumber(line, "dilation", &number) && number != strtod(benchSettings.dilation, NULL)) {
+			fprintf(stderr, "%s was measured at dilation %g, not %s\n", path, number, benchSettings.dilation);
+			exit(1);
+		}
+
+		const char* name = strstr(line, "\"name\": \"");
+		if (name == NULL || count == gateScenarioCount) {
+			continue;
+		}
+
+		struct scenarioResultStruct* result = &results[count++];
+		sscanf(name + 9, "%63[^\"]", result->name);
+
+		result->throughput.present = readJsonNumber(line, "throughput_mean", &result->throughput.mean);
+		readJsonNumber(line, "throughput_ci", &result->throughput.interval);
+		result->p99.present = readJsonNumber(line, "p99_mean", &result->p99.mean);
+		readJsonNumber(line, "p99_ci", &result->p99.interval);
+	}
+
+	fclose(in);
+	return count;
+}
+
+/**
+ * @brief Compares one metric against its baseline and prints a report line.
+ *
+ * A change only counts when it is larger than both the threshold and the sum of the
+ * two confidence intervals, so ordinary run-to-run noise does not fail the gate.
+ *
+ * @param name The scenario.
+ * @param metric The metric's name.
+ * @param baseline The baseline estimate.
+ * @param current The current estimate.
+ * @param higherIsBetter 1 for throughput, 0 for latency.
+ * @return 1 if the metric regressed, otherwise 0.
+ */
+int compareMetric(const char* name, const char* metric, const struct estimateStruct* baseline, const struct estimateStruct* current, int higherIsBetter) {
+	if (!baseline->present || !current->present) {
+		return 0;
+	}
+
+	double change = current->mean - baseline->mean;
+	double worse = higherIsBetter ? -change : change;
+	double noise = baseline->interval + current->interval;
+	double threshold = benchSettings.threshold / 100 * baseline->mean;
+	double limit = noise > threshold ? noise : threshold;
+	const char* verdict = worse > limit ? "REGRESSED" : -worse > limit ? "improved" : "ok";
+
+	printf("%-28s %-10s %11.4f +- %-9.4f %11.4f +- %-9.4f %+7.1f%%  %s\n", name, metric,
+		baseline->mean, baseline->interval, current->mean, current->interval,
+		baseline->mean != 0 ? 100 * change / baseline->mean : 0.0, verdict);
+
+	return worse > limit;
+}
+
+/**
+ * @brief Runs the gate scenarios and compares them against a baseline file.
+ *
+ * @param path The baseline file.
+ * @param run Scratch space for the runs.
+ * @return 0 if nothing regressed, otherwise 1.
+ */
+int runGate(const char* path, struct runStruct* run) {
+	struct scenarioResultStruct baseline[gateScenarioCount];
+	struct scenarioResultStruct current[gateScenarioCount];
+	int baselineCount = readBaseline(path, baseline);
+	int failed = runGateScenarios(current, run) != 0;
+	int regressions = 0;
+
+	printf("%-28s %-10s %24s %24s %8s\n", "SCENARIO", "METRIC", "BASELINE (95% CI)", "CURRENT (95% CI)", "CHANGE");
+
+	for (int i = 0; i < gateScenarioCount; i++) {
+		int match = -1;
+
+		for (int j = 0; j < baselineCount; j++) {
+			if (strcmp(baseline[j].name, current[i].name) == 0) {
+				match = j;
+			}
+		}
+
+		if (match < 0) {
+			printf("%-28s has no baseline; write one with --write-baseline\n", current[i].name);
+			continue;
+		}
+
+		regressions += compareMetric(current[i].name, "throughput", &baseline[match].throughput, &current[i].throughput, 1);
+		regressions += compareMetric(current[i].name, "p99", &baseline[match].p99, &current[i].p99, 0);
+	}
+
+	if (failed) {
+		printf("Some scenarios did not complete; see the messages above\n");
+		return 1;
+	}
+
+	if (regressions > 0) {
+		printf("%d metrics regressed beyond the noise threshold (%.1f%% or the confidence intervals, whichever is larger)\n",
+			regressions, benchSettings.threshold);
+		return 1;
+	}
+
+	printf("No regressions beyond the noise threshold\n");
+	return 0;
+}
+
+/**
+ * @brief Prints the command line usage of the harness.
+ *
+ * @param name The name the harness was invoked with.
+ */
+void printUsage(const char* name) {
+	printf("Usage: %s [options] [-- KITCHEN_OPTIONS]\n", name);
+	printf("Runs the kitchen once per cell of a scenario matrix and prints one result row per run.\n");
+	printf("  -p, --program PATH     The kitchen binary (default ./program)\n");
+	printf("  -n, --bakers LIST      Baker counts (default 1,2,4,...,4096)\n");
+	printf("  -s, --backends LIST    Synchronization backends for the threads engine (default sysv,posix,futex)\n");
+	printf("  -e, --engines LIST     Engines: threads, des, coroutines (default threads)\n");
+	printf("  -k, --kitchens LIST    Kitchen files giving the capacity sets; default is the compiled-in kitchen\n");
+	printf("  -u, --supply LIST      Supply schedules (UNITS/SECONDS) to run each scenario with in inventory\n");
+	printf("                         mode, giving throughput as a function of the supply rate (default none)\n");
+	printf("  -t, --shelves LIST     Shelves per storage area to run each scenario with, 0 for whole storage\n");
+	printf("                         areas, giving storage wait as a function of the striping (default none)\n");
+	printf("      --policies LIST    Recipe policies to run each scenario with, reporting each one's blocked time\n");
+	printf("                         against round-robin, which always runs first (default none)\n");
+	printf("  -d, --dilation FACTOR  Time dilation of every run (default 1000)\n");
+	printf("      --seed N           Seed of every run (default 1)\n");
+	printf("  -f, --format FORMAT    csv (default) or json\n");
+	printf("  -g, --gate BASELINE    Run the fixed gate scenarios and compare them against BASELINE;\n");
+	printf("                         exits with status 1 if any of them regressed\n");
+	printf("      --write-baseline FILE  Run the fixed gate scenarios and write their results to FILE\n");
+	printf("      --warmup N         Warm-up rounds per gate scenario (default 1)\n");
+	printf("      --repetitions N    Measured rounds per gate scenario (default 5)\n");
+	printf("      --threshold PCT    Smallest change the gate reports, in percent (default 5)\n");
+	printf("  -h, --help             Show this message\n");
+	printf("Options after -- are passed to every run, for example -- --batched --oven-racks 2\n");
+}
+
+/**
+ * @brief Parses the command line into the benchmark settings.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ */
+void parseArguments(int argc, char* argv[]) {
+	static const struct option longOptions[] = {
+		{ "program", required_argument, NULL, 'p' },
+		{ "bakers", required_argument, NULL, 'n' },
+		{ "backends", required_argument, NULL, 's' },
+		{ "engines", required_argument, NULL, 'e' },
+		{ "kitchens", required_argument, NULL, 'k' },
+		{ "supply", required_argument, NULL, 'u' },
+		{ "shelves", required_argument, NULL, 't' },
+		{ "policies", required_argument, NULL, 'P' },
+		{ "dilation", required_argument, NULL, 'd' },
+		{ "seed", required_argument, NULL, 'S' },
+		{ "format", required_argument, NULL, 'f' },
+		{ "gate", required_argument, NULL, 'g' },
+		{ "write-baseline", required_argument, NULL, 'B' },
+		{ "warmup", required_argument, NULL, 'W' },
+		{ "repetitions", required_argument, NULL, 'R' },
+		{ "threshold", required_argument, NULL, 'T' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	static char defaultBakers[] = "1,2,4,8,16,32,64,128,256,512,1024,2048,4096";
+	static char defaultBackends[] = "sysv,posix,futex";
+	static char defaultEngines[] = "threads";
+	static char defaultKitchens[] = "default";
+	static char referencePolicy[] = "round-robin";
+
+	benchSettings.program = "./program";
+	benchSettings.dilation = "1000";
+	benchSettings.seed = "1";
+	benchSettings.warmup = 1;
+	benchSettings.repetitions = 5;
+	benchSettings.threshold = 5;
+	splitList(&benchSettings.bakers, defaultBakers);
+	splitList(&benchSettings.backends, defaultBackends);
+	splitList(&benchSettings.engines, defaultEngines);
+	splitList(&benchSettings.kitchens, defaultKitchens);
+
+	int option;
+	while ((option = getopt_long(argc, argv, "p:n:s:e:k:u:t:d:f:g:h", longOptions, NULL)) != -1) {
+		switch (option) {
+			case 'p':
+				benchSettings.program = optarg;
+				break;
+			case 'n':
+				splitList(&benchSettings.bakers, optarg);
+				break;
+			case 's':
+				splitList(&benchSettings.backends, optarg);
+				break;
+			case 'e':
+				splitList(&benchSettings.engines, optarg);
+				break;
+			case 'k':
+				splitList(&benchSettings.kitchens, optarg);
+				break;
+			case 'u':
+				splitList(&benchSettings.supplies, optarg);
+				break;
+			case 't':
+				splitList(&benchSettings.shelves, optarg);
+				break;
+			case 'P':
+				splitList(&benchSettings.policies, optarg);
+				break;
+			case 'd':
+				benchSettings.dilation = optarg;
+				break;
+			case 'S':
+				benchSettings.seed = optarg;
+				break;
+			case 'f':
+				if (strcmp(optarg, "json") == 0) {
+					benchSettings.json = 1;
+				}
+				else if (strcmp(optarg, "csv") != 0) {
+					fprintf(stderr, "Unknown format %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'g':
+				benchSettings.gatePath = optarg;
+				break;
+			case 'B':
+				benchSettings.baselinePath = optarg;
+				break;
+			case 'W':
+				benchSettings.warmup = atoi(optarg);
+				if (benchSettings.warmup < 0) {
+					fprintf(stderr, "The number of warm-up rounds cannot be negative\n");
+					exit(1);
+				}
+				break;
+			case 'R':
+				benchSettings.repetitions = atoi(optarg);
+				if (benchSettings.repetitions <= 0) {
+					fprintf(stderr, "The number of repetitions must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'T':
+				benchSettings.threshold = atof(optarg);
+				if (benchSettings.threshold < 0) {
+					fprintf(stderr, "The threshold cannot be negative\n");
+					exit(1);
+				}
+				break;
+			case 'h':
+				printUsage(argv[0]);
+				exit(0);
+			default:
+				printUsage(argv[0]);
+				exit(1);
+		}
+	}
+
+	for (int i = optind; i < argc; i++) {
+		if (benchSettings.extraArgumentCount == MAX_EXTRA_ARGUMENTS) {
+			fprintf(stderr, "Too many kitchen options\n");
+			exit(1);
+		}
+
+		benchSettings.extraArguments[benchSettings.extraArgumentCount++] = argv[i];
+	}
+
+	if (benchSettings.policies.count > 0) {
+		struct listStruct* policies = &benchSettings.policies;
+		int reference = 0;
+
+		while (reference < policies->count && strcmp(policies->items[reference], referencePolicy) != 0) {
+			reference++;
+		}
+
+		if (reference == policies->count) {
+			if (policies->count == MAX_LIST) {
+				fprintf(stderr, "Too many policies\n");
+				exit(1);
+			}
+
+			policies->count++;
+		}
+
+		memmove(&policies->items[1], &policies->items[0], reference * sizeof(policies->items[0]));
+		policies->items[0] = referencePolicy;
+	}
+
+	if (benchSettings.warmup + benchSettings.repetitions > MAX_ROUNDS) {
+		fprintf(stderr, "At most %d warm-up and measured rounds are supported\n", MAX_ROUNDS);
+		exit(1);
+	}
+}
+
+/**
+ * @file kitchen_bench.c
+ * @brief A non-interactive benchmark harness for the kitchen.
+ *
+ * The harness runs the kitchen once for every combination of engine, synchronization backend,
+ * kitchen file and baker count, each as its own process with --bakers, --summary and a fast time
+ * dilation. For each run it reports the kitchen's throughput (recipes per simulated second) and recipe
+ * latency percentiles from the summary line, and the CPU time, context switches and peak memory of the
+ * process from wait4, as CSV or JSON. Backends only vary with the threads engine, since the
+ * coroutines engine brings its own and the des engine takes none. With --supply, every run is
+ * repeated in inventory mode for each supply schedule, so the rows give throughput against supply_per_s.
+ * With --shelves, every run is repeated with its storage areas split into that many shelves, so the rows
+ * give storage_wait_s against the number of shelves.
+ * With --policies, every run is repeated with each recipe policy, round-robin first, so the rows give
+ * blocked_reduction_pct: how much less time each policy spent blocked than round-robin in the same scenario.
+ * Passing -- --orders FILE replays the same order stream in every run, so the rows give the orders shed and
+ * the order latency against the baker count.
+ *
+ * With --gate, it instead runs a fixed set of seeded scenarios, each as one kitchen process whose first
+ * --warmup rounds are discarded and whose next --repetitions rounds are measured. It computes 95% confidence
+ * intervals for throughput and recipe p99 latency and compares them with a baseline written earlier by
+ * --write-baseline (bench_baseline.json is the checked-in one). A scenario regresses when it got worse by
+ * more than both --threshold and the two confidence intervals together.
+ *
+ * @note Build with: gcc kitchen_bench.c -o kitchen_bench -lm
+ *
+ * @return int: Returns 0 once every run has been reported, even if some of them failed. The gate returns 1
+ * if any scenario regressed or did not complete.
+ */
+int main(int argc, char* argv[]) {
+	parseArguments(argc, argv);
+
+	struct runStruct* run = malloc(sizeof(struct runStruct));
+
+	if (run == NULL) {
+		perror("Failed to allocate memory for a run");
+		exit(1);
+	}
+
+	if (benchSettings.baselinePath != NULL) {
+		struct scenarioResultStruct results[gateScenarioCount];
+
+		if (runGateScenarios(results, run) != 0) {
+			fprintf(stderr, "Not writing a baseline from incomplete runs\n");
+			return 1;
+		}
+
+		writeBaseline(benchSettings.baselinePath, results);
+		return 0;
+	}
+
+	if (benchSettings.gatePath != NULL) {
+		return runGate(benchSettings.gatePath, run);
+	}
+
+	printHeader();
+
+	for (int e = 0; e < benchSettings.engines.count; e++) {
+		const char* engine = benchSettings.engines.items[e];
+		int backendCount = strcmp(engine, "threads") == 0 ? benchSettings.backends.count : 1;
+
+		for (int s = 0; s < backendCount; s++) {
+			const char* backend = strcmp(engine, "threads") == 0 ? benchSettings.backends.items[s] : NULL;
+
+			for (int k = 0; k < benchSettings.kitchens.count; k++) {
+				const char* kitchen = strcmp(benchSettings.kitchens.items[k], "default") == 0 ? NULL : benchSettings.kitchens.items[k];
+
+				for (int b = 0; b < benchSettings.bakers.count; b++) {
+					for (int u = 0; u == 0 || u < benchSettings.supplies.count; u++) {
+						for (int t = 0; t == 0 || t < benchSettings.shelves.count; t++) {
+							double referenceBlocked = NAN;
+
+							for (int o = 0; o == 0 || o < benchSettings.policies.count; o++) {
+								const char* options[7];
+								int count = 0;
+
+								if (benchSettings.supplies.count > 0) {
+									options[count++] = "--supply";
+									options[count++] = benchSettings.supplies.items[u];
+								}
+								if (benchSettings.shelves.count > 0 && strcmp(benchSettings.shelves.items[t], "0") != 0) {
+									options[count++] = "--shelves";
+									options[count++] = benchSettings.shelves.items[t];
+								}
+								if (benchSettings.policies.count > 0) {
+									options[count++] = "--recipe-policy";
+									options[count++] = benchSettings.policies.items[o];
+								}
+								options[count] = NULL;
+
+								runKitchen(run, engine, backend, kitchen, benchSettings.bakers.items[b], 1, options);
+
+								const char* blocked = findValue(lastSummary(run), "blocked_s");
+								double blockedReduction = NAN;
+
+								if (benchSettings.policies.count > 0 && o == 0 && blocked != NULL) {
+									referenceBlocked = atof(blocked);
+								}
+								if (benchSettings.policies.count > 0 && blocked != NULL && referenceBlocked > 0) {
+									blockedReduction = (referenceBlocked - atof(blocked)) / referenceBlocked * 100;
+								}
+
+								printRow(run, kitchen, benchSettings.bakers.items[b], blockedReduction);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (benchSettings.json) {
+		printf("\n]\n");
+	}
+
+	free(run);
+	return 0;
+}
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <getopt.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "kitchenstat.h"
+
+/**
+ * The number of bakers listed one by one below the state counts.
+ */
+#define LISTED_BAKERS 20
+
+const char* bakerStateNames[] = { "idle", "gathering", "mixing", "baking", "finished" };
+
+/**
+ * @brief Counter values from the previous refresh, for computing rates.
+ *
+ * @var previousStruct::time
+ * CLOCK_MONOTONIC time of the previous refresh in nanoseconds, or 0 before the first one.
+ */
+struct previousStruct {
+	uint64_t time;
+	unsigned long long acquires[KITCHENSTAT_MAX_RESOURCES];
+	unsigned long long completed[KITCHENSTAT_MAX_RECIPES];
+};
+
+struct previousStruct previous;
+
+/**
+ * @brief Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ *
+ * @return The time in nanoseconds.
+ */
+uint64_t monotonicNanoseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * @brief Attaches read-only to the live statistics segment of a running kitchen.
+ *
+ * @param programPath The path the kitchen derives its shared memory keys from.
+ * @return The segment, exits the program if there is none or its layout is not the one this monitor was built for.
+ */
+const KitchenstatSegment* attachSegment(const char* programPath) {
+	key_t key = ftok(programPath, KITCHENSTAT_SHARED_MEMORY_ID);
+
+	if (key == -1) {
+		perror(programPath);
+		exit(1);
+	}
+
+	int id = shmget(key, 0, 0);
+
+	if (id < 0) {
+		fprintf(stderr, "No kitchen is publishing live statistics; start it with --live-stats\n");
+		exit(1);
+	}
+
+	const KitchenstatSegment* segment = shmat(id, NULL, SHM_RDONLY);
+
+	if (segment == (void*)-1) {
+		perror("Unable to attach");
+		exit(1);
+	}
+
+	if (atomic_load_explicit(&segment->magic, memory_order_acquire) != KITCHENSTAT_MAGIC) {
+		fprintf(stderr, "The shared memory segment does not hold kitchen statistics\n");
+		exit(1);
+	}
+
+	if (segment->version != KITCHENSTAT_VERSION || segment->size != sizeof(KitchenstatSegment)) {
+		fprintf(stderr, "The kitchen publishes statistics version %u, this monitor reads version %d\n",
+			segment->version, KITCHENSTAT_VERSION);
+		exit(1);
+	}
+
+	return segment;
+}
+
+/**
+ * @brief Prints one screen of statistics.
+ *
+ * Rates are computed against the previous refresh and are left blank on the first one.
+ *
+ * @param segment The live statistics segment.
+ */
+void render(const KitchenstatSegment* segment) {
+	uint64_t now = monotonicNanoseconds();
+	double elapsed = previous.time != 0 ? (now - previous.time) / 1e9 : 0;
+	int running = atomic_load_explicit(&segment->running, memory_order_relaxed);
+	int bakers = atomic_load_explicit(&segment->bakers, memory_order_relaxed);
+	uint64_t roundStart = atomic_load_explicit(&segment->roundStart, memory_order_relaxed);
+
+	if (isatty(STDOUT_FILENO)) {
+		printf("\033[H\033[2J");
+	}
+
+	printf("Kitchen %d, round %d with %d bakers, ", segment->pid, atomic_load_explicit(&segment->round, memory_order_relaxed), bakers);
+	if (running) {
+		printf("running for %.1f s\n\n", (now - roundStart) / 1e9);
+	}
+	else {
+		printf("waiting for the next round\n\n");
+	}
+
+	printf("%-16s %8s %8s %8s %10s %12s\n", "RESOURCE", "CAPACITY", "IN USE", "WAITING", "TIMEOUTS", "ACQUIRES/S");
+
+	for (int i = 0; i < segment->resourceCount; i++) {
+		const KitchenstatResource* counters = &segment->resources[i];
+		unsigned long long acquires = atomic_load_explicit(&counters->acquires, memory_order_relaxed);
+
+		printf("%-16s %8d %8d %8d %10llu", segment->resourceNames[i], segment->capacities[i],
+			atomic_load_explicit(&counters->inUse, memory_order_relaxed),
+			atomic_load_explicit(&counters->waiting, memory_order_relaxed),
+			atomic_load_explicit(&counters->timeouts, memory_order_relaxed));
+		if (elapsed > 0) {
+			printf(" %12.1f", (acquires - previous.acquires[i]) / elapsed);
+		}
+		printf("\n");
+
+		previous.acquires[i] = acquires;
+	}
+
+	printf("\nRestock queue: %d returns\n", atomic_load_explicit(&segment->restockQueued, memory_order_relaxed));
+
+	printf("\n%-16s %10s %10s\n", "RECIPE", "COMPLETED", "PER S");
+
+	for (int i = 0; i < segment->recipeCount; i++) {
+		unsigned long long completed = atomic_load_explicit(&segment->recipes[i].completed, memory_order_relaxed);
+
+		printf("%-16s %10llu", segment->recipeNames[i], completed);
+		if (elapsed > 0) {
+			printf(" %10.1f", (completed - previous.completed[i]) / elapsed);
+		}
+		printf("\n");
+
+		previous.completed[i] = completed;
+	}
+
+	int tracked = bakers < KITCHENSTAT_MAX_BAKERS ? bakers : KITCHENSTAT_MAX_BAKERS;
+	int stateCounts[KITCHENSTAT_STATE_COUNT] = { 0 };
+
+	for (int i = 0; i < tracked; i++) {
+		int state = atomic_load_explicit(&segment->bakerStates[i].state, memory_order_relaxed);
+
+		if (state < KITCHENSTAT_STATE_COUNT) {
+			stateCounts[state]++;
+		}
+	}
+
+	printf("\nBAKERS");
+	for (int i = 0; i < KITCHENSTAT_STATE_COUNT; i++) {
+		printf("  %s %d", bakerStateNames[i], stateCounts[i]);
+	}
+	printf("\n");
+
+	int listed = 0;
+	for (int i = 0; i < tracked && listed < LISTED_BAKERS; i++) {
+		int state = atomic_load_explicit(&segment->bakerStates[i].state, memory_order_relaxed);
+		int recipe = atomic_load_explicit(&segment->bakerStates[i].recipe, memory_order_relaxed);
+
+		if (state == KITCHENSTAT_IDLE || state == KITCHENSTAT_FINISHED || state >= KITCHENSTAT_STATE_COUNT) {
+			continue;
+		}
+
+		printf("  Baker %-6d %-10s %s\n", i, bakerStateNames[state],
+			recipe < segment->recipeCount ? segment->recipeNames[recipe] : "");
+		listed++;
+	}
+
+	fflush(stdout);
+	previous.time = now;
+}
+
+/**
+ * @brief Prints the command line usage of the monitor.
+ *
+ * @param name The name the monitor was invoked with.
+ */
+void printUsage(const char* name) {
+	printf("Usage: %s [options] [PROGRAM_PATH]\n", name);
+	printf("Shows the live statistics of a kitchen started with --live-stats in the same directory,\n");
+	printf("or of the kitchen whose shared memory keys are derived from PROGRAM_PATH (default ./program.c).\n");
+	printf("  -n, --iterations N     Refresh N times and exit (default: until the kitchen exits)\n");
+	printf("  -h, --help             Show this message\n");
+}
+
+/**
+ * @file kitchenstat.c
+ * @brief A top-like monitor for a running kitchen.
+ *
+ * The monitor attaches read-only to the live statistics segment described in kitchenstat.h and
+ * prints it once a second: units in use, bakers waiting, timed-out waits and acquires per second for every resource,
+ * the restock queue, recipes completed, and what the bakers are doing. It never writes to the segment, so watching a
+ * run does not slow the bakers down beyond the counters they keep anyway.
+ *
+ * @note Build with: gcc kitchenstat.c -o kitchenstat
+ *
+ * @return int: Returns 0 when the kitchen exits or the requested number of refreshes is done.
+ */
+int main(int argc, char* argv[]) {
+	static const struct option longOptions[] = {
+		{ "iterations", required_argument, NULL, 'n' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	long iterations = 0;
+
+	int option;
+	while ((option = getopt_long(argc, argv, "n:h", longOptions, NULL)) != -1) {
+		switch (option) {
+			case 'n':
+				iterations = atol(optarg);
+				if (iterations <= 0) {
+					fprintf(stderr, "The number of iterations must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'h':
+				printUsage(argv[0]);
+				exit(0);
+			default:
+				printUsage(argv[0]);
+				exit(1);
+		}
+	}
+
+	const KitchenstatSegment* segment = attachSegment(optind < argc ? argv[optind] : "./program.c");
+
+	for (long i = 0; iterations == 0 || i < iterations; i++) {
+		if (i > 0) {
+			sleep(1);
+		}
+
+		if (kill(segment->pid, 0) == -1 && errno == ESRCH) {
+			printf("Kitchen %d has exited\n", segment->pid);
+			break;
+		}
+
+		render(segment);
+	}
+
+	shmdt(segment);
+	return 0;
+}
@@ -0,0 +1,138 @@
+#ifndef KITCHENSTAT_H
+#define KITCHENSTAT_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * @file kitchenstat.h
+ * @brief The layout of the live statistics segment shared by program.c and kitchenstat.c.
+ *
+ * With --live-stats the kitchen creates a SysV shared memory segment with the key
+ * ftok(programPath, KITCHENSTAT_SHARED_MEMORY_ID) and keeps its counters up to date with
+ * relaxed atomic operations. The kitchenstat monitor attaches to it read-only.
+ *
+ * Change KITCHENSTAT_VERSION whenever the layout changes, so that a monitor built
+ * against another layout refuses to read the segment instead of misreading it.
+ */
+
+#define KITCHENSTAT_MAGIC 0x4B535441u
+#define KITCHENSTAT_VERSION 3
+#define KITCHENSTAT_SHARED_MEMORY_ID 1
+#define KITCHENSTAT_MAX_RESOURCES 32
+#define KITCHENSTAT_MAX_RECIPES 32
+#define KITCHENSTAT_MAX_BAKERS 65536
+#define KITCHENSTAT_NAME_SIZE 24
+
+/**
+ * @brief What a baker is doing, as shown by the monitor.
+ */
+enum kitchenstatBakerState {
+	KITCHENSTAT_IDLE,
+	KITCHENSTAT_GATHERING,
+	KITCHENSTAT_MIXING,
+	KITCHENSTAT_BAKING,
+	KITCHENSTAT_FINISHED,
+	KITCHENSTAT_STATE_COUNT
+};
+
+/**
+ * @brief The live counters of one resource, on a cache line of their own.
+ *
+ * @var KitchenstatResource::waiting
+ * The number of bakers blocked waiting for the resource.
+ *
+ * @var KitchenstatResource::inUse
+ * The number of units of the resource held by bakers.
+ *
+ * @var KitchenstatResource::acquires
+ * The number of units taken since the kitchen started.
+ *
+ * @var KitchenstatResource::timeouts
+ * The number of timed waits for the resource that reached their deadline since the kitchen started.
+ */
+typedef struct {
+	_Alignas(64) atomic_int waiting;
+	atomic_int inUse;
+	atomic_ullong acquires;
+	atomic_ullong timeouts;
+} KitchenstatResource;
+
+/**
+ * @brief The live counter of one recipe, on a cache line of its own.
+ *
+ * @var KitchenstatRecipe::completed
+ * The number of recipes of this kind baked since the kitchen started.
+ */
+typedef struct {
+	_Alignas(64) atomic_ullong completed;
+} KitchenstatRecipe;
+
+/**
+ * @brief What one baker is doing. Only the baker writes it.
+ *
+ * @var KitchenstatBaker::state
+ * One of the kitchenstatBakerState values.
+ *
+ * @var KitchenstatBaker::recipe
+ * The recipe the baker is working on.
+ */
+typedef struct {
+	atomic_uchar state;
+	atomic_uchar recipe;
+} KitchenstatBaker;
+
+/**
+ * @brief The live statistics segment.
+ *
+ * Everything before the counters is written once when the segment is created, and
+ * magic is stored last, so a reader that sees the magic number sees the whole header.
+ *
+ * @var KitchenstatSegment::size
+ * sizeof(KitchenstatSegment) in the writer.
+ *
+ * @var KitchenstatSegment::pid
+ * The process ID of the kitchen.
+ *
+ * @var KitchenstatSegment::capacities
+ * The number of units of each resource.
+ *
+ * @var KitchenstatSegment::round
+ * The number of rounds started so far.
+ *
+ * @var KitchenstatSegment::bakers
+ * The number of bakers in the current round.
+ *
+ * @var KitchenstatSegment::running
+ * Set while a round is running.
+ *
+ * @var KitchenstatSegment::roundStart
+ * CLOCK_MONOTONIC time at which the current round started, in nanoseconds.
+ *
+ * @var KitchenstatSegment::restockQueued
+ * The number of returns waiting in the restock queue.
+ *
+ * @var KitchenstatSegment::bakerStates
+ * The state of the first KITCHENSTAT_MAX_BAKERS bakers, indexed by baker.
+ */
+typedef struct {
+	atomic_uint magic;
+	uint32_t version;
+	uint32_t size;
+	int32_t pid;
+	int32_t resourceCount;
+	int32_t recipeCount;
+	int32_t capacities[KITCHENSTAT_MAX_RESOURCES];
+	char resourceNames[KITCHENSTAT_MAX_RESOURCES][KITCHENSTAT_NAME_SIZE];
+	char recipeNames[KITCHENSTAT_MAX_RECIPES][KITCHENSTAT_NAME_SIZE];
+	_Alignas(64) atomic_int round;
+	atomic_int bakers;
+	atomic_int running;
+	atomic_ullong roundStart;
+	atomic_int restockQueued;
+	KitchenstatResource resources[KITCHENSTAT_MAX_RESOURCES];
+	KitchenstatRecipe recipes[KITCHENSTAT_MAX_RECIPES];
+	KitchenstatBaker bakerStates[KITCHENSTAT_MAX_BAKERS];
+} KitchenstatSegment;
+
+#endif
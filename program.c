@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <pthread.h>
 #include <stdio.h>
 #include <errno.h>
@@ -11,63 +12,174 @@
 #include <sys/shm.h>
 #include <sys/stat.h>
 #include <sys/sem.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <ucontext.h>
+#include <getopt.h>
+#include <time.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <stdint.h>
+#include <math.h>
+#include <strings.h>
+#include <limits.h>
+
+#include "kitchenstat.h"
 
-const int FLOUR = 0;
-const int SUGAR = 1;
-const int YEAST = 2;
-const int BAKING_SODA = 3;
-const int SALT = 4;
-const int CINNAMON = 5;
-const int EGGS = 6;
-const int MILK = 7;
-const int BUTTER = 8;
-
-const int MIXER = 0;
-const int BOWL = 1;
-const int SPOON = 2;
-
-const int PANTRY = 3;
-const int REFRIGERATOR = 4;
-
-const int OVEN = 5;
-
-const int COOKIE = 0;
-const int PANCAKE = 1;
-const int PIZZA = 2;
-const int PRETZEL = 3;
-const int CINROLL = 4;
-
-const int cookieRecipe[] = { FLOUR, SUGAR, MILK, BUTTER };
-const int pancakeRecipe[] = { FLOUR, SUGAR, BAKING_SODA, SALT, EGGS, MILK, BUTTER };
-const int pizzaDoughRecipe[] = { YEAST, SUGAR, SALT };
-const int softPretzelRecipe[] = { FLOUR, SUGAR, SALT, YEAST, BAKING_SODA, EGGS };
-const int cinnamonRollRecipe[] = { FLOUR, SUGAR, SALT, BUTTER, EGGS, CINNAMON };
-
-const int pantryIngredients[] = { FLOUR, SUGAR, YEAST, BAKING_SODA, SALT, CINNAMON };
-const int refrigeratorIngredients[] = { EGGS, MILK, BUTTER };
-
-int mixerSemID;
-int pantrySemID;
-int refrigeratorSemID;
-int bowlSemID;
-int spoonSemID;
-int ovenSemID;
-
-int semOffset = OVEN + 1;
-
-int flourSemId;
-int sugarSemId;
-int yeastSemId;
-int bakingSodaSemId;
-int saltSemId;
-int cinnamonSemId;
-int eggsSemId;
-int milkSemId;
-int butterSemId;
+/**
+ * The default kitchen. Each list names one kind of kitchen item with its capacity;
+ * the identifiers below and the initializer of the kitchen table are generated from
+ * these lists at compile time, so the default kitchen needs no setup at startup.
+ * A kitchen file given with --kitchen replaces the table (see loadKitchen).
+ */
+#define DEFAULT_TOOLS(X) \
+	X(MIXER, "mixer", 2) \
+	X(BOWL, "bowl", 3) \
+	X(SPOON, "spoon", 5)
+
+#define DEFAULT_STORAGES(X) \
+	X(PANTRY, "pantry", 1) \
+	X(REFRIGERATOR, "refrigerator", 2)
+
+#define DEFAULT_OVENS 1
+
+#define DEFAULT_INGREDIENTS(X, ...) \
+	X(FLOUR, "Flour", PANTRY, 1, __VA_ARGS__) \
+	X(SUGAR, "Sugar", PANTRY, 1, __VA_ARGS__) \
+	X(YEAST, "Yeast", PANTRY, 1, __VA_ARGS__) \
+	X(BAKING_SODA, "Baking Soda", PANTRY, 1, __VA_ARGS__) \
+	X(SALT, "Salt", PANTRY, 1, __VA_ARGS__) \
+	X(CINNAMON, "Cinnamon", PANTRY, 1, __VA_ARGS__) \
+	X(EGGS, "Eggs", REFRIGERATOR, 2, __VA_ARGS__) \
+	X(MILK, "Milk", REFRIGERATOR, 2, __VA_ARGS__) \
+	X(BUTTER, "Butter", REFRIGERATOR, 2, __VA_ARGS__)
+
+#define DEFAULT_RECIPES(X) \
+	X(COOKIE, "Cookie", "Cookies", (1 << FLOUR) | (1 << SUGAR) | (1 << MILK) | (1 << BUTTER)) \
+	X(PANCAKE, "Pancake", "Pancakes", (1 << FLOUR) | (1 << SUGAR) | (1 << BAKING_SODA) | (1 << SALT) | (1 << EGGS) | (1 << MILK) | (1 << BUTTER)) \
+	X(PIZZA, "Pizza Dough", "Pizza Dough", (1 << YEAST) | (1 << SUGAR) | (1 << SALT)) \
+	X(PRETZEL, "Soft Pretzel", "Soft Pretzels", (1 << FLOUR) | (1 << SUGAR) | (1 << SALT) | (1 << YEAST) | (1 << BAKING_SODA) | (1 << EGGS)) \
+	X(CINROLL, "Cinnamon Roll", "Cinnamon Rolls", (1 << FLOUR) | (1 << SUGAR) | (1 << SALT) | (1 << BUTTER) | (1 << EGGS) | (1 << CINNAMON))
+
+#define KITCHEN_ID(id, ...) id,
+#define KITCHEN_NAME(id, name, ...) [id] = name,
+#define KITCHEN_CAPACITY(id, name, capacity) [id] = capacity,
+#define KITCHEN_INGREDIENT_NAME(id, name, storage, capacity, ...) [DEFAULT_OVEN + 1 + id] = name,
+#define KITCHEN_INGREDIENT_CAPACITY(id, name, storage, capacity, ...) [DEFAULT_OVEN + 1 + id] = capacity,
+#define KITCHEN_INGREDIENT_STORAGE(id, name, storage, capacity, ...) [id] = storage,
+#define KITCHEN_STORAGE_BIT(id, name, storage, capacity, of) | ((storage) == (of) ? 1u << (id) : 0u)
+#define KITCHEN_STORAGE_INGREDIENTS(id, name, capacity) [id] = 0u DEFAULT_INGREDIENTS(KITCHEN_STORAGE_BIT, id),
+#define KITCHEN_PLURAL_NAME(id, name, plural, ingredients) [id] = plural,
+#define KITCHEN_RECIPE_INGREDIENTS(id, name, plural, ingredients) [id] = ingredients,
+
+enum defaultTool { DEFAULT_TOOLS(KITCHEN_ID) DEFAULT_TOOL_COUNT };
+enum defaultStorage { DEFAULT_STORAGE_BEFORE = DEFAULT_TOOL_COUNT - 1, DEFAULT_STORAGES(KITCHEN_ID) DEFAULT_OVEN };
+enum defaultIngredient { DEFAULT_INGREDIENTS(KITCHEN_ID) DEFAULT_INGREDIENT_COUNT };
+enum defaultRecipe { DEFAULT_RECIPES(KITCHEN_ID) DEFAULT_RECIPE_COUNT };
+
+/**
+ * The most resources (tools, storage areas, the oven and ingredients together) and
+ * recipes a kitchen can have. A set of resources or recipes fits in one 32-bit mask.
+ */
+#define KITCHEN_MAX_RESOURCES 32
+#define KITCHEN_MAX_RECIPES 32
+
+/**
+ * @struct kitchenStruct
+ * @brief The kitchen the bakers work in.
+ *
+ * Resources are numbered with the tools first, then the storage areas, then the
+ * oven, followed by the ingredients starting at semOffset.
+ *
+ * @var kitchenStruct::names
+ * The name of each resource, indexed by resource.
+ *
+ * @var kitchenStruct::capacities
+ * The number of units of each resource, indexed by resource. The oven's capacity
+ * is the number of ovens.
+ *
+ * @var kitchenStruct::tools
+ * The tools a baker takes to mix a recipe, which are resources 0 to toolCount - 1.
+ *
+ * @var kitchenStruct::storageCount
+ * The number of entries in storages.
+ *
+ * @var kitchenStruct::storages
+ * The resources a baker enters to reach ingredients: the storage areas, which are
+ * resources toolCount to oven - 1, or the shelves they are split into with --shelves.
+ *
+ * @var kitchenStruct::ingredientStorage
+ * The storage resource (a storage area or a shelf) that holds each ingredient, indexed by ingredient.
+ *
+ * @var kitchenStruct::storageIngredients
+ * A bitmask of the ingredients each storage area or shelf holds, indexed by storage resource.
+ *
+ * @var kitchenStruct::recipeIngredients
+ * The ingredients of each recipe, indexed by recipe, with one bit per ingredient.
+ * A baker's remaining work on a recipe is a copy of its mask with the bits of
+ * gathered ingredients cleared.
+ */
+struct kitchenStruct {
+	int toolCount;
+	int storageCount;
+	int ingredientCount;
+	int recipeCount;
+	int oven;
+	const char* names[KITCHEN_MAX_RESOURCES];
+	int capacities[KITCHEN_MAX_RESOURCES];
+	int tools[KITCHEN_MAX_RESOURCES];
+	int storages[KITCHEN_MAX_RESOURCES];
+	int ingredientStorage[KITCHEN_MAX_RESOURCES];
+	uint32_t storageIngredients[KITCHEN_MAX_RESOURCES];
+	const char* recipeNames[KITCHEN_MAX_RECIPES];
+	const char* recipePluralNames[KITCHEN_MAX_RECIPES];
+	uint32_t recipeIngredients[KITCHEN_MAX_RECIPES];
+};
+
+struct kitchenStruct kitchen = {
+	.toolCount = DEFAULT_TOOL_COUNT,
+	.storageCount = DEFAULT_OVEN - DEFAULT_TOOL_COUNT,
+	.ingredientCount = DEFAULT_INGREDIENT_COUNT,
+	.recipeCount = DEFAULT_RECIPE_COUNT,
+	.oven = DEFAULT_OVEN,
+	.names = {
+		DEFAULT_TOOLS(KITCHEN_NAME)
+		DEFAULT_STORAGES(KITCHEN_NAME)
+		[DEFAULT_OVEN] = "oven",
+		DEFAULT_INGREDIENTS(KITCHEN_INGREDIENT_NAME)
+	},
+	.capacities = {
+		DEFAULT_TOOLS(KITCHEN_CAPACITY)
+		DEFAULT_STORAGES(KITCHEN_CAPACITY)
+		[DEFAULT_OVEN] = DEFAULT_OVENS,
+		DEFAULT_INGREDIENTS(KITCHEN_INGREDIENT_CAPACITY)
+	},
+	.tools = { DEFAULT_TOOLS(KITCHEN_ID) },
+	.storages = { DEFAULT_STORAGES(KITCHEN_ID) },
+	.ingredientStorage = { DEFAULT_INGREDIENTS(KITCHEN_INGREDIENT_STORAGE) },
+	.storageIngredients = { DEFAULT_STORAGES(KITCHEN_STORAGE_INGREDIENTS) },
+	.recipeNames = { DEFAULT_RECIPES(KITCHEN_NAME) },
+	.recipePluralNames = { DEFAULT_RECIPES(KITCHEN_PLURAL_NAME) },
+	.recipeIngredients = { DEFAULT_RECIPES(KITCHEN_RECIPE_INGREDIENTS) }
+};
+
+int semOffset = DEFAULT_OVEN + 1;
+
+int resourceCount = DEFAULT_OVEN + 1 + DEFAULT_INGREDIENT_COUNT;
 
 const char* programPath = "./program.c";
 int ramsiedSharedMemoryID = 0;
 
+/**
+ * The segment holding the ramsied baker, the ramsied recipe and whether the ramsay is
+ * still pending. main attaches it once and every baker reads it through this mapping.
+ */
+struct sharedMem ramsiedMemory;
+
 /**
  * An array of ANSI escape code strings representing different colors.
  * These codes can be used to change the color of text output in the terminal.
@@ -93,6 +205,7 @@ const char* colors[] = {
 
 struct semaphoresStruct semaphores;
 struct sharedMemStruct sharedMemory;
+struct settingsStruct settings;
 
 /**
  * @struct semaphoresStruct
@@ -106,10 +219,245 @@ struct sharedMemStruct sharedMemory;
  *
  * @var semaphoresStruct::semaphoreIds
  * A pointer to an array of semaphore IDs.
+ *
+ * @var semaphoresStruct::setId
+ * The ID of the semaphore set that holds every resource. The index of a resource
+ * within the set is the resource identifier itself.
  */
 struct semaphoresStruct {
 	int length;
 	int* semaphoreIds;
+	int setId;
+};
+
+/**
+ * @brief The outcome of an acquire that is allowed to fail.
+ *
+ * ACQUIRE_BUSY means a try found no free unit, ACQUIRE_TIMED_OUT that a timed
+ * acquire reached its deadline, and ACQUIRE_FAILED that the backend reported an error.
+ * In every case but ACQUIRE_OK the caller holds nothing.
+ */
+enum acquireStatus {
+	ACQUIRE_OK,
+	ACQUIRE_BUSY,
+	ACQUIRE_TIMED_OUT,
+	ACQUIRE_FAILED
+};
+
+/**
+ * @struct syncBackend
+ * @brief The operations that implement the kitchen's counting semaphores.
+ *
+ * useResource, useIngredient, recoverResource and recoverIngredient go through the
+ * backend selected at startup, so the synchronization mechanism can be swapped
+ * without touching the baker logic.
+ *
+ * @var syncBackend::name
+ * The name used to select the backend on the command line.
+ *
+ * @var syncBackend::init
+ * Creates storage for the given number of resources.
+ *
+ * @var syncBackend::setValue
+ * Sets the number of available units of a resource.
+ *
+ * @var syncBackend::acquire
+ * Takes one unit of a resource, blocking until one is available.
+ *
+ * @var syncBackend::release
+ * Gives one unit of a resource back.
+ *
+ * @var syncBackend::tryAcquire
+ * Takes one unit of a resource only if one is free; returns 1 if it did, otherwise 0.
+ *
+ * @var syncBackend::timedAcquire
+ * Takes one unit of a resource, waiting at most the given number of wall-clock
+ * nanoseconds; returns ACQUIRE_OK, ACQUIRE_TIMED_OUT or ACQUIRE_FAILED.
+ *
+ * @var syncBackend::probe
+ * Returns the number of free units of a resource without taking any. The answer is
+ * only a hint: it can be out of date by the time the caller acts on it.
+ *
+ * @var syncBackend::acquireMany
+ * Takes one unit of each listed resource, all or nothing: the caller never holds
+ * part of the set while blocked waiting for the rest.
+ *
+ * @var syncBackend::releaseMany
+ * Gives one unit of each listed resource back.
+ *
+ * @var syncBackend::cleanup
+ * Releases everything created by init.
+ */
+struct syncBackend {
+	const char* name;
+	int (*init)(int count);
+	int (*setValue)(int resource, int value);
+	int (*acquire)(int resource);
+	int (*release)(int resource);
+	int (*tryAcquire)(int resource);
+	int (*timedAcquire)(int resource, uint64_t wallNanoseconds);
+	int (*probe)(int resource);
+	int (*acquireMany)(const int resources[], int count);
+	int (*releaseMany)(const int resources[], int count);
+	int (*cleanup)(void);
+};
+
+/**
+ * @struct settingsStruct
+ * @brief Run-time options selected on the command line.
+ *
+ * @var settingsStruct::batchedGather
+ * When set, a baker takes every pantry (or refrigerator) ingredient its recipe needs
+ * in a single visit instead of entering the storage area once per ingredient.
+ *
+ * @var settingsStruct::backend
+ * The synchronization backend used for every resource.
+ *
+ * @var settingsStruct::benchmarkBackends
+ * When set, the program compares the synchronization backends and exits.
+ *
+ * @var settingsStruct::verbosity
+ * The most detailed log level printed: LOG_NONE, LOG_SUMMARY or LOG_ALL.
+ *
+ * @var settingsStruct::binaryLogPath
+ * When not NULL, events are written raw to this file instead of as text.
+ *
+ * @var settingsStruct::dilation
+ * How many times faster than wall time simulated time runs.
+ *
+ * @var settingsStruct::serviceTimeDistribution
+ * How operation durations are drawn around their configured means.
+ *
+ * @var settingsStruct::seed
+ * The seed of the service-time generators, and of the ramsied choice when seeded is set.
+ *
+ * @var settingsStruct::seeded
+ * Set when the seed was given on the command line.
+ *
+ * @var settingsStruct::engine
+ * How rounds are run: one thread per baker, coroutines on a worker pool, or the
+ * discrete-event engine.
+ *
+ * @var settingsStruct::workers
+ * The number of worker threads that run baker coroutines.
+ *
+ * @var settingsStruct::ovenRacks
+ * How many recipes one oven bakes per cycle. With a single rack every recipe
+ * takes the oven for itself.
+ *
+ * @var settingsStruct::batchWindow
+ * How long, in simulated seconds, a baker holds the oven door open for other
+ * recipes to join its batch before baking.
+ *
+ * @var settingsStruct::latencyStats
+ * When set, every acquire and release is timed and each round reports wait-time and
+ * hold-time percentiles per resource and start-to-finish time per recipe.
+ *
+ * @var settingsStruct::liveStats
+ * When set, the kitchen publishes live counters in a shared memory segment for the
+ * kitchenstat monitor.
+ *
+ * @var settingsStruct::bakers
+ * The number of bakers of every round, or 0 to ask before each round.
+ *
+ * @var settingsStruct::rounds
+ * The number of rounds to run before exiting, or 0 to run until the input ends.
+ *
+ * @var settingsStruct::summary
+ * When set, each round ends with a one-line key=value summary for scripts.
+ *
+ * @var settingsStruct::recipePolicy
+ * How bakers pick the next recipe to work on.
+ *
+ * @var settingsStruct::gatherTimeout
+ * Simulated seconds a baker waits for a storage area or an ingredient before it moves
+ * on to another recipe; 0 only tries, and a negative value waits as long as it takes.
+ *
+ * @var settingsStruct::watchdogPeriod
+ * How often the watchdog scans for deadlocks and convoys, in wall-clock milliseconds, or 0 for no watchdog.
+ *
+ * @var settingsStruct::restockers
+ * The number of restocker threads that return ingredients for the bakers, or 0.
+ *
+ * @var settingsStruct::inventory
+ * Set when --supply turns ingredients into stock that recipes consume.
+ *
+ * @var settingsStruct::suppliers
+ * The number of supplier threads that deliver stock in inventory mode.
+ *
+ * @var settingsStruct::lowStock
+ * The stock a delivery must bring a shelf up to before it wakes the bakers waiting on it.
+ *
+ * @var settingsStruct::shelves
+ * The most shelves each storage area is split into, or 0 to keep storage areas whole.
+ *
+ * @var settingsStruct::stashSize
+ * The most ingredient units each baker keeps in its stash between recipes, or 0 for no stash.
+ *
+ * @var settingsStruct::stashRecipes
+ * The number of recipes a baker keeps a stashed unit for at most.
+ *
+ * @var settingsStruct::stashSeconds
+ * The simulated seconds a baker keeps a stashed unit for at most.
+ *
+ * @var settingsStruct::prefetchers
+ * The number of prefetcher threads that gather a baker's next recipe while it bakes, or 0.
+ *
+ * @var settingsStruct::timeline
+ * The number of bakers whose timeline is printed after each round, or 0.
+ *
+ * @var settingsStruct::ordersSource
+ * Where the orders of order-stream mode come from: a file, - for stdin, or unix:PATH; NULL for rounds of fixed recipes.
+ *
+ * @var settingsStruct::orderQueueSize
+ * The number of orders the order queue holds before it sheds new ones, a power of two.
+ *
+ * @var settingsStruct::orderDeadline
+ * The simulated seconds after its arrival by which an order without a deadline of its own is due, or 0 for none.
+ *
+ * @var settingsStruct::edf
+ * When set, the tools and the oven are granted earliest-deadline-first through wait queues of their own.
+ *
+ * @var settingsStruct::aging
+ * The simulated seconds per priority class after which a baker waiting in an EDF queue is treated as due.
+ */
+struct settingsStruct {
+	int batchedGather;
+	const struct syncBackend* backend;
+	int benchmarkBackends;
+	int verbosity;
+	const char* binaryLogPath;
+	double dilation;
+	int serviceTimeDistribution;
+	uint64_t seed;
+	int seeded;
+	int engine;
+	int workers;
+	int ovenRacks;
+	double batchWindow;
+	int latencyStats;
+	int liveStats;
+	int bakers;
+	int rounds;
+	int summary;
+	int recipePolicy;
+	double gatherTimeout;
+	double watchdogPeriod;
+	int restockers;
+	int inventory;
+	int suppliers;
+	int lowStock;
+	int shelves;
+	int stashSize;
+	int stashRecipes;
+	double stashSeconds;
+	int prefetchers;
+	int timeline;
+	const char* ordersSource;
+	int orderQueueSize;
+	double orderDeadline;
+	int edf;
+	double aging;
 };
 
 /**
@@ -132,17 +480,6 @@ struct sharedMemStruct {
 	struct sharedMem* sharedMemoryAddresses;
 };
 
-/**
- * @brief A structure representing a refrigerator.
- *
- * This structure contains an array of integers representing the ingredients
- * stored in the refrigerator. Each element in the array corresponds to a
- * specific ingredient.
- */
-typedef struct {
-	int ingredients[9];
-} Refrigerator;
-
 /**
  * @brief Returns a string representation of an ingredient.
  *
@@ -153,18 +490,11 @@ typedef struct {
  * @return A string representing the name of the ingredient.
  */
 const char* getIngredientName(int ingredient) {
-	switch (ingredient) {
-		case FLOUR: return "Flour";
-		case SUGAR: return "Sugar";
-		case YEAST: return "Yeast";
-		case BAKING_SODA: return "Baking Soda";
-		case SALT: return "Salt";
-		case CINNAMON: return "Cinnamon";
-		case EGGS: return "Eggs";
-		case MILK: return "Milk";
-		case BUTTER: return "Butter";
-		default: return "Unknown Ingredient";
+	if (ingredient < 0 || ingredient >= kitchen.ingredientCount) {
+		return "Unknown Ingredient";
 	}
+
+	return kitchen.names[semOffset + ingredient];
 }
 
 /**
@@ -177,1113 +507,10086 @@ const char* getIngredientName(int ingredient) {
  * @return A string representing the name of the recipe.
  */
 const char* getRecipeName(int recipe) {
-	switch (recipe) {
-		case COOKIE: return "Cookie";
-		case PANCAKE: return "Pancake";
-		case PIZZA: return "Pizza Dough";
-		case PRETZEL: return "Soft Pretzel";
-		case CINROLL: return "Cinnamon Roll";
-		default: return "Unknown Recipe";
+	if (recipe < 0 || recipe >= kitchen.recipeCount) {
+		return "Unknown Recipe";
 	}
+
+	return kitchen.recipeNames[recipe];
 }
 
 /**
- * @brief Initializes the ingredients in the refrigerator to their default values.
+ * @brief Tells whether a resource is a storage area or one of the shelves it is split into.
  *
- * This function sets the quantities of various ingredients in the refrigerator to their initial values.
+ * @param resource The resource.
+ * @return Returns 1 for a storage area or a shelf, otherwise 0.
+ */
+int isStorageResource(int resource) {
+	return (resource >= kitchen.toolCount && resource < kitchen.oven)
+		|| (resource >= semOffset + kitchen.ingredientCount && resource < resourceCount);
+}
+
+/**
+ * @brief Returns the lowercase name of a storage area or shelf for log messages.
  *
- * @param fridge A pointer to the Refrigerator structure to be initialized.
+ * @param storage The storage resource.
+ * @return A string naming the storage area or shelf.
  */
-void initializeRefrigerator(Refrigerator* fridge) {
-	fridge->ingredients[FLOUR] = 0;
-	fridge->ingredients[SUGAR] = 0;
-	fridge->ingredients[YEAST] = 0;
-	fridge->ingredients[BAKING_SODA] = 0;
-	fridge->ingredients[SALT] = 0;
-	fridge->ingredients[CINNAMON] = 0;
-	fridge->ingredients[EGGS] = 1;
-	fridge->ingredients[MILK] = 1;
-	fridge->ingredients[BUTTER] = 1;
+const char* getStorageName(int storage) {
+	if (!isStorageResource(storage)) {
+		return "unknown storage";
+	}
+
+	return kitchen.names[storage];
 }
 
 /**
- * @brief A structure representing a pantry with a fixed number of ingredients.
+ * @brief The most detailed log level compiled into the program.
  *
- * This structure is used to store the quantities of up to 9 different ingredients.
+ * Build with -DLOG_LEVEL=0 to remove every logging call at compile time, or with
+ * -DLOG_LEVEL=1 to keep only the recipe-level events.
  */
-typedef struct {
-	int ingredients[9];
-} Pantry;
+#ifndef LOG_LEVEL
+#define LOG_LEVEL 2
+#endif
+
+#define LOG_NONE 0
+#define LOG_SUMMARY 1
+#define LOG_ALL 2
 
 /**
- * @brief Initializes the pantry with default ingredient quantities.
+ * @brief Records an event if both the compiled and the selected verbosity include its level.
  *
- * This function sets the initial quantities of various ingredients in the pantry.
+ * When LOG_LEVEL is below the event's level the condition is a compile-time constant
+ * and the call disappears from the program.
+ */
+#define LOG_EVENT(level, bakerId, type, subject, detail) \
+	do { \
+		if (LOG_LEVEL >= (level) && settings.verbosity >= (level)) { \
+			logEvent((bakerId), (type), (subject), (detail)); \
+		} \
+	} while (0)
+
+/**
+ * @brief The kinds of events a baker records.
  *
- * @param pantry A pointer to the Pantry structure to be initialized.
+ * The subject of an event is a resource, an ingredient or a recipe identifier,
+ * depending on the event type.
  */
-void initializePantry(Pantry* pantry) {
-	pantry->ingredients[FLOUR] = 1;
-	pantry->ingredients[SUGAR] = 1;
-	pantry->ingredients[YEAST] = 1;
-	pantry->ingredients[BAKING_SODA] = 1;
-	pantry->ingredients[SALT] = 1;
-	pantry->ingredients[CINNAMON] = 1;
-	pantry->ingredients[EGGS] = 0;
-	pantry->ingredients[MILK] = 0;
-	pantry->ingredients[BUTTER] = 0;
-}
+enum eventType {
+	EVENT_INITIALIZING_RECIPE,
+	EVENT_INITIALIZED_RECIPE,
+	EVENT_ENTERING_STORAGE,
+	EVENT_ENTERED_STORAGE,
+	EVENT_LEAVING_STORAGE,
+	EVENT_LEFT_STORAGE,
+	EVENT_WAITING_FOR_INGREDIENT,
+	EVENT_WAITING_FOR_INGREDIENTS,
+	EVENT_GOT_INGREDIENT,
+	EVENT_RETURNING_INGREDIENT,
+	EVENT_RETURNING_INGREDIENTS,
+	EVENT_ACQUIRING_TOOLS,
+	EVENT_ACQUIRED_TOOLS,
+	EVENT_MIXING,
+	EVENT_MIXED,
+	EVENT_WAITING_FOR_OVEN,
+	EVENT_USING_OVEN,
+	EVENT_FINISHED_OVEN,
+	EVENT_WORKING_ON_RECIPE,
+	EVENT_RAMSIED,
+	EVENT_FINISHED_RECIPE,
+	EVENT_BAKER_FINISHED,
+	EVENT_JOINED_OVEN_BATCH,
+	EVENT_GAVE_UP_STORAGE,
+	EVENT_GAVE_UP_INGREDIENT,
+	EVENT_OUT_OF_STOCK,
+	EVENT_USED_STASH,
+	EVENT_STASHED_INGREDIENT
+};
 
 /**
- * Checks if a given integer is present in an array.
+ * @brief A fixed-size binary log record.
  *
- * @param haystack An array of integers to search within.
- * @param haystackSize The size of the haystack array.
- * @param needle The integer value to search for in the haystack array.
- * @return Returns 1 if the needle is found in the haystack array, otherwise returns 0.
+ * This is also the layout of the records in a binary log file.
+ *
+ * @var EventRecord::timestamp
+ * CLOCK_MONOTONIC time of the event in nanoseconds.
+ *
+ * @var EventRecord::bakerId
+ * The baker that recorded the event.
+ *
+ * @var EventRecord::type
+ * One of the eventType values.
+ *
+ * @var EventRecord::subject
+ * The resource, ingredient or recipe the event is about.
+ *
+ * @var EventRecord::detail
+ * An event-specific count, such as the number of ingredients in a batch.
  */
-int isIn(const int haystack[], const int haystackSize, const int needle) {
+typedef struct {
+	uint64_t timestamp;
+	int32_t bakerId;
+	uint16_t type;
+	int16_t subject;
+	int32_t detail;
+	int32_t reserved;
+} EventRecord;
 
-	for (int i = 0; i < haystackSize; i++) {
-		if (haystack[i] == needle) {
-			return 1;
-		}
-	}
+#define EVENT_RING_SIZE 1024
 
-	return 0;
-}
+/**
+ * @brief A single-producer, single-consumer ring of event records.
+ *
+ * Each baker thread owns one ring and is the only writer of head. The log writer
+ * thread is the only writer of tail. The two counters sit on separate cache lines.
+ */
+typedef struct EventRing {
+	_Alignas(64) atomic_size_t head;
+	_Alignas(64) atomic_size_t tail;
+	atomic_int closed;
+	struct EventRing* next;
+	EventRecord records[EVENT_RING_SIZE];
+} EventRing;
 
 /**
- * @brief Inserts a semaphore ID into the semaphore array at the specified resource index.
+ * @struct eventLogStruct
+ * @brief The state of the background log writer.
  *
- * This function ensures that the semaphore array is large enough to accommodate the specified
- * resource index. If the array is not large enough, it reallocates memory to expand the array.
- * If memory allocation fails, it returns an error code.
+ * @var eventLogStruct::rings
+ * Every registered ring, linked through EventRing::next.
  *
- * @param resource The index in the semaphore array where the semaphore ID should be inserted.
- * @param semaphoreId The semaphore ID to be inserted into the array.
- * @return int Returns 0 on success, or -1 if memory allocation fails.
+ * @var eventLogStruct::ringsLock
+ * Protects the list of rings. Baker threads only take it once, to register.
+ *
+ * @var eventLogStruct::drainLock
+ * Serializes draining between the writer thread and flushEventLog.
+ *
+ * @var eventLogStruct::batch
+ * Records drained in one pass, sorted by timestamp before they are written.
+ *
+ * @var eventLogStruct::binaryFile
+ * When not NULL, records are written raw to this file instead of as text.
  */
-int insertIntoSemaphoreArray(int resource, int semaphoreId) {
-	if (resource >= semaphores.length) {
-		int* temp = realloc(semaphores.semaphoreIds, (resource + 1) * sizeof(int));
-
-		if (temp == NULL) {
-			perror("Failed to allocate memory for semaphoreIds");
-			return -1; // Memory allocation failure
-		}
-
-		semaphores.semaphoreIds = temp;
-		semaphores.length = resource + 1;
+struct eventLogStruct {
+	EventRing* rings;
+	pthread_mutex_t ringsLock;
+	pthread_mutex_t drainLock;
+	pthread_key_t ringKey;
+	pthread_t writer;
+	EventRecord* batch;
+	size_t batchCapacity;
+	FILE* binaryFile;
+};
 
-	}
+struct eventLogStruct eventLog = { .ringsLock = PTHREAD_MUTEX_INITIALIZER, .drainLock = PTHREAD_MUTEX_INITIALIZER };
 
-	semaphores.semaphoreIds[resource] = semaphoreId; // Add the new element
-	return 0; // Success
+__thread EventRing* threadEventRing;
 
+/**
+ * @brief Returns the current CLOCK_MONOTONIC time in nanoseconds.
+ *
+ * @return The time in nanoseconds.
+ */
+uint64_t monotonicNanoseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
 }
 
 /**
- * @brief Inserts a new element into the shared memory array.
+ * @brief Marks a thread's ring as closed when the thread exits.
  *
- * This function reallocates memory for the shared memory array to accommodate
- * a new element, then inserts the provided element into the array.
+ * The writer frees the ring once it has drained the remaining records.
  *
- * @param memoryAddress Pointer to the sharedMem structure to be inserted.
- * @return int Returns 0 on success, or -1 if memory allocation fails.
+ * @param val A void pointer to the thread's EventRing.
  */
-int insertIntoSharedMemArray(struct sharedMem* memoryAddress) {
-
-	struct sharedMem* temp = realloc(sharedMemory.sharedMemoryAddresses,
-
-		(sharedMemory.length + 1) * sizeof(struct sharedMem));
-
-
-
-	if (temp == NULL) {
-
-		perror("Failed to allocate memory for sharedMemoryAddresses");
+void closeEventRing(void* val) {
+	EventRing* ring = (EventRing*)val;
+	atomic_store_explicit(&ring->closed, 1, memory_order_release);
+}
 
-		return -1; // Memory allocation failure
+/**
+ * @brief Creates the calling thread's ring and registers it with the writer.
+ *
+ * @return The new ring, exits the program if memory allocation fails.
+ */
+EventRing* registerEventRing() {
+	EventRing* ring = aligned_alloc(_Alignof(EventRing), sizeof(EventRing));
 
+	if (ring == NULL) {
+		perror("Failed to allocate memory for an event ring");
+		exit(1);
 	}
 
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->closed, 0);
 
+	pthread_mutex_lock(&eventLog.ringsLock);
+	ring->next = eventLog.rings;
+	eventLog.rings = ring;
+	pthread_mutex_unlock(&eventLog.ringsLock);
 
-	sharedMemory.sharedMemoryAddresses = temp;
-
-	sharedMemory.sharedMemoryAddresses[sharedMemory.length++] = *memoryAddress; // Add the new element
-
-	return 0; // Success
+	pthread_setspecific(eventLog.ringKey, ring);
+	threadEventRing = ring;
 
+	return ring;
 }
 
 /**
- * @brief Initializes shared memory segment.
+ * @brief Appends an event to the calling thread's ring.
  *
- * This function creates a shared memory segment with the specified key and size,
- * attaches it to the process's address space, and inserts it into the shared memory array.
+ * This never takes a lock. If the ring is full, the baker yields until the
+ * writer has made room, so no event is lost.
  *
- * @param sharedMemory Pointer to the sharedMem structure to be initialized.
- * @param key The key to be used for the shared memory segment.
- * @param size The size of the shared memory segment.
- * @param isAlreadyCreated Boolean indicating whether the sharedMemory already exists
- * @return Returns 0 on success, exits the program on failure.
+ * @param bakerId The baker recording the event.
+ * @param type One of the eventType values.
+ * @param subject The resource, ingredient or recipe the event is about.
+ * @param detail An event-specific count.
  */
-int initSharedMemory(struct sharedMem* sharedMemory, key_t key, int size, int isAlreadyCreated) {
-
-	sharedMemory->id = shmget(key, size, IPC_CREAT | S_IRUSR | S_IWUSR);
-
-	if (sharedMemory->id < 0) {
-
-		perror("Unable to obtain shared memory\n");
-
-		exit(1);
+void logEvent(int bakerId, int type, int subject, int detail) {
+	EventRing* ring = threadEventRing;
 
+	if (ring == NULL) {
+		ring = registerEventRing();
 	}
 
-	sharedMemory->address = shmat(sharedMemory->id, 0, 0);
-
-	if (sharedMemory->address == (void*)-1) {
-
-		perror("Unable to attach\n");
-
-		exit(1);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
 
+	while (head - atomic_load_explicit(&ring->tail, memory_order_acquire) >= EVENT_RING_SIZE) {
+		sched_yield();
 	}
 
-	if (!isAlreadyCreated) {
-		insertIntoSharedMemArray(sharedMemory);
-	}
+	EventRecord* record = &ring->records[head & (EVENT_RING_SIZE - 1)];
+	record->timestamp = monotonicNanoseconds();
+	record->bakerId = bakerId;
+	record->type = type;
+	record->subject = subject;
+	record->detail = detail;
+	record->reserved = 0;
 
-	return 0;
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
 }
 
 /**
- * @brief Cleans up the shared memory by detaching and deallocating it.
- *
- * This function detaches the shared memory segment from the address space of the calling process
- * and then deallocates the shared memory segment. If either operation fails, an error message is
- * printed and the program exits with a status of 1.
+ * @brief Returns the plural name a recipe is announced with.
  *
- * @param sharedMemory A pointer to the sharedMem structure that contains the shared memory segment's
- *                     address and identifier.
- * @return Returns 0 on successful cleanup of the shared memory.
+ * @param recipe The identifier of the recipe.
+ * @return A string naming what the baker is making.
  */
-int cleanupSharedMemoryAddress(struct sharedMem* sharedMemory) {
-	if (shmdt(sharedMemory->address) < 0) {
+const char* getRecipePluralName(int recipe) {
+	if (recipe < 0 || recipe >= kitchen.recipeCount) {
+		return "Unknown Recipe";
+	}
 
-		perror("Unable to detach\n");
+	return kitchen.recipePluralNames[recipe];
+}
 
-		exit(1);
+/**
+ * @brief Prints the kitchen's mixing tools as a list, such as "a mixer, a bowl and a spoon".
+ *
+ * @param out The stream to write to.
+ */
+void printTools(FILE* out) {
+	for (int i = 0; i < kitchen.toolCount; i++) {
+		const char* name = kitchen.names[kitchen.tools[i]];
+		const char* separator = i == 0 ? "" : (i == kitchen.toolCount - 1 ? " and " : ", ");
+		const char* article = strchr("aeiouAEIOU", name[0]) != NULL ? "an" : "a";
 
+		fprintf(out, "%s%s %s", separator, article, name);
 	}
+}
 
-	if (shmctl(sharedMemory->id, IPC_RMID, 0) < 0) {
-
-		perror("Unable to deallocate\n");
-
-		exit(1);
+/**
+ * @brief Formats an event record as the colored text line a baker used to print.
+ *
+ * @param out The stream to write to.
+ * @param record The event to format.
+ */
+void formatEvent(FILE* out, const EventRecord* record) {
+	int bakerId = record->bakerId;
+	const char* color = colors[bakerId % 7];
+	const char* resetColor = "\033[0m";
 
+	switch (record->type) {
+		case EVENT_INITIALIZING_RECIPE:
+			fprintf(out, "Initializing %s recipe\n", getRecipeName(record->subject));
+			break;
+		case EVENT_INITIALIZED_RECIPE:
+			fprintf(out, "Finished initializing %s recipe\n", getRecipeName(record->subject));
+			break;
+		case EVENT_ENTERING_STORAGE:
+			fprintf(out, "%sBaker %d is looking to enter the %s\n%s", color, bakerId, getStorageName(record->subject), resetColor);
+			break;
+		case EVENT_ENTERED_STORAGE:
+			fprintf(out, "%sBaker %d entered the %s\n%s", color, bakerId, getStorageName(record->subject), resetColor);
+			break;
+		case EVENT_LEAVING_STORAGE:
+			fprintf(out, "%sBaker %d is looking to leave the %s\n%s", color, bakerId, getStorageName(record->subject), resetColor);
+			break;
+		case EVENT_LEFT_STORAGE:
+			fprintf(out, "%sBaker %d left the %s\n%s", color, bakerId, getStorageName(record->subject), resetColor);
+			break;
+		case EVENT_GAVE_UP_STORAGE:
+			fprintf(out, "%sBaker %d gave up waiting to enter the %s\n%s", color, bakerId, getStorageName(record->subject), resetColor);
+			break;
+		case EVENT_GAVE_UP_INGREDIENT:
+			fprintf(out, "%sBaker %d gave up waiting for ingredient %s\n%s", color, bakerId, getIngredientName(record->subject), resetColor);
+			break;
+		case EVENT_OUT_OF_STOCK:
+			fprintf(out, "%sBaker %d found no %s on the shelf and waits for a delivery\n%s", color, bakerId, getIngredientName(record->subject), resetColor);
+			break;
+		case EVENT_USED_STASH:
+			fprintf(out, "%sBaker %d took ingredient %s from its stash\n%s", color, bakerId, getIngredientName(record->subject), resetColor);
+			break;
+		case EVENT_STASHED_INGREDIENT:
+			fprintf(out, "%sBaker %d kept ingredient %s in its stash\n%s", color, bakerId, getIngredientName(record->subject), resetColor);
+			break;
+		case EVENT_WAITING_FOR_INGREDIENT:
+			fprintf(out, "%sBaker %d is waiting for ingredient %s\n%s", color, bakerId, getIngredientName(record->subject), resetColor);
+			break;
+		case EVENT_WAITING_FOR_INGREDIENTS:
+			fprintf(out, "%sBaker %d is waiting for %d ingredients from the %s\n%s", color, bakerId, record->detail, getStorageName(record->subject), resetColor);
+			break;
+		case EVENT_GOT_INGREDIENT:
+			fprintf(out, "%sBaker %d got ingredient %s\n%s", color, bakerId, getIngredientName(record->subject), resetColor);
+			break;
+		case EVENT_RETURNING_INGREDIENT:
+			fprintf(out, "%sBaker %d is returning ingredient %s\n%s", color, bakerId, getIngredientName(record->subject), resetColor);
+			break;
+		case EVENT_RETURNING_INGREDIENTS:
+			fprintf(out, "%sBaker %d is returning %d ingredients to the %s\n%s", color, bakerId, record->detail, getStorageName(record->subject), resetColor);
+			break;
+		case EVENT_ACQUIRING_TOOLS:
+			fprintf(out, "%sBaker %d is looking to acquire ", color, bakerId);
+			printTools(out);
+			fprintf(out, "\n%s", resetColor);
+			break;
+		case EVENT_ACQUIRED_TOOLS:
+			fprintf(out, "%sBaker %d acquired ", color, bakerId);
+			printTools(out);
+			fprintf(out, "\n%s", resetColor);
+			break;
+		case EVENT_MIXING:
+			fprintf(out, "%sBaker %d is mixing the ingredients together\n%s", color, bakerId, resetColor);
+			break;
+		case EVENT_MIXED:
+			fprintf(out, "%sBaker %d mixed all of the ingredients together\n%s", color, bakerId, resetColor);
+			break;
+		case EVENT_WAITING_FOR_OVEN:
+			fprintf(out, "%sBaker %d is looking to use the oven to cook recipe %s%s\n", color, bakerId, getRecipeName(record->subject), resetColor);
+			break;
+		case EVENT_USING_OVEN:
+			if (record->detail > 1) {
+				fprintf(out, "%sBaker %d is using the oven to cook recipe %s in a batch of %d%s\n", color, bakerId, getRecipeName(record->subject), record->detail, resetColor);
+			}
+			else {
+				fprintf(out, "%sBaker %d is using the oven to cook recipe %s%s\n", color, bakerId, getRecipeName(record->subject), resetColor);
+			}
+			break;
+		case EVENT_JOINED_OVEN_BATCH:
+			fprintf(out, "%sBaker %d put recipe %s on rack %d of an oven batch%s\n", color, bakerId, getRecipeName(record->subject), record->detail, resetColor);
+			break;
+		case EVENT_FINISHED_OVEN:
+			fprintf(out, "%sBaker %d finished using the oven to cook recipe %s%s\n", color, bakerId, getRecipeName(record->subject), resetColor);
+			break;
+		case EVENT_WORKING_ON_RECIPE:
+			fprintf(out, "%sBaker %d is working on making %s%s\n", color, bakerId, getRecipePluralName(record->subject), resetColor);
+			break;
+		case EVENT_RAMSIED:
+			fprintf(out, "%sBaker %d has been %sramsied%s on recipe %s%s\n", color, bakerId, resetColor, color, getRecipeName(record->subject), resetColor);
+			break;
+		case EVENT_FINISHED_RECIPE:
+			fprintf(out, "%sBaker %d finished recipe %s%s\n", color, bakerId, getRecipeName(record->subject), resetColor);
+			break;
+		case EVENT_BAKER_FINISHED:
+			fprintf(out, "%sBaker %d has%s finished\n", color, bakerId, resetColor);
+			break;
+		default:
+			fprintf(out, "Baker %d recorded unknown event %d\n", bakerId, record->type);
+			break;
 	}
+}
 
-	return 0;
+/**
+ * @brief Orders event records by timestamp for qsort.
+ *
+ * @param a A pointer to the first EventRecord.
+ * @param b A pointer to the second EventRecord.
+ * @return A negative, zero or positive value as a is earlier than, as early as, or later than b.
+ */
+int compareEventRecords(const void* a, const void* b) {
+	uint64_t first = ((const EventRecord*)a)->timestamp;
+	uint64_t second = ((const EventRecord*)b)->timestamp;
+	return (first > second) - (first < second);
 }
 
 /**
- * @brief Initializes a semaphore with a given resource count.
+ * @brief Moves every pending record out of the rings and writes it.
  *
- * This function creates a new semaphore, sets its initial value, and inserts it into a semaphore array.
+ * Records of one pass are merged by timestamp so that the output interleaves bakers
+ * in the order the events happened. Closed rings are freed once they are empty.
  *
- * @param resource The resource identifier to associate with the semaphore.
- * @param resourceCount The initial count/value for the semaphore.
- * @return The semaphore ID on success.
- * @retval -1 on failure to create or initialize the semaphore.
+ * @return The number of records written.
  */
-int initSemaphore(int resource, int resourceCount) {
+size_t drainEventRings() {
+	pthread_mutex_lock(&eventLog.drainLock);
 
-	int semId = semget(IPC_PRIVATE, 1, 00600);
+	size_t count = 0;
 
-	if (semId == -1) {
-		perror("semget failed");
-		exit(1);
-	}
+	pthread_mutex_lock(&eventLog.ringsLock);
+	EventRing** link = &eventLog.rings;
 
-	int ctlErrorCode = semctl(semId, 0, SETVAL, resourceCount);
+	while (*link != NULL) {
+		EventRing* ring = *link;
+		int closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+		size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+		size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+		if (count + (head - tail) > eventLog.batchCapacity) {
+			size_t capacity = 2 * (count + (head - tail));
+			EventRecord* temp = realloc(eventLog.batch, capacity * sizeof(EventRecord));
+
+			if (temp == NULL) {
+				perror("Failed to allocate memory for the event batch");
+				exit(1);
+			}
+
+			eventLog.batch = temp;
+			eventLog.batchCapacity = capacity;
+		}
+
+		for (; tail != head; tail++) {
+			eventLog.batch[count++] = ring->records[tail & (EVENT_RING_SIZE - 1)];
+		}
+
+		atomic_store_explicit(&ring->tail, tail, memory_order_release);
+
+		if (closed) {
+			*link = ring->next;
+			free(ring);
+		}
+		else {
+			link = &ring->next;
+		}
+	}
+
+	pthread_mutex_unlock(&eventLog.ringsLock);
+
+	if (count > 0) {
+		qsort(eventLog.batch, count, sizeof(EventRecord), compareEventRecords);
+
+		if (eventLog.binaryFile != NULL) {
+			fwrite(eventLog.batch, sizeof(EventRecord), count, eventLog.binaryFile);
+		}
+		else {
+			for (size_t i = 0; i < count; i++) {
+				formatEvent(stdout, &eventLog.batch[i]);
+			}
+		}
+	}
+
+	pthread_mutex_unlock(&eventLog.drainLock);
+
+	return count;
+}
+
+/**
+ * @brief The background writer: drains the rings, sleeping briefly when they are empty.
+ *
+ * @param val Unused.
+ * @return A void pointer, never returns.
+ */
+void* runEventWriter(void* val) {
+	struct timespec idle = { 0, 1000000 };
+
+	while (1) {
+		if (drainEventRings() == 0) {
+			nanosleep(&idle, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Writes out every event recorded so far.
+ *
+ * Main calls this once all bakers have finished, so the round's events appear
+ * before anything main prints next.
+ */
+void flushEventLog() {
+	drainEventRings();
+
+	if (eventLog.binaryFile != NULL) {
+		fflush(eventLog.binaryFile);
+	}
+	fflush(stdout);
+}
+
+/**
+ * @brief Starts the background log writer thread.
+ *
+ * @param binaryPath When not NULL, the file that receives raw event records.
+ */
+void startEventLog(const char* binaryPath) {
+	pthread_key_create(&eventLog.ringKey, closeEventRing);
+
+	if (binaryPath != NULL) {
+		eventLog.binaryFile = fopen(binaryPath, "wb");
+
+		if (eventLog.binaryFile == NULL) {
+			perror("Unable to open the binary log");
+			exit(1);
+		}
+	}
+
+	int threadStatus = pthread_create(&eventLog.writer, NULL, runEventWriter, NULL);
+
+	if (threadStatus != 0) {
+		fprintf(stderr, "Thread create error %d: %s\n", threadStatus, strerror(threadStatus));
+		exit(1);
+	}
+
+	pthread_detach(eventLog.writer);
+}
+
+/**
+ * @brief The timed operations of the kitchen.
+ */
+enum operation {
+	OPERATION_MIX,
+	OPERATION_BAKE,
+	OPERATION_RETURN,
+	OPERATION_COUNT
+};
+
+/**
+ * @brief The ways a simulated service time can be drawn around its mean.
+ */
+enum serviceTimeDistribution {
+	SERVICE_TIME_FIXED,
+	SERVICE_TIME_EXPONENTIAL,
+	SERVICE_TIME_UNIFORM
+};
+
+/**
+ * @brief The ways a round can be run.
+ */
+enum engine {
+	ENGINE_THREADS,
+	ENGINE_DISCRETE_EVENT,
+	ENGINE_COROUTINES
+};
+
+const char* engineNames[] = { "threads", "des", "coroutines" };
+
+/**
+ * @brief How a baker picks the next recipe to work on.
+ *
+ * Round-robin takes the next unfinished recipe in order. Available probes the
+ * resources each unfinished recipe needs and takes the one with the fewest busy.
+ */
+enum recipePolicy {
+	RECIPE_POLICY_ROUND_ROBIN,
+	RECIPE_POLICY_AVAILABLE
+};
+
+const char* recipePolicyNames[] = { "round-robin", "available" };
+
+/**
+ * @brief How many recipes in a row a baker may pick out of round-robin order before
+ * it takes the next one in order regardless of availability, so no recipe is put off forever.
+ */
+#define RECIPE_SKIP_LIMIT 4
+
+/**
+ * @brief Simulated seconds a baker that only tries to take resources (--gather-timeout 0)
+ * waits after a visit to a recipe in which it could gather nothing.
+ */
+#define GATHER_RETRY_SECONDS 0.1
+
+const char* operationNames[] = { "mix", "bake", "return" };
+const char* serviceTimeDistributionNames[] = { "fixed", "exponential", "uniform" };
+
+/**
+ * @struct durationsStruct
+ * @brief How long each operation takes, in simulated seconds.
+ *
+ * @var durationsStruct::operations
+ * The default duration of each operation.
+ *
+ * @var durationsStruct::recipes
+ * Per-recipe durations, used where recipeSet is set.
+ *
+ * @var durationsStruct::recipeSet
+ * Set for each per-recipe duration given on the command line; the others fall back to the operation's default.
+ */
+struct durationsStruct {
+	double operations[OPERATION_COUNT];
+	double recipes[KITCHEN_MAX_RECIPES][OPERATION_COUNT];
+	uint8_t recipeSet[KITCHEN_MAX_RECIPES][OPERATION_COUNT];
+};
+
+struct durationsStruct durations = { { 1.0, 3.0, 1.0 } };
+
+/**
+ * @brief The number of priority classes orders come in; class 0 is the most urgent.
+ */
+#define ORDER_PRIORITIES 4
+
+/**
+ * @struct roundStatsStruct
+ * @brief Completion statistics and simulated time accounting for the current round.
+ *
+ * In the threaded engine simulated time runs `dilation` times faster than wall time.
+ * The totals add up the simulated duration of every operation performed, across all
+ * bakers, so both engines report the same figures for the same workload.
+ *
+ * @var roundStatsStruct::roundStart
+ * CLOCK_MONOTONIC time at which the round started, in nanoseconds.
+ *
+ * @var roundStatsStruct::operationTotals
+ * Simulated time spent in each operation during the round, in microseconds.
+ *
+ * @var roundStatsStruct::operationCounts
+ * The number of times each operation was performed during the round.
+ *
+ * @var roundStatsStruct::recipesCompleted
+ * The number of recipes of each kind baked during the round.
+ *
+ * @var roundStatsStruct::recipesRamsied
+ * The number of recipes that were ramsied and had to be started over.
+ *
+ * @var roundStatsStruct::startUsage
+ * The process's resource usage when the round started, for counting context switches.
+ *
+ * @var roundStatsStruct::coroutineSwitches
+ * The number of times a baker coroutine suspended during the round.
+ *
+ * @var roundStatsStruct::ovenCycles
+ * The number of oven batches baked during the round.
+ *
+ * @var roundStatsStruct::ovenLoads
+ * The number of recipes baked in those batches.
+ *
+ * @var roundStatsStruct::resourceTimeouts
+ * The number of timed acquires of each resource that reached their deadline.
+ *
+ * @var roundStatsStruct::resourceBusy
+ * The number of tries to take each resource that found no free unit.
+ *
+ * @var roundStatsStruct::restocks
+ * The number of returns the restockers gave back.
+ *
+ * @var roundStatsStruct::restockLagTotal
+ * The total time between returns being due and the restockers giving them back, in nanoseconds.
+ *
+ * @var roundStatsStruct::restockLagMax
+ * The longest such delay, in nanoseconds.
+ *
+ * @var roundStatsStruct::restockOverflows
+ * The number of returns bakers made themselves because the restock queue was full.
+ *
+ * @var roundStatsStruct::restockQueued
+ * The number of returns in the restock queue.
+ *
+ * @var roundStatsStruct::restockQueuedMax
+ * The deepest the restock queue got.
+ *
+ * @var roundStatsStruct::supplied
+ * The units of each ingredient the suppliers delivered, indexed by ingredient.
+ *
+ * @var roundStatsStruct::consumed
+ * The units of each ingredient bakers took off the shelves, indexed by ingredient.
+ *
+ * @var roundStatsStruct::stockouts
+ * The number of times a baker found an ingredient's shelf empty, indexed by ingredient.
+ *
+ * @var roundStatsStruct::stashLookups
+ * The number of ingredients bakers looked for in their stash.
+ *
+ * @var roundStatsStruct::stashHits
+ * The number of those a baker found in its stash.
+ *
+ * @var roundStatsStruct::storageVisitsSaved
+ * The number of storage visits bakers skipped because their stash held everything they came for.
+ *
+ * @var roundStatsStruct::stashReclaimed
+ * The number of stashed units the rebalancer gave back for waiting bakers.
+ *
+ * @var roundStatsStruct::stashReturned
+ * The number of stashed units bakers gave back themselves.
+ *
+ * @var roundStatsStruct::prefetchRequests
+ * The number of requests bakers queued for the prefetchers.
+ *
+ * @var roundStatsStruct::prefetchTakenBack
+ * The number of those no prefetcher had taken up when the baker came back from the oven.
+ *
+ * @var roundStatsStruct::prefetchedIngredients
+ * The number of ingredients the prefetchers gathered.
+ *
+ * @var roundStatsStruct::prefetchHiddenNanoseconds
+ * The wall time prefetchers spent gathering while their bakers were at the oven.
+ *
+ * @var roundStatsStruct::prefetchExposedNanoseconds
+ * The wall time bakers back from the oven waited for their prefetcher to finish.
+ *
+ * @var roundStatsStruct::ordersReceived
+ * The number of orders the order stream brought, shed or not.
+ *
+ * @var roundStatsStruct::ordersShed
+ * The number of orders dropped because the order queue was full.
+ *
+ * @var roundStatsStruct::ordersCompleted
+ * The number of orders baked.
+ *
+ * @var roundStatsStruct::ordersWithDeadline
+ * The number of orders with a deadline that were baked, indexed by priority class.
+ *
+ * @var roundStatsStruct::deadlinesMissed
+ * The number of those baked after their deadline, indexed by priority class.
+ */
+struct roundStatsStruct {
+	uint64_t roundStart;
+	struct rusage startUsage;
+	atomic_llong coroutineSwitches;
+	atomic_llong operationTotals[OPERATION_COUNT];
+	atomic_llong operationCounts[OPERATION_COUNT];
+	atomic_llong recipesCompleted[KITCHEN_MAX_RECIPES];
+	atomic_llong recipesRamsied;
+	atomic_llong ovenCycles;
+	atomic_llong ovenLoads;
+	atomic_llong resourceTimeouts[KITCHEN_MAX_RESOURCES];
+	atomic_llong resourceBusy[KITCHEN_MAX_RESOURCES];
+	atomic_llong restocks;
+	atomic_llong restockLagTotal;
+	atomic_llong restockLagMax;
+	atomic_llong restockOverflows;
+	atomic_int restockQueued;
+	atomic_int restockQueuedMax;
+	atomic_llong supplied[KITCHEN_MAX_RESOURCES];
+	atomic_llong consumed[KITCHEN_MAX_RESOURCES];
+	atomic_llong stockouts[KITCHEN_MAX_RESOURCES];
+	atomic_llong stashLookups;
+	atomic_llong stashHits;
+	atomic_llong storageVisitsSaved;
+	atomic_llong stashReclaimed;
+	atomic_llong stashReturned;
+	atomic_llong prefetchRequests;
+	atomic_llong prefetchTakenBack;
+	atomic_llong prefetchedIngredients;
+	atomic_llong prefetchHiddenNanoseconds;
+	atomic_llong prefetchExposedNanoseconds;
+	atomic_llong ordersReceived;
+	atomic_llong ordersShed;
+	atomic_llong ordersCompleted;
+	atomic_llong ordersWithDeadline[ORDER_PRIORITIES];
+	atomic_llong deadlinesMissed[ORDER_PRIORITIES];
+};
+
+struct roundStatsStruct roundStats;
+
+__thread uint64_t serviceTimeState = 1;
+
+/**
+ * @brief Seeds the calling thread's service-time generator.
+ *
+ * Each baker gets its own stream derived from the run's seed, so its service times
+ * do not depend on how the threads are scheduled.
+ *
+ * @param bakerId The baker the calling thread simulates.
+ */
+void seedServiceTimes(int bakerId) {
+	uint64_t state = settings.seed ^ (0x9E3779B97F4A7C15ULL * (uint64_t)(bakerId + 1));
+	serviceTimeState = state != 0 ? state : 1;
+}
+
+/**
+ * @brief Returns a uniformly distributed number in (0, 1) from the calling thread's generator.
+ *
+ * @return The random number.
+ */
+double nextServiceTimeRandom() {
+	uint64_t x = serviceTimeState;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	serviceTimeState = x;
+	return ((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) + (0.5 / 9007199254740992.0);
+}
+
+/**
+ * @brief Returns the configured duration of an operation, in simulated seconds.
+ *
+ * @param operation One of the operation values.
+ * @param recipe The recipe the operation is for, or -1 if it is not tied to a recipe.
+ * @return The mean duration of the operation.
+ */
+double getDuration(int operation, int recipe) {
+	if (recipe >= 0 && recipe < kitchen.recipeCount && durations.recipeSet[recipe][operation]) {
+		return durations.recipes[recipe][operation];
+	}
+
+	return durations.operations[operation];
+}
+
+/**
+ * @brief Draws a service time with the given mean from the selected distribution.
+ *
+ * @param mean The mean service time in simulated seconds.
+ * @return The service time in simulated seconds.
+ */
+double sampleServiceTime(double mean) {
+	switch (settings.serviceTimeDistribution) {
+		case SERVICE_TIME_EXPONENTIAL:
+			return -mean * log(nextServiceTimeRandom());
+		case SERVICE_TIME_UNIFORM:
+			return mean * (0.5 + nextServiceTimeRandom());
+		default:
+			return mean;
+	}
+}
+
+struct Coroutine;
+__thread struct Coroutine* currentCoroutine;
+struct Coroutine* getCurrentCoroutine();
+void sleepCoroutine(uint64_t wallNanoseconds);
+extern const struct syncBackend coroutineBackend;
+
+/**
+ * @brief Lets a span of simulated time pass.
+ *
+ * The calling thread sleeps for the simulated duration divided by the dilation factor.
+ * A baker running as a coroutine suspends instead, leaving its worker thread free.
+ *
+ * @param simulatedSeconds The simulated duration.
+ */
+void simulateDuration(double simulatedSeconds) {
+	double wallSeconds = simulatedSeconds / settings.dilation;
+
+	if (wallSeconds <= 0) {
+		return;
+	}
+
+	if (getCurrentCoroutine() != NULL) {
+		sleepCoroutine((uint64_t)(wallSeconds * 1e9));
+		return;
+	}
+
+	struct timespec remaining;
+	remaining.tv_sec = (time_t)wallSeconds;
+	remaining.tv_nsec = (long)((wallSeconds - remaining.tv_sec) * 1e9);
+
+	while (nanosleep(&remaining, &remaining) == -1 && errno == EINTR) {
+	}
+}
+
+/**
+ * @brief Adds an operation's simulated duration to the round's totals.
+ *
+ * @param operation One of the operation values.
+ * @param simulatedSeconds The simulated duration of the operation.
+ */
+void recordOperation(int operation, double simulatedSeconds) {
+	atomic_fetch_add_explicit(&roundStats.operationTotals[operation], (long long)(simulatedSeconds * 1e6), memory_order_relaxed);
+	atomic_fetch_add_explicit(&roundStats.operationCounts[operation], 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Performs a timed operation and accounts for it on the simulated clock.
+ *
+ * @param operation One of the operation values.
+ * @param recipe The recipe the operation is for, or -1 if it is not tied to a recipe.
+ */
+void simulateOperation(int operation, int recipe) {
+	double simulatedSeconds = sampleServiceTime(getDuration(operation, recipe));
+
+	recordOperation(operation, simulatedSeconds);
+
+	simulateDuration(simulatedSeconds);
+}
+
+/**
+ * @brief Whether the wait-time and hold-time histograms are compiled in.
+ *
+ * Build with -DLATENCY_STATS=0 to remove the timing calls around every acquire and
+ * release at compile time. When compiled in, they only run with --latency.
+ */
+#ifndef LATENCY_STATS
+#define LATENCY_STATS 1
+#endif
+
+/**
+ * @brief Each power of two is split into 2^LATENCY_SUB_BITS histogram buckets, so a
+ * bucket's midpoint is within 1/32 (about 3%) of every value counted in it.
+ */
+#define LATENCY_SUB_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_MAX_BITS 44
+#define LATENCY_BUCKETS ((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+/**
+ * @brief Evaluates to 1 when latencies are compiled in and were requested with --latency.
+ *
+ * When LATENCY_STATS is 0 the condition is a compile-time constant and the timing
+ * calls guarded by it disappear from the program.
+ */
+#define LATENCY_ENABLED (LATENCY_STATS && settings.latencyStats)
+
+/**
+ * @brief Reads the latency clock when latencies are enabled, otherwise returns 0.
+ */
+#define LATENCY_NOW() (LATENCY_ENABLED ? latencyTicks() : 0)
+
+/**
+ * @brief A log-linear (HDR-style) histogram of durations in latency clock ticks.
+ *
+ * Values below LATENCY_SUB_BUCKETS have a bucket each; above that, each power of two
+ * is split into LATENCY_SUB_BUCKETS equal buckets. Values beyond 2^LATENCY_MAX_BITS
+ * ticks land in the last bucket, but max and total are always exact.
+ */
+typedef struct {
+	uint64_t count;
+	uint64_t total;
+	uint64_t max;
+	uint32_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+/**
+ * @brief The histograms recorded by one thread.
+ *
+ * Only the owning thread writes to them, so recording takes no lock and no atomic
+ * operation. A histogram is allocated the first time the thread records into it.
+ *
+ * @var LatencyHistograms::wait
+ * Time spent waiting to acquire each resource, indexed by resource.
+ *
+ * @var LatencyHistograms::hold
+ * Time each resource was held between its acquire and its release, indexed by resource.
+ *
+ * @var LatencyHistograms::recipes
+ * Time from a baker starting on a recipe to finishing it, indexed by recipe.
+ *
+ * @var LatencyHistograms::blockedTicks
+ * Total time spent waiting for resources, counting a wait for several resources once.
+ */
+typedef struct LatencyHistograms {
+	LatencyHistogram* wait[KITCHEN_MAX_RESOURCES];
+	LatencyHistogram* hold[KITCHEN_MAX_RESOURCES];
+	LatencyHistogram* recipes[KITCHEN_MAX_RECIPES];
+	uint64_t blockedTicks;
+	struct LatencyHistograms* next;
+} LatencyHistograms;
+
+/**
+ * @struct latencyStruct
+ * @brief The per-thread histograms of the round and their merged totals.
+ *
+ * @var latencyStruct::threads
+ * Every thread's histograms, linked through LatencyHistograms::next.
+ *
+ * @var latencyStruct::generation
+ * Incremented when the per-thread histograms are merged and freed. A thread whose
+ * cached histograms belong to an older generation registers new ones.
+ *
+ * @var latencyStruct::total
+ * The merged histograms of the round.
+ *
+ * @var latencyStruct::blockedTicks
+ * The merged time bakers spent waiting for resources.
+ *
+ * @var latencyStruct::startTicks
+ * The latency clock when the round started, for converting ticks to nanoseconds.
+ *
+ * @var latencyStruct::startNanoseconds
+ * CLOCK_MONOTONIC time when the round started, in nanoseconds.
+ */
+struct latencyStruct {
+	pthread_mutex_t lock;
+	LatencyHistograms* threads;
+	atomic_uint generation;
+	LatencyHistogram wait[KITCHEN_MAX_RESOURCES];
+	LatencyHistogram hold[KITCHEN_MAX_RESOURCES];
+	LatencyHistogram recipes[KITCHEN_MAX_RECIPES];
+	uint64_t blockedTicks;
+	uint64_t startTicks;
+	uint64_t startNanoseconds;
+};
+
+struct latencyStruct latency = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+__thread LatencyHistograms* threadLatency;
+__thread unsigned threadLatencyGeneration;
+
+/**
+ * @brief Reads the latency clock.
+ *
+ * On x86 this is the time stamp counter, which costs a few nanoseconds and is
+ * converted to nanoseconds against CLOCK_MONOTONIC over the whole round.
+ * Elsewhere it is CLOCK_MONOTONIC itself.
+ *
+ * @return The current time in latency clock ticks.
+ */
+static inline uint64_t latencyTicks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return monotonicNanoseconds();
+#endif
+}
+
+/**
+ * @brief Returns the bucket a duration is counted in.
+ *
+ * @param ticks The duration in latency clock ticks.
+ * @return The bucket index.
+ */
+static inline int latencyBucket(uint64_t ticks) {
+	if (ticks < LATENCY_SUB_BUCKETS) {
+		return (int)ticks;
+	}
+
+	if (ticks >= 1ULL << LATENCY_MAX_BITS) {
+		return LATENCY_BUCKETS - 1;
+	}
+
+	int exponent = 63 - __builtin_clzll(ticks);
+	int subBucket = (ticks >> (exponent - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+
+	return (exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + subBucket;
+}
+
+/**
+ * @brief Returns the duration a bucket stands for when it is reported.
+ *
+ * @param bucket The bucket index.
+ * @return The midpoint of the bucket's range in latency clock ticks.
+ */
+uint64_t latencyBucketValue(int bucket) {
+	if (bucket < LATENCY_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	int shift = bucket / LATENCY_SUB_BUCKETS - 1;
+	uint64_t subBucket = bucket % LATENCY_SUB_BUCKETS;
+	uint64_t low = (LATENCY_SUB_BUCKETS + subBucket) << shift;
+
+	return low + ((1ULL << shift) >> 1);
+}
+
+/**
+ * @brief Returns the calling thread's histograms, registering them on first use in a round.
+ *
+ * @return The calling thread's histograms, exits the program if memory allocation fails.
+ */
+LatencyHistograms* getThreadLatency() {
+	unsigned generation = atomic_load_explicit(&latency.generation, memory_order_relaxed);
+
+	if (threadLatency != NULL && threadLatencyGeneration == generation) {
+		return threadLatency;
+	}
+
+	LatencyHistograms* histograms = calloc(1, sizeof(LatencyHistograms));
+
+	if (histograms == NULL) {
+		perror("Failed to allocate memory for latency histograms");
+		exit(1);
+	}
+
+	pthread_mutex_lock(&latency.lock);
+	histograms->next = latency.threads;
+	latency.threads = histograms;
+	pthread_mutex_unlock(&latency.lock);
+
+	threadLatency = histograms;
+	threadLatencyGeneration = generation;
+
+	return histograms;
+}
+
+/**
+ * @brief Counts a duration in one of the calling thread's histograms.
+ *
+ * @param slot The histogram to count it in, allocated if it is still NULL.
+ * @param ticks The duration in latency clock ticks.
+ */
+void recordLatency(LatencyHistogram** slot, uint64_t ticks) {
+	LatencyHistogram* histogram = *slot;
+
+	if (histogram == NULL) {
+		histogram = calloc(1, sizeof(LatencyHistogram));
+
+		if (histogram == NULL) {
+			perror("Failed to allocate memory for a latency histogram");
+			exit(1);
+		}
+
+		*slot = histogram;
+	}
+
+	histogram->buckets[latencyBucket(ticks)]++;
+	histogram->count++;
+	histogram->total += ticks;
+
+	if (ticks > histogram->max) {
+		histogram->max = ticks;
+	}
+}
+
+/**
+ * @brief Records how long a baker took to make a recipe, from starting on it to finishing it.
+ *
+ * @param recipe The recipe.
+ * @param startTicks The latency clock when the baker started on the recipe.
+ */
+void recordRecipeLatency(int recipe, uint64_t startTicks) {
+	recordLatency(&getThreadLatency()->recipes[recipe], latencyTicks() - startTicks);
+}
+
+/**
+ * @brief Adds one histogram's counts to another.
+ *
+ * @param total The histogram to add to.
+ * @param histogram The histogram to add, or NULL.
+ */
+void mergeLatencyHistogram(LatencyHistogram* total, const LatencyHistogram* histogram) {
+	if (histogram == NULL) {
+		return;
+	}
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		total->buckets[i] += histogram->buckets[i];
+	}
+
+	total->count += histogram->count;
+	total->total += histogram->total;
+
+	if (histogram->max > total->max) {
+		total->max = histogram->max;
+	}
+}
+
+/**
+ * @brief Clears the merged histograms and starts the latency clock for a new round.
+ */
+void startLatencyStats() {
+	memset(latency.wait, 0, sizeof(latency.wait));
+	memset(latency.hold, 0, sizeof(latency.hold));
+	memset(latency.recipes, 0, sizeof(latency.recipes));
+	latency.blockedTicks = 0;
+	latency.startTicks = latencyTicks();
+	latency.startNanoseconds = monotonicNanoseconds();
+}
+
+/**
+ * @brief Merges every thread's histograms into the round's totals and frees them.
+ *
+ * This must only be called once every baker of the round has finished.
+ */
+void mergeLatencyStats() {
+	pthread_mutex_lock(&latency.lock);
+
+	LatencyHistograms* histograms = latency.threads;
+	latency.threads = NULL;
+	atomic_fetch_add(&latency.generation, 1);
+
+	pthread_mutex_unlock(&latency.lock);
+
+	while (histograms != NULL) {
+		for (int i = 0; i < KITCHEN_MAX_RESOURCES; i++) {
+			mergeLatencyHistogram(&latency.wait[i], histograms->wait[i]);
+			mergeLatencyHistogram(&latency.hold[i], histograms->hold[i]);
+			free(histograms->wait[i]);
+			free(histograms->hold[i]);
+		}
+
+		for (int i = 0; i < KITCHEN_MAX_RECIPES; i++) {
+			mergeLatencyHistogram(&latency.recipes[i], histograms->recipes[i]);
+			free(histograms->recipes[i]);
+		}
+
+		latency.blockedTicks += histograms->blockedTicks;
+
+		LatencyHistograms* next = histograms->next;
+		free(histograms);
+		histograms = next;
+	}
+}
+
+/**
+ * @brief Returns the smallest recorded duration that at least a fraction of the values do not exceed.
+ *
+ * @param histogram The histogram.
+ * @param fraction The fraction of values, from 0 to 1.
+ * @return The duration in latency clock ticks, at most the histogram's maximum.
+ */
+uint64_t latencyPercentile(const LatencyHistogram* histogram, double fraction) {
+	uint64_t rank = (uint64_t)ceil(fraction * histogram->count);
+	uint64_t seen = 0;
+
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += histogram->buckets[i];
+
+		if (seen >= rank && seen > 0) {
+			uint64_t value = latencyBucketValue(i);
+			return value < histogram->max ? value : histogram->max;
+		}
+	}
+
+	return histogram->max;
+}
+
+/**
+ * @brief Prints the p50, p99, p99.9 and maximum of a histogram in simulated seconds.
+ *
+ * @param histogram The histogram.
+ * @param secondsPerTick Simulated seconds per latency clock tick.
+ */
+void printLatencyPercentiles(const LatencyHistogram* histogram, double secondsPerTick) {
+	printf(" %9.4f %9.4f %9.4f %9.4f",
+		latencyPercentile(histogram, 0.5) * secondsPerTick,
+		latencyPercentile(histogram, 0.99) * secondsPerTick,
+		latencyPercentile(histogram, 0.999) * secondsPerTick,
+		histogram->max * secondsPerTick);
+}
+
+/**
+ * @brief Returns how many simulated seconds one latency clock tick stood for during the round.
+ *
+ * @return Simulated seconds per tick.
+ */
+double latencySecondsPerTick() {
+	uint64_t ticks = latencyTicks() - latency.startTicks;
+	uint64_t nanoseconds = monotonicNanoseconds() - latency.startNanoseconds;
+
+	return (ticks > 0 ? (double)nanoseconds / ticks : 1.0) * settings.dilation / 1e9;
+}
+
+/**
+ * @brief Prints the wait and hold times of every resource and the time bakers took to
+ * make each recipe, from the histograms merged by mergeLatencyStats.
+ *
+ * Durations are measured on the wall clock and reported in simulated seconds.
+ */
+void printLatencyStats() {
+	double secondsPerTick = latencySecondsPerTick();
+
+	printf("  Latency in simulated s:\n    %-14s %8s %9s %9s %9s %9s %9s %9s %9s %9s\n",
+		"", "count", "wait p50", "p99", "p99.9", "max", "hold p50", "p99", "p99.9", "max");
+
+	for (int i = 0; i < resourceCount; i++) {
+		if (latency.wait[i].count == 0 && latency.hold[i].count == 0) {
+			continue;
+		}
+
+		printf("    %-14s %8llu", kitchen.names[i], (unsigned long long)latency.wait[i].count);
+		printLatencyPercentiles(&latency.wait[i], secondsPerTick);
+		printLatencyPercentiles(&latency.hold[i], secondsPerTick);
+		printf("\n");
+	}
+
+	for (int i = 0; i < kitchen.recipeCount; i++) {
+		if (latency.recipes[i].count == 0) {
+			continue;
+		}
+
+		printf("    %-14s %8llu", getRecipeName(i), (unsigned long long)latency.recipes[i].count);
+		printLatencyPercentiles(&latency.recipes[i], secondsPerTick);
+		printf("   (recipe, start to finish)\n");
+	}
+}
+
+/**
+ * @brief Clears the statistics and starts the clock for a new round.
+ */
+void startRoundStats() {
+	for (int i = 0; i < OPERATION_COUNT; i++) {
+		atomic_store(&roundStats.operationTotals[i], 0);
+		atomic_store(&roundStats.operationCounts[i], 0);
+	}
+
+	for (int i = 0; i < KITCHEN_MAX_RECIPES; i++) {
+		atomic_store(&roundStats.recipesCompleted[i], 0);
+	}
+
+	for (int i = 0; i < KITCHEN_MAX_RESOURCES; i++) {
+		atomic_store(&roundStats.resourceTimeouts[i], 0);
+		atomic_store(&roundStats.resourceBusy[i], 0);
+		atomic_store(&roundStats.supplied[i], 0);
+		atomic_store(&roundStats.consumed[i], 0);
+		atomic_store(&roundStats.stockouts[i], 0);
+	}
+
+	atomic_store(&roundStats.recipesRamsied, 0);
+	atomic_store(&roundStats.coroutineSwitches, 0);
+	atomic_store(&roundStats.ovenCycles, 0);
+	atomic_store(&roundStats.ovenLoads, 0);
+	atomic_store(&roundStats.restocks, 0);
+	atomic_store(&roundStats.restockLagTotal, 0);
+	atomic_store(&roundStats.restockLagMax, 0);
+	atomic_store(&roundStats.restockOverflows, 0);
+	atomic_store(&roundStats.restockQueuedMax, 0);
+	atomic_store(&roundStats.stashLookups, 0);
+	atomic_store(&roundStats.stashHits, 0);
+	atomic_store(&roundStats.storageVisitsSaved, 0);
+	atomic_store(&roundStats.stashReclaimed, 0);
+	atomic_store(&roundStats.stashReturned, 0);
+	atomic_store(&roundStats.prefetchRequests, 0);
+	atomic_store(&roundStats.prefetchTakenBack, 0);
+	atomic_store(&roundStats.prefetchedIngredients, 0);
+	atomic_store(&roundStats.prefetchHiddenNanoseconds, 0);
+	atomic_store(&roundStats.prefetchExposedNanoseconds, 0);
+	atomic_store(&roundStats.ordersReceived, 0);
+	atomic_store(&roundStats.ordersShed, 0);
+	atomic_store(&roundStats.ordersCompleted, 0);
+
+	for (int i = 0; i < ORDER_PRIORITIES; i++) {
+		atomic_store(&roundStats.ordersWithDeadline[i], 0);
+		atomic_store(&roundStats.deadlinesMissed[i], 0);
+	}
+
+	getrusage(RUSAGE_SELF, &roundStats.startUsage);
+	roundStats.roundStart = monotonicNanoseconds();
+
+	if (LATENCY_ENABLED) {
+		startLatencyStats();
+	}
+}
+
+/**
+ * @brief Returns the wall time elapsed since the round started, in seconds.
+ *
+ * @return The elapsed wall time.
+ */
+double roundWallSeconds() {
+	return (monotonicNanoseconds() - roundStats.roundStart) / 1e9;
+}
+
+/**
+ * @brief Returns the simulated time elapsed since the round started, in seconds.
+ *
+ * @return The elapsed simulated time.
+ */
+double roundSimulatedSeconds() {
+	return roundWallSeconds() * settings.dilation;
+}
+
+/**
+ * @brief Prints the round's wall time, simulated time, completed recipes and time spent per operation.
+ *
+ * @param wallSeconds The wall time the round took.
+ * @param simulatedSeconds The simulated time the round took.
+ * @param blockedSeconds The simulated time bakers spent waiting for resources, or a
+ * negative value if it was not measured.
+ */
+void printRoundStats(double wallSeconds, double simulatedSeconds, double blockedSeconds) {
+	printf("Round took %.3f s of wall time, %.3f s of simulated time (%.4gx real time)\n",
+		wallSeconds, simulatedSeconds, wallSeconds > 0 ? simulatedSeconds / wallSeconds : 0.0);
+
+	long long completed = 0;
+	printf("  Recipes completed:");
+	for (int i = 0; i < kitchen.recipeCount; i++) {
+		long long count = atomic_load(&roundStats.recipesCompleted[i]);
+		completed += count;
+		printf(" %s %lld,", getRecipeName(i), count);
+	}
+	printf(" total %lld, ramsied %lld\n", completed, (long long)atomic_load(&roundStats.recipesRamsied));
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	long switches = (usage.ru_nvcsw - roundStats.startUsage.ru_nvcsw) + (usage.ru_nivcsw - roundStats.startUsage.ru_nivcsw);
+	long long coroutineSwitches = atomic_load(&roundStats.coroutineSwitches);
+	double perRecipe = completed > 0 ? 1.0 / completed : 0.0;
+
+	printf("  Context switches: %ld OS (%.2f per recipe), %lld coroutine (%.2f per recipe)\n",
+		switches, switches * perRecipe, coroutineSwitches, coroutineSwitches * perRecipe);
+
+	if (blockedSeconds >= 0) {
+		printf("  Blocked: %.3f simulated s waiting for resources (%.3f s per recipe) with the %s recipe policy\n",
+			blockedSeconds, blockedSeconds * perRecipe, recipePolicyNames[settings.recipePolicy]);
+	}
+
+	int gaveUp = 0;
+	for (int i = 0; i < resourceCount; i++) {
+		long long timeouts = atomic_load(&roundStats.resourceTimeouts[i]);
+		long long busy = atomic_load(&roundStats.resourceBusy[i]);
+
+		if (timeouts == 0 && busy == 0) {
+			continue;
+		}
+
+		printf(gaveUp++ == 0 ? "  Gave up on:" : ",");
+		printf(" %s %lld timed out, %lld busy", kitchen.names[i], timeouts, busy);
+	}
+	if (gaveUp > 0) {
+		printf("\n");
+	}
+
+	long long ovenCycles = atomic_load(&roundStats.ovenCycles);
+	if (ovenCycles > 0) {
+		printf("  Oven: %lld batches on %d racks, %.2f recipes per batch\n",
+			ovenCycles, settings.ovenRacks, (double)atomic_load(&roundStats.ovenLoads) / ovenCycles);
+	}
+
+	if (settings.restockers > 0) {
+		long long restocks = atomic_load(&roundStats.restocks);
+
+		printf("  Restockers: %d threads gave back %lld returns, queue depth max %d, %lld returned by bakers on a full queue\n",
+			settings.restockers, restocks, atomic_load(&roundStats.restockQueuedMax), (long long)atomic_load(&roundStats.restockOverflows));
+		printf("  Restock lag: %.3f ms mean, %.3f ms max of wall time past the end of the return\n",
+			restocks > 0 ? atomic_load(&roundStats.restockLagTotal) / 1e6 / restocks : 0.0, atomic_load(&roundStats.restockLagMax) / 1e6);
+	}
+
+	if (settings.stashSize > 0) {
+		long long lookups = atomic_load(&roundStats.stashLookups);
+		long long hits = atomic_load(&roundStats.stashHits);
+
+		printf("  Stash: %lld of %lld ingredients found in the baker's stash (%.1f%%), %lld storage visits saved\n",
+			hits, lookups, lookups > 0 ? 100.0 * hits / lookups : 0.0, (long long)atomic_load(&roundStats.storageVisitsSaved));
+		printf("  Stash returns: %lld units reclaimed by the rebalancer for waiting bakers, %lld given back by their bakers\n",
+			(long long)atomic_load(&roundStats.stashReclaimed), (long long)atomic_load(&roundStats.stashReturned));
+	}
+
+	if (settings.prefetchers > 0) {
+		printf("  Prefetch: %lld requests, %lld taken back unserved, %lld ingredients gathered by %d prefetchers\n",
+			(long long)atomic_load(&roundStats.prefetchRequests), (long long)atomic_load(&roundStats.prefetchTakenBack),
+			(long long)atomic_load(&roundStats.prefetchedIngredients), settings.prefetchers);
+		printf("  Prefetch overlap: %.3f simulated s of gathering hidden behind the oven, %.3f s waited for after it\n",
+			atomic_load(&roundStats.prefetchHiddenNanoseconds) / 1e9 * settings.dilation,
+			atomic_load(&roundStats.prefetchExposedNanoseconds) / 1e9 * settings.dilation);
+	}
+
+	for (int i = 0; i < OPERATION_COUNT; i++) {
+		long long count = atomic_load(&roundStats.operationCounts[i]);
+		double total = atomic_load(&roundStats.operationTotals[i]) / 1e6;
+
+		printf("  %-7s %8lld operations, %10.3f simulated s total, %8.3f s mean\n",
+			operationNames[i], count, total, count > 0 ? total / count : 0.0);
+	}
+}
+
+/**
+ * @brief Looks up a name in a list of names.
+ *
+ * @param names The list of names.
+ * @param count The number of entries in names.
+ * @param name The name to look up, compared without regard to case.
+ * @return The index of the name, or -1 if it is not in the list.
+ */
+int findName(const char* names[], int count, const char* name) {
+	for (int i = 0; i < count; i++) {
+		if (strcasecmp(names[i], name) == 0) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Applies a duration given on the command line.
+ *
+ * The specification has the form OPERATION=SECONDS, or RECIPE:OPERATION=SECONDS for
+ * a duration that only applies to one recipe. Recipes may be given by name or index.
+ *
+ * @param specification The duration specification.
+ * @return Returns 0 on success, or -1 if the specification is not valid.
+ */
+int parseDuration(const char* specification) {
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "%s", specification);
+
+	char* operationName = buffer;
+	int recipe = -1;
+	char* colon = strchr(buffer, ':');
+
+	if (colon != NULL) {
+		*colon = '\0';
+		operationName = colon + 1;
+
+		for (int i = 0; i < kitchen.recipeCount; i++) {
+			if (strcasecmp(getRecipeName(i), buffer) == 0) {
+				recipe = i;
+			}
+		}
+
+		if (recipe < 0) {
+			char* end;
+			recipe = strtol(buffer, &end, 10);
+			if (*end != '\0' || recipe < 0 || recipe >= kitchen.recipeCount) {
+				return -1;
+			}
+		}
+	}
+
+	char* equals = strchr(operationName, '=');
+	if (equals == NULL) {
+		return -1;
+	}
+	*equals = '\0';
+
+	int operation = findName(operationNames, OPERATION_COUNT, operationName);
+	char* end;
+	double seconds = strtod(equals + 1, &end);
+
+	if (operation < 0 || equals[1] == '\0' || *end != '\0' || seconds < 0) {
+		return -1;
+	}
+
+	if (recipe >= 0) {
+		durations.recipes[recipe][operation] = seconds;
+		durations.recipeSet[recipe][operation] = 1;
+	}
+	else {
+		durations.operations[operation] = seconds;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Splits a line of a kitchen file into words.
+ *
+ * Words are separated by spaces or tabs, and a word in double quotes may contain
+ * spaces. A # outside of quotes starts a comment that runs to the end of the line.
+ *
+ * @param line The line, which is modified in place.
+ * @param words Receives a pointer to each word.
+ * @param maxWords The number of entries in words.
+ * @return The number of words, or -1 if a quote is not closed or there are too many words.
+ */
+int splitKitchenLine(char* line, char* words[], int maxWords) {
+	int count = 0;
+	char* next = line;
+
+	while (1) {
+		next += strspn(next, " \t\r\n");
+
+		if (*next == '\0' || *next == '#') {
+			return count;
+		}
+
+		if (count == maxWords) {
+			return -1;
+		}
+
+		if (*next == '"') {
+			words[count++] = ++next;
+			next = strchr(next, '"');
+			if (next == NULL) {
+				return -1;
+			}
+		}
+		else {
+			words[count++] = next;
+			next += strcspn(next, " \t\r\n");
+			if (*next == '\0') {
+				return count;
+			}
+		}
+
+		*next++ = '\0';
+	}
+}
+
+/**
+ * @brief Reports an error in a kitchen file and exits the program.
+ *
+ * @param path The kitchen file.
+ * @param lineNumber The line the error is on, or 0 if it is not tied to a line.
+ * @param message What is wrong.
+ * @param name The name the error is about, or NULL.
+ */
+void kitchenError(const char* path, int lineNumber, const char* message, const char* name) {
+	if (lineNumber > 0) {
+		fprintf(stderr, "%s:%d: ", path, lineNumber);
+	}
+	else {
+		fprintf(stderr, "%s: ", path);
+	}
+
+	if (name != NULL) {
+		fprintf(stderr, "%s %s\n", message, name);
+	}
+	else {
+		fprintf(stderr, "%s\n", message);
+	}
+
+	exit(1);
+}
+
+/**
+ * @brief Parses a positive capacity from a kitchen file.
+ *
+ * @param path The kitchen file.
+ * @param lineNumber The line the capacity is on.
+ * @param word The capacity as written.
+ * @return The capacity. Exits the program if it is not a positive integer that fits
+ *         in a SysV semaphore.
+ */
+int parseKitchenCapacity(const char* path, int lineNumber, const char* word) {
+	char* end;
+	long capacity = strtol(word, &end, 10);
+
+	if (*end != '\0' || capacity <= 0 || capacity > 32767) {
+		kitchenError(path, lineNumber, "Not a valid capacity:", word);
+	}
+
+	return (int)capacity;
+}
+
+/**
+ * @brief Replaces the default kitchen with one described in a file.
+ *
+ * Each line of the file declares one item:
+ *
+ *     tool NAME CAPACITY
+ *     storage NAME CAPACITY
+ *     oven CAPACITY
+ *     ingredient NAME STORAGE CAPACITY
+ *     recipe NAME PLURAL INGREDIENT...
+ *
+ * Names are matched without regard to case, and may be quoted to contain spaces.
+ * The declarations may come in any order. Mixing a recipe takes one of every tool,
+ * and the oven's capacity is the number of ovens. A kitchen has at most
+ * KITCHEN_MAX_RESOURCES tools, storage areas, ovens and ingredients together, and at
+ * most KITCHEN_MAX_RECIPES recipes.
+ *
+ * @param path The kitchen file.
+ * @return Returns 0 on success. Exits the program if the file cannot be read or is not valid.
+ */
+int loadKitchen(const char* path) {
+	FILE* file = fopen(path, "r");
+
+	if (file == NULL) {
+		perror(path);
+		exit(1);
+	}
+
+	const char* tools[KITCHEN_MAX_RESOURCES];
+	int toolCapacities[KITCHEN_MAX_RESOURCES];
+	int toolCount = 0;
+
+	const char* storages[KITCHEN_MAX_RESOURCES];
+	int storageCapacities[KITCHEN_MAX_RESOURCES];
+	int storageCount = 0;
+
+	const char* ingredients[KITCHEN_MAX_RESOURCES];
+	const char* ingredientStorages[KITCHEN_MAX_RESOURCES];
+	int ingredientCapacities[KITCHEN_MAX_RESOURCES];
+	int ingredientLines[KITCHEN_MAX_RESOURCES];
+	int ingredientCount = 0;
+
+	char* recipeWords[KITCHEN_MAX_RECIPES][KITCHEN_MAX_RESOURCES + 2];
+	int recipeWordCounts[KITCHEN_MAX_RECIPES];
+	int recipeLines[KITCHEN_MAX_RECIPES];
+	int recipeCount = 0;
+
+	int ovens = 0;
+
+	char line[1024];
+	int lineNumber = 0;
+
+	while (fgets(line, sizeof(line), file) != NULL) {
+		char* words[KITCHEN_MAX_RESOURCES + 3];
+		int wordCount = splitKitchenLine(line, words, KITCHEN_MAX_RESOURCES + 3);
+
+		lineNumber++;
+
+		if (wordCount == 0) {
+			continue;
+		}
+
+		if (wordCount < 0) {
+			kitchenError(path, lineNumber, "Unterminated quote or too many words", NULL);
+		}
+
+		for (int i = 1; i < wordCount; i++) {
+			words[i] = strdup(words[i]);
+		}
+
+		int resources = toolCount + storageCount + 1 + ingredientCount;
+
+		if (strcasecmp(words[0], "tool") == 0 && wordCount == 3) {
+			if (resources == KITCHEN_MAX_RESOURCES) {
+				kitchenError(path, lineNumber, "Too many resources at tool", words[1]);
+			}
+			if (findName(tools, toolCount, words[1]) >= 0) {
+				kitchenError(path, lineNumber, "Duplicate tool", words[1]);
+			}
+			tools[toolCount] = words[1];
+			toolCapacities[toolCount++] = parseKitchenCapacity(path, lineNumber, words[2]);
+		}
+		else if (strcasecmp(words[0], "storage") == 0 && wordCount == 3) {
+			if (resources == KITCHEN_MAX_RESOURCES) {
+				kitchenError(path, lineNumber, "Too many resources at storage", words[1]);
+			}
+			if (findName(storages, storageCount, words[1]) >= 0) {
+				kitchenError(path, lineNumber, "Duplicate storage area", words[1]);
+			}
+			storages[storageCount] = words[1];
+			storageCapacities[storageCount++] = parseKitchenCapacity(path, lineNumber, words[2]);
+		}
+		else if (strcasecmp(words[0], "oven") == 0 && wordCount == 2) {
+			if (ovens > 0) {
+				kitchenError(path, lineNumber, "The oven is declared more than once", NULL);
+			}
+			ovens = parseKitchenCapacity(path, lineNumber, words[1]);
+		}
+		else if (strcasecmp(words[0], "ingredient") == 0 && wordCount == 4) {
+			if (resources == KITCHEN_MAX_RESOURCES) {
+				kitchenError(path, lineNumber, "Too many resources at ingredient", words[1]);
+			}
+			if (findName(ingredients, ingredientCount, words[1]) >= 0) {
+				kitchenError(path, lineNumber, "Duplicate ingredient", words[1]);
+			}
+			ingredients[ingredientCount] = words[1];
+			ingredientStorages[ingredientCount] = words[2];
+			ingredientLines[ingredientCount] = lineNumber;
+			ingredientCapacities[ingredientCount++] = parseKitchenCapacity(path, lineNumber, words[3]);
+		}
+		else if (strcasecmp(words[0], "recipe") == 0 && wordCount >= 4) {
+			if (recipeCount == KITCHEN_MAX_RECIPES) {
+				kitchenError(path, lineNumber, "Too many recipes at", words[1]);
+			}
+			for (int i = 0; i < recipeCount; i++) {
+				if (strcasecmp(recipeWords[i][0], words[1]) == 0) {
+					kitchenError(path, lineNumber, "Duplicate recipe", words[1]);
+				}
+			}
+			memcpy(recipeWords[recipeCount], words + 1, (wordCount - 1) * sizeof(char*));
+			recipeWordCounts[recipeCount] = wordCount - 1;
+			recipeLines[recipeCount++] = lineNumber;
+		}
+		else {
+			kitchenError(path, lineNumber, "Not a valid declaration:", words[0]);
+		}
+	}
+
+	fclose(file);
+
+	if (toolCount == 0 || storageCount == 0 || ingredientCount == 0 || recipeCount == 0 || ovens == 0) {
+		kitchenError(path, 0, "A kitchen needs at least one tool, storage area, ingredient and recipe, and an oven", NULL);
+	}
+
+	struct kitchenStruct loaded = { 0 };
+	int resource = 0;
+
+	loaded.toolCount = toolCount;
+	for (int i = 0; i < toolCount; i++, resource++) {
+		loaded.names[resource] = tools[i];
+		loaded.capacities[resource] = toolCapacities[i];
+		loaded.tools[i] = resource;
+	}
+
+	loaded.storageCount = storageCount;
+	for (int i = 0; i < storageCount; i++, resource++) {
+		loaded.names[resource] = storages[i];
+		loaded.capacities[resource] = storageCapacities[i];
+		loaded.storages[i] = resource;
+	}
+
+	loaded.oven = resource;
+	loaded.names[resource] = "oven";
+	loaded.capacities[resource++] = ovens;
+
+	loaded.ingredientCount = ingredientCount;
+	for (int i = 0; i < ingredientCount; i++, resource++) {
+		int storage = findName(storages, storageCount, ingredientStorages[i]);
+
+		if (storage < 0) {
+			kitchenError(path, ingredientLines[i], "Unknown storage area", ingredientStorages[i]);
+		}
+
+		loaded.names[resource] = ingredients[i];
+		loaded.capacities[resource] = ingredientCapacities[i];
+		loaded.ingredientStorage[i] = toolCount + storage;
+		loaded.storageIngredients[toolCount + storage] |= 1u << i;
+	}
+
+	loaded.recipeCount = recipeCount;
+	for (int i = 0; i < recipeCount; i++) {
+		loaded.recipeNames[i] = recipeWords[i][0];
+		loaded.recipePluralNames[i] = recipeWords[i][1];
+
+		for (int j = 2; j < recipeWordCounts[i]; j++) {
+			int ingredient = findName(ingredients, ingredientCount, recipeWords[i][j]);
+
+			if (ingredient < 0) {
+				kitchenError(path, recipeLines[i], "Unknown ingredient", recipeWords[i][j]);
+			}
+
+			loaded.recipeIngredients[i] |= 1u << ingredient;
+		}
+	}
+
+	kitchen = loaded;
+	semOffset = loaded.oven + 1;
+	resourceCount = resource;
+
+	return 0;
+}
+
+/**
+ * @brief Sets the capacity of a storage area given on the command line.
+ *
+ * The specification has the form STORAGE=CAPACITY, with the storage area given by name.
+ *
+ * @param specification The capacity specification.
+ * @return Returns 0 on success, or -1 if the specification is not valid.
+ */
+int parseStorageCapacity(const char* specification) {
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "%s", specification);
+
+	char* equals = strchr(buffer, '=');
+	if (equals == NULL) {
+		return -1;
+	}
+	*equals = '\0';
+
+	int storage = findName(&kitchen.names[kitchen.toolCount], kitchen.oven - kitchen.toolCount, buffer);
+	char* end;
+	long capacity = strtol(equals + 1, &end, 10);
+
+	if (storage < 0 || *end != '\0' || capacity <= 0 || capacity > 32767) {
+		return -1;
+	}
+
+	kitchen.capacities[kitchen.toolCount + storage] = capacity;
+	return 0;
+}
+
+/**
+ * The names of the shelves added by stripeStorages, indexed by resource.
+ */
+char shelfNames[KITCHEN_MAX_RESOURCES][KITCHENSTAT_NAME_SIZE];
+
+/**
+ * @brief Splits every storage area into shelves that are guarded separately.
+ *
+ * The ingredients of a storage area are dealt in turn to at most shelves shelves, named
+ * after the area ("pantry/1"), and each shelf admits as many bakers at once as the
+ * storage area did. The shelves are added as resources after the ingredients and take the
+ * storage areas' place in storages and ingredientStorage, so that a baker holds only the
+ * shelf of the ingredient it takes. The storage areas stay in the table, unused.
+ *
+ * Exits the program if the shelves do not fit in KITCHEN_MAX_RESOURCES.
+ *
+ * @param shelves The most shelves per storage area.
+ */
+void stripeStorages(int shelves) {
+	int resource = resourceCount;
+
+	kitchen.storageCount = 0;
+
+	for (int area = kitchen.toolCount; area < kitchen.oven; area++) {
+		uint32_t ingredients = kitchen.storageIngredients[area];
+		int held = __builtin_popcount(ingredients);
+		int stripes = held < shelves ? held : shelves;
+
+		if (resource + stripes > KITCHEN_MAX_RESOURCES) {
+			fprintf(stderr, "%d shelves per storage area do not fit in the kitchen's %d resources\n", shelves, KITCHEN_MAX_RESOURCES);
+			exit(1);
+		}
+
+		for (int i = 0; i < stripes; i++) {
+			snprintf(shelfNames[resource + i], sizeof(shelfNames[0]), "%s/%d", kitchen.names[area], i + 1);
+			kitchen.names[resource + i] = shelfNames[resource + i];
+			kitchen.capacities[resource + i] = kitchen.capacities[area];
+			kitchen.storageIngredients[resource + i] = 0;
+			kitchen.storages[kitchen.storageCount++] = resource + i;
+		}
+
+		int position = 0;
+		for (uint32_t rest = ingredients; rest != 0; rest &= rest - 1, position++) {
+			int ingredient = __builtin_ctz(rest);
+			int shelf = resource + position % stripes;
+
+			kitchen.ingredientStorage[ingredient] = shelf;
+			kitchen.storageIngredients[shelf] |= 1u << ingredient;
+		}
+
+		resource += stripes;
+	}
+
+	resourceCount = resource;
+}
+
+/**
+ * Checks if a given integer is present in an array.
+ *
+ * @param haystack An array of integers to search within.
+ * @param haystackSize The size of the haystack array.
+ * @param needle The integer value to search for in the haystack array.
+ * @return Returns 1 if the needle is found in the haystack array, otherwise returns 0.
+ */
+int isIn(const int haystack[], const int haystackSize, const int needle) {
+
+	for (int i = 0; i < haystackSize; i++) {
+		if (haystack[i] == needle) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Inserts a semaphore ID into the semaphore array at the specified resource index.
+ *
+ * This function ensures that the semaphore array is large enough to accommodate the specified
+ * resource index. If the array is not large enough, it reallocates memory to expand the array.
+ * If memory allocation fails, it returns an error code.
+ *
+ * @param resource The index in the semaphore array where the semaphore ID should be inserted.
+ * @param semaphoreId The semaphore ID to be inserted into the array.
+ * @return int Returns 0 on success, or -1 if memory allocation fails.
+ */
+int insertIntoSemaphoreArray(int resource, int semaphoreId) {
+	if (resource >= semaphores.length) {
+		int* temp = realloc(semaphores.semaphoreIds, (resource + 1) * sizeof(int));
+
+		if (temp == NULL) {
+			perror("Failed to allocate memory for semaphoreIds");
+			return -1; // Memory allocation failure
+		}
+
+		semaphores.semaphoreIds = temp;
+		semaphores.length = resource + 1;
+
+	}
+
+	semaphores.semaphoreIds[resource] = semaphoreId; // Add the new element
+	return 0; // Success
+
+}
+
+/**
+ * @brief Inserts a new element into the shared memory array.
+ *
+ * This function reallocates memory for the shared memory array to accommodate
+ * a new element, then inserts the provided element into the array.
+ *
+ * @param memoryAddress Pointer to the sharedMem structure to be inserted.
+ * @return int Returns 0 on success, or -1 if memory allocation fails.
+ */
+int insertIntoSharedMemArray(struct sharedMem* memoryAddress) {
+
+	struct sharedMem* temp = realloc(sharedMemory.sharedMemoryAddresses,
+
+		(sharedMemory.length + 1) * sizeof(struct sharedMem));
+
+
+
+	if (temp == NULL) {
+
+		perror("Failed to allocate memory for sharedMemoryAddresses");
+
+		return -1; // Memory allocation failure
+
+	}
+
+
+
+	sharedMemory.sharedMemoryAddresses = temp;
+
+	sharedMemory.sharedMemoryAddresses[sharedMemory.length++] = *memoryAddress; // Add the new element
+
+	return 0; // Success
+
+}
+
+/**
+ * @brief Derives the key of one of the kitchen's shared memory segments from programPath.
+ *
+ * Exits the program if programPath does not exist, since ftok would return -1 for every
+ * segment and the segments would end up sharing one key.
+ *
+ * @param id The segment's project ID.
+ * @return The key.
+ */
+key_t getSharedMemoryKey(int id) {
+	key_t key = ftok(programPath, id);
+
+	if (key == -1) {
+		fprintf(stderr, "Unable to derive the shared memory keys from %s: %s; run the kitchen from the directory that holds it\n",
+			programPath, strerror(errno));
+		exit(1);
+	}
+
+	return key;
+}
+
+/**
+ * @brief Initializes shared memory segment.
+ *
+ * This function creates a shared memory segment with the specified key and size,
+ * attaches it to the process's address space, and inserts it into the shared memory array.
+ *
+ * @param sharedMemory Pointer to the sharedMem structure to be initialized.
+ * @param key The key to be used for the shared memory segment.
+ * @param size The size of the shared memory segment.
+ * @param isAlreadyCreated Boolean indicating whether the sharedMemory already exists
+ * @return Returns 0 on success, exits the program on failure.
+ */
+int initSharedMemory(struct sharedMem* sharedMemory, key_t key, int size, int isAlreadyCreated) {
+
+	sharedMemory->id = shmget(key, size, IPC_CREAT | S_IRUSR | S_IWUSR);
+
+	if (sharedMemory->id < 0) {
+
+		perror("Unable to obtain shared memory\n");
+
+		exit(1);
+
+	}
+
+	sharedMemory->address = shmat(sharedMemory->id, 0, 0);
+
+	if (sharedMemory->address == (void*)-1) {
+
+		perror("Unable to attach\n");
+
+		exit(1);
+
+	}
+
+	if (!isAlreadyCreated) {
+		insertIntoSharedMemArray(sharedMemory);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Cleans up the shared memory by detaching and deallocating it.
+ *
+ * This function detaches the shared memory segment from the address space of the calling process
+ * and then deallocates the shared memory segment. If either operation fails, an error message is
+ * printed and the program exits with a status of 1.
+ *
+ * @param sharedMemory A pointer to the sharedMem structure that contains the shared memory segment's
+ *                     address and identifier.
+ * @return Returns 0 on successful cleanup of the shared memory.
+ */
+int cleanupSharedMemoryAddress(struct sharedMem* sharedMemory) {
+	if (shmdt(sharedMemory->address) < 0) {
+
+		perror("Unable to detach\n");
+
+		exit(1);
+
+	}
+
+	if (shmctl(sharedMemory->id, IPC_RMID, 0) < 0) {
+
+		perror("Unable to deallocate\n");
+
+		exit(1);
+
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Creates the semaphore set that holds every kitchen resource.
+ *
+ * All resources live in one SysV semaphore set so that several of them can be
+ * decremented or incremented together by a single, atomic semop call.
+ *
+ * @param count The number of semaphores in the set.
+ * @return The semaphore set ID on success, exits the program on failure.
+ */
+int initSemaphoreSet(int count) {
+
+	int semId = semget(IPC_PRIVATE, count, 00600);
+
+	if (semId == -1) {
+		perror("semget failed");
+		exit(1);
+	}
+
+	semaphores.setId = semId;
+
+	return semId;
+}
+
+/**
+ * @brief Sets the value of a resource's semaphore within the kitchen semaphore set.
+ *
+ * This function sets the initial value of the resource's semaphore and inserts the
+ * set ID into the semaphore array.
+ *
+ * @param resource The resource identifier to associate with the semaphore.
+ * @param resourceCount The initial count/value for the semaphore.
+ * @return Returns 0 on success, exits the program on failure.
+ */
+int sysvSetValue(int resource, int resourceCount) {
+
+	int semId = semaphores.setId;
+
+	int ctlErrorCode = semctl(semId, resource, SETVAL, resourceCount);
 
 	if (ctlErrorCode == -1) {
 		perror("semctl failed");
 		exit(1);
 	}
 
-	insertIntoSemaphoreArray(resource, semId);
+	insertIntoSemaphoreArray(resource, semId);
+
+	return 0;
+}
+
+/**
+ * @brief Initializes a semaphore with a given resource count.
+ *
+ * This function sets the initial value of the resource's semaphore through the
+ * selected synchronization backend.
+ *
+ * @param resource The resource identifier to associate with the semaphore.
+ * @param resourceCount The initial count/value for the semaphore.
+ * @return The resource identifier on success.
+ */
+int initSemaphore(int resource, int resourceCount) {
+
+	settings.backend->setValue(resource, resourceCount);
+
+	return resource;
+}
+
+/**
+ * @brief Cleans up and removes a semaphore set.
+ *
+ * This function attempts to remove a semaphore set identified by the given semaphore ID.
+ * If the removal fails, an error message is printed to standard error.
+ *
+ * @param semId The identifier of the semaphore set to be removed.
+ * @return Returns 0 on success.
+ */
+int cleanupSemaphore(int semId) {
+	if (semctl(semId, 0, IPC_RMID) == -1) {
+		perror("Failed to remove semaphores");
+	}
+	return 0;
+}
+
+/**
+ * @brief Cleans up the SysV semaphores by releasing their resources.
+ *
+ * This function removes the kitchen semaphore set, which every semaphore ID stored in
+ * the `semaphores` structure refers to, and then frees the memory allocated for the
+ * semaphore IDs array.
+ *
+ * @return Returns 0 upon successful cleanup.
+ */
+int sysvCleanup() {
+
+	cleanupSemaphore(semaphores.setId);
+
+	free(semaphores.semaphoreIds);
+	semaphores.semaphoreIds = NULL;
+	semaphores.length = 0;
+	return 0;
+
+}
+
+/**
+ * @brief Cleans up all semaphores by releasing their resources.
+ *
+ * This function asks the selected synchronization backend to release everything
+ * it created for the kitchen resources.
+ *
+ * @return Returns 0 upon successful cleanup.
+ */
+int cleanupSemaphores() {
+
+	return settings.backend->cleanup();
+
+}
+
+/**
+ * @brief Cleans up shared memory by iterating through each shared memory address
+ *        and freeing the allocated memory.
+ *
+ * This function iterates through the shared memory addresses stored in the
+ * sharedMemory structure, calls the cleanupSharedMemoryAddress function for
+ * each address, and then frees the memory allocated for the shared memory addresses.
+ *
+ * @return Returns 0 upon successful cleanup.
+ */
+int cleanupSharedMemory() {
+
+	int length = sharedMemory.length;
+	for (int i = 0; i < length; i++) {
+
+		struct sharedMem* memoryContainer = &(sharedMemory.sharedMemoryAddresses[i]);
+		cleanupSharedMemoryAddress(memoryContainer);
+	}
+
+	free(sharedMemory.sharedMemoryAddresses);
+	return 0;
+
+}
+
+KitchenstatSegment* liveStats;
+
+/**
+ * @brief Creates the live statistics segment read by the kitchenstat monitor.
+ *
+ * A segment left behind by a kitchen that was killed is removed first if it is no
+ * longer attached and has another layout. Exits the program on failure.
+ */
+void initLiveStats() {
+	key_t key = getSharedMemoryKey(KITCHENSTAT_SHARED_MEMORY_ID);
+	int staleId = shmget(key, 0, 0);
+	struct shmid_ds info;
+
+	if (staleId >= 0 && shmctl(staleId, IPC_STAT, &info) == 0 && info.shm_nattch == 0 && info.shm_segsz != sizeof(KitchenstatSegment)) {
+		shmctl(staleId, IPC_RMID, 0);
+	}
+
+	struct sharedMem segment;
+	initSharedMemory(&segment, key, sizeof(KitchenstatSegment), 0);
+
+	liveStats = (KitchenstatSegment*)segment.address;
+	memset(liveStats, 0, sizeof(KitchenstatSegment));
+
+	liveStats->version = KITCHENSTAT_VERSION;
+	liveStats->size = sizeof(KitchenstatSegment);
+	liveStats->pid = getpid();
+	liveStats->resourceCount = resourceCount;
+	liveStats->recipeCount = kitchen.recipeCount;
+
+	for (int i = 0; i < resourceCount; i++) {
+		liveStats->capacities[i] = kitchen.capacities[i];
+		snprintf(liveStats->resourceNames[i], KITCHENSTAT_NAME_SIZE, "%s", kitchen.names[i]);
+	}
+
+	for (int i = 0; i < kitchen.recipeCount; i++) {
+		snprintf(liveStats->recipeNames[i], KITCHENSTAT_NAME_SIZE, "%s", getRecipeName(i));
+	}
+
+	atomic_store_explicit(&liveStats->magic, KITCHENSTAT_MAGIC, memory_order_release);
+}
+
+/**
+ * @brief Publishes the start of a round to the live statistics segment.
+ *
+ * @param bakers The number of bakers in the round.
+ */
+void startLiveStatsRound(int bakers) {
+	int tracked = bakers < KITCHENSTAT_MAX_BAKERS ? bakers : KITCHENSTAT_MAX_BAKERS;
+
+	for (int i = 0; i < tracked; i++) {
+		atomic_store_explicit(&liveStats->bakerStates[i].state, KITCHENSTAT_IDLE, memory_order_relaxed);
+	}
+
+	atomic_store_explicit(&liveStats->bakers, bakers, memory_order_relaxed);
+	atomic_store_explicit(&liveStats->roundStart, monotonicNanoseconds(), memory_order_relaxed);
+	atomic_fetch_add_explicit(&liveStats->round, 1, memory_order_relaxed);
+	atomic_store_explicit(&liveStats->running, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Publishes the end of a round to the live statistics segment.
+ */
+void finishLiveStatsRound() {
+	atomic_store_explicit(&liveStats->running, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Counts bakers that start waiting for resources.
+ *
+ * @param resources The resources waited for.
+ * @param count The number of entries in resources.
+ */
+void liveStatsWaiting(const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		atomic_fetch_add_explicit(&liveStats->resources[resources[i]].waiting, 1, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Moves resources that were waited for to in use.
+ *
+ * @param resources The resources acquired.
+ * @param count The number of entries in resources.
+ */
+void liveStatsAcquired(const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		KitchenstatResource* counters = &liveStats->resources[resources[i]];
+
+		atomic_fetch_sub_explicit(&counters->waiting, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&counters->inUse, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&counters->acquires, 1, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Counts bakers that stop waiting for resources without getting them.
+ *
+ * @param resources The resources given up on.
+ * @param count The number of entries in resources.
+ */
+void liveStatsGaveUp(const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		KitchenstatResource* counters = &liveStats->resources[resources[i]];
+
+		atomic_fetch_sub_explicit(&counters->waiting, 1, memory_order_relaxed);
+		atomic_fetch_add_explicit(&counters->timeouts, 1, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Counts resources that are given back.
+ *
+ * @param resources The resources released.
+ * @param count The number of entries in resources.
+ */
+void liveStatsReleased(const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		atomic_fetch_sub_explicit(&liveStats->resources[resources[i]].inUse, 1, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Publishes what a baker is doing, if live statistics are enabled.
+ *
+ * @param bakerId The baker.
+ * @param state One of the kitchenstatBakerState values.
+ * @param recipe The recipe the baker is working on.
+ */
+void setBakerState(int bakerId, int state, int recipe) {
+	if (liveStats == NULL || bakerId >= KITCHENSTAT_MAX_BAKERS) {
+		return;
+	}
+
+	atomic_store_explicit(&liveStats->bakerStates[bakerId].recipe, recipe, memory_order_relaxed);
+	atomic_store_explicit(&liveStats->bakerStates[bakerId].state, state, memory_order_relaxed);
+}
+
+/**
+ * @brief Counts a completed recipe, in the round's statistics and the live statistics segment.
+ *
+ * @param recipe The recipe that was completed.
+ */
+void countCompletedRecipe(int recipe) {
+	atomic_fetch_add(&roundStats.recipesCompleted[recipe], 1);
+
+	if (liveStats != NULL) {
+		atomic_fetch_add_explicit(&liveStats->recipes[recipe].completed, 1, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Retrieves the semaphore ID associated with a given resource.
+ *
+ * This function takes a resource identifier as input and returns the
+ * corresponding semaphore ID from the semaphores structure.
+ *
+ * @param resource The identifier of the resource for which the semaphore ID is needed.
+ * @return The semaphore ID associated with the specified resource.
+ */
+int getSemIdFromResource(int resource) {
+	return semaphores.semaphoreIds[resource];
+}
+
+/**
+ * @brief Decrements the semaphore value.
+ *
+ * This function performs a semaphore operation to decrement the semaphore
+ * value by 1. It uses the `semop` system call to perform the operation.
+ *
+ * @param semId The semaphore set ID.
+ * @param semNum The index of the semaphore within the set.
+ * @return Returns 0 on success, or prints an error message if the operation fails.
+ */
+int decSem(int semId, int semNum) {
+
+	struct sembuf sbuf;
+	sbuf.sem_num = semNum;
+	sbuf.sem_op = -1;
+	sbuf.sem_flg = SEM_UNDO;
+
+	if (semop(semId, &sbuf, 1) == -1) {
+		perror("Unable to use resource");
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Increment a semaphore.
+ *
+ * This function increments the semaphore specified by the semaphore ID (semId).
+ * It uses the semop system call to perform the increment operation.
+ *
+ * @param semId The ID of the semaphore set.
+ * @param semNum The index of the semaphore within the set.
+ * @return Returns 0 on success. If the semop call fails, an error message is printed.
+ */
+int incSem(int semId, int semNum) {
+	struct sembuf sbuf;
+	sbuf.sem_num = semNum;
+	sbuf.sem_op = 1;
+	sbuf.sem_flg = SEM_UNDO;
+
+	if (semop(semId, &sbuf, 1) == -1) {
+		perror("Unable to use resource");
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Adds the same value to several semaphores of a set in one atomic operation.
+ *
+ * The kernel applies either all of the operations or none of them, so a decrement
+ * blocks until every listed semaphore can be decremented at once.
+ *
+ * @param semId The ID of the semaphore set.
+ * @param semNums The indices of the semaphores within the set.
+ * @param count The number of entries in semNums.
+ * @param value The value to add to each semaphore (-1 to take, 1 to give back).
+ * @return Returns 0 on success. If the semop call fails, an error message is printed.
+ */
+int addSems(int semId, const int semNums[], int count, int value) {
+	struct sembuf sbuf[count];
+
+	for (int i = 0; i < count; i++) {
+		sbuf[i].sem_num = semNums[i];
+		sbuf[i].sem_op = value;
+		sbuf[i].sem_flg = SEM_UNDO;
+	}
+
+	if (semop(semId, sbuf, count) == -1) {
+		perror("Unable to use resources");
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Takes one unit of a resource from the kitchen semaphore set.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return int The result of the semaphore decrement operation.
+ */
+int sysvAcquire(int resource) {
+	return decSem(getSemIdFromResource(resource), resource);
+}
+
+/**
+ * @brief Gives one unit of a resource back to the kitchen semaphore set.
+ *
+ * @param resource The identifier of the resource to be recovered.
+ * @return int The result of the semaphore increment operation.
+ */
+int sysvRelease(int resource) {
+	return incSem(getSemIdFromResource(resource), resource);
+}
+
+/**
+ * @brief Takes one unit of a resource from the kitchen semaphore set without blocking.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return Returns 1 if a unit was taken, otherwise 0.
+ */
+int sysvTryAcquire(int resource) {
+	struct sembuf sbuf;
+	sbuf.sem_num = resource;
+	sbuf.sem_op = -1;
+	sbuf.sem_flg = SEM_UNDO | IPC_NOWAIT;
+
+	if (semop(getSemIdFromResource(resource), &sbuf, 1) == -1) {
+		if (errno != EAGAIN) {
+			perror("Unable to use resource");
+		}
+		return 0;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Takes one unit of a resource from the kitchen semaphore set, giving up at a deadline.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @param wallNanoseconds How long to wait at most.
+ * @return ACQUIRE_OK, ACQUIRE_TIMED_OUT, or ACQUIRE_FAILED if semtimedop fails.
+ */
+int sysvTimedAcquire(int resource, uint64_t wallNanoseconds) {
+	struct sembuf sbuf;
+	sbuf.sem_num = resource;
+	sbuf.sem_op = -1;
+	sbuf.sem_flg = SEM_UNDO;
+
+	uint64_t deadline = monotonicNanoseconds() + wallNanoseconds;
+
+	while (1) {
+		uint64_t now = monotonicNanoseconds();
+		uint64_t left = deadline > now ? deadline - now : 0;
+		struct timespec timeout = { (time_t)(left / 1000000000ULL), (long)(left % 1000000000ULL) };
+
+		if (semtimedop(getSemIdFromResource(resource), &sbuf, 1, &timeout) == 0) {
+			return ACQUIRE_OK;
+		}
+
+		if (errno == EAGAIN) {
+			return ACQUIRE_TIMED_OUT;
+		}
+
+		if (errno != EINTR) {
+			perror("Unable to use resource");
+			return ACQUIRE_FAILED;
+		}
+	}
+}
+
+/**
+ * @brief Reads the number of free units of a resource with semctl.
+ *
+ * @param resource The resource to probe.
+ * @return The number of free units, or 0 if it cannot be read.
+ */
+int sysvProbe(int resource) {
+	int value = semctl(getSemIdFromResource(resource), resource, GETVAL);
+
+	if (value == -1) {
+		perror("Unable to read resource");
+		return 0;
+	}
+
+	return value;
+}
+
+/**
+ * @brief Takes one unit of each listed resource with a single atomic semop.
+ *
+ * @param resources The identifiers of the resources to take.
+ * @param count The number of entries in resources.
+ * @return int The result of the semaphore operation.
+ */
+int sysvAcquireMany(const int resources[], int count) {
+	return addSems(semaphores.setId, resources, count, -1);
+}
+
+/**
+ * @brief Gives one unit of each listed resource back with a single semop.
+ *
+ * @param resources The identifiers of the resources to give back.
+ * @param count The number of entries in resources.
+ * @return int The result of the semaphore operation.
+ */
+int sysvReleaseMany(const int resources[], int count) {
+	return addSems(semaphores.setId, resources, count, 1);
+}
+
+extern const struct syncBackend posixBackend;
+extern const struct syncBackend futexBackend;
+
+/**
+ * @brief Sorts a small list of resource identifiers in ascending order.
+ *
+ * @param sorted The array receiving the sorted identifiers.
+ * @param resources The identifiers to sort.
+ * @param count The number of entries in resources.
+ */
+void sortResources(int sorted[], const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		int j = i;
+		while (j > 0 && sorted[j - 1] > resources[i]) {
+			sorted[j] = sorted[j - 1];
+			j--;
+		}
+		sorted[j] = resources[i];
+	}
+}
+
+/**
+ * @brief Takes one unit of each listed resource, all or nothing, using single-resource operations.
+ *
+ * This is the multi-resource protocol for backends without an atomic operation over a
+ * set of semaphores. The caller blocks on one resource only while holding nothing else,
+ * then tries to take the rest without blocking. If any of them is busy, everything
+ * taken so far is given back and the caller blocks on the busy resource instead, so a
+ * baker never sits on a mixer while it waits for a spoon.
+ *
+ * @param backend The backend providing acquire, tryAcquire and release.
+ * @param resources The identifiers of the resources to take.
+ * @param count The number of entries in resources.
+ * @return Always returns 0.
+ */
+int acquireAllOrNothing(const struct syncBackend* backend, const int resources[], int count) {
+	int sorted[count];
+	sortResources(sorted, resources, count);
+
+	int blocking = 0;
+
+	while (1) {
+		backend->acquire(sorted[blocking]);
+
+		int busy = -1;
+		for (int i = 0; i < count && busy < 0; i++) {
+			if (i != blocking && !backend->tryAcquire(sorted[i])) {
+				busy = i;
+			}
+		}
+
+		if (busy < 0) {
+			return 0;
+		}
+
+		for (int i = 0; i < busy; i++) {
+			if (i != blocking) {
+				backend->release(sorted[i]);
+			}
+		}
+		backend->release(sorted[blocking]);
+
+		blocking = busy;
+	}
+}
+
+sem_t* posixSemaphores;
+
+/**
+ * @brief Allocates one unnamed POSIX semaphore per resource.
+ *
+ * @param count The number of resources.
+ * @return Returns 0 on success, exits the program on failure.
+ */
+int posixInit(int count) {
+	posixSemaphores = calloc(count, sizeof(sem_t));
+
+	if (posixSemaphores == NULL) {
+		perror("Failed to allocate memory for POSIX semaphores");
+		exit(1);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Sets the number of available units of a resource.
+ *
+ * @param resource The identifier of the resource.
+ * @param value The number of available units.
+ * @return Returns 0 on success, exits the program on failure.
+ */
+int posixSetValue(int resource, int value) {
+	if (sem_init(&posixSemaphores[resource], 0, value) == -1) {
+		perror("sem_init failed");
+		exit(1);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Takes one unit of a resource, retrying when interrupted by a signal.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return Returns 0 on success, or prints an error message if the operation fails.
+ */
+int posixAcquire(int resource) {
+	while (sem_wait(&posixSemaphores[resource]) == -1) {
+		if (errno != EINTR) {
+			perror("Unable to use resource");
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Gives one unit of a resource back.
+ *
+ * @param resource The identifier of the resource to be recovered.
+ * @return Returns 0 on success, or prints an error message if the operation fails.
+ */
+int posixRelease(int resource) {
+	if (sem_post(&posixSemaphores[resource]) == -1) {
+		perror("Unable to use resource");
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Takes one unit of a resource only if one is free.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return Returns 1 if a unit was taken, otherwise 0.
+ */
+int posixTryAcquire(int resource) {
+	while (sem_trywait(&posixSemaphores[resource]) == -1) {
+		if (errno != EINTR) {
+			if (errno != EAGAIN) {
+				perror("Unable to use resource");
+			}
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Takes one unit of a resource with sem_timedwait, giving up at a deadline.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @param wallNanoseconds How long to wait at most.
+ * @return ACQUIRE_OK, ACQUIRE_TIMED_OUT, or ACQUIRE_FAILED if sem_timedwait fails.
+ */
+int posixTimedAcquire(int resource, uint64_t wallNanoseconds) {
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+
+	uint64_t nanoseconds = deadline.tv_nsec + wallNanoseconds;
+	deadline.tv_sec += nanoseconds / 1000000000ULL;
+	deadline.tv_nsec = nanoseconds % 1000000000ULL;
+
+	while (sem_timedwait(&posixSemaphores[resource], &deadline) == -1) {
+		if (errno == ETIMEDOUT) {
+			return ACQUIRE_TIMED_OUT;
+		}
+
+		if (errno != EINTR) {
+			perror("Unable to use resource");
+			return ACQUIRE_FAILED;
+		}
+	}
+
+	return ACQUIRE_OK;
+}
+
+/**
+ * @brief Reads the number of free units of a POSIX semaphore.
+ *
+ * @param resource The resource to probe.
+ * @return The number of free units, or 0 if it cannot be read.
+ */
+int posixProbe(int resource) {
+	int value;
+
+	if (sem_getvalue(&posixSemaphores[resource], &value) == -1) {
+		perror("Unable to read resource");
+		return 0;
+	}
+
+	return value > 0 ? value : 0;
+}
+
+/**
+ * @brief Takes one unit of each listed resource, all or nothing.
+ *
+ * @param resources The identifiers of the resources to take.
+ * @param count The number of entries in resources.
+ * @return Always returns 0.
+ */
+int posixAcquireMany(const int resources[], int count) {
+	return acquireAllOrNothing(&posixBackend, resources, count);
+}
+
+/**
+ * @brief Gives one unit of each listed resource back.
+ *
+ * @param resources The identifiers of the resources to give back.
+ * @param count The number of entries in resources.
+ * @return Always returns 0.
+ */
+int posixReleaseMany(const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		posixRelease(resources[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Destroys the POSIX semaphores and frees their storage.
+ *
+ * @return Always returns 0.
+ */
+int posixCleanup() {
+	for (int i = 0; i < resourceCount; i++) {
+		sem_destroy(&posixSemaphores[i]);
+	}
+
+	free(posixSemaphores);
+	posixSemaphores = NULL;
+	return 0;
+}
+
+/**
+ * @brief A counting semaphore built on an atomic counter and a futex.
+ *
+ * The uncontended path is a single compare-and-swap in user space. A baker that
+ * finds no free unit spins briefly and then parks in the kernel on the counter.
+ * Each semaphore sits on its own cache line.
+ */
+typedef struct {
+	_Alignas(64) atomic_int value;
+	atomic_int waiters;
+} FutexSemaphore;
+
+const int futexSpinLimit = 100;
+
+FutexSemaphore* futexSemaphores;
+
+/**
+ * @brief Hints to the processor that the caller is spinning.
+ */
+static inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#else
+	atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+/**
+ * @brief Takes one unit of a futex semaphore if one is free, without blocking.
+ *
+ * @param semaphore The semaphore to decrement.
+ * @return Returns 1 if a unit was taken, otherwise 0.
+ */
+int futexTryAcquire(FutexSemaphore* semaphore) {
+	int value = atomic_load_explicit(&semaphore->value, memory_order_relaxed);
+
+	while (value > 0) {
+		if (atomic_compare_exchange_weak_explicit(&semaphore->value, &value, value - 1,
+			memory_order_acquire, memory_order_relaxed)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Allocates one futex semaphore per resource.
+ *
+ * @param count The number of resources.
+ * @return Returns 0 on success, exits the program on failure.
+ */
+int futexInit(int count) {
+	futexSemaphores = aligned_alloc(_Alignof(FutexSemaphore), count * sizeof(FutexSemaphore));
+
+	if (futexSemaphores == NULL) {
+		perror("Failed to allocate memory for futex semaphores");
+		exit(1);
+	}
+
+	memset(futexSemaphores, 0, count * sizeof(FutexSemaphore));
+	return 0;
+}
+
+/**
+ * @brief Sets the number of available units of a resource.
+ *
+ * @param resource The identifier of the resource.
+ * @param value The number of available units.
+ * @return Always returns 0.
+ */
+int futexSetValue(int resource, int value) {
+	atomic_store(&futexSemaphores[resource].value, value);
+	atomic_store(&futexSemaphores[resource].waiters, 0);
+	return 0;
+}
+
+/**
+ * @brief Takes one unit of a resource, spinning briefly before parking in the kernel.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return Always returns 0.
+ */
+int futexAcquire(int resource) {
+	FutexSemaphore* semaphore = &futexSemaphores[resource];
+
+	for (int spin = 0; spin < futexSpinLimit; spin++) {
+		if (futexTryAcquire(semaphore)) {
+			return 0;
+		}
+		cpuRelax();
+	}
+
+	atomic_fetch_add(&semaphore->waiters, 1);
+
+	while (!futexTryAcquire(semaphore)) {
+		syscall(SYS_futex, &semaphore->value, FUTEX_WAIT_PRIVATE, 0, NULL, NULL, 0);
+	}
+
+	atomic_fetch_sub(&semaphore->waiters, 1);
+	return 0;
+}
+
+/**
+ * @brief Gives one unit of a resource back, waking a parked baker only if there is one.
+ *
+ * @param resource The identifier of the resource to be recovered.
+ * @return Always returns 0.
+ */
+int futexRelease(int resource) {
+	FutexSemaphore* semaphore = &futexSemaphores[resource];
+
+	atomic_fetch_add(&semaphore->value, 1);
+
+	if (atomic_load(&semaphore->waiters) > 0) {
+		syscall(SYS_futex, &semaphore->value, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Takes one unit of a resource only if one is free.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return Returns 1 if a unit was taken, otherwise 0.
+ */
+int futexTryAcquireResource(int resource) {
+	return futexTryAcquire(&futexSemaphores[resource]);
+}
+
+/**
+ * @brief Takes one unit of a resource, parking in the kernel until a deadline at most.
+ *
+ * There is no spinning: a caller that bounds its wait would rather give up the
+ * processor. A waiter that is woken always tries again before it gives up, so a
+ * wake-up that races with the deadline is never lost to the other waiters.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @param wallNanoseconds How long to wait at most.
+ * @return ACQUIRE_OK or ACQUIRE_TIMED_OUT.
+ */
+int futexTimedAcquire(int resource, uint64_t wallNanoseconds) {
+	FutexSemaphore* semaphore = &futexSemaphores[resource];
+
+	if (futexTryAcquire(semaphore)) {
+		return ACQUIRE_OK;
+	}
+
+	uint64_t deadline = monotonicNanoseconds() + wallNanoseconds;
+	int status = ACQUIRE_OK;
+
+	atomic_fetch_add(&semaphore->waiters, 1);
+
+	while (!futexTryAcquire(semaphore)) {
+		uint64_t now = monotonicNanoseconds();
+
+		if (now >= deadline) {
+			status = ACQUIRE_TIMED_OUT;
+			break;
+		}
+
+		struct timespec timeout = { (time_t)((deadline - now) / 1000000000ULL), (long)((deadline - now) % 1000000000ULL) };
+		syscall(SYS_futex, &semaphore->value, FUTEX_WAIT_PRIVATE, 0, &timeout, NULL, 0);
+	}
+
+	atomic_fetch_sub(&semaphore->waiters, 1);
+	return status;
+}
+
+/**
+ * @brief Reads the number of free units of a futex semaphore without entering the kernel.
+ *
+ * @param resource The resource to probe.
+ * @return The number of free units.
+ */
+int futexProbe(int resource) {
+	return atomic_load_explicit(&futexSemaphores[resource].value, memory_order_relaxed);
+}
+
+/**
+ * @brief Takes one unit of each listed resource, all or nothing.
+ *
+ * @param resources The identifiers of the resources to take.
+ * @param count The number of entries in resources.
+ * @return Always returns 0.
+ */
+int futexAcquireMany(const int resources[], int count) {
+	return acquireAllOrNothing(&futexBackend, resources, count);
+}
+
+/**
+ * @brief Gives one unit of each listed resource back.
+ *
+ * @param resources The identifiers of the resources to give back.
+ * @param count The number of entries in resources.
+ * @return Always returns 0.
+ */
+int futexReleaseMany(const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		futexRelease(resources[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Frees the futex semaphores.
+ *
+ * @return Always returns 0.
+ */
+int futexCleanup() {
+	free(futexSemaphores);
+	futexSemaphores = NULL;
+	return 0;
+}
+
+const struct syncBackend sysvBackend = {
+	"sysv", initSemaphoreSet, sysvSetValue, sysvAcquire, sysvRelease, sysvTryAcquire, sysvTimedAcquire, sysvProbe, sysvAcquireMany, sysvReleaseMany, sysvCleanup
+};
+
+const struct syncBackend posixBackend = {
+	"posix", posixInit, posixSetValue, posixAcquire, posixRelease, posixTryAcquire, posixTimedAcquire, posixProbe, posixAcquireMany, posixReleaseMany, posixCleanup
+};
+
+const struct syncBackend futexBackend = {
+	"futex", futexInit, futexSetValue, futexAcquire, futexRelease, futexTryAcquireResource, futexTimedAcquire, futexProbe, futexAcquireMany, futexReleaseMany, futexCleanup
+};
+
+const struct syncBackend* syncBackends[] = { &sysvBackend, &posixBackend, &futexBackend };
+
+const int syncBackendCount = sizeof(syncBackends) / sizeof(syncBackends[0]);
+
+/**
+ * @brief Looks up a synchronization backend by name.
+ *
+ * @param name The name of the backend ("sysv", "posix" or "futex").
+ * @return A pointer to the backend, or NULL if no backend has that name.
+ */
+const struct syncBackend* findSyncBackend(const char* name) {
+	for (int i = 0; i < syncBackendCount; i++) {
+		if (strcmp(syncBackends[i]->name, name) == 0) {
+			return syncBackends[i];
+		}
+	}
+
+	return NULL;
+}
+
+#define COROUTINE_STACK_SIZE (64 * 1024)
+
+/**
+ * How often a coroutine waiting with a deadline checks a resource again, in wall-clock nanoseconds.
+ */
+#define COROUTINE_POLL_NANOSECONDS 1000000ULL
+
+/**
+ * @brief A baker running as a stackful coroutine on the worker pool.
+ *
+ * A coroutine that has to wait records what it waits for and switches back to its
+ * worker. The worker performs the wait on the coroutine's behalf after the switch,
+ * so a coroutine is never resumed before it has finished suspending.
+ *
+ * @var Coroutine::blockedOn
+ * The resource the coroutine suspended to wait for, or -1.
+ *
+ * @var Coroutine::awaiting
+ * The completion the coroutine suspended to wait for, or NULL.
+ *
+ * @var Coroutine::wakeAt
+ * The CLOCK_MONOTONIC time the coroutine suspended to sleep until, or 0.
+ *
+ * @var Coroutine::randomState
+ * The baker's service-time generator while the coroutine is suspended.
+ *
+ * @var Coroutine::heldSince
+ * The latency clock when the baker acquired each resource it holds, indexed by resource.
+ *
+ * @var Coroutine::next
+ * The next coroutine in the run queue or in a semaphore's wait queue.
+ */
+typedef struct Coroutine {
+	ucontext_t context;
+	void* stack;
+	int bakerId;
+	int finished;
+	int blockedOn;
+	struct Completion* awaiting;
+	uint64_t wakeAt;
+	uint64_t randomState;
+	uint64_t heldSince[KITCHEN_MAX_RESOURCES];
+	struct Coroutine* next;
+} Coroutine;
+
+/**
+ * @struct schedulerStruct
+ * @brief The run queue and timers shared by the worker threads.
+ *
+ * @var schedulerStruct::timers
+ * Sleeping coroutines, as a min-heap ordered by wakeAt.
+ *
+ * @var schedulerStruct::switches
+ * The number of times a coroutine suspended during the round.
+ */
+struct schedulerStruct {
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	Coroutine* runHead;
+	Coroutine* runTail;
+	Coroutine** timers;
+	int timerCount;
+	int total;
+	int finished;
+	atomic_llong switches;
+};
+
+struct schedulerStruct scheduler = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+__thread ucontext_t* workerContext;
+
+/**
+ * @brief A counting semaphore whose waiters are suspended coroutines.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	int value;
+	Coroutine* waitHead;
+	Coroutine* waitTail;
+} CoroutineSemaphore;
+
+CoroutineSemaphore* coroutineSemaphores;
+
+/**
+ * @brief Returns the coroutine running on the calling thread.
+ *
+ * This is not inlined so that the thread-local variable is read again after every
+ * switch: a coroutine may resume on a different worker thread.
+ *
+ * @return The running coroutine, or NULL when the caller is not a coroutine.
+ */
+__attribute__((noinline)) Coroutine* getCurrentCoroutine() {
+	return currentCoroutine;
+}
+
+/**
+ * @brief Switches from the running coroutine back to its worker.
+ *
+ * @param coroutine The running coroutine.
+ */
+__attribute__((noinline)) void suspendCoroutine(Coroutine* coroutine) {
+	atomic_fetch_add_explicit(&scheduler.switches, 1, memory_order_relaxed);
+	swapcontext(&coroutine->context, workerContext);
+}
+
+/**
+ * @brief Appends a coroutine to the run queue and wakes an idle worker.
+ *
+ * @param coroutine The coroutine that can run again.
+ */
+void makeRunnable(Coroutine* coroutine) {
+	pthread_mutex_lock(&scheduler.lock);
+
+	coroutine->next = NULL;
+	if (scheduler.runTail == NULL) {
+		scheduler.runHead = coroutine;
+	}
+	else {
+		scheduler.runTail->next = coroutine;
+	}
+	scheduler.runTail = coroutine;
+
+	pthread_cond_signal(&scheduler.wakeup);
+	pthread_mutex_unlock(&scheduler.lock);
+}
+
+/**
+ * @brief Suspends the running coroutine until a wall-clock deadline.
+ *
+ * @param wallNanoseconds How long to sleep, in nanoseconds of wall time.
+ */
+void sleepCoroutine(uint64_t wallNanoseconds) {
+	Coroutine* coroutine = getCurrentCoroutine();
+	coroutine->wakeAt = monotonicNanoseconds() + wallNanoseconds;
+	suspendCoroutine(coroutine);
+}
+
+/**
+ * @brief Adds a sleeping coroutine to the timer heap. The scheduler lock must be held.
+ *
+ * @param coroutine The sleeping coroutine.
+ */
+void addTimer(Coroutine* coroutine) {
+	int i = scheduler.timerCount++;
+
+	while (i > 0 && scheduler.timers[(i - 1) / 2]->wakeAt > coroutine->wakeAt) {
+		scheduler.timers[i] = scheduler.timers[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+
+	scheduler.timers[i] = coroutine;
+}
+
+/**
+ * @brief Removes the earliest sleeping coroutine from the timer heap. The scheduler lock must be held.
+ *
+ * @return The coroutine with the earliest deadline.
+ */
+Coroutine* removeTimer() {
+	Coroutine* first = scheduler.timers[0];
+	Coroutine* last = scheduler.timers[--scheduler.timerCount];
+	int i = 0;
+
+	while (2 * i + 1 < scheduler.timerCount) {
+		int child = 2 * i + 1;
+		if (child + 1 < scheduler.timerCount && scheduler.timers[child + 1]->wakeAt < scheduler.timers[child]->wakeAt) {
+			child++;
+		}
+		if (last->wakeAt <= scheduler.timers[child]->wakeAt) {
+			break;
+		}
+		scheduler.timers[i] = scheduler.timers[child];
+		i = child;
+	}
+
+	if (scheduler.timerCount > 0) {
+		scheduler.timers[i] = last;
+	}
+
+	return first;
+}
+
+/**
+ * @brief Allocates one coroutine semaphore per resource.
+ *
+ * @param count The number of resources.
+ * @return Returns 0 on success, exits the program on failure.
+ */
+int coroutineInit(int count) {
+	coroutineSemaphores = calloc(count, sizeof(CoroutineSemaphore));
+
+	if (coroutineSemaphores == NULL) {
+		perror("Failed to allocate memory for coroutine semaphores");
+		exit(1);
+	}
+
+	for (int i = 0; i < count; i++) {
+		pthread_mutex_init(&coroutineSemaphores[i].lock, NULL);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Sets the number of available units of a resource.
+ *
+ * @param resource The identifier of the resource.
+ * @param value The number of available units.
+ * @return Always returns 0.
+ */
+int coroutineSetValue(int resource, int value) {
+	coroutineSemaphores[resource].value = value;
+	return 0;
+}
+
+/**
+ * @brief Takes one unit of a resource only if one is free.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return Returns 1 if a unit was taken, otherwise 0.
+ */
+int coroutineTryAcquire(int resource) {
+	CoroutineSemaphore* semaphore = &coroutineSemaphores[resource];
+	int taken = 0;
+
+	pthread_mutex_lock(&semaphore->lock);
+	if (semaphore->value > 0) {
+		semaphore->value--;
+		taken = 1;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+
+	return taken;
+}
+
+/**
+ * @brief Takes one unit of a resource, polling until a deadline at most.
+ *
+ * A coroutine sleeps between polls, which suspends it like any other timed wait; a
+ * caller that is not a coroutine yields its thread. Pollers do not join the FIFO
+ * wait queue, so units released to queued waiters are never given to them.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @param wallNanoseconds How long to wait at most.
+ * @return ACQUIRE_OK or ACQUIRE_TIMED_OUT.
+ */
+int coroutineTimedAcquire(int resource, uint64_t wallNanoseconds) {
+	uint64_t deadline = monotonicNanoseconds() + wallNanoseconds;
+	Coroutine* coroutine = getCurrentCoroutine();
+
+	while (!coroutineTryAcquire(resource)) {
+		uint64_t now = monotonicNanoseconds();
+
+		if (now >= deadline) {
+			return ACQUIRE_TIMED_OUT;
+		}
+
+		if (coroutine != NULL) {
+			sleepCoroutine(deadline - now < COROUTINE_POLL_NANOSECONDS ? deadline - now : COROUTINE_POLL_NANOSECONDS);
+		}
+		else {
+			sched_yield();
+		}
+	}
+
+	return ACQUIRE_OK;
+}
+
+/**
+ * @brief Reads the number of free units of a coroutine semaphore.
+ *
+ * @param resource The resource to probe.
+ * @return The number of free units.
+ */
+int coroutineProbe(int resource) {
+	CoroutineSemaphore* semaphore = &coroutineSemaphores[resource];
+
+	pthread_mutex_lock(&semaphore->lock);
+	int value = semaphore->value;
+	pthread_mutex_unlock(&semaphore->lock);
+
+	return value;
+}
+
+/**
+ * @brief Takes one unit of a resource, suspending the coroutine instead of its thread.
+ *
+ * A caller that is not a coroutine yields its thread until a unit is free.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return Always returns 0.
+ */
+int coroutineAcquire(int resource) {
+	if (coroutineTryAcquire(resource)) {
+		return 0;
+	}
+
+	Coroutine* coroutine = getCurrentCoroutine();
+
+	if (coroutine == NULL) {
+		while (!coroutineTryAcquire(resource)) {
+			sched_yield();
+		}
+		return 0;
+	}
+
+	coroutine->blockedOn = resource;
+	suspendCoroutine(coroutine);
+
+	return 0;
+}
+
+/**
+ * @brief Gives one unit of a resource back, handing it straight to the first waiter if there is one.
+ *
+ * @param resource The identifier of the resource to be recovered.
+ * @return Always returns 0.
+ */
+int coroutineRelease(int resource) {
+	CoroutineSemaphore* semaphore = &coroutineSemaphores[resource];
+	Coroutine* waiter = NULL;
+
+	pthread_mutex_lock(&semaphore->lock);
+	if (semaphore->waitHead != NULL) {
+		waiter = semaphore->waitHead;
+		semaphore->waitHead = waiter->next;
+		if (semaphore->waitHead == NULL) {
+			semaphore->waitTail = NULL;
+		}
+	}
+	else {
+		semaphore->value++;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+
+	if (waiter != NULL) {
+		makeRunnable(waiter);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Finishes suspending a coroutine that waits for a resource.
+ *
+ * Called by the worker after the switch. If a unit was released in the meantime the
+ * coroutine takes it and runs again; otherwise it joins the wait queue.
+ *
+ * @param coroutine The suspended coroutine.
+ */
+void parkOnSemaphore(Coroutine* coroutine) {
+	CoroutineSemaphore* semaphore = &coroutineSemaphores[coroutine->blockedOn];
+	int granted = 0;
+
+	coroutine->blockedOn = -1;
+
+	pthread_mutex_lock(&semaphore->lock);
+	if (semaphore->value > 0) {
+		semaphore->value--;
+		granted = 1;
+	}
+	else {
+		coroutine->next = NULL;
+		if (semaphore->waitTail == NULL) {
+			semaphore->waitHead = coroutine;
+		}
+		else {
+			semaphore->waitTail->next = coroutine;
+		}
+		semaphore->waitTail = coroutine;
+	}
+	pthread_mutex_unlock(&semaphore->lock);
+
+	if (granted) {
+		makeRunnable(coroutine);
+	}
+}
+
+/**
+ * @brief Takes one unit of each listed resource, all or nothing.
+ *
+ * @param resources The identifiers of the resources to take.
+ * @param count The number of entries in resources.
+ * @return Always returns 0.
+ */
+int coroutineAcquireMany(const int resources[], int count) {
+	return acquireAllOrNothing(&coroutineBackend, resources, count);
+}
+
+/**
+ * @brief Gives one unit of each listed resource back.
+ *
+ * @param resources The identifiers of the resources to give back.
+ * @param count The number of entries in resources.
+ * @return Always returns 0.
+ */
+int coroutineReleaseMany(const int resources[], int count) {
+	for (int i = 0; i < count; i++) {
+		coroutineRelease(resources[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Frees the coroutine semaphores.
+ *
+ * @return Always returns 0.
+ */
+int coroutineCleanup() {
+	for (int i = 0; i < resourceCount; i++) {
+		pthread_mutex_destroy(&coroutineSemaphores[i].lock);
+	}
+
+	free(coroutineSemaphores);
+	coroutineSemaphores = NULL;
+	return 0;
+}
+
+const struct syncBackend coroutineBackend = {
+	"coroutine", coroutineInit, coroutineSetValue, coroutineAcquire, coroutineRelease, coroutineTryAcquire, coroutineTimedAcquire, coroutineProbe, coroutineAcquireMany, coroutineReleaseMany, coroutineCleanup
+};
+
+/**
+ * @brief A one-shot event that bakers wait for, such as the end of an oven batch.
+ *
+ * Threads wait on the condition variable; coroutines are parked on the wait list
+ * and made runnable again when the completion is signaled.
+ */
+typedef struct Completion {
+	pthread_mutex_t lock;
+	pthread_cond_t signaled;
+	int done;
+	Coroutine* waitHead;
+} Completion;
+
+/**
+ * @brief Prepares a completion that has not been signaled.
+ *
+ * @param completion The completion to initialize.
+ */
+void initCompletion(Completion* completion) {
+	pthread_mutex_init(&completion->lock, NULL);
+	pthread_cond_init(&completion->signaled, NULL);
+	completion->done = 0;
+	completion->waitHead = NULL;
+}
+
+/**
+ * @brief Destroys a completion that nobody waits for anymore.
+ *
+ * @param completion The completion to destroy.
+ */
+void destroyCompletion(Completion* completion) {
+	pthread_mutex_destroy(&completion->lock);
+	pthread_cond_destroy(&completion->signaled);
+}
+
+/**
+ * @brief Blocks until a completion is signaled, suspending the coroutine instead of its thread.
+ *
+ * @param completion The completion to wait for.
+ */
+void waitForCompletion(Completion* completion) {
+	Coroutine* coroutine = getCurrentCoroutine();
+
+	if (coroutine != NULL) {
+		coroutine->awaiting = completion;
+		suspendCoroutine(coroutine);
+		return;
+	}
+
+	pthread_mutex_lock(&completion->lock);
+	while (!completion->done) {
+		pthread_cond_wait(&completion->signaled, &completion->lock);
+	}
+	pthread_mutex_unlock(&completion->lock);
+}
+
+/**
+ * @brief Waits for a completion for a span of wall time at most.
+ *
+ * Threads wait on the condition variable with a deadline; a coroutine polls the
+ * completion like coroutineTimedAcquire polls a semaphore.
+ *
+ * @param completion The completion to wait for.
+ * @param wallNanoseconds How long to wait at most, in nanoseconds of wall time.
+ * @return Returns 1 if the completion was signaled, or 0 at the deadline.
+ */
+int waitForCompletionWithin(Completion* completion, uint64_t wallNanoseconds) {
+	uint64_t deadline = monotonicNanoseconds() + wallNanoseconds;
+	int done;
+
+	if (getCurrentCoroutine() != NULL) {
+		while (1) {
+			pthread_mutex_lock(&completion->lock);
+			done = completion->done;
+			pthread_mutex_unlock(&completion->lock);
+
+			uint64_t now = monotonicNanoseconds();
+			if (done || now >= deadline) {
+				return done;
+			}
+
+			sleepCoroutine(deadline - now < COROUTINE_POLL_NANOSECONDS ? deadline - now : COROUTINE_POLL_NANOSECONDS);
+		}
+	}
+
+	struct timespec until;
+	clock_gettime(CLOCK_REALTIME, &until);
+	until.tv_sec += wallNanoseconds / 1000000000ULL;
+	until.tv_nsec += wallNanoseconds % 1000000000ULL;
+	if (until.tv_nsec >= 1000000000L) {
+		until.tv_sec++;
+		until.tv_nsec -= 1000000000L;
+	}
+
+	pthread_mutex_lock(&completion->lock);
+	while (!completion->done) {
+		if (pthread_cond_timedwait(&completion->signaled, &completion->lock, &until) == ETIMEDOUT) {
+			break;
+		}
+	}
+	done = completion->done;
+	pthread_mutex_unlock(&completion->lock);
+
+	return done;
+}
+
+/**
+ * @brief Finishes suspending a coroutine that waits for a completion.
+ *
+ * Called by the worker after the switch, like parkOnSemaphore.
+ *
+ * @param coroutine The suspended coroutine.
+ */
+void parkOnCompletion(Coroutine* coroutine) {
+	Completion* completion = coroutine->awaiting;
+	int done;
+
+	coroutine->awaiting = NULL;
+
+	pthread_mutex_lock(&completion->lock);
+	done = completion->done;
+	if (!done) {
+		coroutine->next = completion->waitHead;
+		completion->waitHead = coroutine;
+	}
+	pthread_mutex_unlock(&completion->lock);
+
+	if (done) {
+		makeRunnable(coroutine);
+	}
+}
+
+/**
+ * @brief Signals a completion, waking every thread and coroutine that waits for it.
+ *
+ * @param completion The completion to signal.
+ */
+void signalCompletion(Completion* completion) {
+	pthread_mutex_lock(&completion->lock);
+	completion->done = 1;
+	Coroutine* waiter = completion->waitHead;
+	completion->waitHead = NULL;
+	pthread_cond_broadcast(&completion->signaled);
+	pthread_mutex_unlock(&completion->lock);
+
+	while (waiter != NULL) {
+		Coroutine* next = waiter->next;
+		makeRunnable(waiter);
+		waiter = next;
+	}
+}
+
+void* simulateBaker(void* val);
+
+/**
+ * @brief The first function a baker coroutine runs.
+ *
+ * It runs the unchanged simulateBaker logic and then switches back to its worker
+ * for the last time.
+ */
+void runBakerCoroutine() {
+	Coroutine* coroutine = getCurrentCoroutine();
+
+	int bakerId = coroutine->bakerId;
+	simulateBaker(&bakerId);
+
+	coroutine = getCurrentCoroutine();
+	coroutine->finished = 1;
+	suspendCoroutine(coroutine);
+}
+
+/**
+ * @brief A worker thread: resumes runnable coroutines until every baker has finished.
+ *
+ * After each switch back, the worker completes whatever the coroutine suspended for:
+ * finishing, waiting on a semaphore or a completion, or sleeping.
+ *
+ * @param val Unused.
+ * @return A void pointer, always returns NULL.
+ */
+void* runCoroutineWorker(void* val) {
+	ucontext_t context;
+	workerContext = &context;
+
+	pthread_mutex_lock(&scheduler.lock);
+
+	while (scheduler.finished < scheduler.total) {
+		uint64_t now = monotonicNanoseconds();
+
+		while (scheduler.timerCount > 0 && scheduler.timers[0]->wakeAt <= now) {
+			Coroutine* woken = removeTimer();
+			woken->wakeAt = 0;
+			woken->next = NULL;
+			if (scheduler.runTail == NULL) {
+				scheduler.runHead = woken;
+			}
+			else {
+				scheduler.runTail->next = woken;
+			}
+			scheduler.runTail = woken;
+		}
+
+		if (scheduler.runHead == NULL) {
+			if (scheduler.timerCount > 0) {
+				uint64_t deadline = scheduler.timers[0]->wakeAt;
+				struct timespec until = { deadline / 1000000000ULL, deadline % 1000000000ULL };
+				pthread_cond_timedwait(&scheduler.wakeup, &scheduler.lock, &until);
+			}
+			else {
+				pthread_cond_wait(&scheduler.wakeup, &scheduler.lock);
+			}
+			continue;
+		}
+
+		Coroutine* coroutine = scheduler.runHead;
+		scheduler.runHead = coroutine->next;
+		if (scheduler.runHead == NULL) {
+			scheduler.runTail = NULL;
+		}
+
+		pthread_mutex_unlock(&scheduler.lock);
+
+		currentCoroutine = coroutine;
+		serviceTimeState = coroutine->randomState;
+		swapcontext(&context, &coroutine->context);
+		coroutine->randomState = serviceTimeState;
+		currentCoroutine = NULL;
+
+		if (coroutine->finished) {
+			munmap(coroutine->stack, COROUTINE_STACK_SIZE);
+			pthread_mutex_lock(&scheduler.lock);
+			scheduler.finished++;
+			if (scheduler.finished == scheduler.total) {
+				pthread_cond_broadcast(&scheduler.wakeup);
+			}
+			continue;
+		}
+
+		if (coroutine->blockedOn >= 0) {
+			parkOnSemaphore(coroutine);
+		}
+		else if (coroutine->awaiting != NULL) {
+			parkOnCompletion(coroutine);
+		}
+		else if (coroutine->wakeAt != 0) {
+			pthread_mutex_lock(&scheduler.lock);
+			addTimer(coroutine);
+			pthread_cond_signal(&scheduler.wakeup);
+			pthread_mutex_unlock(&scheduler.lock);
+		}
+		else {
+			makeRunnable(coroutine);
+		}
+
+		pthread_mutex_lock(&scheduler.lock);
+	}
+
+	pthread_mutex_unlock(&scheduler.lock);
+	return NULL;
+}
+
+/**
+ * @brief The number of recent acquires and releases the watchdog keeps for each baker.
+ */
+#define WATCHDOG_HISTORY 8
+
+/**
+ * @brief How many bakers must be queued for a resource before a long hold of it counts as a convoy.
+ */
+#define WATCHDOG_CONVOY_WAITERS 4
+
+/**
+ * @brief How many times longer than the resource's mean hold a hold must last to count as a convoy.
+ */
+#define WATCHDOG_CONVOY_FACTOR 10
+
+/**
+ * @brief How many holds of a resource must have completed before its mean hold time is trusted.
+ */
+#define WATCHDOG_MIN_HOLDS 16
+
+/**
+ * @brief The kinds of events in a baker's watchdog history.
+ */
+enum watchdogEventType {
+	WATCHDOG_WAIT,
+	WATCHDOG_ACQUIRE,
+	WATCHDOG_RELEASE,
+	WATCHDOG_GIVE_UP
+};
+
+const char* watchdogEventNames[] = { "waited for", "acquired", "released", "gave up on" };
+
+/**
+ * @brief What the watchdog knows about one baker. Only the baker writes it.
+ *
+ * @var WatchdogBaker::held
+ * A bitmask of the resources the baker holds.
+ *
+ * @var WatchdogBaker::waitingFor
+ * A bitmask of the resources the baker is waiting for, or 0.
+ *
+ * @var WatchdogBaker::waitingSince
+ * The watchdog clock when the baker started waiting.
+ *
+ * @var WatchdogBaker::eventCount
+ * The number of events the baker has recorded; the last WATCHDOG_HISTORY are kept.
+ *
+ * @var WatchdogBaker::events
+ * A ring of recent events, each packed as time << 8 | resource << 2 | type.
+ *
+ * @var WatchdogBaker::heldSince
+ * The watchdog clock when the baker acquired each resource, indexed by resource.
+ */
+typedef struct {
+	_Alignas(64) atomic_uint held;
+	atomic_uint waitingFor;
+	atomic_ullong waitingSince;
+	atomic_uint eventCount;
+	atomic_ullong events[WATCHDOG_HISTORY];
+	atomic_ullong heldSince[KITCHEN_MAX_RESOURCES];
+} WatchdogBaker;
+
+/**
+ * @brief The completed holds of one resource, on a cache line of their own.
+ */
+typedef struct {
+	_Alignas(64) atomic_ullong holdNanoseconds;
+	atomic_ullong holds;
+} WatchdogResource;
+
+/**
+ * @struct watchdogStruct
+ * @brief The wait-for graph watchdog enabled with --watchdog.
+ *
+ * Bakers publish what they hold and what they wait for through the resource layer.
+ * Every period the watchdog thread takes a snapshot, links each baker that has been
+ * waiting for a whole period to the holders of the busy resources it waits for, and
+ * looks for cycles (deadlocks) and for resources with a queue behind a hold far longer
+ * than the resource's mean hold (convoys). Each stall is reported once, on stderr.
+ *
+ * @var watchdogStruct::lock
+ * Held by the watchdog thread while it scans, and by a round while it resizes the arrays.
+ *
+ * @var watchdogStruct::bakers
+ * The bakers' published state, NULL unless the watchdog is enabled.
+ *
+ * @var watchdogStruct::capacity
+ * The number of bakers the arrays have room for.
+ *
+ * @var watchdogStruct::count
+ * The number of bakers in the current round.
+ *
+ * @var watchdogStruct::running
+ * Set while a round is running.
+ *
+ * @var watchdogStruct::epoch
+ * CLOCK_MONOTONIC time when the watchdog started; the watchdog clock counts from it.
+ *
+ * @var watchdogStruct::reportedSince
+ * For each baker, the waitingSince of the last wait reported as part of a deadlock.
+ *
+ * @var watchdogStruct::convoyReported
+ * For each resource, the heldSince of the last hold reported as a convoy.
+ *
+ * @var watchdogStruct::holders
+ * Scratch for the scan: the holders of every resource, grouped by resource from holderStart.
+ */
+struct watchdogStruct {
+	pthread_mutex_t lock;
+	pthread_t thread;
+	WatchdogBaker* bakers;
+	int capacity;
+	int count;
+	int running;
+	uint64_t epoch;
+	uint64_t* reportedSince;
+	uint64_t convoyReported[KITCHEN_MAX_RESOURCES];
+	WatchdogResource resources[KITCHEN_MAX_RESOURCES];
+	uint32_t* held;
+	uint32_t* waiting;
+	uint64_t* since;
+	int8_t* color;
+	int* stackIndex;
+	int* stackNode;
+	uint32_t* stackRest;
+	int* stackPosition;
+	int* holders;
+	int holderCapacity;
+	int holderStart[KITCHEN_MAX_RESOURCES + 1];
+	atomic_llong deadlocks;
+	atomic_llong convoys;
+};
+
+struct watchdogStruct watchdog = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+__thread int threadBakerId;
+
+/**
+ * @brief Returns the baker running on the calling thread.
+ *
+ * @return The ID of the running coroutine's baker, or of the pool thread's baker.
+ */
+int getCurrentBakerId() {
+	Coroutine* coroutine = getCurrentCoroutine();
+
+	return coroutine != NULL ? coroutine->bakerId : threadBakerId;
+}
+
+/**
+ * @brief Reads the watchdog clock.
+ *
+ * @return Nanoseconds since the watchdog started.
+ */
+static inline uint64_t watchdogNow() {
+	return monotonicNanoseconds() - watchdog.epoch;
+}
+
+/**
+ * @brief Appends an event to a baker's watchdog history.
+ *
+ * @param baker The baker's watchdog state.
+ * @param type One of the watchdogEventType values.
+ * @param resource The resource the event is about.
+ * @param now The watchdog clock.
+ */
+void watchdogRecord(WatchdogBaker* baker, int type, int resource, uint64_t now) {
+	unsigned count = atomic_load_explicit(&baker->eventCount, memory_order_relaxed);
+
+	atomic_store_explicit(&baker->events[count % WATCHDOG_HISTORY], now << 8 | (uint64_t)resource << 2 | type, memory_order_relaxed);
+	atomic_store_explicit(&baker->eventCount, count + 1, memory_order_release);
+}
+
+/**
+ * @brief Publishes that the running baker starts waiting for resources.
+ *
+ * @param resources The resources waited for.
+ * @param count The number of entries in resources.
+ */
+void watchdogWaiting(const int resources[], int count) {
+	WatchdogBaker* baker = &watchdog.bakers[getCurrentBakerId()];
+	uint64_t now = watchdogNow();
+	uint32_t mask = 0;
+
+	for (int i = 0; i < count; i++) {
+		mask |= 1u << resources[i];
+		watchdogRecord(baker, WATCHDOG_WAIT, resources[i], now);
+	}
+
+	atomic_store_explicit(&baker->waitingSince, now, memory_order_relaxed);
+	atomic_store_explicit(&baker->waitingFor, mask, memory_order_release);
+}
+
+/**
+ * @brief Publishes that the running baker holds resources it waited for or took.
+ *
+ * @param resources The resources acquired.
+ * @param count The number of entries in resources.
+ */
+void watchdogAcquired(const int resources[], int count) {
+	WatchdogBaker* baker = &watchdog.bakers[getCurrentBakerId()];
+	uint64_t now = watchdogNow();
+	uint32_t mask = 0;
+
+	for (int i = 0; i < count; i++) {
+		mask |= 1u << resources[i];
+		atomic_store_explicit(&baker->heldSince[resources[i]], now, memory_order_relaxed);
+		watchdogRecord(baker, WATCHDOG_ACQUIRE, resources[i], now);
+	}
+
+	atomic_store_explicit(&baker->held, atomic_load_explicit(&baker->held, memory_order_relaxed) | mask, memory_order_release);
+	atomic_store_explicit(&baker->waitingFor, 0, memory_order_release);
+}
+
+/**
+ * @brief Publishes that the running baker stopped waiting for resources without getting them.
+ *
+ * @param resources The resources given up on.
+ * @param count The number of entries in resources.
+ */
+void watchdogGaveUp(const int resources[], int count) {
+	WatchdogBaker* baker = &watchdog.bakers[getCurrentBakerId()];
+	uint64_t now = watchdogNow();
+
+	for (int i = 0; i < count; i++) {
+		watchdogRecord(baker, WATCHDOG_GIVE_UP, resources[i], now);
+	}
+
+	atomic_store_explicit(&baker->waitingFor, 0, memory_order_release);
+}
+
+/**
+ * @brief Publishes that the running baker gives resources back, and adds up how long it held them.
+ *
+ * @param resources The resources released.
+ * @param count The number of entries in resources.
+ */
+void watchdogReleased(const int resources[], int count) {
+	WatchdogBaker* baker = &watchdog.bakers[getCurrentBakerId()];
+	uint64_t now = watchdogNow();
+	uint32_t mask = 0;
+
+	for (int i = 0; i < count; i++) {
+		WatchdogResource* totals = &watchdog.resources[resources[i]];
+		uint64_t heldSince = atomic_load_explicit(&baker->heldSince[resources[i]], memory_order_relaxed);
+
+		mask |= 1u << resources[i];
+		atomic_fetch_add_explicit(&totals->holdNanoseconds, now - heldSince, memory_order_relaxed);
+		atomic_fetch_add_explicit(&totals->holds, 1, memory_order_relaxed);
+		watchdogRecord(baker, WATCHDOG_RELEASE, resources[i], now);
+	}
+
+	atomic_store_explicit(&baker->held, atomic_load_explicit(&baker->held, memory_order_relaxed) & ~mask, memory_order_release);
+}
+
+/**
+ * @brief Prints the names of the resources in a bitmask, separated by commas.
+ *
+ * @param resources A bitmask of resources.
+ */
+void printResourceNames(uint32_t resources) {
+	for (uint32_t rest = resources; rest != 0; rest &= rest - 1) {
+		fprintf(stderr, "%s%s", kitchen.names[__builtin_ctz(rest)], (rest & (rest - 1)) != 0 ? ", " : "");
+	}
+}
+
+/**
+ * @brief Prints what a baker holds and waits for, and its recent events, as of the scan.
+ *
+ * @param bakerId The baker.
+ * @param now The watchdog clock at the scan.
+ */
+void watchdogDumpBaker(int bakerId, uint64_t now) {
+	WatchdogBaker* baker = &watchdog.bakers[bakerId];
+
+	fprintf(stderr, "    Baker %d holds ", bakerId);
+	printResourceNames(watchdog.held[bakerId]);
+	if (watchdog.held[bakerId] == 0) {
+		fprintf(stderr, "nothing");
+	}
+
+	if (watchdog.waiting[bakerId] != 0) {
+		fprintf(stderr, " and has waited %.1f ms for ", (now - watchdog.since[bakerId]) / 1e6);
+		printResourceNames(watchdog.waiting[bakerId]);
+	}
+	fprintf(stderr, "\n");
+
+	unsigned count = atomic_load_explicit(&baker->eventCount, memory_order_acquire);
+	unsigned first = count > WATCHDOG_HISTORY ? count - WATCHDOG_HISTORY : 0;
+
+	for (unsigned i = count; i > first; i--) {
+		uint64_t event = atomic_load_explicit(&baker->events[(i - 1) % WATCHDOG_HISTORY], memory_order_relaxed);
+		uint64_t time = event >> 8;
+
+		fprintf(stderr, "      %9.1f ms ago %s %s\n", now > time ? (now - time) / 1e6 : 0.0,
+			watchdogEventNames[event & 3], kitchen.names[(event >> 2) & 31]);
+	}
+}
+
+/**
+ * @brief Returns the next baker a waiting baker depends on, for the depth-first search.
+ *
+ * The edges of a baker lead to the holders of each busy resource it waits for.
+ *
+ * @param bakerId The waiting baker.
+ * @param rest The busy resources whose holders have not all been returned yet; updated.
+ * @param position The next holder of the first of those resources; updated.
+ * @return The next holder, or -1 when there are none left.
+ */
+int watchdogNextHolder(int bakerId, uint32_t* rest, int* position) {
+	while (*rest != 0) {
+		int resource = __builtin_ctz(*rest);
+		int index = watchdog.holderStart[resource] + *position;
+
+		if (index < watchdog.holderStart[resource + 1]) {
+			(*position)++;
+			if (watchdog.holders[index] != bakerId) {
+				return watchdog.holders[index];
+			}
+			continue;
+		}
+
+		*rest &= *rest - 1;
+		*position = 0;
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Reports a cycle in the wait-for graph if it is still there and was not reported before.
+ *
+ * The snapshot is not taken atomically, so every member is read again: the cycle is
+ * only real if none of them has moved since the snapshot.
+ *
+ * @param first The index of the cycle's first member on the search stack.
+ * @param depth The depth of the search stack; the cycle is the stack from first on.
+ * @param busy A bitmask of the resources with no free unit.
+ * @param now The watchdog clock at the scan.
+ */
+void watchdogReportCycle(int first, int depth, uint32_t busy, uint64_t now) {
+	int fresh = 0;
+
+	for (int i = first; i < depth; i++) {
+		int bakerId = watchdog.stackNode[i];
+		WatchdogBaker* baker = &watchdog.bakers[bakerId];
+
+		if (atomic_load_explicit(&baker->waitingFor, memory_order_acquire) != watchdog.waiting[bakerId] ||
+			atomic_load_explicit(&baker->waitingSince, memory_order_relaxed) != watchdog.since[bakerId] ||
+			atomic_load_explicit(&baker->held, memory_order_acquire) != watchdog.held[bakerId]) {
+			return;
+		}
+
+		fresh |= watchdog.reportedSince[bakerId] != watchdog.since[bakerId];
+	}
+
+	if (!fresh) {
+		return;
+	}
+
+	atomic_fetch_add(&watchdog.deadlocks, 1);
+	fprintf(stderr, "Watchdog: deadlock among %d baker%s\n", depth - first, depth - first == 1 ? "" : "s");
+
+	for (int i = first; i < depth; i++) {
+		int bakerId = watchdog.stackNode[i];
+		int next = watchdog.stackNode[i + 1 < depth ? i + 1 : first];
+		uint32_t blocking = watchdog.waiting[bakerId] & busy & watchdog.held[next];
+
+		fprintf(stderr, "  Baker %d waits for %s, held by baker %d\n", bakerId,
+			blocking != 0 ? kitchen.names[__builtin_ctz(blocking)] : "?", next);
+		watchdog.reportedSince[bakerId] = watchdog.since[bakerId];
+	}
+
+	for (int i = first; i < depth; i++) {
+		watchdogDumpBaker(watchdog.stackNode[i], now);
+	}
+}
+
+/**
+ * @brief Makes sure the scan's scratch arrays have room for a number of bakers.
+ *
+ * Must be called with the watchdog locked. Exits the program if memory runs out.
+ *
+ * @param bakers The number of bakers in the coming round.
+ */
+void growWatchdog(int bakers) {
+	if (bakers <= watchdog.capacity) {
+		return;
+	}
+
+	free(watchdog.bakers);
+	free(watchdog.reportedSince);
+	free(watchdog.held);
+	free(watchdog.waiting);
+	free(watchdog.since);
+	free(watchdog.color);
+	free(watchdog.stackIndex);
+	free(watchdog.stackNode);
+	free(watchdog.stackRest);
+	free(watchdog.stackPosition);
+
+	watchdog.bakers = aligned_alloc(_Alignof(WatchdogBaker), bakers * sizeof(WatchdogBaker));
+	watchdog.reportedSince = malloc(bakers * sizeof(uint64_t));
+	watchdog.held = malloc(bakers * sizeof(uint32_t));
+	watchdog.waiting = malloc(bakers * sizeof(uint32_t));
+	watchdog.since = malloc(bakers * sizeof(uint64_t));
+	watchdog.color = malloc(bakers * sizeof(int8_t));
+	watchdog.stackIndex = malloc(bakers * sizeof(int));
+	watchdog.stackNode = malloc(bakers * sizeof(int));
+	watchdog.stackRest = malloc(bakers * sizeof(uint32_t));
+	watchdog.stackPosition = malloc(bakers * sizeof(int));
+
+	if (watchdog.bakers == NULL || watchdog.reportedSince == NULL || watchdog.held == NULL || watchdog.waiting == NULL ||
+		watchdog.since == NULL || watchdog.color == NULL || watchdog.stackIndex == NULL || watchdog.stackNode == NULL ||
+		watchdog.stackRest == NULL || watchdog.stackPosition == NULL) {
+		perror("Failed to allocate memory for the watchdog");
+		exit(1);
+	}
+
+	watchdog.capacity = bakers;
+}
+
+int probeScheduled(int resource);
+
+/**
+ * @brief Takes a snapshot of the bakers and reports deadlocks and convoys found in it.
+ *
+ * Must be called with the watchdog locked.
+ *
+ * @param periodNanoseconds The scan period; only waits at least this old are considered.
+ */
+void watchdogScan(uint64_t periodNanoseconds) {
+	int count = watchdog.count;
+	uint64_t now = watchdogNow();
+	uint32_t waitedFor = 0;
+	int heldTotal = 0;
+	int waiters[KITCHEN_MAX_RESOURCES] = { 0 };
+
+	memset(watchdog.holderStart, 0, sizeof(watchdog.holderStart));
+
+	for (int i = 0; i < count; i++) {
+		WatchdogBaker* baker = &watchdog.bakers[i];
+
+		watchdog.waiting[i] = atomic_load_explicit(&baker->waitingFor, memory_order_acquire);
+		watchdog.since[i] = atomic_load_explicit(&baker->waitingSince, memory_order_relaxed);
+		watchdog.held[i] = atomic_load_explicit(&baker->held, memory_order_acquire);
+		watchdog.color[i] = 0;
+
+		waitedFor |= watchdog.waiting[i];
+		heldTotal += __builtin_popcount(watchdog.held[i]);
+
+		for (uint32_t rest = watchdog.held[i]; rest != 0; rest &= rest - 1) {
+			watchdog.holderStart[__builtin_ctz(rest) + 1]++;
+		}
+
+		for (uint32_t rest = watchdog.waiting[i]; rest != 0; rest &= rest - 1) {
+			waiters[__builtin_ctz(rest)]++;
+		}
+	}
+
+	if (waitedFor == 0) {
+		return;
+	}
+
+	if (heldTotal > watchdog.holderCapacity) {
+		free(watchdog.holders);
+		watchdog.holders = malloc(heldTotal * sizeof(int));
+		if (watchdog.holders == NULL) {
+			perror("Failed to allocate memory for the watchdog");
+			exit(1);
+		}
+		watchdog.holderCapacity = heldTotal;
+	}
+
+	int fill[KITCHEN_MAX_RESOURCES];
+	for (int r = 0; r < KITCHEN_MAX_RESOURCES; r++) {
+		watchdog.holderStart[r + 1] += watchdog.holderStart[r];
+		fill[r] = watchdog.holderStart[r];
+	}
+
+	for (int i = 0; i < count; i++) {
+		for (uint32_t rest = watchdog.held[i]; rest != 0; rest &= rest - 1) {
+			watchdog.holders[fill[__builtin_ctz(rest)]++] = i;
+		}
+	}
+
+	uint32_t busy = 0;
+	for (uint32_t rest = waitedFor; rest != 0; rest &= rest - 1) {
+		int resource = __builtin_ctz(rest);
+		if (probeScheduled(resource) <= 0) {
+			busy |= 1u << resource;
+		}
+	}
+
+	//Look for cycles among the bakers that have waited on a busy resource for a whole period.
+	for (int start = 0; start < count; start++) {
+		if (watchdog.color[start] != 0 || (watchdog.waiting[start] & busy) == 0 || now - watchdog.since[start] < periodNanoseconds) {
+			continue;
+		}
+
+		//A baker waiting for a resource that no one but itself holds waits for itself.
+		for (uint32_t rest = watchdog.waiting[start] & busy & watchdog.held[start]; rest != 0; rest &= rest - 1) {
+			int resource = __builtin_ctz(rest);
+
+			if (watchdog.holderStart[resource + 1] - watchdog.holderStart[resource] == 1) {
+				watchdog.stackNode[0] = start;
+				watchdogReportCycle(0, 1, busy, now);
+				break;
+			}
+		}
+
+		int depth = 0;
+		watchdog.color[start] = 1;
+		watchdog.stackIndex[start] = depth;
+		watchdog.stackNode[depth] = start;
+		watchdog.stackRest[depth] = watchdog.waiting[start] & busy;
+		watchdog.stackPosition[depth] = 0;
+		depth++;
+
+		while (depth > 0) {
+			int top = depth - 1;
+			int next = watchdogNextHolder(watchdog.stackNode[top], &watchdog.stackRest[top], &watchdog.stackPosition[top]);
+
+			if (next < 0) {
+				watchdog.color[watchdog.stackNode[top]] = 2;
+				depth--;
+				continue;
+			}
+
+			if (watchdog.color[next] == 2 || (watchdog.waiting[next] & busy) == 0 || now - watchdog.since[next] < periodNanoseconds) {
+				continue;
+			}
+
+			if (watchdog.color[next] == 1) {
+				watchdogReportCycle(watchdog.stackIndex[next], depth, busy, now);
+				continue;
+			}
+
+			watchdog.color[next] = 1;
+			watchdog.stackIndex[next] = depth;
+			watchdog.stackNode[depth] = next;
+			watchdog.stackRest[depth] = watchdog.waiting[next] & busy;
+			watchdog.stackPosition[depth] = 0;
+			depth++;
+		}
+	}
+
+	//Look for queues behind a hold far longer than the resource's mean hold.
+	for (uint32_t rest = busy; rest != 0; rest &= rest - 1) {
+		int resource = __builtin_ctz(rest);
+		uint64_t holds = atomic_load_explicit(&watchdog.resources[resource].holds, memory_order_relaxed);
+
+		if (waiters[resource] < WATCHDOG_CONVOY_WAITERS || holds < WATCHDOG_MIN_HOLDS) {
+			continue;
+		}
+
+		uint64_t meanHold = atomic_load_explicit(&watchdog.resources[resource].holdNanoseconds, memory_order_relaxed) / holds;
+
+		for (int i = watchdog.holderStart[resource]; i < watchdog.holderStart[resource + 1]; i++) {
+			int holder = watchdog.holders[i];
+			uint64_t heldSince = atomic_load_explicit(&watchdog.bakers[holder].heldSince[resource], memory_order_relaxed);
+			uint64_t holdTime = now > heldSince ? now - heldSince : 0;
+
+			if (holdTime < WATCHDOG_CONVOY_FACTOR * meanHold || holdTime < periodNanoseconds || watchdog.convoyReported[resource] == heldSince) {
+				continue;
+			}
+
+			watchdog.convoyReported[resource] = heldSince;
+			atomic_fetch_add(&watchdog.convoys, 1);
+
+			fprintf(stderr, "Watchdog: convoy on %s: %d bakers queued while baker %d has held it for %.1f ms (mean hold %.3f ms)\n",
+				kitchen.names[resource], waiters[resource], holder, holdTime / 1e6, meanHold / 1e6);
+			watchdogDumpBaker(holder, now);
+		}
+	}
+}
+
+/**
+ * @brief The watchdog thread: scans the bakers once per period while a round runs.
+ *
+ * @param val Unused.
+ * @return Never returns.
+ */
+void* runWatchdog(void* val) {
+	uint64_t periodNanoseconds = (uint64_t)(settings.watchdogPeriod * 1e6);
+	struct timespec period = { (time_t)(periodNanoseconds / 1000000000ULL), (long)(periodNanoseconds % 1000000000ULL) };
+
+	while (1) {
+		nanosleep(&period, NULL);
+
+		pthread_mutex_lock(&watchdog.lock);
+		if (watchdog.running) {
+			watchdogScan(periodNanoseconds);
+		}
+		pthread_mutex_unlock(&watchdog.lock);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Starts the watchdog thread. Exits the program if the thread cannot be created.
+ */
+void initWatchdog() {
+	watchdog.epoch = monotonicNanoseconds();
+
+	pthread_mutex_lock(&watchdog.lock);
+	growWatchdog(1);
+	pthread_mutex_unlock(&watchdog.lock);
+
+	if (pthread_create(&watchdog.thread, NULL, runWatchdog, NULL) != 0) {
+		perror("Failed to create the watchdog thread");
+		exit(1);
+	}
+
+	pthread_detach(watchdog.thread);
+}
+
+/**
+ * @brief Clears the bakers' published state and lets the watchdog scan the new round.
+ *
+ * @param bakers The number of bakers in the round.
+ */
+void startWatchdogRound(int bakers) {
+	pthread_mutex_lock(&watchdog.lock);
+
+	growWatchdog(bakers);
+	memset(watchdog.bakers, 0, bakers * sizeof(WatchdogBaker));
+	memset(watchdog.reportedSince, 0xFF, bakers * sizeof(uint64_t));
+	memset(watchdog.convoyReported, 0xFF, sizeof(watchdog.convoyReported));
+	memset(watchdog.resources, 0, sizeof(watchdog.resources));
+	atomic_store(&watchdog.deadlocks, 0);
+	atomic_store(&watchdog.convoys, 0);
+	watchdog.count = bakers;
+	watchdog.running = 1;
+
+	pthread_mutex_unlock(&watchdog.lock);
+}
+
+/**
+ * @brief Stops the watchdog from scanning until the next round starts.
+ */
+void finishWatchdogRound() {
+	pthread_mutex_lock(&watchdog.lock);
+	watchdog.running = 0;
+	pthread_mutex_unlock(&watchdog.lock);
+}
+
+__thread uint64_t threadHeldSince[KITCHEN_MAX_RESOURCES];
+
+/**
+ * @brief Returns where the running baker keeps the time it acquired each resource.
+ *
+ * A coroutine can resume on another worker thread, so its acquire times live in the coroutine.
+ *
+ * @return The acquire times of the running baker, indexed by resource.
+ */
+uint64_t* getHeldSince() {
+	Coroutine* coroutine = getCurrentCoroutine();
+
+	return coroutine != NULL ? coroutine->heldSince : threadHeldSince;
+}
+
+/**
+ * @brief Records how long the running baker waited for resources it has just acquired.
+ *
+ * @param resources The resources acquired.
+ * @param count The number of entries in resources.
+ * @param startTicks The latency clock when the baker started waiting.
+ */
+void recordAcquired(const int resources[], int count, uint64_t startTicks) {
+	uint64_t now = latencyTicks();
+	LatencyHistograms* histograms = getThreadLatency();
+	uint64_t* heldSince = getHeldSince();
+
+	histograms->blockedTicks += now - startTicks;
+
+	for (int i = 0; i < count; i++) {
+		recordLatency(&histograms->wait[resources[i]], now - startTicks);
+		heldSince[resources[i]] = now;
+	}
+}
+
+/**
+ * @brief Records how long the running baker held resources it is about to release.
+ *
+ * @param resources The resources being released.
+ * @param count The number of entries in resources.
+ */
+void recordReleased(const int resources[], int count) {
+	uint64_t now = latencyTicks();
+	LatencyHistograms* histograms = getThreadLatency();
+	uint64_t* heldSince = getHeldSince();
+
+	for (int i = 0; i < count; i++) {
+		recordLatency(&histograms->hold[resources[i]], now - heldSince[resources[i]]);
+	}
+}
+
+/**
+ * @brief A baker waiting in an EDF wait queue, on its stack.
+ *
+ * @var EdfWaiter::key
+ * The effective deadline: the baker's deadline, or the time its priority class has aged
+ * to due if that comes first, in CLOCK_MONOTONIC nanoseconds.
+ *
+ * @var EdfWaiter::sequence
+ * The order in which waiters of the gate arrived, for ties.
+ *
+ * @var EdfWaiter::granted
+ * Signaled when the releasing baker hands the unit over.
+ */
+typedef struct {
+	uint64_t key;
+	int priority;
+	uint64_t sequence;
+	Completion granted;
+} EdfWaiter;
+
+/**
+ * @brief The units of a resource granted earliest-deadline-first, and the bakers waiting for them.
+ *
+ * @var EdfGate::available
+ * The free units. A unit is only free while nobody waits; otherwise release hands it to the first waiter.
+ *
+ * @var EdfGate::waiters
+ * A binary heap of the waiting bakers, earliest effective deadline first.
+ */
+typedef struct {
+	pthread_mutex_t lock;
+	int available;
+	int count;
+	uint64_t sequence;
+	EdfWaiter** waiters;
+} EdfGate;
+
+/**
+ * @brief The deadline and priority class of the order a baker is working on.
+ *
+ * @var EdfBaker::deadline
+ * CLOCK_MONOTONIC time by which the order is due, in nanoseconds, or 0 for no deadline.
+ */
+typedef struct {
+	uint64_t deadline;
+	int priority;
+} EdfBaker;
+
+/**
+ * @struct edfStruct
+ * @brief The EDF wait queues enabled with --edf for the tools and the oven.
+ *
+ * A baker waiting for a scheduled resource is queued by its effective deadline: the
+ * deadline of its order, but no later than (priority + 1) times --aging simulated
+ * seconds after it started waiting, so bakers without a deadline or with a late one
+ * still get their turn. Ties go to the more urgent class, then to the earlier waiter.
+ *
+ * @var edfStruct::resources
+ * A bitmask of the resources granted through the gates, 0 without --edf.
+ *
+ * @var edfStruct::bakers
+ * The current order of each baker, indexed by baker.
+ */
+struct edfStruct {
+	uint32_t resources;
+	EdfGate gates[KITCHEN_MAX_RESOURCES];
+	EdfBaker* bakers;
+	int size;
+};
+
+struct edfStruct edf;
+
+/**
+ * @brief Sets the deadline and priority class the baker's waits are scheduled by.
+ *
+ * @param bakerId The ID of the baker.
+ * @param deadline CLOCK_MONOTONIC time by which its order is due, in nanoseconds, or 0 for none.
+ * @param priority The priority class of its order.
+ */
+void setBakerDeadline(int bakerId, uint64_t deadline, int priority) {
+	if (edf.resources != 0) {
+		edf.bakers[bakerId].deadline = deadline;
+		edf.bakers[bakerId].priority = priority;
+	}
+}
+
+/**
+ * @brief Tells whether a waiter goes before another.
+ *
+ * @return Returns 1 if a is to be granted before b.
+ */
+static inline int isEdfEarlier(const EdfWaiter* a, const EdfWaiter* b) {
+	if (a->key != b->key) {
+		return a->key < b->key;
+	}
+
+	if (a->priority != b->priority) {
+		return a->priority < b->priority;
+	}
+
+	return a->sequence < b->sequence;
+}
+
+/**
+ * @brief Adds a waiter to a gate's heap. The gate's lock must be held.
+ *
+ * @param gate The gate.
+ * @param waiter The waiter.
+ */
+void pushEdfWaiter(EdfGate* gate, EdfWaiter* waiter) {
+	int i = gate->count++;
+
+	while (i > 0 && isEdfEarlier(waiter, gate->waiters[(i - 1) / 2])) {
+		gate->waiters[i] = gate->waiters[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+
+	gate->waiters[i] = waiter;
+}
+
+/**
+ * @brief Removes the first waiter from a gate's heap. The gate's lock must be held.
+ *
+ * @param gate The gate, with at least one waiter.
+ * @return The waiter with the earliest effective deadline.
+ */
+EdfWaiter* popEdfWaiter(EdfGate* gate) {
+	EdfWaiter* first = gate->waiters[0];
+	EdfWaiter* last = gate->waiters[--gate->count];
+	int i = 0;
+
+	while (1) {
+		int child = 2 * i + 1;
+
+		if (child >= gate->count) {
+			break;
+		}
+
+		if (child + 1 < gate->count && isEdfEarlier(gate->waiters[child + 1], gate->waiters[child])) {
+			child++;
+		}
+
+		if (!isEdfEarlier(gate->waiters[child], last)) {
+			break;
+		}
+
+		gate->waiters[i] = gate->waiters[child];
+		i = child;
+	}
+
+	gate->waiters[i] = last;
+	return first;
+}
+
+/**
+ * @brief Takes a unit of a scheduled resource, waiting in its EDF queue if there is none.
+ *
+ * Threads block and coroutines suspend on a completion of their own, which the
+ * releasing baker signals once it has handed the unit over.
+ *
+ * @param resource The resource, one of edf.resources.
+ * @return Always returns 0.
+ */
+int edfAcquire(int resource) {
+	EdfGate* gate = &edf.gates[resource];
+	int bakerId = getCurrentBakerId();
+
+	pthread_mutex_lock(&gate->lock);
+
+	if (gate->available > 0 && gate->count == 0) {
+		gate->available--;
+		pthread_mutex_unlock(&gate->lock);
+		return 0;
+	}
+
+	EdfWaiter waiter;
+	uint64_t aging = (uint64_t)(settings.aging / settings.dilation * 1e9);
+	uint64_t deadline = bakerId >= 0 && bakerId < edf.size ? edf.bakers[bakerId].deadline : 0;
+
+	waiter.priority = bakerId >= 0 && bakerId < edf.size ? edf.bakers[bakerId].priority : ORDER_PRIORITIES - 1;
+	waiter.key = monotonicNanoseconds() + aging * (waiter.priority + 1);
+	waiter.sequence = gate->sequence++;
+	if (deadline != 0 && deadline < waiter.key) {
+		waiter.key = deadline;
+	}
+
+	initCompletion(&waiter.granted);
+	pushEdfWaiter(gate, &waiter);
+	pthread_mutex_unlock(&gate->lock);
+
+	waitForCompletion(&waiter.granted);
+	destroyCompletion(&waiter.granted);
+
+	return 0;
+}
+
+/**
+ * @brief Gives a unit of a scheduled resource back, handing it to the first waiter if there is one.
+ *
+ * @param resource The resource, one of edf.resources.
+ * @return Always returns 0.
+ */
+int edfRelease(int resource) {
+	EdfGate* gate = &edf.gates[resource];
+
+	pthread_mutex_lock(&gate->lock);
+
+	if (gate->count == 0) {
+		gate->available++;
+		pthread_mutex_unlock(&gate->lock);
+		return 0;
+	}
+
+	EdfWaiter* first = popEdfWaiter(gate);
+	pthread_mutex_unlock(&gate->lock);
+
+	signalCompletion(&first->granted);
+	return 0;
+}
+
+/**
+ * @brief Sets up the EDF gates of the tools and the oven with their capacities.
+ */
+void initEdf() {
+	edf.resources = 1u << kitchen.oven;
+	for (int i = 0; i < kitchen.toolCount; i++) {
+		edf.resources |= 1u << kitchen.tools[i];
+	}
+
+	for (uint32_t rest = edf.resources; rest != 0; rest &= rest - 1) {
+		int resource = __builtin_ctz(rest);
+
+		pthread_mutex_init(&edf.gates[resource].lock, NULL);
+		edf.gates[resource].available = kitchen.capacities[resource];
+	}
+}
+
+/**
+ * @brief Makes room for every baker of the round in the gates and clears the bakers' deadlines.
+ *
+ * Every unit is back at its gate between rounds, so the heaps are empty here.
+ *
+ * @param bakers The number of bakers in the round.
+ */
+void startEdfRound(int bakers) {
+	if (bakers > edf.size) {
+		EdfBaker* grown = realloc(edf.bakers, bakers * sizeof(EdfBaker));
+
+		if (grown == NULL) {
+			perror("Failed to allocate memory for the EDF queues");
+			exit(1);
+		}
+
+		edf.bakers = grown;
+		edf.size = bakers;
+
+		for (uint32_t rest = edf.resources; rest != 0; rest &= rest - 1) {
+			EdfGate* gate = &edf.gates[__builtin_ctz(rest)];
+			EdfWaiter** waiters = realloc(gate->waiters, bakers * sizeof(EdfWaiter*));
+
+			if (waiters == NULL) {
+				perror("Failed to allocate memory for the EDF queues");
+				exit(1);
+			}
+
+			gate->waiters = waiters;
+		}
+	}
+
+	for (int i = 0; i < bakers; i++) {
+		edf.bakers[i].deadline = 0;
+		edf.bakers[i].priority = ORDER_PRIORITIES - 1;
+	}
+}
+
+/**
+ * @brief Takes a unit of a resource through its EDF gate if it has one, or through the backend.
+ *
+ * @param resource The resource.
+ * @return The result of the acquire.
+ */
+static inline int acquireScheduled(int resource) {
+	return edf.resources & (1u << resource) ? edfAcquire(resource) : settings.backend->acquire(resource);
+}
+
+/**
+ * @brief Returns the free units of a resource, from its EDF gate if it has one, or from the backend.
+ *
+ * A gate with bakers waiting has no free unit, since every unit released goes to them.
+ *
+ * @param resource The resource.
+ * @return The number of free units.
+ */
+int probeScheduled(int resource) {
+	if (!(edf.resources & (1u << resource))) {
+		return settings.backend->probe(resource);
+	}
+
+	EdfGate* gate = &edf.gates[resource];
+
+	pthread_mutex_lock(&gate->lock);
+	int available = gate->count > 0 ? 0 : gate->available;
+	pthread_mutex_unlock(&gate->lock);
+
+	return available;
+}
+
+/**
+ * @brief Gives a unit of a resource back through its EDF gate if it has one, or through the backend.
+ *
+ * @param resource The resource.
+ * @return The result of the release.
+ */
+static inline int releaseScheduled(int resource) {
+	return edf.resources & (1u << resource) ? edfRelease(resource) : settings.backend->release(resource);
+}
+
+/**
+ * @brief Takes one unit of each listed resource.
+ *
+ * A set with a scheduled resource is taken one resource at a time in ascending order,
+ * each through its own wait queue, so bakers never wait for each other in a cycle.
+ * Other sets go to the backend, all or nothing.
+ *
+ * @param resources The identifiers of the resources.
+ * @param count The number of entries in resources.
+ * @return The result of the acquire.
+ */
+int acquireManyScheduled(const int resources[], int count) {
+	uint32_t mask = 0;
+	for (int i = 0; i < count; i++) {
+		mask |= 1u << resources[i];
+	}
+
+	if ((mask & edf.resources) == 0) {
+		return settings.backend->acquireMany(resources, count);
+	}
+
+	int sorted[count];
+	sortResources(sorted, resources, count);
+
+	for (int i = 0; i < count; i++) {
+		acquireScheduled(sorted[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Gives one unit of each listed resource back, through the EDF gates where there are some.
+ *
+ * @param resources The identifiers of the resources.
+ * @param count The number of entries in resources.
+ * @return The result of the release.
+ */
+int releaseManyScheduled(const int resources[], int count) {
+	uint32_t mask = 0;
+	for (int i = 0; i < count; i++) {
+		mask |= 1u << resources[i];
+	}
+
+	if ((mask & edf.resources) == 0) {
+		return settings.backend->releaseMany(resources, count);
+	}
+
+	for (int i = 0; i < count; i++) {
+		releaseScheduled(resources[i]);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Uses a resource by decrementing its associated semaphore.
+ *
+ * This function takes one unit of the given resource through the selected
+ * synchronization backend, blocking until one is available. With --edf, the tools
+ * and the oven are granted through their EDF wait queues instead.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return int The result of the semaphore decrement operation.
+ */
+int useResource(int resource) {
+	uint64_t startTicks = LATENCY_NOW();
+
+	if (liveStats != NULL) {
+		liveStatsWaiting(&resource, 1);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogWaiting(&resource, 1);
+	}
+
+	int status = acquireScheduled(resource);
+
+	if (liveStats != NULL) {
+		liveStatsAcquired(&resource, 1);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogAcquired(&resource, 1);
+	}
+
+	if (LATENCY_ENABLED) {
+		recordAcquired(&resource, 1, startTicks);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Uses a composite resource: one unit of each listed resource, all or nothing.
+ *
+ * The caller either gets the whole set or waits while holding none of it, so no
+ * resource of the set sits idle while the caller waits for another one.
+ *
+ * @param resources The identifiers of the resources that make up the composite resource.
+ * @param count The number of entries in resources.
+ * @return int The result of the backend operation.
+ */
+int useResources(const int resources[], int count) {
+	uint64_t startTicks = LATENCY_NOW();
+
+	if (liveStats != NULL) {
+		liveStatsWaiting(resources, count);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogWaiting(resources, count);
+	}
+
+	int status = acquireManyScheduled(resources, count);
+
+	if (liveStats != NULL) {
+		liveStatsAcquired(resources, count);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogAcquired(resources, count);
+	}
+
+	if (LATENCY_ENABLED) {
+		recordAcquired(resources, count, startTicks);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Takes one unit of a resource only if one is free right now.
+ *
+ * A resource that is busy is counted in the round's statistics, so that callers
+ * that route around busy resources still show where capacity is short.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @return ACQUIRE_OK if a unit was taken, otherwise ACQUIRE_BUSY.
+ */
+int tryUseResource(int resource) {
+	uint64_t startTicks = LATENCY_NOW();
+
+	if (!settings.backend->tryAcquire(resource)) {
+		atomic_fetch_add_explicit(&roundStats.resourceBusy[resource], 1, memory_order_relaxed);
+		return ACQUIRE_BUSY;
+	}
+
+	if (liveStats != NULL) {
+		liveStatsWaiting(&resource, 1);
+		liveStatsAcquired(&resource, 1);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogAcquired(&resource, 1);
+	}
+
+	if (LATENCY_ENABLED) {
+		recordAcquired(&resource, 1, startTicks);
+	}
+
+	return ACQUIRE_OK;
+}
+
+/**
+ * @brief Uses a resource, waiting for it for a span of simulated time at most.
+ *
+ * A wait that reaches its deadline is counted per resource in the round's statistics
+ * and in the live statistics. The time spent waiting counts as blocked either way.
+ *
+ * @param resource The identifier of the resource to be used.
+ * @param simulatedSeconds How long to wait at most, in simulated seconds.
+ * @return ACQUIRE_OK, ACQUIRE_TIMED_OUT, or ACQUIRE_FAILED if the backend fails.
+ */
+int useResourceWithin(int resource, double simulatedSeconds) {
+	uint64_t startTicks = LATENCY_NOW();
+
+	if (liveStats != NULL) {
+		liveStatsWaiting(&resource, 1);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogWaiting(&resource, 1);
+	}
+
+	int status = settings.backend->timedAcquire(resource, (uint64_t)(simulatedSeconds / settings.dilation * 1e9));
+
+	if (status != ACQUIRE_OK) {
+		if (status == ACQUIRE_TIMED_OUT) {
+			atomic_fetch_add_explicit(&roundStats.resourceTimeouts[resource], 1, memory_order_relaxed);
+		}
+
+		if (liveStats != NULL) {
+			liveStatsGaveUp(&resource, 1);
+		}
+
+		if (watchdog.bakers != NULL) {
+			watchdogGaveUp(&resource, 1);
+		}
+
+		if (LATENCY_ENABLED) {
+			getThreadLatency()->blockedTicks += latencyTicks() - startTicks;
+		}
+
+		return status;
+	}
+
+	if (liveStats != NULL) {
+		liveStatsAcquired(&resource, 1);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogAcquired(&resource, 1);
+	}
+
+	if (LATENCY_ENABLED) {
+		recordAcquired(&resource, 1, startTicks);
+	}
+
+	return ACQUIRE_OK;
+}
+
+/**
+ * @brief Takes a storage area or an ingredient while gathering, bounded by --gather-timeout.
+ *
+ * Without a gather timeout this blocks like useResource; with a timeout of 0 it only
+ * tries once.
+ *
+ * @param resource The storage area or ingredient resource.
+ * @return ACQUIRE_OK if the resource was taken, otherwise the reason it was not.
+ */
+int useGatherResource(int resource) {
+	if (settings.gatherTimeout < 0) {
+		useResource(resource);
+		return ACQUIRE_OK;
+	}
+
+	if (settings.gatherTimeout == 0) {
+		return tryUseResource(resource);
+	}
+
+	return useResourceWithin(resource, settings.gatherTimeout);
+}
+
+/**
+ * @brief Decrements the semaphore associated with the given ingredient.
+ *
+ * This function finds the semaphore for the specified ingredient by adding
+ * the ingredient value to a predefined semaphore offset and then takes one
+ * unit of it through the selected synchronization backend.
+ *
+ * @param ingredient The ingredient identifier for which the semaphore
+ *                   needs to be decremented.
+ * @return int The result of the backend operation, typically indicating
+ *             success or failure of the semaphore operation.
+ */
+int useIngredient(int ingredient) {
+	return useResource(semOffset + ingredient);
+}
+
+/**
+ * @brief Takes several ingredients in a single atomic operation.
+ *
+ * The baker blocks until every listed ingredient is available and then takes all
+ * of them at once, so it never holds part of the set while waiting for the rest.
+ *
+ * @param ingredients The identifiers of the ingredients to take.
+ * @param count The number of entries in ingredients.
+ * @return int The result of the semaphore operation.
+ */
+int useIngredients(const int ingredients[], int count) {
+	int resources[count];
+
+	for (int i = 0; i < count; i++) {
+		resources[i] = semOffset + ingredients[i];
+	}
+
+	return useResources(resources, count);
+}
+
+/**
+ * @brief Recovers a resource by incrementing its associated semaphore.
+ *
+ * This function gives one unit of the given resource back through the selected
+ * synchronization backend.
+ *
+ * @param resource The identifier of the resource to be recovered.
+ * @return int The result of the backend operation, typically indicating success or failure.
+ */
+int recoverResource(int resource) {
+	if (LATENCY_ENABLED) {
+		recordReleased(&resource, 1);
+	}
+
+	if (liveStats != NULL) {
+		liveStatsReleased(&resource, 1);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogReleased(&resource, 1);
+	}
+
+	return releaseScheduled(resource);
+}
+
+/**
+ * @brief Recovers every resource of a composite resource.
+ *
+ * @param resources The identifiers of the resources that make up the composite resource.
+ * @param count The number of entries in resources.
+ * @return int The result of the backend operation.
+ */
+int recoverResources(const int resources[], int count) {
+	if (LATENCY_ENABLED) {
+		recordReleased(resources, count);
+	}
+
+	if (liveStats != NULL) {
+		liveStatsReleased(resources, count);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogReleased(resources, count);
+	}
+
+	return releaseManyScheduled(resources, count);
+}
+
+/**
+ * @brief The number of returns the restock queue holds. Must be a power of two.
+ */
+#define RESTOCK_QUEUE_SIZE 1024
+
+/**
+ * @brief Ingredients handed to the restockers, and when they are due back.
+ *
+ * @var RestockItem::resources
+ * A bitmask of the ingredient resources to give back.
+ *
+ * @var RestockItem::due
+ * CLOCK_MONOTONIC time at which the return is over, in nanoseconds.
+ */
+typedef struct {
+	uint32_t resources;
+	uint64_t due;
+} RestockItem;
+
+/**
+ * @brief A slot of the restock queue. sequence tells producers and consumers whose turn the slot is.
+ */
+typedef struct {
+	atomic_size_t sequence;
+	RestockItem item;
+} RestockCell;
+
+/**
+ * @struct restockStruct
+ * @brief The restockers enabled with --restockers, and the queue bakers hand their returns to.
+ *
+ * The queue is a bounded lock-free multi-producer multi-consumer ring: each slot
+ * carries a sequence number, and a producer or consumer claims a position with one
+ * compare-and-swap on its end of the ring. Each restocker moves what it pops into a
+ * private heap ordered by due time and gives the ingredients back when they are due,
+ * so one restocker replays any number of overlapping returns.
+ *
+ * @var restockStruct::threadCount
+ * The number of restocker threads, 0 when bakers return ingredients themselves.
+ *
+ * @var restockStruct::posted
+ * Incremented for every return pushed; idle restockers sleep on it.
+ *
+ * @var restockStruct::idle
+ * The number of restockers asleep on posted.
+ *
+ * @var restockStruct::outstanding
+ * The number of returns pushed and not given back yet.
+ */
+struct restockStruct {
+	int threadCount;
+	RestockCell* cells;
+	_Alignas(64) atomic_size_t enqueuePosition;
+	_Alignas(64) atomic_size_t dequeuePosition;
+	_Alignas(64) atomic_int posted;
+	atomic_int idle;
+	atomic_int outstanding;
+};
+
+struct restockStruct restock;
+
+/**
+ * @brief Appends a return to the restock queue without blocking.
+ *
+ * @param item The return.
+ * @return Returns 1 if the return was queued, or 0 if the queue is full.
+ */
+int pushRestock(const RestockItem* item) {
+	size_t position = atomic_load_explicit(&restock.enqueuePosition, memory_order_relaxed);
+	RestockCell* cell;
+
+	while (1) {
+		cell = &restock.cells[position & (RESTOCK_QUEUE_SIZE - 1)];
+		size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&restock.enqueuePosition, &position, position + 1,
+				memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			return 0;
+		}
+		else {
+			position = atomic_load_explicit(&restock.enqueuePosition, memory_order_relaxed);
+		}
+	}
+
+	cell->item = *item;
+	atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+	return 1;
+}
+
+/**
+ * @brief Removes the oldest return from the restock queue without blocking.
+ *
+ * @param item Receives the return.
+ * @return Returns 1 if a return was removed, or 0 if the queue is empty.
+ */
+int popRestock(RestockItem* item) {
+	size_t position = atomic_load_explicit(&restock.dequeuePosition, memory_order_relaxed);
+	RestockCell* cell;
+
+	while (1) {
+		cell = &restock.cells[position & (RESTOCK_QUEUE_SIZE - 1)];
+		size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&restock.dequeuePosition, &position, position + 1,
+				memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			return 0;
+		}
+		else {
+			position = atomic_load_explicit(&restock.dequeuePosition, memory_order_relaxed);
+		}
+	}
+
+	*item = cell->item;
+	atomic_store_explicit(&cell->sequence, position + RESTOCK_QUEUE_SIZE, memory_order_release);
+	return 1;
+}
+
+/**
+ * @brief Gives returned ingredients back once their return is over.
+ *
+ * @param resources A bitmask of the ingredient resources.
+ */
+void releaseRestocked(uint32_t resources) {
+	int released[__builtin_popcount(resources)];
+	int count = 0;
+
+	for (uint32_t rest = resources; rest != 0; rest &= rest - 1) {
+		released[count++] = __builtin_ctz(rest);
+	}
+
+	if (liveStats != NULL) {
+		liveStatsReleased(released, count);
+	}
+
+	settings.backend->releaseMany(released, count);
+}
+
+/**
+ * @brief Adds a return to a restocker's heap of pending returns, ordered by due time.
+ *
+ * @param heap The heap.
+ * @param size The number of returns in the heap; incremented.
+ * @param item The return.
+ */
+void addPendingRestock(RestockItem heap[], int* size, RestockItem item) {
+	int i = (*size)++;
+
+	while (i > 0 && heap[(i - 1) / 2].due > item.due) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+
+	heap[i] = item;
+}
+
+/**
+ * @brief Removes the return that is due first from a restocker's heap.
+ *
+ * @param heap The heap.
+ * @param size The number of returns in the heap; decremented.
+ * @return The return that is due first.
+ */
+RestockItem removePendingRestock(RestockItem heap[], int* size) {
+	RestockItem first = heap[0];
+	RestockItem last = heap[--(*size)];
+	int i = 0;
+
+	while (2 * i + 1 < *size) {
+		int child = 2 * i + 1;
+		if (child + 1 < *size && heap[child + 1].due < heap[child].due) {
+			child++;
+		}
+		if (last.due <= heap[child].due) {
+			break;
+		}
+		heap[i] = heap[child];
+		i = child;
+	}
+
+	if (*size > 0) {
+		heap[i] = last;
+	}
+
+	return first;
+}
+
+/**
+ * @brief Records how late a return was given back, in the round's statistics.
+ *
+ * @param lateNanoseconds The time between the return being due and its ingredients being given back.
+ */
+void recordRestockLag(uint64_t lateNanoseconds) {
+	long long late = (long long)lateNanoseconds;
+	long long latest = atomic_load_explicit(&roundStats.restockLagMax, memory_order_relaxed);
+
+	atomic_fetch_add_explicit(&roundStats.restocks, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&roundStats.restockLagTotal, late, memory_order_relaxed);
+
+	while (late > latest && !atomic_compare_exchange_weak_explicit(&roundStats.restockLagMax, &latest, late,
+		memory_order_relaxed, memory_order_relaxed)) {
+	}
+}
+
+/**
+ * @brief A restocker thread: pops returns, waits until each is due, and gives its ingredients back.
+ *
+ * A restocker with nothing to do sleeps on restock.posted until a baker pushes a
+ * return or its earliest pending return is due.
+ *
+ * @param val Unused.
+ * @return Never returns.
+ */
+void* runRestocker(void* val) {
+	RestockItem* pending = malloc(RESTOCK_QUEUE_SIZE * sizeof(RestockItem));
+	int pendingCount = 0;
+
+	if (pending == NULL) {
+		perror("Failed to allocate memory for a restocker");
+		exit(1);
+	}
+
+	while (1) {
+		int posted = atomic_load_explicit(&restock.posted, memory_order_acquire);
+		RestockItem item;
+
+		while (pendingCount < RESTOCK_QUEUE_SIZE && popRestock(&item)) {
+			int queued = atomic_fetch_sub_explicit(&roundStats.restockQueued, 1, memory_order_relaxed) - 1;
+
+			if (liveStats != NULL) {
+				atomic_store_explicit(&liveStats->restockQueued, queued, memory_order_relaxed);
+			}
+
+			addPendingRestock(pending, &pendingCount, item);
+		}
+
+		uint64_t now = monotonicNanoseconds();
+
+		while (pendingCount > 0 && pending[0].due <= now) {
+			item = removePendingRestock(pending, &pendingCount);
+			releaseRestocked(item.resources);
+			recordRestockLag(monotonicNanoseconds() - item.due);
+
+			if (atomic_fetch_sub(&restock.outstanding, 1) == 1) {
+				syscall(SYS_futex, &restock.outstanding, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+			}
+		}
+
+		struct timespec timeout;
+
+		if (pendingCount > 0) {
+			uint64_t wait = pending[0].due - now;
+			timeout.tv_sec = (time_t)(wait / 1000000000ULL);
+			timeout.tv_nsec = (long)(wait % 1000000000ULL);
+		}
+
+		atomic_fetch_add(&restock.idle, 1);
+		syscall(SYS_futex, &restock.posted, FUTEX_WAIT_PRIVATE, posted, pendingCount > 0 ? &timeout : NULL, NULL, 0);
+		atomic_fetch_sub(&restock.idle, 1);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Creates the restock queue and starts the restocker threads.
+ *
+ * Exits the program if memory runs out or a thread cannot be created.
+ *
+ * @param threads The number of restockers.
+ */
+void initRestockers(int threads) {
+	restock.cells = malloc(RESTOCK_QUEUE_SIZE * sizeof(RestockCell));
+
+	if (restock.cells == NULL) {
+		perror("Failed to allocate memory for the restock queue");
+		exit(1);
+	}
+
+	for (size_t i = 0; i < RESTOCK_QUEUE_SIZE; i++) {
+		atomic_init(&restock.cells[i].sequence, i);
+	}
+
+	for (int i = 0; i < threads; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, runRestocker, NULL) != 0) {
+			perror("Failed to create a restocker thread");
+			exit(1);
+		}
+
+		pthread_detach(thread);
+	}
+
+	restock.threadCount = threads;
+}
+
+/**
+ * @brief Waits until every return handed to the restockers has been given back.
+ */
+void drainRestockers() {
+	int outstanding;
+
+	while ((outstanding = atomic_load(&restock.outstanding)) > 0) {
+		syscall(SYS_futex, &restock.outstanding, FUTEX_WAIT_PRIVATE, outstanding, NULL, NULL, 0);
+	}
+}
+
+/**
+ * @brief Hands ingredients to the restockers, so the baker does not wait out their return.
+ *
+ * The return's duration is drawn and accounted for by the baker as usual, and the
+ * baker's hold of the ingredients ends here; the ingredients stay in use until a
+ * restocker gives them back when the return is over. If the queue is full the baker
+ * returns the ingredients itself.
+ *
+ * @param ingredients The identifiers of the ingredients to return.
+ * @param count The number of entries in ingredients.
+ * @return Always returns 0.
+ */
+int restockIngredients(const int ingredients[], int count) {
+	int resources[count];
+	RestockItem item = { 0, 0 };
+
+	for (int i = 0; i < count; i++) {
+		resources[i] = semOffset + ingredients[i];
+		item.resources |= 1u << resources[i];
+	}
+
+	double simulatedSeconds = sampleServiceTime(getDuration(OPERATION_RETURN, -1));
+	recordOperation(OPERATION_RETURN, simulatedSeconds);
+
+	if (LATENCY_ENABLED) {
+		recordReleased(resources, count);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogReleased(resources, count);
+	}
+
+	item.due = monotonicNanoseconds() + (uint64_t)(simulatedSeconds / settings.dilation * 1e9);
+	atomic_fetch_add(&restock.outstanding, 1);
+
+	if (!pushRestock(&item)) {
+		atomic_fetch_add_explicit(&roundStats.restockOverflows, 1, memory_order_relaxed);
+		simulateDuration(simulatedSeconds);
+		releaseRestocked(item.resources);
+
+		if (atomic_fetch_sub(&restock.outstanding, 1) == 1) {
+			syscall(SYS_futex, &restock.outstanding, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+		}
+		return 0;
+	}
+
+	int queued = atomic_fetch_add_explicit(&roundStats.restockQueued, 1, memory_order_relaxed) + 1;
+	int deepest = atomic_load_explicit(&roundStats.restockQueuedMax, memory_order_relaxed);
+
+	while (queued > deepest && !atomic_compare_exchange_weak_explicit(&roundStats.restockQueuedMax, &deepest, queued,
+		memory_order_relaxed, memory_order_relaxed)) {
+	}
+
+	if (liveStats != NULL) {
+		atomic_store_explicit(&liveStats->restockQueued, queued, memory_order_relaxed);
+	}
+
+	atomic_fetch_add_explicit(&restock.posted, 1, memory_order_release);
+
+	if (atomic_load(&restock.idle) > 0) {
+		syscall(SYS_futex, &restock.posted, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Recovers the specified ingredient by incrementing its semaphore.
+ *
+ * This function waits for the return operation's duration while the ingredient is put away and then gives its
+ * semaphore back to indicate that the ingredient has been recovered. With --restockers the ingredient is handed
+ * to the restockers instead.
+ *
+ * @param ingredient The identifier of the ingredient to be recovered.
+ * @return int The result of the semaphore increment operation.
+ */
+int recoverIngredient(int ingredient) {
+	if (restock.threadCount > 0) {
+		return restockIngredients(&ingredient, 1);
+	}
+
+	simulateOperation(OPERATION_RETURN, -1);
+
+	return recoverResource(semOffset + ingredient);
+}
+
+/**
+ * @brief Returns several ingredients in a single trip.
+ *
+ * Like recoverIngredient, returning takes one return operation, but the whole set is carried
+ * back together and released with one backend operation. With --restockers the set is handed to the
+ * restockers as one return.
+ *
+ * @param ingredients The identifiers of the ingredients to return.
+ * @param count The number of entries in ingredients.
+ * @return int The result of the semaphore operation.
+ */
+int recoverIngredients(const int ingredients[], int count) {
+	if (restock.threadCount > 0) {
+		return restockIngredients(ingredients, count);
+	}
+
+	int resources[count];
+
+	for (int i = 0; i < count; i++) {
+		resources[i] = semOffset + ingredients[i];
+	}
+
+	simulateOperation(OPERATION_RETURN, -1);
+
+	return recoverResources(resources, count);
+}
+
+/**
+ * @brief Returns the storage area that holds an ingredient.
+ *
+ * @param ingredient The ingredient to look up.
+ * @return The storage resource that holds the ingredient.
+ */
+int getIngredientStorage(int ingredient) {
+	return kitchen.ingredientStorage[ingredient];
+}
+
+/**
+ * @brief Signal handler for SIGINT.
+ *
+ * This function is called when the program receives a SIGINT signal (usually generated by pressing Ctrl+C).
+ * It performs cleanup operations and terminates the program gracefully.
+ *
+ * @param signal The signal number received (expected to be SIGINT).
+ */
+void sigHandler(int signal) {
+	if (signal == SIGINT) {
+
+		printf("\nTerminating program...\n");
+
+		cleanupSemaphores();
+		cleanupSharedMemory();
+		exit(0);
+
+	}
+
+}
+
+/**
+ * @brief A completion that wakes the bakers waiting on an empty shelf.
+ *
+ * A refill is signaled once, so the supplier replaces it on every wakeup. The old one
+ * is freed by whoever drops the last reference to it, the supplier that signaled it
+ * or the last baker to wake up from it.
+ *
+ * @var ShelfRefill::references
+ * One for the shelf or the supplier signaling it, plus one per baker waiting on it. Protected by the shelf's lock.
+ */
+typedef struct ShelfRefill {
+	Completion completion;
+	int references;
+} ShelfRefill;
+
+/**
+ * @brief The stock of one ingredient in inventory mode, and its delivery schedule.
+ *
+ * Bakers take units with a compare-and-swap on stock and never give them back. A baker
+ * that finds the shelf empty waits on refill. A delivery that brings the stock up to
+ * --low-stock wakes every waiting baker at once, rather than one baker per unit.
+ *
+ * @var Shelf::stock
+ * The units on the shelf.
+ *
+ * @var Shelf::waiting
+ * The number of bakers waiting on refill. Protected by lock.
+ *
+ * @var Shelf::refill
+ * Signaled when a delivery brings the stock up to the threshold. Protected by lock.
+ *
+ * @var Shelf::units
+ * The units each delivery brings, or 0 if the ingredient is not supplied.
+ *
+ * @var Shelf::period
+ * The simulated seconds between deliveries.
+ *
+ * @var Shelf::nextDelivery
+ * CLOCK_MONOTONIC time of the next delivery in nanoseconds. Protected by inventory.lock.
+ */
+typedef struct {
+	_Alignas(64) atomic_int stock;
+	pthread_mutex_t lock;
+	int waiting;
+	ShelfRefill* refill;
+	int units;
+	double period;
+	uint64_t nextDelivery;
+} Shelf;
+
+/**
+ * @struct inventoryStruct
+ * @brief The shelves and the supplier threads of inventory mode.
+ *
+ * Ingredient i is delivered by supplier i % supplierCount. The suppliers sleep on
+ * wakeup between deliveries and while no round is running.
+ *
+ * @var inventoryStruct::shelves
+ * The shelf of each ingredient, indexed by ingredient.
+ *
+ * @var inventoryStruct::running
+ * Set while a round is running. Protected by lock.
+ */
+struct inventoryStruct {
+	Shelf shelves[KITCHEN_MAX_RESOURCES];
+	pthread_mutex_t lock;
+	pthread_cond_t wakeup;
+	int supplierCount;
+	int supplierIds[KITCHEN_MAX_RESOURCES];
+	int running;
+};
+
+struct inventoryStruct inventory = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Applies a supply schedule given on the command line.
+ *
+ * The specification has the form UNITS/SECONDS, a delivery of UNITS units of every
+ * ingredient each SECONDS simulated seconds, or INGREDIENT=UNITS/SECONDS for one
+ * ingredient only. Ingredients may be given by name.
+ *
+ * @param specification The supply specification.
+ * @return Returns 0 on success, or -1 if the specification is not valid.
+ */
+int parseSupply(const char* specification) {
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "%s", specification);
+
+	char* rate = buffer;
+	int ingredient = -1;
+	char* equals = strchr(buffer, '=');
+
+	if (equals != NULL) {
+		*equals = '\0';
+		rate = equals + 1;
+
+		ingredient = findName(&kitchen.names[semOffset], kitchen.ingredientCount, buffer);
+		if (ingredient < 0) {
+			return -1;
+		}
+	}
+
+	char* slash = strchr(rate, '/');
+	if (slash == NULL) {
+		return -1;
+	}
+	*slash = '\0';
+
+	char* end;
+	long units = strtol(rate, &end, 10);
+	if (*end != '\0' || units <= 0 || units > INT_MAX / 2) {
+		return -1;
+	}
+
+	double seconds = strtod(slash + 1, &end);
+	if (*end != '\0' || seconds <= 0) {
+		return -1;
+	}
+
+	for (int i = 0; i < kitchen.ingredientCount; i++) {
+		if (ingredient < 0 || i == ingredient) {
+			inventory.shelves[i].units = units;
+			inventory.shelves[i].period = seconds;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Returns the units per simulated second the suppliers deliver, over every ingredient.
+ *
+ * @return The supply rate.
+ */
+double getSupplyRate() {
+	double rate = 0;
+
+	for (int i = 0; i < kitchen.ingredientCount; i++) {
+		if (inventory.shelves[i].units > 0) {
+			rate += inventory.shelves[i].units / inventory.shelves[i].period;
+		}
+	}
+
+	return rate;
+}
+
+/**
+ * @brief Allocates a refill that has not been signaled.
+ *
+ * @return The refill, exits the program if memory runs out.
+ */
+ShelfRefill* createShelfRefill() {
+	ShelfRefill* refill = malloc(sizeof(ShelfRefill));
+
+	if (refill == NULL) {
+		perror("Failed to allocate memory for a shelf refill");
+		exit(1);
+	}
+
+	initCompletion(&refill->completion);
+	refill->references = 1;
+	return refill;
+}
+
+/**
+ * @brief Drops a reference to a refill, freeing it with the last one.
+ *
+ * @param shelf The shelf the refill belongs to.
+ * @param refill The refill.
+ */
+void releaseShelfRefill(Shelf* shelf, ShelfRefill* refill) {
+	pthread_mutex_lock(&shelf->lock);
+	int references = --refill->references;
+	pthread_mutex_unlock(&shelf->lock);
+
+	if (references == 0) {
+		destroyCompletion(&refill->completion);
+		free(refill);
+	}
+}
+
+/**
+ * @brief Takes one unit of an ingredient off its shelf if there is one.
+ *
+ * @param ingredient The ingredient to take.
+ * @return Returns 1 if a unit was taken, or 0 if the shelf is empty.
+ */
+int takeStock(int ingredient) {
+	Shelf* shelf = &inventory.shelves[ingredient];
+	int stock = atomic_load_explicit(&shelf->stock, memory_order_relaxed);
+
+	while (stock > 0) {
+		if (atomic_compare_exchange_weak(&shelf->stock, &stock, stock - 1)) {
+			atomic_fetch_add_explicit(&roundStats.consumed[ingredient], 1, memory_order_relaxed);
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * @brief Waits until an empty shelf is restocked, bounded by --gather-timeout.
+ *
+ * The wait counts as a stockout and as time blocked on the ingredient. With a gather
+ * timeout of 0 the baker does not wait at all.
+ *
+ * @param ingredient The ingredient whose shelf is empty.
+ * @return ACQUIRE_OK once the shelf has stock again, otherwise the reason the baker stopped waiting.
+ */
+int waitForStock(int ingredient) {
+	Shelf* shelf = &inventory.shelves[ingredient];
+	int resource = semOffset + ingredient;
+	uint64_t startTicks = LATENCY_NOW();
+
+	atomic_fetch_add_explicit(&roundStats.stockouts[ingredient], 1, memory_order_relaxed);
+
+	if (settings.gatherTimeout == 0) {
+		atomic_fetch_add_explicit(&roundStats.resourceBusy[resource], 1, memory_order_relaxed);
+		return ACQUIRE_BUSY;
+	}
+
+	pthread_mutex_lock(&shelf->lock);
+	if (atomic_load(&shelf->stock) > 0) {
+		pthread_mutex_unlock(&shelf->lock);
+		return ACQUIRE_OK;
+	}
+	ShelfRefill* refill = shelf->refill;
+	shelf->waiting++;
+	refill->references++;
+	pthread_mutex_unlock(&shelf->lock);
+
+	int status = ACQUIRE_OK;
+
+	if (settings.gatherTimeout < 0) {
+		waitForCompletion(&refill->completion);
+	}
+	else if (!waitForCompletionWithin(&refill->completion, (uint64_t)(settings.gatherTimeout / settings.dilation * 1e9))) {
+		pthread_mutex_lock(&shelf->lock);
+		if (shelf->refill == refill) {
+			shelf->waiting--;
+		}
+		pthread_mutex_unlock(&shelf->lock);
+
+		atomic_fetch_add_explicit(&roundStats.resourceTimeouts[resource], 1, memory_order_relaxed);
+		status = ACQUIRE_TIMED_OUT;
+	}
+
+	releaseShelfRefill(shelf, refill);
+
+	if (LATENCY_ENABLED) {
+		LatencyHistograms* histograms = getThreadLatency();
+		uint64_t waited = latencyTicks() - startTicks;
+
+		histograms->blockedTicks += waited;
+		recordLatency(&histograms->wait[resource], waited);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Puts one delivery on a shelf and wakes the waiting bakers once the stock reaches --low-stock.
+ *
+ * Called by a supplier with inventory.lock held.
+ *
+ * @param ingredient The ingredient delivered.
+ */
+void deliverStock(int ingredient) {
+	Shelf* shelf = &inventory.shelves[ingredient];
+	int stock = atomic_fetch_add(&shelf->stock, shelf->units) + shelf->units;
+
+	atomic_fetch_add_explicit(&roundStats.supplied[ingredient], shelf->units, memory_order_relaxed);
+
+	if (stock < settings.lowStock) {
+		return;
+	}
+
+	ShelfRefill* woken = NULL;
+
+	pthread_mutex_lock(&shelf->lock);
+	if (shelf->waiting > 0) {
+		woken = shelf->refill;
+		shelf->refill = createShelfRefill();
+		shelf->waiting = 0;
+	}
+	pthread_mutex_unlock(&shelf->lock);
+
+	if (woken != NULL) {
+		signalCompletion(&woken->completion);
+		releaseShelfRefill(shelf, woken);
+	}
+}
+
+/**
+ * @brief A supplier thread: delivers its ingredients on their schedules while a round runs.
+ *
+ * A supplier that falls behind makes every delivery it missed at once.
+ *
+ * @param val A pointer to the supplier's index.
+ * @return A void pointer, never returns.
+ */
+void* runSupplier(void* val) {
+	int supplier = *(int*)val;
+
+	pthread_mutex_lock(&inventory.lock);
+
+	while (1) {
+		if (!inventory.running) {
+			pthread_cond_wait(&inventory.wakeup, &inventory.lock);
+			continue;
+		}
+
+		uint64_t now = monotonicNanoseconds();
+		uint64_t next = UINT64_MAX;
+
+		for (int i = supplier; i < kitchen.ingredientCount; i += inventory.supplierCount) {
+			Shelf* shelf = &inventory.shelves[i];
+			uint64_t period = (uint64_t)(shelf->period / settings.dilation * 1e9);
+
+			if (shelf->units == 0) {
+				continue;
+			}
+
+			while (shelf->nextDelivery <= now) {
+				deliverStock(i);
+				shelf->nextDelivery += period > 0 ? period : 1;
+			}
+
+			if (shelf->nextDelivery < next) {
+				next = shelf->nextDelivery;
+			}
+		}
+
+		if (next == UINT64_MAX) {
+			pthread_cond_wait(&inventory.wakeup, &inventory.lock);
+			continue;
+		}
+
+		struct timespec deadline = { (time_t)(next / 1000000000ULL), (long)(next % 1000000000ULL) };
+		pthread_cond_timedwait(&inventory.wakeup, &inventory.lock, &deadline);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Sets up the shelves and starts the supplier threads.
+ *
+ * Exits the program if a thread cannot be created.
+ *
+ * @param suppliers The number of supplier threads, at most one per ingredient is useful.
+ */
+void initInventory(int suppliers) {
+	pthread_condattr_t attributes;
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&inventory.wakeup, &attributes);
+	pthread_condattr_destroy(&attributes);
+
+	for (int i = 0; i < kitchen.ingredientCount; i++) {
+		pthread_mutex_init(&inventory.shelves[i].lock, NULL);
+		inventory.shelves[i].refill = createShelfRefill();
+	}
+
+	inventory.supplierCount = suppliers < kitchen.ingredientCount ? suppliers : kitchen.ingredientCount;
+
+	for (int i = 0; i < inventory.supplierCount; i++) {
+		pthread_t thread;
+
+		inventory.supplierIds[i] = i;
+		if (pthread_create(&thread, NULL, runSupplier, &inventory.supplierIds[i]) != 0) {
+			perror("Failed to create a supplier thread");
+			exit(1);
+		}
+
+		pthread_detach(thread);
+	}
+}
+
+/**
+ * @brief Stocks every shelf with its ingredient's capacity and starts the delivery schedules.
+ */
+void startInventoryRound() {
+	uint64_t now = monotonicNanoseconds();
+
+	pthread_mutex_lock(&inventory.lock);
+
+	for (int i = 0; i < kitchen.ingredientCount; i++) {
+		Shelf* shelf = &inventory.shelves[i];
+
+		atomic_store(&shelf->stock, kitchen.capacities[semOffset + i]);
+		shelf->nextDelivery = now + (uint64_t)(shelf->period / settings.dilation * 1e9);
+	}
+
+	inventory.running = 1;
+	pthread_cond_broadcast(&inventory.wakeup);
+	pthread_mutex_unlock(&inventory.lock);
+}
+
+/**
+ * @brief Stops the deliveries once every baker has finished.
+ */
+void finishInventoryRound() {
+	pthread_mutex_lock(&inventory.lock);
+	inventory.running = 0;
+	pthread_mutex_unlock(&inventory.lock);
+}
+
+/**
+ * @brief Prints the round's deliveries, consumption and stockouts, overall and per ingredient.
+ *
+ * @param simulatedSeconds The simulated time the round took.
+ */
+void printInventoryStats(double simulatedSeconds) {
+	long long completed = 0;
+	for (int i = 0; i < kitchen.recipeCount; i++) {
+		completed += atomic_load(&roundStats.recipesCompleted[i]);
+	}
+
+	long long supplied = 0;
+	long long consumed = 0;
+	long long stockouts = 0;
+	for (int i = 0; i < kitchen.ingredientCount; i++) {
+		supplied += atomic_load(&roundStats.supplied[i]);
+		consumed += atomic_load(&roundStats.consumed[i]);
+		stockouts += atomic_load(&roundStats.stockouts[i]);
+	}
+
+	double throughput = simulatedSeconds > 0 ? completed / simulatedSeconds : 0.0;
+
+	printf("  Inventory: %lld units supplied at %.3f units/s, %lld consumed, %lld stockouts; %.4f recipes/s, %.4f per unit/s of supply\n",
+		supplied, getSupplyRate(), consumed, stockouts, throughput, throughput / getSupplyRate());
+
+	for (int i = 0; i < kitchen.ingredientCount; i++) {
+		if (inventory.shelves[i].units == 0) {
+			continue;
+		}
+
+		printf("    %-16s %6lld supplied, %6lld consumed, %6d left, %6lld stockouts\n", getIngredientName(i),
+			(long long)atomic_load(&roundStats.supplied[i]), (long long)atomic_load(&roundStats.consumed[i]),
+			atomic_load(&inventory.shelves[i].stock), (long long)atomic_load(&roundStats.stockouts[i]));
+	}
+}
+
+/**
+ * @brief Takes one unit of an ingredient off its shelf in inventory mode.
+ *
+ * The baker enters the storage area, takes a unit if the shelf has one, and leaves. A
+ * baker that finds the shelf empty leaves empty-handed and waits for a delivery outside
+ * the storage area, so that the storage area stays open to bakers after other
+ * ingredients, and then tries again.
+ *
+ * @param bakerId The ID of the baker taking the ingredient.
+ * @param ingredient The ingredient to take.
+ * @return ACQUIRE_OK once the baker has the unit, otherwise the reason it gave up.
+ */
+int takeFromShelf(int bakerId, int ingredient) {
+	int storage = getIngredientStorage(ingredient);
+
+	while (1) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERING_STORAGE, storage, 0);
+		int status = useGatherResource(storage);
+		if (status != ACQUIRE_OK) {
+			LOG_EVENT(LOG_ALL, bakerId, EVENT_GAVE_UP_STORAGE, storage, 0);
+			return status;
+		}
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERED_STORAGE, storage, 0);
+
+		int taken = takeStock(ingredient);
+
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_LEAVING_STORAGE, storage, 0);
+		recoverResource(storage);
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_LEFT_STORAGE, storage, 0);
+
+		if (taken) {
+			return ACQUIRE_OK;
+		}
+
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_OUT_OF_STOCK, ingredient, 0);
+		status = waitForStock(ingredient);
+		if (status != ACQUIRE_OK) {
+			LOG_EVENT(LOG_ALL, bakerId, EVENT_GAVE_UP_INGREDIENT, ingredient, 0);
+			return status;
+		}
+	}
+}
+
+/**
+ * @brief Takes every needed ingredient that is in stock from one storage area in a single visit.
+ *
+ * If none of them is in stock, the baker waits outside for a delivery of the first one.
+ *
+ * @param bakerId The ID of the baker gathering the ingredients.
+ * @param recipe A pointer to the recipe's bitmask of needed ingredients.
+ * @param storage The storage resource to visit.
+ * @param wanted A bitmask of the needed ingredients the storage area holds, not 0.
+ * @return Returns 1 if any ingredient was taken, otherwise 0.
+ */
+int gatherFromShelves(int bakerId, uint32_t* recipe, int storage, uint32_t wanted) {
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERING_STORAGE, storage, 0);
+	if (useGatherResource(storage) != ACQUIRE_OK) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_GAVE_UP_STORAGE, storage, 0);
+		return 0;
+	}
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERED_STORAGE, storage, 0);
+
+	uint32_t taken = 0;
+
+	for (uint32_t rest = wanted; rest != 0; rest &= rest - 1) {
+		int ingredient = __builtin_ctz(rest);
+
+		if (takeStock(ingredient)) {
+			taken |= 1u << ingredient;
+			LOG_EVENT(LOG_ALL, bakerId, EVENT_GOT_INGREDIENT, ingredient, 0);
+		}
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_LEAVING_STORAGE, storage, 0);
+	recoverResource(storage);
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_LEFT_STORAGE, storage, 0);
+
+	*recipe &= ~taken;
+
+	if (taken == 0) {
+		int ingredient = __builtin_ctz(wanted);
+
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_OUT_OF_STOCK, ingredient, 0);
+		if (waitForStock(ingredient) != ACQUIRE_OK) {
+			LOG_EVENT(LOG_ALL, bakerId, EVENT_GAVE_UP_INGREDIENT, ingredient, 0);
+		}
+	}
+
+	return taken != 0;
+}
+
+/**
+ * @brief How long the rebalancer waits before looking again while bakers are waiting on a stashed ingredient.
+ */
+#define STASH_REBALANCE_NANOSECONDS 1000000
+
+/**
+ * @brief The ingredients one baker keeps between recipes with --stash.
+ *
+ * A stashed unit stays taken from its ingredient's semaphore, but the baker's hold of it
+ * ends when it is stashed, as with a return handed to the restockers. Whoever clears a bit
+ * of held owns that unit: the baker, to use it or give it back, or the rebalancer, to give
+ * it to the bakers waiting for it.
+ *
+ * @var BakerStash::held
+ * A bitmask of the stashed ingredients, one unit of each.
+ *
+ * @var BakerStash::recipesLeft
+ * The number of recipes each stashed unit may still be kept for, indexed by ingredient. Only the baker touches it.
+ *
+ * @var BakerStash::expires
+ * CLOCK_MONOTONIC time by which each stashed unit must be given back, in nanoseconds, indexed by
+ * ingredient. Only the baker touches it.
+ */
+typedef struct {
+	_Alignas(64) atomic_uint held;
+	int recipesLeft[KITCHEN_MAX_RESOURCES];
+	uint64_t expires[KITCHEN_MAX_RESOURCES];
+} BakerStash;
+
+/**
+ * @struct stashStruct
+ * @brief The bakers' stashes and the rebalancer thread that reclaims stashed units for waiting bakers.
+ *
+ * A baker that goes to storage for an ingredient counts itself in demand while it is
+ * there, and wakes the rebalancer when it is the first. While any ingredient is in
+ * demand and has no free unit, the rebalancer takes stashed units of it out of the
+ * bakers' stashes and gives them back, looking again every STASH_REBALANCE_NANOSECONDS.
+ *
+ * @var stashStruct::bakers
+ * The stash of each baker, indexed by baker ID, or NULL without --stash. Protected by lock
+ * while it is reallocated between rounds.
+ *
+ * @var stashStruct::capacity
+ * The number of stashes allocated.
+ *
+ * @var stashStruct::count
+ * The number of bakers in the current round, or 0 between rounds.
+ *
+ * @var stashStruct::cursor
+ * The baker the rebalancer's next search starts at, so that reclaims are spread over the bakers.
+ *
+ * @var stashStruct::demand
+ * The number of bakers going to storage for each ingredient, indexed by ingredient.
+ *
+ * @var stashStruct::requests
+ * Bumped when an ingredient comes into demand; the rebalancer sleeps on it.
+ */
+struct stashStruct {
+	BakerStash* bakers;
+	int capacity;
+	int count;
+	int cursor;
+	pthread_mutex_t lock;
+	pthread_t thread;
+	_Alignas(64) atomic_int demand[KITCHEN_MAX_RESOURCES];
+	_Alignas(64) atomic_int requests;
+};
+
+struct stashStruct stash = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Gives a stashed unit back to its ingredient's semaphore.
+ *
+ * @param ingredient The ingredient.
+ */
+void releaseStashed(int ingredient) {
+	int resource = semOffset + ingredient;
+
+	if (liveStats != NULL) {
+		liveStatsReleased(&resource, 1);
+	}
+
+	settings.backend->release(resource);
+}
+
+/**
+ * @brief Takes the units of a set of ingredients the baker has stashed out of its stash to use them.
+ *
+ * The caller puts them back with restashIngredients once it has used them.
+ *
+ * @param bakerId The ID of the baker.
+ * @param ingredients A bitmask of the ingredients the baker needs.
+ * @return A bitmask of the ingredients taken from the stash.
+ */
+uint32_t takeFromStash(int bakerId, uint32_t ingredients) {
+	BakerStash* baker = &stash.bakers[bakerId];
+
+	atomic_fetch_add_explicit(&roundStats.stashLookups, __builtin_popcount(ingredients), memory_order_relaxed);
+
+	if (!(atomic_load_explicit(&baker->held, memory_order_relaxed) & ingredients)) {
+		return 0;
+	}
+
+	uint32_t taken = atomic_fetch_and_explicit(&baker->held, ~ingredients, memory_order_acquire) & ingredients;
+
+	atomic_fetch_add_explicit(&roundStats.stashHits, __builtin_popcount(taken), memory_order_relaxed);
+
+	for (uint32_t rest = taken; rest != 0; rest &= rest - 1) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_USED_STASH, __builtin_ctz(rest), 0);
+	}
+
+	return taken;
+}
+
+/**
+ * @brief Puts units taken with takeFromStash back into the baker's stash.
+ *
+ * They keep their age; ageStash gives them back when it runs out.
+ *
+ * @param bakerId The ID of the baker.
+ * @param ingredients A bitmask of the ingredients.
+ */
+void restashIngredients(int bakerId, uint32_t ingredients) {
+	atomic_fetch_or_explicit(&stash.bakers[bakerId].held, ingredients, memory_order_release);
+}
+
+/**
+ * @brief Keeps units the baker has just taken from storage in its stash, as far as there is room.
+ *
+ * The baker's hold of a stashed unit ends here, so the latency statistics and the
+ * watchdog do not count the unit as held by the baker while it sits in the stash.
+ *
+ * @param bakerId The ID of the baker.
+ * @param ingredients A bitmask of the ingredients the baker holds a unit of.
+ * @return A bitmask of the ingredients stashed; the caller returns the others as usual.
+ */
+uint32_t stashIngredients(int bakerId, uint32_t ingredients) {
+	BakerStash* baker = &stash.bakers[bakerId];
+	int room = settings.stashSize - __builtin_popcount(atomic_load_explicit(&baker->held, memory_order_relaxed));
+	uint64_t expires = monotonicNanoseconds() + (uint64_t)(settings.stashSeconds / settings.dilation * 1e9);
+	uint32_t stashed = 0;
+	int resources[KITCHEN_MAX_RESOURCES];
+	int count = 0;
+
+	for (uint32_t rest = ingredients; rest != 0 && count < room; rest &= rest - 1) {
+		int ingredient = __builtin_ctz(rest);
+
+		baker->recipesLeft[ingredient] = settings.stashRecipes;
+		baker->expires[ingredient] = expires;
+		stashed |= 1u << ingredient;
+		resources[count++] = semOffset + ingredient;
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_STASHED_INGREDIENT, ingredient, 0);
+	}
+
+	if (count == 0) {
+		return 0;
+	}
+
+	if (LATENCY_ENABLED) {
+		recordReleased(resources, count);
+	}
+
+	if (watchdog.bakers != NULL) {
+		watchdogReleased(resources, count);
+	}
+
+	atomic_fetch_or_explicit(&baker->held, stashed, memory_order_release);
+	return stashed;
+}
+
+/**
+ * @brief Gives back the stashed units a baker should not keep any longer, in one return trip.
+ *
+ * Called after each recipe the baker finishes. A unit goes back when none of the baker's
+ * unfinished recipes needs it, when it has been kept for --stash-recipes recipes, or when
+ * it has been kept for --stash-seconds. With no recipes remaining, everything goes back.
+ *
+ * @param bakerId The ID of the baker.
+ * @param recipes The ingredients each recipe still needs, indexed by recipe.
+ * @param remaining A bitmask of the recipes the baker has not finished.
+ */
+void ageStash(int bakerId, const uint32_t recipes[], uint32_t remaining) {
+	BakerStash* baker = &stash.bakers[bakerId];
+	uint32_t needed = 0;
+	uint32_t expired = 0;
+	uint64_t now = monotonicNanoseconds();
+
+	for (uint32_t rest = remaining; rest != 0; rest &= rest - 1) {
+		needed |= recipes[__builtin_ctz(rest)];
+	}
+
+	for (uint32_t rest = atomic_load_explicit(&baker->held, memory_order_relaxed); rest != 0; rest &= rest - 1) {
+		int ingredient = __builtin_ctz(rest);
+
+		if (!(needed & (1u << ingredient)) || --baker->recipesLeft[ingredient] <= 0 || now >= baker->expires[ingredient]) {
+			expired |= 1u << ingredient;
+		}
+	}
+
+	if (expired == 0) {
+		return;
+	}
+
+	expired = atomic_fetch_and_explicit(&baker->held, ~expired, memory_order_acquire) & expired;
+
+	if (expired == 0) {
+		return;
+	}
+
+	for (uint32_t rest = expired; rest != 0; rest &= rest - 1) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_RETURNING_INGREDIENT, __builtin_ctz(rest), 0);
+	}
+
+	simulateOperation(OPERATION_RETURN, -1);
+
+	for (uint32_t rest = expired; rest != 0; rest &= rest - 1) {
+		releaseStashed(__builtin_ctz(rest));
+	}
+
+	atomic_fetch_add_explicit(&roundStats.stashReturned, __builtin_popcount(expired), memory_order_relaxed);
+}
+
+/**
+ * @brief Counts the baker in the demand for ingredients it is going to storage for.
+ *
+ * Wakes the rebalancer if an ingredient was not in demand before. The caller calls
+ * leaveStashDemand with the same ingredients once it is back.
+ *
+ * @param ingredients A bitmask of the ingredients.
+ */
+void enterStashDemand(uint32_t ingredients) {
+	int first = 0;
+
+	for (uint32_t rest = ingredients; rest != 0; rest &= rest - 1) {
+		first |= atomic_fetch_add_explicit(&stash.demand[__builtin_ctz(rest)], 1, memory_order_relaxed) == 0;
+	}
+
+	if (first) {
+		atomic_fetch_add_explicit(&stash.requests, 1, memory_order_release);
+		syscall(SYS_futex, &stash.requests, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+}
+
+/**
+ * @brief Takes the baker out of the demand for ingredients again.
+ *
+ * @param ingredients A bitmask of the ingredients passed to enterStashDemand.
+ */
+void leaveStashDemand(uint32_t ingredients) {
+	for (uint32_t rest = ingredients; rest != 0; rest &= rest - 1) {
+		atomic_fetch_sub_explicit(&stash.demand[__builtin_ctz(rest)], 1, memory_order_relaxed);
+	}
+}
+
+/**
+ * @brief Reclaims stashed units of every ingredient that bakers wait for and that has no free unit.
+ *
+ * Takes at most as many units of an ingredient as there are bakers in demand for it.
+ * Must be called with the stash locked.
+ *
+ * @return Returns 1 if any ingredient is still in demand, otherwise 0.
+ */
+int rebalanceStashes() {
+	int inDemand = 0;
+
+	for (int ingredient = 0; ingredient < kitchen.ingredientCount; ingredient++) {
+		int wanted = atomic_load_explicit(&stash.demand[ingredient], memory_order_relaxed);
+
+		if (wanted <= 0) {
+			continue;
+		}
+
+		inDemand = 1;
+
+		if (settings.backend->probe(semOffset + ingredient) > 0) {
+			continue;
+		}
+
+		uint32_t bit = 1u << ingredient;
+
+		for (int i = 0; i < stash.count && wanted > 0; i++) {
+			BakerStash* baker = &stash.bakers[(stash.cursor + i) % stash.count];
+
+			if ((atomic_load_explicit(&baker->held, memory_order_relaxed) & bit) &&
+				(atomic_fetch_and_explicit(&baker->held, ~bit, memory_order_acquire) & bit)) {
+				releaseStashed(ingredient);
+				atomic_fetch_add_explicit(&roundStats.stashReclaimed, 1, memory_order_relaxed);
+				stash.cursor = (stash.cursor + i + 1) % stash.count;
+				wanted--;
+			}
+		}
+	}
+
+	return inDemand;
+}
+
+/**
+ * @brief The rebalancer thread: reclaims stashed units while bakers are waiting on them.
+ *
+ * @param val Unused.
+ * @return Never returns.
+ */
+void* runRebalancer(void* val) {
+	struct timespec period = { 0, STASH_REBALANCE_NANOSECONDS };
+
+	while (1) {
+		int requests = atomic_load_explicit(&stash.requests, memory_order_acquire);
+
+		pthread_mutex_lock(&stash.lock);
+		int inDemand = stash.count > 0 && rebalanceStashes();
+		pthread_mutex_unlock(&stash.lock);
+
+		syscall(SYS_futex, &stash.requests, FUTEX_WAIT_PRIVATE, requests, inDemand ? &period : NULL, NULL, 0);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Starts the rebalancer thread. Exits the program if it cannot be created.
+ */
+void initStash() {
+	if (pthread_create(&stash.thread, NULL, runRebalancer, NULL) != 0) {
+		perror("Failed to create the rebalancer thread");
+		exit(1);
+	}
+
+	pthread_detach(stash.thread);
+}
+
+/**
+ * @brief Gives every baker of the new round an empty stash.
+ *
+ * Exits the program if memory runs out.
+ *
+ * @param bakers The number of bakers in the round.
+ */
+void startStashRound(int bakers) {
+	pthread_mutex_lock(&stash.lock);
+
+	if (bakers > stash.capacity) {
+		free(stash.bakers);
+		stash.bakers = aligned_alloc(_Alignof(BakerStash), bakers * sizeof(BakerStash));
+
+		if (stash.bakers == NULL) {
+			perror("Failed to allocate memory for the stashes");
+			exit(1);
+		}
+
+		stash.capacity = bakers;
+	}
+
+	memset(stash.bakers, 0, bakers * sizeof(BakerStash));
+	stash.count = bakers;
+	stash.cursor = 0;
+
+	pthread_mutex_unlock(&stash.lock);
+}
+
+/**
+ * @brief Stops the rebalancer from looking at the stashes and the backend until the next round starts.
+ */
+void finishStashRound() {
+	pthread_mutex_lock(&stash.lock);
+	stash.count = 0;
+	pthread_mutex_unlock(&stash.lock);
+}
+
+/**
+ * @brief Decrements the semaphores for the specified ingredient and baker.
+ *
+ * This function looks up the storage area (the pantry or refrigerator in the default kitchen)
+ * that holds the specified ingredient, and the baker attempts to enter it and use the resource.
+ * The function then waits for the specified ingredient to be available and uses it.
+ * With --gather-timeout the baker gives up on either wait at the deadline and leaves
+ * the storage area again, holding nothing.
+ *
+ * @param bakerId The ID of the baker attempting to use the ingredient.
+ * @param ingredient The ingredient that the baker needs.
+ * @return ACQUIRE_OK if the baker holds the storage area and the ingredient, otherwise the reason it does not.
+ */
+int decSemaphores(int bakerId, int ingredient) {
+	int storage = getIngredientStorage(ingredient);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERING_STORAGE, storage, 0);
+	int status = useGatherResource(storage);
+	if (status != ACQUIRE_OK) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_GAVE_UP_STORAGE, storage, 0);
+		return status;
+	}
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERED_STORAGE, storage, 0);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_WAITING_FOR_INGREDIENT, ingredient, 0);
+
+	status = useGatherResource(semOffset + ingredient);
+	if (status != ACQUIRE_OK) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_GAVE_UP_INGREDIENT, ingredient, 0);
+		recoverResource(storage);
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_LEFT_STORAGE, storage, 0);
+	}
+
+	return status;
+}
+
+/**
+ * @brief Increments the semaphores for the specified ingredient and handles resource recovery.
+ *
+ * This function looks up the storage area that holds the given ingredient, logs the
+ * baker's intention to leave it, recovers the storage resource, and logs that the baker
+ * has left. Finally, it recovers the specified ingredient.
+ *
+ * @param bakerId The ID of the baker attempting to increment the ingredient semaphore.
+ * @param ingredient The ingredient for which the semaphore needs to be incremented.
+ */
+void incIngredientSemaphores(int bakerId, int ingredient) {
+	int storage = getIngredientStorage(ingredient);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_LEAVING_STORAGE, storage, 0);
+	recoverResource(storage);
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_LEFT_STORAGE, storage, 0);
+
+	recoverIngredient(ingredient);
+
+}
+
+/**
+ * @brief Initializes the ingredients for a given recipe.
+ *
+ * @param bakerId The ID of the baker the recipe belongs to.
+ * @param recipe The recipe identifier, from 0 to the kitchen's recipe count - 1.
+ * @return The recipe's ingredients as a bitmask, copied from the kitchen's recipe table.
+ *
+ * The function logs events indicating the initialization process. If the recipe identifier is invalid,
+ * the function prints an error message and exits the program.
+ */
+uint32_t initRecipes(int bakerId, int recipe) {
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_INITIALIZING_RECIPE, recipe, 0);
+	if (recipe < 0 || recipe >= kitchen.recipeCount) {
+		perror("Not a valid recipe");
+		exit(1);
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_INITIALIZED_RECIPE, recipe, 0);
+	return kitchen.recipeIngredients[recipe];
+}
+
+/**
+ * @brief Removes an ingredient from the ingredients a recipe still needs.
+ *
+ * @param recipe Pointer to the bitmask of ingredients the recipe still needs.
+ * @param ingredient The ingredient that was gathered.
+ */
+void addIngredient(uint32_t* recipe, int ingredient) {
+	*recipe &= ~(1u << ingredient);
+}
+
+/**
+ * @brief Retrieves an ingredient for a baker and updates the recipe.
+ *
+ * This function handles the process of a baker obtaining an ingredient,
+ * updating the recipe with the ingredient, and then returning the ingredient.
+ * It uses semaphores to manage access to the ingredients. In inventory mode the
+ * baker takes a unit off the ingredient's shelf instead and keeps it. With --stash
+ * the baker first looks in its stash, and keeps the unit it took from storage there
+ * instead of returning it if there is room.
+ *
+ * @param bakerId The ID of the baker retrieving the ingredient.
+ * @param recipe A pointer to the recipe's bitmask of needed ingredients.
+ * @param ingredient The ingredient to be retrieved and added to the recipe.
+ * @return Returns 1 if the ingredient was gathered, or 0 if the baker gave up waiting for it.
+ */
+int getIngredient(int bakerId, uint32_t* recipe, int ingredient) {
+	if (settings.inventory) {
+		if (takeFromShelf(bakerId, ingredient) != ACQUIRE_OK) {
+			return 0;
+		}
+		addIngredient(recipe, ingredient);
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_GOT_INGREDIENT, ingredient, 0);
+		return 1;
+	}
+
+	if (settings.stashSize > 0) {
+		if (takeFromStash(bakerId, 1u << ingredient)) {
+			addIngredient(recipe, ingredient);
+			restashIngredients(bakerId, 1u << ingredient);
+			atomic_fetch_add_explicit(&roundStats.storageVisitsSaved, 1, memory_order_relaxed);
+			return 1;
+		}
+
+		enterStashDemand(1u << ingredient);
+	}
+
+	int status = decSemaphores(bakerId, ingredient);
+
+	if (settings.stashSize > 0) {
+		leaveStashDemand(1u << ingredient);
+	}
+
+	if (status != ACQUIRE_OK) {
+		return 0;
+	}
+	addIngredient(recipe, ingredient);
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_GOT_INGREDIENT, ingredient, 0);
+
+	//sleep(1);
+
+	if (settings.stashSize > 0 && stashIngredients(bakerId, 1u << ingredient)) {
+		int storage = getIngredientStorage(ingredient);
+
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_LEAVING_STORAGE, storage, 0);
+		recoverResource(storage);
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_LEFT_STORAGE, storage, 0);
+		return 1;
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_RETURNING_INGREDIENT, ingredient, 0);
+
+	incIngredientSemaphores(bakerId, ingredient);
+
+	return 1;
+}
+
+/**
+ * @brief Gathers every ingredient a recipe still needs from one storage area in a single visit.
+ *
+ * The baker enters the storage area once, takes all of the needed ingredients it holds
+ * with one atomic operation, leaves, and then returns the whole set in one trip.
+ * In inventory mode it takes what is in stock and keeps it (see gatherFromShelves).
+ * With --stash the baker uses what its stash holds first, skips the visit if that
+ * is everything, and stashes what it takes as far as there is room.
+ *
+ * @param bakerId The ID of the baker gathering the ingredients.
+ * @param recipe A pointer to the recipe's bitmask of needed ingredients.
+ * @param storage The storage resource to visit.
+ * @return Returns 1 if any ingredient was gathered, otherwise 0. With --gather-timeout
+ * the baker gives up on a storage area it cannot enter in time and gathers nothing.
+ */
+int gatherFromStorage(int bakerId, uint32_t* recipe, int storage) {
+	uint32_t wanted = *recipe & kitchen.storageIngredients[storage];
+
+	if (wanted == 0) {
+		return 0;
+	}
+
+	if (settings.inventory) {
+		return gatherFromShelves(bakerId, recipe, storage, wanted);
+	}
+
+	if (settings.stashSize > 0) {
+		uint32_t stashed = takeFromStash(bakerId, wanted);
+
+		*recipe &= ~stashed;
+		restashIngredients(bakerId, stashed);
+		wanted &= ~stashed;
+
+		if (wanted == 0) {
+			atomic_fetch_add_explicit(&roundStats.storageVisitsSaved, 1, memory_order_relaxed);
+			return 1;
+		}
+	}
+
+	int needed[__builtin_popcount(wanted)];
+	int count = 0;
+
+	for (uint32_t rest = wanted; rest != 0; rest &= rest - 1) {
+		needed[count++] = __builtin_ctz(rest);
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERING_STORAGE, storage, 0);
+	if (useGatherResource(storage) != ACQUIRE_OK) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_GAVE_UP_STORAGE, storage, 0);
+		return 0;
+	}
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ENTERED_STORAGE, storage, 0);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_WAITING_FOR_INGREDIENTS, storage, count);
+	if (settings.stashSize > 0) {
+		enterStashDemand(wanted);
+	}
+	useIngredients(needed, count);
+	if (settings.stashSize > 0) {
+		leaveStashDemand(wanted);
+	}
+
+	*recipe &= ~wanted;
+
+	for (int i = 0; i < count; i++) {
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_GOT_INGREDIENT, needed[i], 0);
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_LEAVING_STORAGE, storage, 0);
+	recoverResource(storage);
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_LEFT_STORAGE, storage, 0);
+
+	if (settings.stashSize > 0) {
+		uint32_t kept = stashIngredients(bakerId, wanted);
+
+		count = 0;
+		for (uint32_t rest = wanted & ~kept; rest != 0; rest &= rest - 1) {
+			needed[count++] = __builtin_ctz(rest);
+		}
+
+		if (count == 0) {
+			return 1;
+		}
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_RETURNING_INGREDIENTS, storage, count);
+	recoverIngredients(needed, count);
+
+	return 1;
+}
+
+/**
+ * @brief Retrieves available ingredients for a given baker based on a recipe.
+ *
+ * This function takes the recipe's needed ingredients one at a time, lowest
+ * ingredient first, for the specified baker. It updates the status if any
+ * ingredient is successfully obtained. In batched gather mode the baker makes
+ * one visit to each storage area instead. With --gather-timeout the baker stops
+ * at the first ingredient it gives up on and leaves the rest for a later visit.
+ *
+ * @param bakerId The ID of the baker requesting the ingredients.
+ * @param recipe A pointer to the recipe's bitmask of needed ingredients.
+ * @return An integer indicating if any ingredient was successfully obtained
+ *         (non-zero if successful, zero otherwise).
+ */
+int getAvailableIngredients(int bakerId, uint32_t* recipe) {
+	int updated = 0;
+
+	if (settings.batchedGather) {
+		for (int i = 0; i < kitchen.storageCount; i++) {
+			updated |= gatherFromStorage(bakerId, recipe, kitchen.storages[i]);
+		}
+
+		return updated;
+	}
+
+	while (*recipe != 0) {
+		if (!getIngredient(bakerId, recipe, __builtin_ctz(*recipe))) {
+			break;
+		}
+		updated = 1;
+	}
+
+	return updated;
+}
+
+/**
+ * @brief Acquires the necessary mixing resources for a baker.
+ *
+ * This function acquires every tool of the kitchen (a mixer, a bowl, and a spoon by
+ * default) for the baker identified by the given bakerId as one composite resource:
+ * the baker gets all of the tools at once or waits while holding none of them. It
+ * logs the process of acquiring them.
+ *
+ * @param bakerId The ID of the baker attempting to acquire the resources.
+ * @param tools An array where the acquired resources will be stored.
+ * @param size The size of the tools array. Must be the kitchen's tool count.
+ * @return 0 on success, or an error code on failure.
+ */
+int getMixingResources(int bakerId, int* tools, int size) {
+	if (size != kitchen.toolCount) {
+		perror("Not a valid set of tools");
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ACQUIRING_TOOLS, kitchen.tools[0], size);
+	int status = useResources(kitchen.tools, kitchen.toolCount);
+	for (int i = 0; i < size; i++) {
+		tools[i] = status;
+	}
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_ACQUIRED_TOOLS, kitchen.tools[0], size);
+
+	return status;
+}
+
+/**
+ * @brief Returns the mixing resources used by a baker.
+ *
+ * This function recovers the resources used for mixing, which include:
+ * - Mixer
+ * - Bowl
+ * - Spoon
+ *
+ * @param bakerId The ID of the baker returning the resources.
+ * @return Always returns 0.
+ */
+int returnMixingResources(int bakerId) {
+	recoverResources(kitchen.tools, kitchen.toolCount);
+
+	return 0;
+}
+
+/**
+ * @brief Mixes ingredients using the specified tools.
+ *
+ * This function simulates a baker mixing ingredients together. It first acquires
+ * the necessary mixing resources, then prints messages indicating the mixing process,
+ * and finally releases the mixing resources.
+ *
+ * @param bakerId The ID of the baker performing the mixing.
+ * @param tools An array of integers representing the tools required for mixing.
+ * @param size The number of tools in the tools array.
+ * @param recipe The ID of the recipe being mixed.
+ * @return Always returns 0.
+ */
+int mixIngredients(int bakerId, int* tools, int size, int recipe) {
+	getMixingResources(bakerId, tools, size);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_MIXING, kitchen.tools[0], 0);
+
+	simulateOperation(OPERATION_MIX, recipe);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_MIXED, kitchen.tools[0], 0);
+
+	returnMixingResources(bakerId);
+
+	return 0;
+}
+
+/**
+ * @brief A set of recipes that go through one oven cycle together.
+ *
+ * @var OvenBatch::loaded
+ * The number of recipes on the racks.
+ *
+ * @var OvenBatch::references
+ * The number of bakers that still have to leave the batch; the last one frees it.
+ *
+ * @var OvenBatch::done
+ * Signaled by the baker that opened the batch when it comes out of the oven.
+ */
+typedef struct {
+	int loaded;
+	int references;
+	Completion done;
+} OvenBatch;
+
+/**
+ * @struct ovenStruct
+ * @brief The oven batches that are still accepting recipes.
+ *
+ * @var ovenStruct::joinable
+ * For each bake-time class, the open batch that has a free rack, or NULL.
+ */
+struct ovenStruct {
+	pthread_mutex_t lock;
+	OvenBatch* joinable[KITCHEN_MAX_RECIPES];
+};
+
+struct ovenStruct oven = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Returns the bake-time class of a recipe.
+ *
+ * Recipes share an oven cycle only if their bake times are the same. The class is
+ * the first recipe with the same configured bake time.
+ *
+ * @param recipe The ID of the recipe.
+ * @return The class of the recipe, between 0 and recipe.
+ */
+int getBakeClass(int recipe) {
+	for (int i = 0; i < recipe; i++) {
+		if (getDuration(OPERATION_BAKE, i) == getDuration(OPERATION_BAKE, recipe)) {
+			return i;
+		}
+	}
+
+	return recipe;
+}
+
+/**
+ * @brief Leaves an oven batch, freeing it if the caller was the last baker in it.
+ *
+ * @param batch The batch to leave.
+ */
+void leaveOvenBatch(OvenBatch* batch) {
+	pthread_mutex_lock(&oven.lock);
+	int last = --batch->references == 0;
+	pthread_mutex_unlock(&oven.lock);
+
+	if (last) {
+		destroyCompletion(&batch->done);
+		free(batch);
+	}
+}
+
+/**
+ * @brief Cooks a recipe in a shared oven batch.
+ *
+ * If a batch of the same bake-time class has a free rack the baker puts its recipe
+ * in and waits for the batch to finish. Otherwise it opens a batch, waits for the
+ * oven, keeps the door open for the batch window unless every rack is already
+ * taken, and bakes everything that was loaded in one cycle.
+ *
+ * @param bakerId The ID of the baker who is cooking the recipe.
+ * @param recipe The ID of the recipe to be cooked.
+ * @return Always returns 0.
+ */
+int cookInBatch(int bakerId, int recipe) {
+	int bakeClass = getBakeClass(recipe);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_WAITING_FOR_OVEN, recipe, 0);
+
+	pthread_mutex_lock(&oven.lock);
+
+	OvenBatch* batch = oven.joinable[bakeClass];
+	if (batch != NULL) {
+		int rack = ++batch->loaded;
+		batch->references++;
+		if (batch->loaded == settings.ovenRacks) {
+			oven.joinable[bakeClass] = NULL;
+		}
+		pthread_mutex_unlock(&oven.lock);
+
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_JOINED_OVEN_BATCH, recipe, rack);
+
+		waitForCompletion(&batch->done);
+
+		LOG_EVENT(LOG_ALL, bakerId, EVENT_FINISHED_OVEN, recipe, 0);
+
+		leaveOvenBatch(batch);
+		return 0;
+	}
+
+	batch = malloc(sizeof(OvenBatch));
+	if (batch == NULL) {
+		perror("Failed to allocate memory for an oven batch");
+		exit(1);
+	}
+
+	batch->loaded = 1;
+	batch->references = 1;
+	initCompletion(&batch->done);
+	oven.joinable[bakeClass] = batch;
+
+	pthread_mutex_unlock(&oven.lock);
+
+	useResource(kitchen.oven);
+
+	pthread_mutex_lock(&oven.lock);
+	int full = batch->loaded == settings.ovenRacks;
+	pthread_mutex_unlock(&oven.lock);
+
+	if (!full) {
+		simulateDuration(settings.batchWindow);
+	}
+
+	pthread_mutex_lock(&oven.lock);
+	if (oven.joinable[bakeClass] == batch) {
+		oven.joinable[bakeClass] = NULL;
+	}
+	int loaded = batch->loaded;
+	pthread_mutex_unlock(&oven.lock);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_USING_OVEN, recipe, loaded);
+
+	simulateOperation(OPERATION_BAKE, recipe);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_FINISHED_OVEN, recipe, 0);
+
+	recoverResource(kitchen.oven);
+
+	atomic_fetch_add(&roundStats.ovenCycles, 1);
+	atomic_fetch_add(&roundStats.ovenLoads, loaded);
+
+	signalCompletion(&batch->done);
+	leaveOvenBatch(batch);
+
+	return 0;
+}
+
+/**
+ * @brief Cooks a recipe using the oven.
+ *
+ * This function simulates a baker using the oven to cook a specified recipe.
+ * It prints messages to indicate the stages of the cooking process, including
+ * looking to use the oven, using the oven, and finishing using the oven.
+ * The function also simulates the time taken to cook the recipe: the bake
+ * operation's duration for that recipe, 3 simulated seconds by default.
+ * With more than one oven rack the recipe is cooked in a batch instead.
+ *
+ * @param bakerId The ID of the baker who is cooking the recipe.
+ * @param recipe The ID of the recipe to be cooked.
+ * @return Always returns 0.
+ */
+int cookRecipe(int bakerId, int recipe) {
+	if (settings.ovenRacks > 1) {
+		return cookInBatch(bakerId, recipe);
+	}
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_WAITING_FOR_OVEN, recipe, 0);
+
+	useResource(kitchen.oven);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_USING_OVEN, recipe, 0);
+
+	simulateOperation(OPERATION_BAKE, recipe);
+
+	LOG_EVENT(LOG_ALL, bakerId, EVENT_FINISHED_OVEN, recipe, 0);
+
+	recoverResource(kitchen.oven);
+
+	return 0;
+}
+
+/**
+ * @brief Returns the resources a baker takes to gather a set of ingredients: the
+ * ingredients themselves and the storage areas or shelves that hold them.
+ *
+ * @param ingredients A bitmask of ingredients.
+ * @return A bitmask of resources.
+ */
+uint32_t getGatherResources(uint32_t ingredients) {
+	uint32_t resources = ingredients << semOffset;
+
+	for (int i = 0; i < kitchen.storageCount; i++) {
+		if (ingredients & kitchen.storageIngredients[kitchen.storages[i]]) {
+			resources |= 1u << kitchen.storages[i];
+		}
+	}
+
+	return resources;
+}
+
+/**
+ * @brief Probes resources through the synchronization backend without taking them.
+ *
+ * In inventory mode an ingredient is busy when its shelf is empty.
+ *
+ * @param resources A bitmask of the resources to probe.
+ * @return A bitmask of the probed resources that have no free unit.
+ */
+uint32_t probeBusyResources(uint32_t resources) {
+	uint32_t busy = 0;
+
+	for (uint32_t rest = resources; rest != 0; rest &= rest - 1) {
+		int resource = __builtin_ctz(rest);
+		int available = settings.inventory && resource >= semOffset
+			? atomic_load_explicit(&inventory.shelves[resource - semOffset].stock, memory_order_relaxed)
+			: settings.backend->probe(resource);
+
+		if (available <= 0) {
+			busy |= 1u << resource;
+		}
+	}
+
+	return busy;
+}
+
+/**
+ * @brief Picks the recipe a baker works on next, following the selected recipe policy.
+ *
+ * Round-robin takes the first unfinished recipe from next on. The available policy
+ * probes every resource the unfinished recipes still need to gather, once each, and
+ * takes the recipe with the fewest busy ones, preferring round-robin order on ties.
+ * After RECIPE_SKIP_LIMIT picks in a row that were not the round-robin choice, the
+ * round-robin choice is taken regardless.
+ *
+ * @param remaining A bitmask of the baker's unfinished recipes, not 0.
+ * @param recipes The ingredients each recipe still needs, indexed by recipe.
+ * @param next The recipe after the one the baker worked on last.
+ * @param passedOver The number of picks in a row that were not the round-robin choice.
+ * @param findBusy Returns which of the given resources have no free unit.
+ * @return The recipe to work on.
+ */
+int chooseRecipe(uint32_t remaining, const uint32_t recipes[], int next, uint8_t* passedOver, uint32_t (*findBusy)(uint32_t)) {
+	uint32_t fromNext = remaining & ~((1u << next) - 1);
+	int inOrder = __builtin_ctz(fromNext != 0 ? fromNext : remaining);
+
+	if (settings.recipePolicy == RECIPE_POLICY_ROUND_ROBIN || *passedOver >= RECIPE_SKIP_LIMIT || (remaining & (remaining - 1)) == 0) {
+		*passedOver = 0;
+		return inOrder;
+	}
+
+	uint32_t needed = 0;
+	for (uint32_t rest = remaining; rest != 0; rest &= rest - 1) {
+		needed |= recipes[__builtin_ctz(rest)];
+	}
+
+	uint32_t busy = findBusy(getGatherResources(needed));
+	int best = inOrder;
+	int bestBlockers = __builtin_popcount(getGatherResources(recipes[inOrder]) & busy);
+
+	for (int step = 1; step < kitchen.recipeCount && bestBlockers > 0; step++) {
+		int recipe = (inOrder + step) % kitchen.recipeCount;
+
+		if (!(remaining & (1u << recipe))) {
+			continue;
+		}
+
+		int blockers = __builtin_popcount(getGatherResources(recipes[recipe]) & busy);
+		if (blockers < bestBlockers) {
+			best = recipe;
+			bestBlockers = blockers;
+		}
+	}
+
+	*passedOver = best == inOrder ? 0 : *passedOver + 1;
+	return best;
+}
+
+/**
+ * @brief The number of spans each lane of a baker's timeline holds; later spans are dropped.
+ */
+#define TIMELINE_SPANS 512
+
+/**
+ * @brief The number of columns a timeline is printed in.
+ */
+#define TIMELINE_WIDTH 72
+
+/**
+ * @brief What a timeline span shows.
+ */
+enum timelineActivity {
+	TIMELINE_GATHERING,
+	TIMELINE_MIXING,
+	TIMELINE_BAKING,
+	TIMELINE_COLLECTING,
+	TIMELINE_PREFETCHING,
+	TIMELINE_ACTIVITY_COUNT
+};
+
+/**
+ * The character each activity is drawn with, indexed by timelineActivity.
+ */
+const char timelineSymbols[TIMELINE_ACTIVITY_COUNT] = { 'g', 'm', 'B', 'w', 'p' };
+
+/**
+ * @brief The lanes of a baker's timeline: what the baker does, and what is prefetched for it.
+ */
+enum timelineLane {
+	TIMELINE_BAKER,
+	TIMELINE_PREFETCH,
+	TIMELINE_LANE_COUNT
+};
+
+/**
+ * @brief A span of wall time a baker spent on one activity.
+ *
+ * @var TimelineSpan::start
+ * When the span started, in nanoseconds since the round started.
+ *
+ * @var TimelineSpan::end
+ * When the span ended, in nanoseconds since the round started.
+ */
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+	int activity;
+} TimelineSpan;
+
+/**
+ * @brief The recorded spans of one baker. Each lane has a single writer: the baker, or
+ * the prefetcher serving it.
+ */
+typedef struct {
+	int count[TIMELINE_LANE_COUNT];
+	TimelineSpan spans[TIMELINE_LANE_COUNT][TIMELINE_SPANS];
+} BakerTimeline;
+
+/**
+ * @struct timelineStruct
+ * @brief The timelines of the bakers shown with --timeline.
+ *
+ * @var timelineStruct::bakers
+ * The timeline of each shown baker, indexed by baker ID.
+ *
+ * @var timelineStruct::count
+ * The number of bakers shown in the current round.
+ */
+struct timelineStruct {
+	BakerTimeline* bakers;
+	int count;
+};
+
+struct timelineStruct timeline;
+
+/**
+ * @brief Tells whether a baker's activities are recorded for the timeline.
+ *
+ * @param bakerId The ID of the baker.
+ * @return Returns 1 if they are, otherwise 0.
+ */
+static inline int isOnTimeline(int bakerId) {
+	return bakerId < timeline.count;
+}
+
+/**
+ * @brief Records a span that ends now on a baker's timeline.
+ *
+ * @param bakerId The ID of the baker.
+ * @param lane One of the timelineLane values.
+ * @param activity One of the timelineActivity values.
+ * @param start CLOCK_MONOTONIC time at which the span started, in nanoseconds.
+ */
+void recordTimeline(int bakerId, int lane, int activity, uint64_t start) {
+	BakerTimeline* baker = &timeline.bakers[bakerId];
+
+	if (baker->count[lane] == TIMELINE_SPANS) {
+		return;
+	}
+
+	TimelineSpan* span = &baker->spans[lane][baker->count[lane]++];
+	span->start = start - roundStats.roundStart;
+	span->end = monotonicNanoseconds() - roundStats.roundStart;
+	span->activity = activity;
+}
+
+/**
+ * @brief Clears the timelines for a new round.
+ *
+ * Exits the program if memory runs out.
+ *
+ * @param bakers The number of bakers in the round.
+ */
+void startTimelineRound(int bakers) {
+	int shown = bakers < settings.timeline ? bakers : settings.timeline;
+
+	if (timeline.bakers == NULL) {
+		timeline.bakers = malloc(settings.timeline * sizeof(BakerTimeline));
+
+		if (timeline.bakers == NULL) {
+			perror("Failed to allocate memory for the timeline");
+			exit(1);
+		}
+	}
+
+	for (int i = 0; i < shown; i++) {
+		memset(timeline.bakers[i].count, 0, sizeof(timeline.bakers[i].count));
+	}
+
+	timeline.count = shown;
+}
+
+/**
+ * @brief Draws one lane of a baker's timeline, each span over the columns it covers.
+ *
+ * @param baker The baker's timeline.
+ * @param lane One of the timelineLane values.
+ * @param nanosecondsPerColumn The wall time one column stands for.
+ */
+void printTimelineLane(const BakerTimeline* baker, int lane, double nanosecondsPerColumn) {
+	char columns[TIMELINE_WIDTH + 1];
+
+	memset(columns, '.', TIMELINE_WIDTH);
+	columns[TIMELINE_WIDTH] = '\0';
+
+	for (int i = 0; i < baker->count[lane]; i++) {
+		const TimelineSpan* span = &baker->spans[lane][i];
+		int first = (int)(span->start / nanosecondsPerColumn);
+		int last = (int)(span->end / nanosecondsPerColumn);
+
+		for (int column = first; column <= last && column < TIMELINE_WIDTH; column++) {
+			columns[column] = timelineSymbols[span->activity];
+		}
+	}
+
+	printf("|%s|\n", columns);
+}
+
+/**
+ * @brief Prints the timelines of the shown bakers over the whole round.
+ *
+ * @param wallSeconds The wall time the round took.
+ */
+void printTimeline(double wallSeconds) {
+	double nanosecondsPerColumn = wallSeconds * 1e9 / TIMELINE_WIDTH;
+
+	printf("  Timeline, one column per %.3g simulated s (g gathering, m mixing, B baking, w waiting for prefetched ingredients,\n",
+		nanosecondsPerColumn / 1e9 * settings.dilation);
+	printf("  p prefetching for the baker):\n");
+
+	for (int i = 0; i < timeline.count; i++) {
+		printf("  Baker %-8d ", i);
+		printTimelineLane(&timeline.bakers[i], TIMELINE_BAKER, nanosecondsPerColumn);
+
+		if (settings.prefetchers > 0) {
+			printf("  %-15s", "  prefetched");
+			printTimelineLane(&timeline.bakers[i], TIMELINE_PREFETCH, nanosecondsPerColumn);
+		}
+	}
+}
+
+/**
+ * @brief Where a baker's prefetch request is.
+ */
+enum prefetchState {
+	PREFETCH_IDLE,
+	PREFETCH_QUEUED,
+	PREFETCH_RUNNING
+};
+
+/**
+ * @brief The ingredients a baker asks a prefetcher to gather for its next recipe.
+ *
+ * @var PrefetchRequest::state
+ * One of the prefetchState values. Protected by prefetch.lock.
+ *
+ * @var PrefetchRequest::needed
+ * The ingredients the recipe still needs.
+ *
+ * @var PrefetchRequest::gathered
+ * The ingredients the prefetcher gathered, set before done is signaled.
+ *
+ * @var PrefetchRequest::started
+ * CLOCK_MONOTONIC time at which a prefetcher took the request up, in nanoseconds.
+ *
+ * @var PrefetchRequest::finished
+ * CLOCK_MONOTONIC time at which the prefetcher was done with it, in nanoseconds.
+ */
+typedef struct PrefetchRequest {
+	struct PrefetchRequest* previous;
+	struct PrefetchRequest* next;
+	int bakerId;
+	int state;
+	uint32_t needed;
+	uint32_t gathered;
+	uint64_t started;
+	uint64_t finished;
+	Completion done;
+} PrefetchRequest;
+
+/**
+ * @struct prefetchStruct
+ * @brief The prefetcher threads enabled with --prefetch, and the requests waiting for them.
+ *
+ * When a baker takes a recipe to the oven, it queues a request for the ingredients of its
+ * next recipe. A prefetcher takes the request up and gathers them on the baker's behalf,
+ * through the same storage areas and semaphores, while the baker waits for the oven and
+ * bakes. Back from the oven, the baker collects what was gathered. If no prefetcher has
+ * taken the request up by then, the baker takes it back and gathers the ingredients itself.
+ *
+ * @var prefetchStruct::requests
+ * The request of each baker, indexed by baker ID. Reallocated between rounds only.
+ *
+ * @var prefetchStruct::head
+ * The oldest queued request. Protected by lock, as are tail and every request's links.
+ *
+ * @var prefetchStruct::posted
+ * Signaled when a request is queued.
+ */
+struct prefetchStruct {
+	PrefetchRequest* requests;
+	int capacity;
+	pthread_mutex_t lock;
+	pthread_cond_t posted;
+	PrefetchRequest* head;
+	PrefetchRequest* tail;
+};
+
+struct prefetchStruct prefetch = { .lock = PTHREAD_MUTEX_INITIALIZER, .posted = PTHREAD_COND_INITIALIZER };
+
+/**
+ * @brief A prefetcher thread: gathers queued ingredients on behalf of the bakers that asked for them.
+ *
+ * While it serves a request, the thread acts as the baker that made it, so events and
+ * the stash are the baker's. Its service times come from a stream of its own.
+ *
+ * @param val The prefetcher's index, cast to a pointer.
+ * @return Never returns.
+ */
+void* runPrefetcher(void* val) {
+	seedServiceTimes(-2 - (int)(intptr_t)val);
+
+	while (1) {
+		pthread_mutex_lock(&prefetch.lock);
+		while (prefetch.head == NULL) {
+			pthread_cond_wait(&prefetch.posted, &prefetch.lock);
+		}
+
+		PrefetchRequest* request = prefetch.head;
+		prefetch.head = request->next;
+		if (prefetch.head != NULL) {
+			prefetch.head->previous = NULL;
+		}
+		else {
+			prefetch.tail = NULL;
+		}
+		request->state = PREFETCH_RUNNING;
+		pthread_mutex_unlock(&prefetch.lock);
+
+		int bakerId = request->bakerId;
+		uint32_t remaining = request->needed;
+
+		threadBakerId = bakerId;
+		request->started = monotonicNanoseconds();
+		getAvailableIngredients(bakerId, &remaining);
+		request->gathered = request->needed & ~remaining;
+		request->finished = monotonicNanoseconds();
+
+		if (isOnTimeline(bakerId)) {
+			recordTimeline(bakerId, TIMELINE_PREFETCH, TIMELINE_PREFETCHING, request->started);
+		}
+
+		signalCompletion(&request->done);
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Starts the prefetcher threads. Exits the program if one cannot be created.
+ *
+ * @param threads The number of prefetchers.
+ */
+void initPrefetchers(int threads) {
+	for (int i = 0; i < threads; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, runPrefetcher, (void*)(intptr_t)i) != 0) {
+			perror("Failed to create a prefetcher thread");
+			exit(1);
+		}
+
+		pthread_detach(thread);
+	}
+}
+
+/**
+ * @brief Makes room for the requests of a new round's bakers.
+ *
+ * Exits the program if memory runs out.
+ *
+ * @param bakers The number of bakers in the round.
+ */
+void startPrefetchRound(int bakers) {
+	if (bakers <= prefetch.capacity) {
+		return;
+	}
+
+	free(prefetch.requests);
+	prefetch.requests = calloc(bakers, sizeof(PrefetchRequest));
+
+	if (prefetch.requests == NULL) {
+		perror("Failed to allocate memory for the prefetch requests");
+		exit(1);
+	}
+
+	prefetch.capacity = bakers;
+}
+
+/**
+ * @brief Returns the recipe a baker visits after the current one, going round-robin.
+ *
+ * @param recipes The ingredients each recipe still needs, indexed by recipe.
+ * @param remaining A bitmask of the recipes the baker has not finished.
+ * @param current The recipe the baker is working on.
+ * @return The next unfinished recipe that still needs ingredients, or -1 if there is none.
+ */
+int nextRecipeToPrefetch(const uint32_t recipes[], uint32_t remaining, int current) {
+	for (int step = 1; step <= kitchen.recipeCount; step++) {
+		int recipe = (current + step) % kitchen.recipeCount;
+
+		if ((remaining & (1u << recipe)) && recipes[recipe] != 0 && recipe != current) {
+			return recipe;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * @brief Queues a request for a prefetcher to gather ingredients for the baker.
+ *
+ * @param bakerId The ID of the baker.
+ * @param needed The ingredients to gather.
+ */
+void postPrefetch(int bakerId, uint32_t needed) {
+	PrefetchRequest* request = &prefetch.requests[bakerId];
+
+	request->bakerId = bakerId;
+	request->needed = needed;
+	request->gathered = 0;
+	initCompletion(&request->done);
+
+	pthread_mutex_lock(&prefetch.lock);
+	request->state = PREFETCH_QUEUED;
+	request->next = NULL;
+	request->previous = prefetch.tail;
+	if (prefetch.tail != NULL) {
+		prefetch.tail->next = request;
+	}
+	else {
+		prefetch.head = request;
+	}
+	prefetch.tail = request;
+	pthread_cond_signal(&prefetch.posted);
+	pthread_mutex_unlock(&prefetch.lock);
+
+	atomic_fetch_add_explicit(&roundStats.prefetchRequests, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Collects what a prefetcher gathered for the baker, waiting for it to finish if it is still at it.
+ *
+ * A request no prefetcher has taken up yet is taken back instead, and the baker gathers
+ * the ingredients itself when it gets to the recipe.
+ *
+ * @param bakerId The ID of the baker.
+ * @param recipe A pointer to the bitmask of ingredients the prefetched recipe still needs.
+ */
+void collectPrefetch(int bakerId, uint32_t* recipe) {
+	PrefetchRequest* request = &prefetch.requests[bakerId];
+
+	pthread_mutex_lock(&prefetch.lock);
+	int state = request->state;
+	if (state == PREFETCH_QUEUED) {
+		if (request->previous != NULL) {
+			request->previous->next = request->next;
+		}
+		else {
+			prefetch.head = request->next;
+		}
+		if (request->next != NULL) {
+			request->next->previous = request->previous;
+		}
+		else {
+			prefetch.tail = request->previous;
+		}
+	}
+	request->state = PREFETCH_IDLE;
+	pthread_mutex_unlock(&prefetch.lock);
+
+	if (state == PREFETCH_QUEUED) {
+		atomic_fetch_add_explicit(&roundStats.prefetchTakenBack, 1, memory_order_relaxed);
+		destroyCompletion(&request->done);
+		return;
+	}
+
+	uint64_t waitStarted = monotonicNanoseconds();
+	waitForCompletion(&request->done);
+	uint64_t waited = monotonicNanoseconds() - waitStarted;
+
+	if (isOnTimeline(bakerId)) {
+		recordTimeline(bakerId, TIMELINE_BAKER, TIMELINE_COLLECTING, waitStarted);
+	}
+
+	destroyCompletion(&request->done);
+	*recipe &= ~request->gathered;
+
+	uint64_t busy = request->finished - request->started;
+
+	atomic_fetch_add_explicit(&roundStats.prefetchedIngredients, __builtin_popcount(request->gathered), memory_order_relaxed);
+	atomic_fetch_add_explicit(&roundStats.prefetchHiddenNanoseconds, busy > waited ? busy - waited : 0, memory_order_relaxed);
+	atomic_fetch_add_explicit(&roundStats.prefetchExposedNanoseconds, waited, memory_order_relaxed);
+}
+
+/**
+ * @brief The number of orders the order queue holds unless --order-queue says otherwise.
+ */
+#define ORDER_QUEUE_SIZE 256
+
+/**
+ * @brief The longest line an order source may send.
+ */
+#define ORDER_LINE_SIZE 256
+
+/**
+ * @brief An order waiting in the order queue.
+ *
+ * @var Order::recipe
+ * The recipe ordered.
+ *
+ * @var Order::priority
+ * The priority class of the order, from 0 (the most urgent) to ORDER_PRIORITIES - 1.
+ *
+ * @var Order::arrival
+ * CLOCK_MONOTONIC time at which the order arrived, in nanoseconds.
+ *
+ * @var Order::deadline
+ * CLOCK_MONOTONIC time by which the order is due, in nanoseconds, or 0 for no deadline.
+ */
+typedef struct {
+	int recipe;
+	int priority;
+	uint64_t arrival;
+	uint64_t deadline;
+} Order;
+
+/**
+ * @brief A slot of the order queue, used like a RestockCell.
+ */
+typedef struct {
+	atomic_size_t sequence;
+	Order order;
+} OrderCell;
+
+/**
+ * @struct orderStruct
+ * @brief The order queue of order-stream mode, the threads that feed it, and the order latencies.
+ *
+ * The queue is a bounded lock-free multi-producer multi-consumer ring like the restock
+ * queue. Readers push the orders of the source as they arrive and drop (shed) an order
+ * when the queue is full; bakers pop them. The stream closes once every reader has
+ * reached the end of its input.
+ *
+ * @var orderStruct::size
+ * The number of slots, a power of two.
+ *
+ * @var orderStruct::posted
+ * Incremented for every order pushed and when the stream closes; idle baker threads sleep on it.
+ *
+ * @var orderStruct::idle
+ * The number of baker threads asleep on posted.
+ *
+ * @var orderStruct::producers
+ * The readers still running, counting the thread that accepts connections on a socket.
+ *
+ * @var orderStruct::closed
+ * Set once the last reader is done; bakers leave when it is set and the queue is empty.
+ *
+ * @var orderStruct::listener
+ * The listening socket of a unix: source, or -1.
+ *
+ * @var orderStruct::queueing
+ * The wall nanoseconds orders waited in the queue. Protected by lock.
+ *
+ * @var orderStruct::endToEnd
+ * The wall nanoseconds from the arrival of an order to its recipe coming out of the oven, indexed by
+ * priority class. Protected by lock.
+ *
+ * @var orderStruct::firstArrival
+ * CLOCK_MONOTONIC time of the round's first order that was not shed, or 0. Protected by lock.
+ *
+ * @var orderStruct::lastCompletion
+ * CLOCK_MONOTONIC time at which the round's last order was completed, or 0. Protected by lock.
+ */
+struct orderStruct {
+	OrderCell* cells;
+	size_t size;
+	_Alignas(64) atomic_size_t enqueuePosition;
+	_Alignas(64) atomic_size_t dequeuePosition;
+	_Alignas(64) atomic_int posted;
+	atomic_int idle;
+	atomic_int producers;
+	atomic_int closed;
+	int listener;
+	pthread_mutex_t lock;
+	LatencyHistogram* queueing;
+	LatencyHistogram* endToEnd[ORDER_PRIORITIES];
+	uint64_t firstArrival;
+	uint64_t lastCompletion;
+};
+
+struct orderStruct orders = { .listener = -1, .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/**
+ * @brief Appends an order to the order queue without blocking.
+ *
+ * @param order The order.
+ * @return Returns 1 if the order was queued, or 0 if the queue is full.
+ */
+int pushOrder(const Order* order) {
+	size_t position = atomic_load_explicit(&orders.enqueuePosition, memory_order_relaxed);
+	OrderCell* cell;
+
+	while (1) {
+		cell = &orders.cells[position & (orders.size - 1)];
+		size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&orders.enqueuePosition, &position, position + 1,
+				memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			return 0;
+		}
+		else {
+			position = atomic_load_explicit(&orders.enqueuePosition, memory_order_relaxed);
+		}
+	}
+
+	cell->order = *order;
+	atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+	return 1;
+}
+
+/**
+ * @brief Removes the oldest order from the order queue without blocking.
+ *
+ * @param order Receives the order.
+ * @return Returns 1 if an order was removed, or 0 if the queue is empty.
+ */
+int popOrder(Order* order) {
+	size_t position = atomic_load_explicit(&orders.dequeuePosition, memory_order_relaxed);
+	OrderCell* cell;
+
+	while (1) {
+		cell = &orders.cells[position & (orders.size - 1)];
+		size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+		intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+		if (difference == 0) {
+			if (atomic_compare_exchange_weak_explicit(&orders.dequeuePosition, &position, position + 1,
+				memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (difference < 0) {
+			return 0;
+		}
+		else {
+			position = atomic_load_explicit(&orders.dequeuePosition, memory_order_relaxed);
+		}
+	}
+
+	*order = cell->order;
+	atomic_store_explicit(&cell->sequence, position + orders.size, memory_order_release);
+	return 1;
+}
+
+/**
+ * @brief Tells the bakers that an order was pushed or that the stream closed.
+ *
+ * @param count The most baker threads asleep on the queue to wake.
+ */
+void wakeOrderWaiters(int count) {
+	atomic_fetch_add_explicit(&orders.posted, 1, memory_order_release);
+
+	if (atomic_load(&orders.idle) > 0) {
+		syscall(SYS_futex, &orders.posted, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+	}
+}
+
+/**
+ * @brief Parses one line of an order source.
+ *
+ * A line holds a recipe, by name (singular or plural) or index, optionally preceded by
+ * the simulated seconds after the start of the round at which the order arrives, and
+ * optionally followed by deadline=SECONDS, simulated seconds after its arrival, and
+ * priority=CLASS. Blank lines and # comments hold no order.
+ *
+ * @param line The line, which is modified in place.
+ * @param order Receives the recipe and the priority class of the order.
+ * @param offset Receives the arrival offset in simulated seconds, or a negative value if the order arrives now.
+ * @param deadline Receives the deadline in simulated seconds, or --order-deadline if the line gives none.
+ * @return Returns 1 for an order, 0 for a line without one, or -1 if the line is not valid.
+ */
+int parseOrder(char* line, Order* order, double* offset, double* deadline) {
+	char* words[4];
+	char* positional[2];
+	int positionalCount = 0;
+	int count = splitKitchenLine(line, words, 4);
+
+	if (count <= 0) {
+		return count;
+	}
+
+	char* end;
+	*offset = -1;
+	*deadline = settings.orderDeadline;
+	order->priority = ORDER_PRIORITIES - 1;
+
+	for (int i = 0; i < count; i++) {
+		if (strncasecmp(words[i], "deadline=", strlen("deadline=")) == 0) {
+			*deadline = strtod(words[i] + strlen("deadline="), &end);
+			if (*end != '\0' || *deadline <= 0) {
+				return -1;
+			}
+		}
+		else if (strncasecmp(words[i], "priority=", strlen("priority=")) == 0) {
+			order->priority = strtol(words[i] + strlen("priority="), &end, 10);
+			if (*end != '\0' || order->priority < 0 || order->priority >= ORDER_PRIORITIES) {
+				return -1;
+			}
+		}
+		else if (positionalCount < 2) {
+			positional[positionalCount++] = words[i];
+		}
+		else {
+			return -1;
+		}
+	}
+
+	if (positionalCount == 0) {
+		return -1;
+	}
+
+	if (positionalCount == 2) {
+		*offset = strtod(positional[0], &end);
+		if (*end != '\0' || *offset < 0) {
+			return -1;
+		}
+	}
+
+	const char* name = positional[positionalCount - 1];
+
+	for (int i = 0; i < kitchen.recipeCount; i++) {
+		if (strcasecmp(getRecipeName(i), name) == 0 || strcasecmp(getRecipePluralName(i), name) == 0) {
+			order->recipe = i;
+			return 1;
+		}
+	}
+
+	order->recipe = strtol(name, &end, 10);
+	return *end == '\0' && order->recipe >= 0 && order->recipe < kitchen.recipeCount ? 1 : -1;
+}
+
+/**
+ * @brief Ends one reader of the order stream, closing the stream after the last one.
+ */
+void leaveOrderStream() {
+	if (atomic_fetch_sub(&orders.producers, 1) == 1) {
+		atomic_store(&orders.closed, 1);
+		wakeOrderWaiters(INT32_MAX);
+	}
+}
+
+/**
+ * @brief Reads orders from a source until its end and queues them as they arrive.
+ *
+ * An order with an arrival offset is held back until then. Lines that are not valid
+ * are reported on stderr and skipped, so a bad client does not stop the kitchen. On a
+ * socket connection, a line reading end stops accepting new connections.
+ *
+ * @param in The source.
+ * @param name The name of the source, for error messages.
+ * @param isConnection Set when the source is a socket connection.
+ */
+void readOrders(FILE* in, const char* name, int isConnection) {
+	char line[ORDER_LINE_SIZE];
+	int lineNumber = 0;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		Order order;
+		double offset;
+		double deadline;
+
+		lineNumber++;
+
+		if (isConnection && strcmp(line, "end\n") == 0) {
+			shutdown(orders.listener, SHUT_RDWR);
+			continue;
+		}
+
+		int parsed = parseOrder(line, &order, &offset, &deadline);
+
+		if (parsed < 0) {
+			fprintf(stderr, "%s:%d: Not a valid order\n", name, lineNumber);
+			continue;
+		}
+
+		if (parsed == 0) {
+			continue;
+		}
+
+		if (offset >= 0) {
+			uint64_t due = roundStats.roundStart + (uint64_t)(offset / settings.dilation * 1e9);
+			struct timespec until = { (time_t)(due / 1000000000ULL), (long)(due % 1000000000ULL) };
+
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+			}
+		}
+
+		order.arrival = monotonicNanoseconds();
+		order.deadline = deadline > 0 ? order.arrival + (uint64_t)(deadline / settings.dilation * 1e9) : 0;
+
+		atomic_fetch_add_explicit(&roundStats.ordersReceived, 1, memory_order_relaxed);
+
+		if (!pushOrder(&order)) {
+			atomic_fetch_add_explicit(&roundStats.ordersShed, 1, memory_order_relaxed);
+			continue;
+		}
+
+		pthread_mutex_lock(&orders.lock);
+		if (orders.firstArrival == 0) {
+			orders.firstArrival = order.arrival;
+		}
+		pthread_mutex_unlock(&orders.lock);
+
+		wakeOrderWaiters(1);
+	}
+}
+
+/**
+ * @brief The body of a thread that reads the orders of one socket connection.
+ *
+ * @param val The connection's file descriptor, cast to a pointer.
+ * @return A void pointer, always returns NULL.
+ */
+void* runConnectionReader(void* val) {
+	FILE* in = fdopen((int)(intptr_t)val, "r");
+
+	if (in == NULL) {
+		perror("Failed to read an order connection");
+		close((int)(intptr_t)val);
+	}
+	else {
+		readOrders(in, settings.ordersSource, 1);
+		fclose(in);
+	}
+
+	leaveOrderStream();
+	return NULL;
+}
+
+/**
+ * @brief The body of the thread that feeds the order queue.
+ *
+ * Reads a file or stdin itself. For a unix: source it accepts connections and starts a
+ * reader for each, until a client sends end.
+ *
+ * @param val Unused.
+ * @return A void pointer, always returns NULL.
+ */
+void* runOrderReader(void* val) {
+	(void)val;
+
+	if (orders.listener < 0) {
+		FILE* in = strcmp(settings.ordersSource, "-") == 0 ? stdin : fopen(settings.ordersSource, "r");
+
+		if (in == NULL) {
+			perror(settings.ordersSource);
+			exit(1);
+		}
+
+		readOrders(in, strcmp(settings.ordersSource, "-") == 0 ? "stdin" : settings.ordersSource, 0);
+
+		if (in != stdin) {
+			fclose(in);
+		}
+
+		leaveOrderStream();
+		return NULL;
+	}
+
+	int connection;
+
+	while ((connection = accept(orders.listener, NULL, NULL)) >= 0) {
+		pthread_t thread;
+
+		atomic_fetch_add(&orders.producers, 1);
+		if (pthread_create(&thread, NULL, runConnectionReader, (void*)(intptr_t)connection) != 0) {
+			perror("Failed to create an order reader thread");
+			exit(1);
+		}
+
+		pthread_detach(thread);
+	}
+
+	close(orders.listener);
+	unlink(settings.ordersSource + strlen("unix:"));
+	orders.listener = -1;
+
+	leaveOrderStream();
+	return NULL;
+}
+
+/**
+ * @brief Opens the order source and allocates the order queue.
+ *
+ * A unix: source is bound and listened on here, so that clients can connect as soon as
+ * the program has started. Exits the program on failure.
+ */
+void initOrders() {
+	orders.size = settings.orderQueueSize;
+	orders.cells = malloc(orders.size * sizeof(OrderCell));
+
+	if (orders.cells == NULL) {
+		perror("Failed to allocate memory for the order queue");
+		exit(1);
+	}
+
+	for (size_t i = 0; i < orders.size; i++) {
+		atomic_init(&orders.cells[i].sequence, i);
+	}
 
-	return semId;
+	if (strncmp(settings.ordersSource, "unix:", strlen("unix:")) != 0) {
+		return;
+	}
+
+	const char* path = settings.ordersSource + strlen("unix:");
+	struct sockaddr_un address = { .sun_family = AF_UNIX };
+	struct stat status;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "The socket path %s is too long\n", path);
+		exit(1);
+	}
+
+	strcpy(address.sun_path, path);
+
+	if (stat(path, &status) == 0 && S_ISSOCK(status.st_mode)) {
+		unlink(path);
+	}
+
+	orders.listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (orders.listener < 0 || bind(orders.listener, (struct sockaddr*)&address, sizeof(address)) < 0
+		|| listen(orders.listener, SOMAXCONN) < 0) {
+		perror(path);
+		exit(1);
+	}
 }
 
 /**
- * @brief Cleans up and removes a semaphore set.
+ * @brief Empties the order latencies and starts reading the order source.
  *
- * This function attempts to remove a semaphore set identified by the given semaphore ID.
- * If the removal fails, an error message is printed to standard error.
+ * Called after startRoundStats, which arrival offsets are measured from.
+ */
+void startOrderRound() {
+	pthread_t thread;
+
+	free(orders.queueing);
+	orders.queueing = NULL;
+
+	for (int i = 0; i < ORDER_PRIORITIES; i++) {
+		free(orders.endToEnd[i]);
+		orders.endToEnd[i] = NULL;
+	}
+
+	orders.firstArrival = 0;
+	orders.lastCompletion = 0;
+	atomic_store(&orders.closed, 0);
+	atomic_store(&orders.producers, 1);
+
+	if (pthread_create(&thread, NULL, runOrderReader, NULL) != 0) {
+		perror("Failed to create the order reader thread");
+		exit(1);
+	}
+
+	pthread_detach(thread);
+}
+
+/**
+ * @brief Waits for the next order.
  *
- * @param semId The identifier of the semaphore set to be removed.
- * @return Returns 0 on success.
+ * Baker threads sleep on the queue's posted counter; baker coroutines poll the queue.
+ *
+ * @param order Receives the order.
+ * @return Returns 1 with an order, or 0 once the stream is closed and the queue is empty.
  */
-int cleanupSemaphore(int semId) {
-	if (semctl(semId, 0, IPC_RMID) == -1) {
-		perror("Failed to remove semaphores");
+int waitForOrder(Order* order) {
+	while (1) {
+		int posted = atomic_load_explicit(&orders.posted, memory_order_acquire);
+
+		if (popOrder(order)) {
+			return 1;
+		}
+
+		if (atomic_load(&orders.closed)) {
+			return popOrder(order);
+		}
+
+		if (getCurrentCoroutine() != NULL) {
+			sleepCoroutine(COROUTINE_POLL_NANOSECONDS);
+			continue;
+		}
+
+		atomic_fetch_add(&orders.idle, 1);
+		syscall(SYS_futex, &orders.posted, FUTEX_WAIT_PRIVATE, posted, NULL, NULL, 0);
+		atomic_fetch_sub(&orders.idle, 1);
 	}
-	return 0;
 }
 
 /**
- * @brief Cleans up all semaphores by releasing their resources.
+ * @brief Records how long an order waited in the queue, how long it took overall, and
+ * whether it was baked by its deadline.
  *
- * This function iterates through all semaphore IDs stored in the `semaphores` structure,
- * calls `cleanupSemaphore` on each one to release its resources, and then frees the memory
- * allocated for the semaphore IDs array.
+ * @param order The order.
+ * @param dequeued CLOCK_MONOTONIC time at which a baker took the order, in nanoseconds.
+ */
+void recordOrderLatency(const Order* order, uint64_t dequeued) {
+	uint64_t completed = monotonicNanoseconds();
+
+	pthread_mutex_lock(&orders.lock);
+	recordLatency(&orders.queueing, dequeued - order->arrival);
+	recordLatency(&orders.endToEnd[order->priority], completed - order->arrival);
+	if (completed > orders.lastCompletion) {
+		orders.lastCompletion = completed;
+	}
+	pthread_mutex_unlock(&orders.lock);
+
+	atomic_fetch_add_explicit(&roundStats.ordersCompleted, 1, memory_order_relaxed);
+
+	if (order->deadline != 0) {
+		atomic_fetch_add_explicit(&roundStats.ordersWithDeadline[order->priority], 1, memory_order_relaxed);
+
+		if (completed > order->deadline) {
+			atomic_fetch_add_explicit(&roundStats.deadlinesMissed[order->priority], 1, memory_order_relaxed);
+		}
+	}
+}
+
+/**
+ * @brief Returns the share of the orders with a deadline that were baked after it.
  *
- * @return Returns 0 upon successful cleanup.
+ * @param priority The priority class, or -1 for every class.
+ * @return The deadline miss rate, or 0 if no order had a deadline.
  */
-int cleanupSemaphores() {
+double deadlineMissRate(int priority) {
+	long long withDeadline = 0;
+	long long missed = 0;
+
+	for (int i = 0; i < ORDER_PRIORITIES; i++) {
+		if (priority < 0 || i == priority) {
+			withDeadline += atomic_load(&roundStats.ordersWithDeadline[i]);
+			missed += atomic_load(&roundStats.deadlinesMissed[i]);
+		}
+	}
 
-	int length = semaphores.length;
-	for (int i = 0; i < length; i++) {
-		cleanupSemaphore(semaphores.semaphoreIds[i]);
+	return withDeadline > 0 ? (double)missed / withDeadline : 0.0;
+}
+
+/**
+ * @brief Merges the end-to-end latencies of every priority class.
+ *
+ * @param total The histogram receiving the sum, initially empty.
+ */
+void mergeOrderLatency(LatencyHistogram* total) {
+	for (int i = 0; i < ORDER_PRIORITIES; i++) {
+		if (orders.endToEnd[i] != NULL) {
+			mergeLatencyHistogram(total, orders.endToEnd[i]);
+		}
 	}
+}
 
-	free(semaphores.semaphoreIds);
-	return 0;
+/**
+ * @brief Returns the orders completed per simulated second between the first arrival and the last completion.
+ *
+ * @return The sustained throughput, or 0 if no order was completed.
+ */
+double sustainedOrderThroughput() {
+	long long completed = atomic_load(&roundStats.ordersCompleted);
+
+	if (completed == 0 || orders.lastCompletion <= orders.firstArrival) {
+		return 0.0;
+	}
+
+	return completed / ((orders.lastCompletion - orders.firstArrival) / 1e9 * settings.dilation);
+}
+
+/**
+ * @brief Prints the orders received, shed and completed, the queueing and end-to-end percentiles,
+ * and the end-to-end percentiles and deadline misses of each priority class.
+ */
+void printOrderStats() {
+	long long received = atomic_load(&roundStats.ordersReceived);
+	long long shed = atomic_load(&roundStats.ordersShed);
+	LatencyHistogram none = { 0 };
+	LatencyHistogram endToEnd = { 0 };
+	double secondsPerNanosecond = settings.dilation / 1e9;
+
+	mergeOrderLatency(&endToEnd);
+
+	printf("  Orders: %lld received, %lld shed (%.2f%%) with a queue of %zu, %lld completed, %.4f orders/s sustained\n",
+		received, shed, received > 0 ? 100.0 * shed / received : 0.0, orders.size,
+		(long long)atomic_load(&roundStats.ordersCompleted), sustainedOrderThroughput());
+	printf("    %-16s %9s %9s %9s %9s\n", "", "p50", "p99", "p99.9", "max");
+	printf("    %-16s", "queueing");
+	printLatencyPercentiles(orders.queueing != NULL ? orders.queueing : &none, secondsPerNanosecond);
+	printf("\n    %-16s", "end to end");
+	printLatencyPercentiles(&endToEnd, secondsPerNanosecond);
+	printf("\n");
+
+	for (int i = 0; i < ORDER_PRIORITIES; i++) {
+		long long withDeadline = atomic_load(&roundStats.ordersWithDeadline[i]);
+
+		if (orders.endToEnd[i] == NULL) {
+			continue;
+		}
+
+		printf("      priority %-7d", i);
+		printLatencyPercentiles(orders.endToEnd[i], secondsPerNanosecond);
+		printf("  %lld orders", (long long)orders.endToEnd[i]->count);
+		if (withDeadline > 0) {
+			printf(", %lld of %lld deadlines missed (%.2f%%)", (long long)atomic_load(&roundStats.deadlinesMissed[i]),
+				withDeadline, 100.0 * deadlineMissRate(i));
+		}
+		printf("\n");
+	}
+}
+
+/**
+ * @brief Bakes orders from the order queue until the stream is closed and the queue is empty.
+ *
+ * Each order is one recipe, gathered, mixed and baked like a recipe of a round. A baker
+ * cannot tell what it will be ordered next, so its stash keeps any ingredient a recipe
+ * of the kitchen needs until --stash-recipes or --stash-seconds runs out.
+ *
+ * @param bakerId The ID of the baker.
+ */
+void serveOrders(int bakerId) {
+	int tools[kitchen.toolCount];
+	for (int tool = 0; tool < kitchen.toolCount; tool++) {
+		tools[tool] = 1;
+	}
+
+	uint32_t allRecipes = 0xFFFFFFFFu >> (32 - kitchen.recipeCount);
+	Order order;
+
+	setBakerState(bakerId, KITCHENSTAT_IDLE, 0);
+
+	while (waitForOrder(&order)) {
+		uint64_t dequeued = monotonicNanoseconds();
+		int recipe = order.recipe;
+		uint64_t recipeStarted = LATENCY_NOW();
+		uint32_t needed = initRecipes(bakerId, recipe);
+
+		setBakerDeadline(bakerId, order.deadline, order.priority);
+		LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_WORKING_ON_RECIPE, recipe, 0);
+		setBakerState(bakerId, KITCHENSTAT_GATHERING, recipe);
+
+		while (needed != 0) {
+			uint64_t gatherStarted = monotonicNanoseconds();
+			int gathered = getAvailableIngredients(bakerId, &needed);
+
+			if (isOnTimeline(bakerId)) {
+				recordTimeline(bakerId, TIMELINE_BAKER, TIMELINE_GATHERING, gatherStarted);
+			}
+
+			if (!gathered && settings.gatherTimeout == 0) {
+				simulateDuration(GATHER_RETRY_SECONDS);
+			}
+		}
+
+		setBakerState(bakerId, KITCHENSTAT_MIXING, recipe);
+		uint64_t mixStarted = monotonicNanoseconds();
+		mixIngredients(bakerId, tools, kitchen.toolCount, recipe);
+
+		if (isOnTimeline(bakerId)) {
+			recordTimeline(bakerId, TIMELINE_BAKER, TIMELINE_MIXING, mixStarted);
+		}
+
+		setBakerState(bakerId, KITCHENSTAT_BAKING, recipe);
+		uint64_t bakeStarted = monotonicNanoseconds();
+		cookRecipe(bakerId, recipe);
+
+		if (isOnTimeline(bakerId)) {
+			recordTimeline(bakerId, TIMELINE_BAKER, TIMELINE_BAKING, bakeStarted);
+		}
+
+		LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_FINISHED_RECIPE, recipe, 0);
+		countCompletedRecipe(recipe);
+		recordOrderLatency(&order, dequeued);
+
+		if (LATENCY_ENABLED) {
+			recordRecipeLatency(recipe, recipeStarted);
+		}
+
+		if (settings.stashSize > 0) {
+			ageStash(bakerId, kitchen.recipeIngredients, allRecipes);
+		}
+
+		setBakerState(bakerId, KITCHENSTAT_IDLE, recipe);
+	}
+
+	if (settings.stashSize > 0) {
+		ageStash(bakerId, kitchen.recipeIngredients, 0);
+	}
+}
+
+/**
+ * @brief Simulates the actions of a baker in a multi-threaded environment.
+ *
+ * This function represents the logic for a baker who is responsible for preparing
+ * various recipes. Each baker works on a set of predefined recipes and uses a set
+ * of tools to complete them. The function runs in a loop until all recipes are completed.
+ *
+ * @param val A void pointer to an integer representing the baker's ID.
+ * @return A void pointer, always returns NULL.
+ *
+ * The function performs the following steps:
+ * 1. Initializes the recipes and tools.
+ * 2. Iterates through each recipe, checking if it is completed.
+ * 3. If a recipe is not completed, the baker attempts to gather the necessary ingredients.
+ * 4. If the ingredients are available, the baker mixes and cooks the recipe. With
+ *    --prefetch, the ingredients of its next recipe are gathered for it meanwhile.
+ * 5. The process repeats until all recipes are completed.
+ * 6. The function logs the status of the baker's progress.
+ *
+ * With --orders, the baker bakes the orders of the stream instead, see serveOrders.
+ *
+ * All of the baker's state lives on the stack of this call, so a pooled thread that runs
+ * it again for the next round starts from freshly initialized recipes.
+ */
+void* simulateBaker(void* val) {
+	//Put all baker logic in here
+	int bakerId = *(int*)val;
+
+	seedServiceTimes(bakerId);
+
+	if (settings.ordersSource != NULL) {
+		serveOrders(bakerId);
+
+		LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_BAKER_FINISHED, 0, 0);
+		setBakerState(bakerId, KITCHENSTAT_FINISHED, 0);
+		return NULL;
+	}
+
+	//Setup recipes
+	uint32_t recipes[kitchen.recipeCount];
+
+	for (int recipe = 0; recipe < kitchen.recipeCount; recipe++) {
+		recipes[recipe] = initRecipes(bakerId, recipe);
+	}
+
+	uint32_t recipesRemaining = 0xFFFFFFFFu >> (32 - kitchen.recipeCount);
+	uint64_t recipeStarted[kitchen.recipeCount];
+	memset(recipeStarted, 0, sizeof(recipeStarted));
+
+	//Setup tools
+	int tools[kitchen.toolCount];
+	for (int tool = 0; tool < kitchen.toolCount; tool++) {
+		tools[tool] = 1;
+	}
+
+	int ramsiedBakerId = ramsiedMemory.address[0];
+	int ramsiedRecipeId = ramsiedMemory.address[1];
+	int hasBeenRamsied = ramsiedMemory.address[2];
+
+	//Iterate through each of the recipes.
+	int i = 0;
+	uint8_t passedOver = 0;
+
+	while (recipesRemaining != 0) {
+
+		i = chooseRecipe(recipesRemaining, recipes, i, &passedOver, probeBusyResources);
+
+		uint32_t* currentRecipe = &recipes[i];
+
+		LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_WORKING_ON_RECIPE, i, 0);
+
+		setBakerState(bakerId, KITCHENSTAT_GATHERING, i);
+
+		if (recipeStarted[i] == 0) {
+			recipeStarted[i] = LATENCY_NOW();
+		}
+
+		int gathered = 1;
+
+		if (*currentRecipe != 0) {
+			uint64_t gatherStarted = monotonicNanoseconds();
+
+			gathered = getAvailableIngredients(bakerId, currentRecipe);
+
+			if (isOnTimeline(bakerId)) {
+				recordTimeline(bakerId, TIMELINE_BAKER, TIMELINE_GATHERING, gatherStarted);
+			}
+		}
+
+		int isRecipeComplete = *currentRecipe == 0;
+
+		if (!gathered && settings.gatherTimeout == 0) {
+			simulateDuration(GATHER_RETRY_SECONDS);
+		}
+
+		if (isRecipeComplete) {
+			recipesRemaining &= ~(1u << i);
+		}
+
+		if (isRecipeComplete) {
+			if (bakerId == ramsiedBakerId && i == ramsiedRecipeId && hasBeenRamsied == 1) {
+				LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_RAMSIED, i, 0);
+				atomic_fetch_add(&roundStats.recipesRamsied, 1);
+				recipesRemaining |= 1u << i;
+				hasBeenRamsied = 0;
+				*currentRecipe = initRecipes(bakerId, i);
+			} else {
+				setBakerState(bakerId, KITCHENSTAT_MIXING, i);
+				uint64_t mixStarted = monotonicNanoseconds();
+				mixIngredients(bakerId, tools, kitchen.toolCount, i);
+
+				if (isOnTimeline(bakerId)) {
+					recordTimeline(bakerId, TIMELINE_BAKER, TIMELINE_MIXING, mixStarted);
+				}
+
+				int prefetched = settings.prefetchers > 0 ? nextRecipeToPrefetch(recipes, recipesRemaining, i) : -1;
+
+				if (prefetched >= 0) {
+					postPrefetch(bakerId, recipes[prefetched]);
+				}
+
+				setBakerState(bakerId, KITCHENSTAT_BAKING, i);
+				uint64_t bakeStarted = monotonicNanoseconds();
+				cookRecipe(bakerId, i);
+
+				if (isOnTimeline(bakerId)) {
+					recordTimeline(bakerId, TIMELINE_BAKER, TIMELINE_BAKING, bakeStarted);
+				}
+
+				if (prefetched >= 0) {
+					collectPrefetch(bakerId, &recipes[prefetched]);
+				}
+
+				LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_FINISHED_RECIPE, i, 0);
+				countCompletedRecipe(i);
+
+				if (LATENCY_ENABLED) {
+					recordRecipeLatency(i, recipeStarted[i]);
+				}
+
+				if (settings.stashSize > 0) {
+					ageStash(bakerId, recipes, recipesRemaining);
+				}
+			}
+		}
+
+		i++;
+		i = i % kitchen.recipeCount;
+
+	}
+
+	if (settings.stashSize > 0) {
+		ageStash(bakerId, recipes, 0);
+	}
+
+	LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_BAKER_FINISHED, 0, 0);
+	setBakerState(bakerId, KITCHENSTAT_FINISHED, 0);
+
+	return NULL;
+}
+
+/**
+ * @struct bakerPoolStruct
+ * @brief The baker threads of the threads engine, kept parked between rounds.
+ *
+ * A round bumps generation and wakes every parked thread with one broadcast. The
+ * threads whose baker ID is below bakers run simulateBaker; the others go back to
+ * sleep. The last baker to finish signals done.
+ *
+ * @var bakerPoolStruct::threads
+ * The pool's threads, indexed by baker ID.
+ *
+ * @var bakerPoolStruct::size
+ * The number of threads in the pool.
+ *
+ * @var bakerPoolStruct::generation
+ * The number of rounds released so far.
+ *
+ * @var bakerPoolStruct::bakers
+ * The number of bakers in the current round.
+ *
+ * @var bakerPoolStruct::remaining
+ * The number of bakers of the current round that have not finished yet.
+ */
+struct bakerPoolStruct {
+	pthread_mutex_t lock;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	pthread_t* threads;
+	int size;
+	unsigned generation;
+	int bakers;
+	int remaining;
+};
+
+struct bakerPoolStruct bakerPool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.start = PTHREAD_COND_INITIALIZER,
+	.done = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * @brief The body of a pooled baker thread: waits for each round and runs the baker in it.
+ *
+ * Threads are only created while the pool is locked, just before the round they join
+ * is released, so a new thread has not yet seen the generation it finds.
+ *
+ * @param val The baker ID, cast to a pointer.
+ * @return Never returns.
+ */
+void* runPooledBaker(void* val) {
+	int bakerId = (int)(intptr_t)val;
+
+	pthread_mutex_lock(&bakerPool.lock);
+	unsigned seen = bakerPool.generation - 1;
+
+	while (1) {
+		while (bakerPool.generation == seen) {
+			pthread_cond_wait(&bakerPool.start, &bakerPool.lock);
+		}
+
+		seen = bakerPool.generation;
+
+		if (bakerId >= bakerPool.bakers) {
+			continue;
+		}
+
+		pthread_mutex_unlock(&bakerPool.lock);
+
+		threadBakerId = bakerId;
+		simulateBaker(&bakerId);
+
+		pthread_mutex_lock(&bakerPool.lock);
+		if (--bakerPool.remaining == 0) {
+			pthread_cond_signal(&bakerPool.done);
+		}
+	}
 
+	return NULL;
 }
 
 /**
- * @brief Cleans up shared memory by iterating through each shared memory address
- *        and freeing the allocated memory.
+ * @brief Adds threads to the baker pool until it has one per baker.
  *
- * This function iterates through the shared memory addresses stored in the
- * sharedMemory structure, calls the cleanupSharedMemoryAddress function for
- * each address, and then frees the memory allocated for the shared memory addresses.
+ * Must be called with the pool locked. If the thread creation fails, an error message
+ * is printed and the program exits.
  *
- * @return Returns 0 upon successful cleanup.
+ * @param bakers The number of bakers in the coming round.
  */
-int cleanupSharedMemory() {
+void growBakerPool(int bakers) {
+	if (bakers <= bakerPool.size) {
+		return;
+	}
 
-	int length = sharedMemory.length;
-	for (int i = 0; i < length; i++) {
+	pthread_t* threads = realloc(bakerPool.threads, bakers * sizeof(pthread_t));
 
-		struct sharedMem* memoryContainer = &(sharedMemory.sharedMemoryAddresses[i]);
-		cleanupSharedMemoryAddress(memoryContainer);
+	if (threads == NULL) {
+		perror("Failed to allocate memory for the baker pool");
+		exit(1);
 	}
 
-	free(sharedMemory.sharedMemoryAddresses);
-	return 0;
+	bakerPool.threads = threads;
 
-}
+	for (int bakerId = bakerPool.size; bakerId < bakers; bakerId++) {
+		printf("Initializing baker %d\n", bakerId);
 
-/**
- * @brief Retrieves the semaphore ID associated with a given resource.
- *
- * This function takes a resource identifier as input and returns the
- * corresponding semaphore ID from the semaphores structure.
- *
- * @param resource The identifier of the resource for which the semaphore ID is needed.
- * @return The semaphore ID associated with the specified resource.
- */
-int getSemIdFromResource(int resource) {
-	return semaphores.semaphoreIds[resource];
+		int threadStatus = pthread_create(&bakerPool.threads[bakerId], NULL, runPooledBaker, (void*)(intptr_t)bakerId);
+
+		if (threadStatus != 0) {
+			fprintf(stderr, "Thread create error %d: %s\n", threadStatus, strerror(threadStatus));
+
+			exit(1);
+		}
+
+		bakerPool.size++;
+	}
 }
 
 /**
- * @brief Decrements the semaphore value.
+ * @brief Runs a round with one pooled thread per baker and waits for every baker to finish.
  *
- * This function performs a semaphore operation to decrement the semaphore
- * value by 1. It uses the `semop` system call to perform the operation.
+ * Threads left over from earlier rounds are reused, so after the first round of a
+ * given size starting a round costs one broadcast rather than one thread per baker.
  *
- * @param semId The semaphore ID.
- * @return Returns 0 on success, or prints an error message if the operation fails.
+ * @param bakers The number of bakers.
  */
-int decSem(int semId) {
+void runThreadRound(int bakers) {
+	printf("Initializing %d bakers\n", bakers);
 
-	struct sembuf sbuf;
-	sbuf.sem_num = 0;
-	sbuf.sem_op = -1;
-	sbuf.sem_flg = SEM_UNDO;
+	pthread_mutex_lock(&bakerPool.lock);
 
-	if (semop(semId, &sbuf, 1) == -1) {
-		perror("Unable to use resource");
+	growBakerPool(bakers);
+
+	bakerPool.bakers = bakers;
+	bakerPool.remaining = bakers;
+	bakerPool.generation++;
+	pthread_cond_broadcast(&bakerPool.start);
+
+	while (bakerPool.remaining > 0) {
+		pthread_cond_wait(&bakerPool.done, &bakerPool.lock);
 	}
 
-	return 0;
+	pthread_mutex_unlock(&bakerPool.lock);
 }
 
 /**
- * @brief Increment a semaphore.
+ * @brief Waits for all threads in the given array to complete.
  *
- * This function increments the semaphore specified by the semaphore ID (semId).
- * It uses the semop system call to perform the increment operation.
+ * This function iterates over an array of pthread_t threads and calls
+ * pthread_join on each one, ensuring that the main thread waits for
+ * each thread to complete before continuing.
  *
- * @param semId The ID of the semaphore to increment.
- * @return Returns 0 on success. If the semop call fails, an error message is printed.
+ * @param threads An array of pthread_t representing the threads to wait for.
+ * @param size The number of threads in the array.
  */
-int incSem(int semId) {
-	struct sembuf sbuf;
-	sbuf.sem_num = 0;
-	sbuf.sem_op = 1;
-	sbuf.sem_flg = SEM_UNDO;
-
-	if (semop(semId, &sbuf, 1) == -1) {
-		perror("Unable to use resource");
+void waitForThreads(pthread_t* threads, int size) {
+	for (int i = 0; i < size; i++) {
+		pthread_join(threads[i], NULL);
 	}
-
-	return 0;
 }
 
 /**
- * @brief Uses a resource by decrementing its associated semaphore.
+ * @brief Runs a round with every baker as a coroutine on a fixed pool of worker threads.
  *
- * This function retrieves the semaphore ID associated with the given resource
- * and then decrements the semaphore to indicate usage of the resource.
- *
- * @param resource The identifier of the resource to be used.
- * @return int The result of the semaphore decrement operation.
+ * @param bakers The number of bakers.
  */
-int useResource(int resource) {
+void runCoroutineRound(int bakers) {
+	Coroutine* coroutines = calloc(bakers, sizeof(Coroutine));
+	scheduler.timers = malloc(bakers * sizeof(Coroutine*));
+
+	if (coroutines == NULL || scheduler.timers == NULL) {
+		perror("Failed to allocate memory for coroutines");
+		exit(1);
+	}
+
+	pthread_condattr_t attributes;
+	pthread_condattr_init(&attributes);
+	pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+	pthread_cond_init(&scheduler.wakeup, &attributes);
+	pthread_condattr_destroy(&attributes);
+
+	scheduler.runHead = NULL;
+	scheduler.runTail = NULL;
+	scheduler.timerCount = 0;
+	scheduler.total = bakers;
+	scheduler.finished = 0;
+	atomic_store(&scheduler.switches, 0);
+
+	printf("Initializing %d bakers on %d workers\n", bakers, settings.workers);
+
+	for (int bakerId = 0; bakerId < bakers; bakerId++) {
+		Coroutine* coroutine = &coroutines[bakerId];
+		coroutine->stack = mmap(NULL, COROUTINE_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+
+		if (coroutine->stack == MAP_FAILED) {
+			perror("Unable to allocate a coroutine stack");
+			exit(1);
+		}
+
+		mprotect(coroutine->stack, getpagesize(), PROT_NONE);
+
+		getcontext(&coroutine->context);
+		coroutine->context.uc_stack.ss_sp = coroutine->stack;
+		coroutine->context.uc_stack.ss_size = COROUTINE_STACK_SIZE;
+		coroutine->context.uc_link = NULL;
+		makecontext(&coroutine->context, runBakerCoroutine, 0);
+
+		coroutine->bakerId = bakerId;
+		coroutine->blockedOn = -1;
+		seedServiceTimes(bakerId);
+		coroutine->randomState = serviceTimeState;
+
+		makeRunnable(coroutine);
+	}
+
+	pthread_t workers[settings.workers];
+
+	for (int i = 0; i < settings.workers; i++) {
+		int threadStatus = pthread_create(&workers[i], NULL, runCoroutineWorker, NULL);
 
-	int semId = getSemIdFromResource(resource);
+		if (threadStatus != 0) {
+			fprintf(stderr, "Thread create error %d: %s\n", threadStatus, strerror(threadStatus));
+			exit(1);
+		}
+	}
 
-	return decSem(semId);
+	waitForThreads(workers, settings.workers);
 
+	atomic_store(&roundStats.coroutineSwitches, atomic_load(&scheduler.switches));
+	pthread_cond_destroy(&scheduler.wakeup);
+	free(scheduler.timers);
+	free(coroutines);
 }
 
 /**
- * @brief Decrements the semaphore associated with the given ingredient.
- *
- * This function retrieves the semaphore ID for the specified ingredient
- * by adding the ingredient value to a predefined semaphore offset and
- * then calls the decSem function to decrement the semaphore.
+ * @brief The steps of a baker in the discrete-event engine.
  *
- * @param ingredient The ingredient identifier for which the semaphore
- *                   needs to be decremented.
- * @return int The result of the decSem function, typically indicating
- *             success or failure of the semaphore operation.
+ * Each state names what the baker does next when it is stepped. States that follow
+ * an acquire are entered as soon as the requested resources have been granted, and
+ * states that follow a timed operation are entered when its event fires.
  */
-int useIngredient(int ingredient) {
-	int semId = getSemIdFromResource(semOffset + ingredient);
-
-	return decSem(semId);
-}
+enum desState {
+	DES_NEXT_RECIPE,
+	DES_GATHER_NEXT,
+	DES_GOT_STORAGE,
+	DES_GOT_INGREDIENTS,
+	DES_RETURNED,
+	DES_AFTER_GATHER,
+	DES_GOT_TOOLS,
+	DES_MIXED,
+	DES_GOT_OVEN,
+	DES_OVEN_LOADED,
+	DES_BAKED,
+	DES_DONE
+};
 
 /**
- * @brief Recovers a resource by incrementing its associated semaphore.
+ * @brief The complete state of one simulated baker.
  *
- * This function takes a resource identifier, retrieves the corresponding
- * semaphore ID using the getSemIdFromResource function, and then increments
- * the semaphore using the incSem function.
+ * @var DesBaker::state
+ * One of the desState values.
  *
- * @param resource The identifier of the resource to be recovered.
- * @return int The result of the incSem function, typically indicating success or failure.
+ * @var DesBaker::recipe
+ * The recipe the baker is working on, or will look at next.
+ *
+ * @var DesBaker::recipesRemaining
+ * A bitmask of the recipes the baker still has to bake.
+ *
+ * @var DesBaker::storage
+ * The storage area of the current gather step.
+ *
+ * @var DesBaker::needed
+ * A bitmask of the ingredients the current recipe still needs.
+ *
+ * @var DesBaker::request
+ * A bitmask of the resources the baker is waiting for or holding.
+ *
+ * @var DesBaker::nextWaiter
+ * The next baker in the same resource wait queue, or in the same oven batch.
+ *
+ * @var DesBaker::batch
+ * The baker that opened the oven batch this baker's recipe is in, or -1.
+ *
+ * @var DesBaker::randomState
+ * The baker's service-time generator, identical to the threaded engine's stream.
+ *
+ * @var DesBaker::passedOver
+ * The number of recipe picks in a row that skipped the round-robin choice.
+ *
+ * @var DesBaker::blockedSince
+ * The simulated time at which the baker's pending request was queued.
  */
-int recoverResource(int resource) {
+typedef struct {
+	uint8_t state;
+	uint8_t recipe;
+	uint8_t storage;
+	uint8_t passedOver;
+	uint32_t recipesRemaining;
+	uint32_t needed;
+	uint32_t request;
+	int32_t nextWaiter;
+	int32_t batch;
+	uint64_t randomState;
+	double blockedSince;
+} DesBaker;
 
-	int semId = getSemIdFromResource(resource);
+/**
+ * @brief An oven batch in the discrete-event engine, indexed by the baker that opened it.
+ *
+ * @var DesBatch::loaded
+ * The number of recipes on the racks.
+ *
+ * @var DesBatch::members
+ * The first of the bakers that joined the batch, linked through nextWaiter.
+ */
+typedef struct {
+	int32_t loaded;
+	int32_t members;
+} DesBatch;
 
-	return incSem(semId);
-}
+/**
+ * @brief A timed event: the baker is stepped when simulated time reaches `time`.
+ *
+ * Events at the same time fire in the order they were scheduled.
+ */
+typedef struct {
+	double time;
+	uint64_t sequence;
+	int32_t baker;
+} DesEvent;
 
 /**
- * @brief Recovers the specified ingredient by incrementing its semaphore.
+ * @struct desEngineStruct
+ * @brief The state of the single-threaded discrete-event engine.
  *
- * This function retrieves the semaphore ID associated with the given ingredient
- * and increments the semaphore to indicate that the ingredient has been recovered.
+ * Resources are counters with the kitchen's capacities. A baker that
+ * cannot get every resource of a request waits in the FIFO queue of the first busy
+ * one; when that resource is released the request is checked again, so requests for
+ * several resources are granted all or nothing, like the threaded engine's.
  *
- * @param ingredient The identifier of the ingredient to be recovered.
- * @return int The result of the semaphore increment operation.
+ * @var desEngineStruct::ready
+ * A ring of bakers whose requests were granted at the current time and that are
+ * waiting to be stepped.
+ *
+ * @var desEngineStruct::joinable
+ * For each bake-time class, the baker whose oven batch has a free rack, or -1.
+ *
+ * @var desEngineStruct::blockedTime
+ * The simulated time bakers spent queued for resources during the round.
  */
-int recoverIngredient(int ingredient) {
-	int semId = getSemIdFromResource(semOffset + ingredient);
-	sleep(1);
+struct desEngineStruct {
+	DesBaker* bakers;
+	DesBatch* batches;
+	int bakerCount;
+	DesEvent* heap;
+	int heapSize;
+	int* ready;
+	int readyHead;
+	int readyCount;
+	int available[32];
+	int waitHead[32];
+	int waitTail[32];
+	double now;
+	double blockedTime;
+	uint64_t sequence;
+	uint64_t events;
+	uint32_t toolsMask;
+	int joinable[KITCHEN_MAX_RECIPES];
+	int bakeClasses[KITCHEN_MAX_RECIPES];
+	int ramsiedBakerId;
+	int ramsiedRecipeId;
+	int hasBeenRamsied;
+};
 
-	return incSem(semId);
-}
+struct desEngineStruct des;
 
 /**
- * @brief Checks if a given item is in the pantry.
+ * @brief Builds a bitmask from a list of small identifiers.
  *
- * This function iterates through the pantryIngredients array to determine
- * if the specified item is present in the pantry.
- *
- * @param item The item to check for in the pantry.
- * @return int Returns 1 if the item is found in the pantry, otherwise returns 0.
+ * @param items The identifiers.
+ * @param count The number of entries in items.
+ * @param offset A value added to each identifier before it becomes a bit position.
+ * @return The bitmask.
  */
-int isPantryItem(int item) {
-	int pantrySize = sizeof(pantryIngredients) / sizeof(pantryIngredients[0]);
+uint32_t maskOf(const int items[], int count, int offset) {
+	uint32_t mask = 0;
 
-	for (int i = 0; i < pantrySize; i++) {
-		if (pantryIngredients[i] == item) {
-			return 1;
-		}
+	for (int i = 0; i < count; i++) {
+		mask |= 1u << (items[i] + offset);
 	}
 
-	return 0;
+	return mask;
 }
 
 /**
- * @brief Checks if a given item is in the refrigerator.
+ * @brief Schedules a baker to be stepped after a span of simulated time.
  *
- * This function iterates through the refrigeratorIngredients array to determine
- * if the specified item is present. If the item is found, the function returns 1,
- * otherwise it returns 0.
- *
- * @param item The item to check for in the refrigerator.
- * @return int Returns 1 if the item is found in the refrigerator, otherwise returns 0.
+ * @param bakerId The baker to step.
+ * @param delay The simulated time from now until the event.
  */
-int isRefrigeratorItem(int item) {
-	int refrigeratorSize = sizeof(refrigeratorIngredients) / sizeof(refrigeratorIngredients[0]);
+void desSchedule(int bakerId, double delay) {
+	DesEvent event = { des.now + delay, des.sequence++, bakerId };
+	int i = des.heapSize++;
 
-	for (int i = 0; i < refrigeratorSize; i++) {
-		if (refrigeratorIngredients[i] == item) {
-			return 1;
+	while (i > 0) {
+		int parent = (i - 1) / 2;
+		DesEvent* above = &des.heap[parent];
+
+		if (above->time < event.time || (above->time == event.time && above->sequence < event.sequence)) {
+			break;
 		}
+
+		des.heap[i] = *above;
+		i = parent;
 	}
 
-	return 0;
+	des.heap[i] = event;
 }
 
 /**
- * @brief Signal handler for SIGINT.
+ * @brief Removes the earliest event from the event queue.
  *
- * This function is called when the program receives a SIGINT signal (usually generated by pressing Ctrl+C).
- * It performs cleanup operations and terminates the program gracefully.
- *
- * @param signal The signal number received (expected to be SIGINT).
+ * @return The earliest event.
  */
-void sigHandler(int signal) {
-	if (signal == SIGINT) {
+DesEvent desNextEvent() {
+	DesEvent first = des.heap[0];
+	DesEvent last = des.heap[--des.heapSize];
+	int i = 0;
 
-		printf("\nTerminating program...\n");
+	while (1) {
+		int child = 2 * i + 1;
+		if (child >= des.heapSize) {
+			break;
+		}
 
-		cleanupSemaphores();
-		cleanupSharedMemory();
-		exit(0);
+		if (child + 1 < des.heapSize && (des.heap[child + 1].time < des.heap[child].time ||
+			(des.heap[child + 1].time == des.heap[child].time && des.heap[child + 1].sequence < des.heap[child].sequence))) {
+			child++;
+		}
+
+		if (last.time < des.heap[child].time || (last.time == des.heap[child].time && last.sequence < des.heap[child].sequence)) {
+			break;
+		}
 
+		des.heap[i] = des.heap[child];
+		i = child;
 	}
 
+	if (des.heapSize > 0) {
+		des.heap[i] = last;
+	}
+
+	return first;
 }
 
 /**
- * @brief Decrements the semaphores for the specified ingredient and baker.
- *
- * This function checks if the specified ingredient is in the pantry or refrigerator.
- * If the ingredient is in the pantry, the baker will attempt to enter the pantry and use the resource.
- * If the ingredient is in the refrigerator, the baker will attempt to enter the refrigerator and use the resource.
- * The function then waits for the specified ingredient to be available and uses it.
+ * @brief Returns the first resource of a request that has no free unit.
  *
- * @param bakerId The ID of the baker attempting to use the ingredient.
- * @param ingredient The ingredient that the baker needs.
- * @param color The color code for printing messages.
- * @param resetColor The color code to reset the terminal color.
+ * @param request A bitmask of resources.
+ * @return The busy resource, or -1 if every resource of the request is free.
  */
-void decSemaphores(int bakerId, int ingredient, const char* color, const char* resetColor) {
-	if (isIn(pantryIngredients, 6, ingredient)) {
-		printf("%sBaker %d is looking to enter the pantry\n%s", color, bakerId, resetColor);
-		useResource(PANTRY);
-		printf("%sBaker %d entered the pantry\n%s", color, bakerId, resetColor);
-	}
-
-	if (isIn(refrigeratorIngredients, 3, ingredient)) {
-		printf("%sBaker %d is looking to enter the refrigerator\n%s", color, bakerId, resetColor);
-		useResource(REFRIGERATOR);
-		printf("%sBaker %d entered the refrigerator\n%s", color, bakerId, resetColor);
+int desFirstBusy(uint32_t request) {
+	for (uint32_t rest = request; rest != 0; rest &= rest - 1) {
+		int resource = __builtin_ctz(rest);
+		if (des.available[resource] <= 0) {
+			return resource;
+		}
 	}
 
-	printf("%sBaker %d is waiting for ingredient %s\n%s", color, bakerId, getIngredientName(ingredient), resetColor);
-
-	useIngredient(ingredient);
-
+	return -1;
 }
 
 /**
- * @brief Increments the semaphores for the specified ingredient and handles resource recovery.
- *
- * This function checks if the given ingredient is in the pantry or refrigerator.
- * If the ingredient is in the pantry, it logs the baker's intention to leave the pantry,
- * recovers the pantry resource, and logs that the baker has left the pantry.
- * Similarly, if the ingredient is in the refrigerator, it logs the baker's intention to leave the refrigerator,
- * recovers the refrigerator resource, and logs that the baker has left the refrigerator.
- * Finally, it recovers the specified ingredient.
+ * @brief Returns the resources of a set that have no free unit, for chooseRecipe.
  *
- * @param bakerId The ID of the baker attempting to increment the ingredient semaphore.
- * @param ingredient The ingredient for which the semaphore needs to be incremented.
- * @param color The color code for printing messages.
- * @param resetColor The color code to reset the terminal color.
+ * @param resources A bitmask of resources.
+ * @return A bitmask of the busy ones.
  */
-void incIngredientSemaphores(int bakerId, int ingredient, const char* color, const char* resetColor) {
-	if (isIn(pantryIngredients, 6, ingredient)) {
-		printf("%sBaker %d is looking to leave the pantry\n%s", color, bakerId, resetColor);
-		recoverResource(PANTRY);
-		printf("%sBaker %d left the pantry\n%s", color, bakerId, resetColor);
-	}
+uint32_t desBusyResources(uint32_t resources) {
+	uint32_t busy = 0;
 
-	if (isIn(refrigeratorIngredients, 3, ingredient)) {
-		printf("%sBaker %d is looking to leave the refrigerator\n%s", color, bakerId, resetColor);
-		recoverResource(REFRIGERATOR);
-		printf("%sBaker %d left the refrigerator\n%s", color, bakerId, resetColor);
-	}
+	for (uint32_t rest = resources; rest != 0; rest &= rest - 1) {
+		int resource = __builtin_ctz(rest);
 
-	recoverIngredient(ingredient);
+		if (des.available[resource] <= 0) {
+			busy |= 1u << resource;
+		}
+	}
 
+	return busy;
 }
 
 /**
- * @brief Initializes the ingredients for a given recipe.
- *
- * @param recipe The recipe identifier. Valid values are:
- *               - COOKIE
- *               - PANCAKE
- *               - PIZZA
- *               - PRETZEL
- *               - CINROLL
- * @param initRecipe An array to store the initialized ingredients. The array should have enough space to hold all ingredient values.
- * @return A pointer to the initialized ingredients array.
- *
- * The function prints messages indicating the initialization process. If the recipe identifier is invalid (less than 0 or greater than 4),
- * the function prints an error message and exits the program.
+ * @brief Appends a baker to a resource's wait queue.
  *
- * The ingredients are initialized as follows:
- * - COOKIE: FLOUR, SUGAR, MILK, BUTTER
- * - PANCAKE: FLOUR, SUGAR, BAKING_SODA, SALT, EGGS, MILK, BUTTER
- * - PIZZA: SUGAR, YEAST, SALT
- * - PRETZEL: FLOUR, SUGAR, YEAST, BAKING_SODA, SALT, EGGS
- * - CINROLL: FLOUR, SUGAR, SALT, CINNAMON, EGGS, BUTTER
+ * @param resource The resource the baker waits for.
+ * @param bakerId The waiting baker.
  */
-int* initRecipes(int recipe, int initRecipe[]) {
+void desEnqueue(int resource, int bakerId) {
+	des.bakers[bakerId].nextWaiter = -1;
 
-	printf("Initializing %s recipe\n", getRecipeName(recipe));
-	if (recipe < 0 || recipe > 4) {
-		perror("Not a valid recipe");
-		exit(1);
-	}
-	else {
-		if (recipe == COOKIE) {
-			initRecipe[FLOUR] = 1;
-			initRecipe[SUGAR] = 1;
-			initRecipe[YEAST] = 0;
-			initRecipe[BAKING_SODA] = 0;
-			initRecipe[SALT] = 0;
-			initRecipe[CINNAMON] = 0;
-			initRecipe[EGGS] = 0;
-			initRecipe[MILK] = 1;
-			initRecipe[BUTTER] = 1;
-		}
-		if (recipe == PANCAKE) {
-			initRecipe[FLOUR] = 1;
-			initRecipe[SUGAR] = 1;
-			initRecipe[YEAST] = 0;
-			initRecipe[BAKING_SODA] = 1;
-			initRecipe[SALT] = 1;
-			initRecipe[CINNAMON] = 0;
-			initRecipe[EGGS] = 1;
-			initRecipe[MILK] = 1;
-			initRecipe[BUTTER] = 1;
-		}
-		if (recipe == PIZZA) {
-			initRecipe[FLOUR] = 0;
-			initRecipe[SUGAR] = 1;
-			initRecipe[YEAST] = 1;
-			initRecipe[BAKING_SODA] = 0;
-			initRecipe[SALT] = 1;
-			initRecipe[CINNAMON] = 0;
-			initRecipe[EGGS] = 0;
-			initRecipe[MILK] = 0;
-			initRecipe[BUTTER] = 0;
-		}
-		if (recipe == PRETZEL) {
-			initRecipe[FLOUR] = 1;
-			initRecipe[SUGAR] = 1;
-			initRecipe[YEAST] = 1;
-			initRecipe[BAKING_SODA] = 1;
-			initRecipe[SALT] = 1;
-			initRecipe[CINNAMON] = 0;
-			initRecipe[EGGS] = 1;
-			initRecipe[MILK] = 0;
-			initRecipe[BUTTER] = 0;
-		}
-		if (recipe == CINROLL) {
-			initRecipe[FLOUR] = 1;
-			initRecipe[SUGAR] = 1;
-			initRecipe[YEAST] = 0;
-			initRecipe[BAKING_SODA] = 0;
-			initRecipe[SALT] = 1;
-			initRecipe[CINNAMON] = 1;
-			initRecipe[EGGS] = 1;
-			initRecipe[MILK] = 0;
-			initRecipe[BUTTER] = 1;
-		}
-
-		printf("Finished initializing %s recipe\n", getRecipeName(recipe));
-		return initRecipe;
-	}
-}
-
-/**
- * @brief Checks if a given recipe is valid and contains at least one ingredient.
- *
- * This function checks if the provided recipe array has the correct size and
- * contains at least one ingredient. The recipe is considered valid if its size
- * is exactly 9. If the size is not 9, the function prints an error message and
- * terminates the program. If the size is valid, the function checks each element
- * of the recipe array to see if it contains the ingredient represented by the
- * value 1. If at least one ingredient is found, the function returns 1. Otherwise,
- * it returns 0.
- *
- * @param recipe An array of integers representing the recipe.
- * @param size The size of the recipe array.
- * @return int Returns 1 if the recipe contains at least one ingredient, otherwise 0.
- */
-int checkRecipe(int recipe[], int size) {
-	if (size != 9) {
-		perror("Not a valid recipe");
-		exit(1);
+	if (des.waitHead[resource] < 0) {
+		des.waitHead[resource] = bakerId;
 	}
 	else {
-		for (int i = 0; i < size; i++) {
-			if (recipe[i] == 1) {
-				return 1;
-			}
-		}
+		des.bakers[des.waitTail[resource]].nextWaiter = bakerId;
 	}
 
-	return 0;
+	des.waitTail[resource] = bakerId;
 }
 
 /**
- * @brief Toggles the presence of an ingredient in a recipe.
+ * @brief Takes one unit of each resource of a request.
  *
- * This function checks if the specified ingredient is present in the recipe.
- * If the ingredient is present (indicated by a value of 1), it removes the ingredient
- * by setting its value to 0.
- *
- * @param recipe Pointer to an array representing the recipe, where each index corresponds to an ingredient.
- * @param ingredient The index of the ingredient to be toggled in the recipe array.
+ * @param request A bitmask of resources, all of which must be free.
  */
-void addIngredient(int* recipe, int ingredient) {
-
-	if (recipe[ingredient] == 1) {
-		recipe[ingredient] = 0;
+void desTake(uint32_t request) {
+	for (uint32_t rest = request; rest != 0; rest &= rest - 1) {
+		des.available[__builtin_ctz(rest)]--;
 	}
 }
 
 /**
- * @brief Retrieves an ingredient for a baker and updates the recipe.
- *
- * This function handles the process of a baker obtaining an ingredient,
- * updating the recipe with the ingredient, and then returning the ingredient.
- * It uses semaphores to manage access to the ingredients.
+ * @brief Grants a baker its request now, or queues it behind the first busy resource.
  *
- * @param bakerId The ID of the baker retrieving the ingredient.
- * @param recipe A pointer to the recipe array to be updated.
- * @param ingredient The ingredient to be retrieved and added to the recipe.
- * @param color The color code for printing messages.
- * @param resetColor The color code to reset the terminal color.
- * @return Always returns 1.
+ * @param bakerId The baker whose request field holds the resources it needs.
+ * @return Returns 1 if the request was granted, otherwise 0.
  */
-int getIngredient(int bakerId, int* recipe, int ingredient, const char* color, const char* resetColor) {
-	decSemaphores(bakerId, ingredient, color, resetColor);
-	addIngredient(recipe, ingredient);
-	printf("%sBaker %d got ingredient %s\n%s", color, bakerId, getIngredientName(ingredient), resetColor);
-
-	//sleep(1);
-
-	printf("%sBaker %d is returning ingredient %s\n%s", color, bakerId, getIngredientName(ingredient), resetColor);
+int desAcquire(int bakerId) {
+	uint32_t request = des.bakers[bakerId].request;
+	int busy = desFirstBusy(request);
 
-	incIngredientSemaphores(bakerId, ingredient, color, resetColor);
+	if (busy < 0) {
+		desTake(request);
+		return 1;
+	}
 
-	return 1;
+	des.bakers[bakerId].blockedSince = des.now;
+	desEnqueue(busy, bakerId);
+	return 0;
 }
 
 /**
- * @brief Checks if a specific ingredient is available in the recipe and attempts to get it.
+ * @brief Gives resources back and grants the waiters that can now proceed.
  *
- * This function verifies if the provided recipe is valid and if the specified ingredient
- * is within the acceptable range. If the recipe is valid and the ingredient is available,
- * it attempts to get the ingredient.
+ * A waiter whose request is still blocked by a different resource moves to that
+ * resource's queue. Granted waiters are stepped at the current simulated time.
  *
- * @param bakerId The ID of the baker attempting to get the ingredient.
- * @param recipe An array representing the recipe with ingredients.
- * @param size The size of the recipe array, which must be 9.
- * @param ingredient The index of the ingredient to check and get.
- * @return Returns 0 if the ingredient is not available or if the recipe is invalid.
- *         Otherwise, it returns the result of the getIngredient function.
+ * @param release A bitmask of the resources to give back.
  */
-int checkIngredient(int bakerId, int* recipe, int size, int ingredient, const char* color, const char* resetColor) {
-
-	if (size != 9) {
-		perror("Not a valid recipe");
-		exit(1);
+void desRelease(uint32_t release) {
+	for (uint32_t rest = release; rest != 0; rest &= rest - 1) {
+		des.available[__builtin_ctz(rest)]++;
 	}
-	if (ingredient > 8 || ingredient < 0) {
-		perror("Ingredient is not a valid ingredient");
-	}
-	else {
-		if (recipe[ingredient] == 0) {
-			return 0;
-		}
 
-		return getIngredient(bakerId, recipe, ingredient, color, resetColor);
+	for (uint32_t rest = release; rest != 0; rest &= rest - 1) {
+		int resource = __builtin_ctz(rest);
 
-	}
+		while (des.waitHead[resource] >= 0 && des.available[resource] > 0) {
+			int waiter = des.waitHead[resource];
+			des.waitHead[resource] = des.bakers[waiter].nextWaiter;
 
-	return 0;
+			uint32_t request = des.bakers[waiter].request;
+			int busy = desFirstBusy(request);
+
+			if (busy < 0) {
+				desTake(request);
+				des.blockedTime += des.now - des.bakers[waiter].blockedSince;
+				des.ready[(des.readyHead + des.readyCount++) % des.bakerCount] = waiter;
+			}
+			else {
+				desEnqueue(busy, waiter);
+			}
+		}
+	}
 }
 
 /**
- * @brief Retrieves available ingredients for a given baker based on a recipe.
+ * @brief Draws the duration of a baker's operation from the baker's own generator.
  *
- * This function iterates through the ingredients in the recipe and checks
- * their availability for the specified baker. It updates the status if any
- * ingredient is successfully obtained.
- *
- * @param bakerId The ID of the baker requesting the ingredients.
- * @param recipe A pointer to an array representing the recipe ingredients.
- * @return An integer indicating if any ingredient was successfully obtained
- *         (non-zero if successful, zero otherwise).
+ * @param baker The baker performing the operation.
+ * @param operation One of the operation values.
+ * @param recipe The recipe the operation is for, or -1 if it is not tied to a recipe.
+ * @return The simulated duration.
  */
-int getAvailableIngredients(int bakerId, int* recipe, const char* color, const char* resetColor) {
-	int updated = 0;
-	for (int i = 0; i < 9; i++) {
-		updated |= checkIngredient(bakerId, recipe, 9, i, color, resetColor);
-	}
+double desServiceTime(DesBaker* baker, int operation, int recipe) {
+	serviceTimeState = baker->randomState;
+	double simulatedSeconds = sampleServiceTime(getDuration(operation, recipe));
+	baker->randomState = serviceTimeState;
 
-	return updated;
+	recordOperation(operation, simulatedSeconds);
+	return simulatedSeconds;
 }
 
 /**
- * @brief Checks if there is at least one remaining recipe in the list.
+ * @brief Runs a baker's state machine until it blocks on a resource or starts a timed operation.
  *
- * This function iterates through the given array of recipes and checks if there
- * is at least one non-zero element, indicating that a recipe is remaining.
+ * The steps mirror simulateBaker: recipes are picked by the recipe policy, ingredients are
+ * gathered one at a time (or one storage area at a time in batched mode), then the
+ * baker mixes with the full set of tools and bakes in the oven, joining an open
+ * oven batch instead when there is more than one rack.
  *
- * @param recipes An array of integers representing the recipes.
- * @param length The length of the recipes array.
- * @return 1 if there is at least one remaining recipe, 0 otherwise.
+ * @param bakerId The baker to step.
  */
-int isARecipeRemaining(int recipes[], int length) {
-	for (int i = 0; i < length; i++) {
-		if (recipes[i]) {
-			return 1;
+void desStep(int bakerId) {
+	DesBaker* baker = &des.bakers[bakerId];
+
+	while (1) {
+		switch (baker->state) {
+			case DES_NEXT_RECIPE:
+				if (baker->recipesRemaining == 0) {
+					LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_BAKER_FINISHED, 0, 0);
+					baker->state = DES_DONE;
+					return;
+				}
+
+				baker->recipe = chooseRecipe(baker->recipesRemaining, kitchen.recipeIngredients, baker->recipe,
+					&baker->passedOver, desBusyResources);
+
+				LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_WORKING_ON_RECIPE, baker->recipe, 0);
+				baker->needed = kitchen.recipeIngredients[baker->recipe];
+				baker->state = DES_GATHER_NEXT;
+				break;
+
+			case DES_GATHER_NEXT:
+				if (baker->needed == 0) {
+					baker->state = DES_AFTER_GATHER;
+					break;
+				}
+
+				if (settings.batchedGather) {
+					int i = 0;
+					while (!(baker->needed & kitchen.storageIngredients[kitchen.storages[i]])) {
+						i++;
+					}
+					baker->storage = kitchen.storages[i];
+				}
+				else {
+					baker->storage = getIngredientStorage(__builtin_ctz(baker->needed));
+				}
+
+				baker->request = 1u << baker->storage;
+				baker->state = DES_GOT_STORAGE;
+				if (!desAcquire(bakerId)) {
+					return;
+				}
+				break;
+
+			case DES_GOT_STORAGE:
+				if (settings.batchedGather) {
+					baker->request = (baker->needed & kitchen.storageIngredients[baker->storage]) << semOffset;
+				}
+				else {
+					baker->request = 1u << (semOffset + __builtin_ctz(baker->needed));
+				}
+
+				baker->state = DES_GOT_INGREDIENTS;
+				if (!desAcquire(bakerId)) {
+					return;
+				}
+				break;
+
+			case DES_GOT_INGREDIENTS:
+				desRelease(1u << baker->storage);
+				baker->state = DES_RETURNED;
+				desSchedule(bakerId, desServiceTime(baker, OPERATION_RETURN, -1));
+				return;
+
+			case DES_RETURNED:
+				desRelease(baker->request);
+				baker->needed &= ~(baker->request >> semOffset);
+				baker->state = DES_GATHER_NEXT;
+				break;
+
+			case DES_AFTER_GATHER:
+				if (bakerId == des.ramsiedBakerId && baker->recipe == des.ramsiedRecipeId && des.hasBeenRamsied == 1) {
+					LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_RAMSIED, baker->recipe, 0);
+					atomic_fetch_add(&roundStats.recipesRamsied, 1);
+					des.hasBeenRamsied = 0;
+					baker->recipe = (baker->recipe + 1) % kitchen.recipeCount;
+					baker->state = DES_NEXT_RECIPE;
+					break;
+				}
+
+				baker->request = des.toolsMask;
+				baker->state = DES_GOT_TOOLS;
+				if (!desAcquire(bakerId)) {
+					return;
+				}
+				break;
+
+			case DES_GOT_TOOLS:
+				baker->state = DES_MIXED;
+				desSchedule(bakerId, desServiceTime(baker, OPERATION_MIX, baker->recipe));
+				return;
+
+			case DES_MIXED:
+				desRelease(des.toolsMask);
+
+				if (settings.ovenRacks > 1) {
+					int bakeClass = des.bakeClasses[baker->recipe];
+					int leader = des.joinable[bakeClass];
+
+					if (leader >= 0) {
+						DesBatch* batch = &des.batches[leader];
+						baker->batch = leader;
+						baker->nextWaiter = batch->members;
+						batch->members = bakerId;
+						if (++batch->loaded == settings.ovenRacks) {
+							des.joinable[bakeClass] = -1;
+						}
+						baker->state = DES_BAKED;
+						return;
+					}
+
+					baker->batch = bakerId;
+					des.batches[bakerId].loaded = 1;
+					des.batches[bakerId].members = -1;
+					des.joinable[bakeClass] = bakerId;
+				}
+
+				baker->request = 1u << kitchen.oven;
+				baker->state = DES_GOT_OVEN;
+				if (!desAcquire(bakerId)) {
+					return;
+				}
+				break;
+
+			case DES_GOT_OVEN:
+				baker->state = DES_OVEN_LOADED;
+				if (settings.ovenRacks > 1 && des.batches[bakerId].loaded < settings.ovenRacks && settings.batchWindow > 0) {
+					desSchedule(bakerId, settings.batchWindow);
+					return;
+				}
+				break;
+
+			case DES_OVEN_LOADED:
+				if (settings.ovenRacks > 1) {
+					int bakeClass = des.bakeClasses[baker->recipe];
+					if (des.joinable[bakeClass] == bakerId) {
+						des.joinable[bakeClass] = -1;
+					}
+					atomic_fetch_add(&roundStats.ovenCycles, 1);
+					atomic_fetch_add(&roundStats.ovenLoads, des.batches[bakerId].loaded);
+				}
+
+				baker->state = DES_BAKED;
+				desSchedule(bakerId, desServiceTime(baker, OPERATION_BAKE, baker->recipe));
+				return;
+
+			case DES_BAKED:
+				if (baker->batch == bakerId) {
+					for (int member = des.batches[bakerId].members; member >= 0; member = des.bakers[member].nextWaiter) {
+						des.ready[(des.readyHead + des.readyCount++) % des.bakerCount] = member;
+					}
+				}
+
+				if (baker->batch < 0 || baker->batch == bakerId) {
+					desRelease(1u << kitchen.oven);
+				}
+
+				baker->batch = -1;
+				LOG_EVENT(LOG_SUMMARY, bakerId, EVENT_FINISHED_RECIPE, baker->recipe, 0);
+				countCompletedRecipe(baker->recipe);
+				baker->recipesRemaining &= ~(1u << baker->recipe);
+				baker->recipe = (baker->recipe + 1) % kitchen.recipeCount;
+				baker->state = DES_NEXT_RECIPE;
+				break;
+
+			default:
+				return;
 		}
 	}
-
-	return 0;
 }
 
 /**
- * @brief Acquires the necessary mixing resources for a baker.
+ * @brief Simulates a round in a single thread with a discrete-event engine.
  *
- * This function attempts to acquire a mixer, a bowl, and a spoon for the baker
- * identified by the given bakerId. It logs the process of acquiring each resource.
+ * Every baker starts at simulated time 0. The engine steps the bakers whose
+ * requests were just granted, then advances simulated time to the next timed event,
+ * until no event is left. A given seed always produces the same round.
  *
- * @param bakerId The ID of the baker attempting to acquire the resources.
- * @param tools An array where the acquired resources will be stored.
- * @param size The size of the tools array. Must be 3.
- * @param color The color code for the log messages.
- * @param resetColor The color code to reset the log messages.
- * @return 0 on success, or an error code on failure.
+ * @param bakers The number of bakers.
+ * @param ramsiedBakerId The baker that gets ramsied.
+ * @param ramsiedRecipeId The recipe on which that baker gets ramsied.
+ * @return The simulated time at which the last baker finished.
  */
-int getMixingResources(int bakerId, int* tools, int size, const char* color, const char* resetColor) {
-	if (size != 3) {
-		perror("Not a valid set of tools");
+double runDiscreteEventRound(int bakers, int ramsiedBakerId, int ramsiedRecipeId) {
+	des.bakerCount = bakers;
+	des.bakers = malloc(bakers * sizeof(DesBaker));
+	des.batches = malloc(bakers * sizeof(DesBatch));
+	des.heap = malloc(bakers * sizeof(DesEvent));
+	des.ready = malloc(bakers * sizeof(int));
+
+	if (des.bakers == NULL || des.batches == NULL || des.heap == NULL || des.ready == NULL) {
+		perror("Failed to allocate memory for the discrete-event engine");
+		exit(1);
+	}
+
+	des.toolsMask = maskOf(kitchen.tools, kitchen.toolCount, 0);
+
+	for (int i = 0; i < kitchen.recipeCount; i++) {
+		des.joinable[i] = -1;
+		des.bakeClasses[i] = getBakeClass(i);
+	}
+
+	for (int i = 0; i < resourceCount; i++) {
+		des.available[i] = kitchen.capacities[i];
+		des.waitHead[i] = -1;
+		des.waitTail[i] = -1;
 	}
 
-	printf("%sBaker %d is looking to acquire a mixer\n%s", color, bakerId, resetColor);
-	tools[MIXER] = useResource(MIXER);
-	printf("%sBaker %d acquired a mixer\n%s", color, bakerId, resetColor);
+	des.heapSize = 0;
+	des.readyHead = 0;
+	des.readyCount = 0;
+	des.now = 0;
+	des.blockedTime = 0;
+	des.sequence = 0;
+	des.events = 0;
+	des.ramsiedBakerId = ramsiedBakerId;
+	des.ramsiedRecipeId = ramsiedRecipeId;
+	des.hasBeenRamsied = 1;
+
+	for (int bakerId = 0; bakerId < bakers; bakerId++) {
+		DesBaker* baker = &des.bakers[bakerId];
+		baker->state = DES_NEXT_RECIPE;
+		baker->recipe = 0;
+		baker->passedOver = 0;
+		baker->recipesRemaining = 0xFFFFFFFFu >> (32 - kitchen.recipeCount);
+		baker->needed = 0;
+		baker->request = 0;
+		baker->nextWaiter = -1;
+		baker->batch = -1;
+
+		seedServiceTimes(bakerId);
+		baker->randomState = serviceTimeState;
+
+		des.ready[des.readyCount++] = bakerId;
+	}
+
+	while (1) {
+		if (des.readyCount > 0) {
+			int bakerId = des.ready[des.readyHead];
+			des.readyHead = (des.readyHead + 1) % des.bakerCount;
+			des.readyCount--;
+
+			desStep(bakerId);
+			continue;
+		}
+
+		if (des.heapSize == 0) {
+			break;
+		}
 
-	printf("%sBaker %d is looking to acquire a bowl\n%s", color, bakerId, resetColor);
-	tools[MIXER] = useResource(BOWL);
-	printf("%sBaker %d acquired a bowl\n%s", color, bakerId, resetColor);
+		DesEvent event = desNextEvent();
+		des.now = event.time;
+		des.events++;
+		desStep(event.baker);
+	}
+
+	for (int bakerId = 0; bakerId < bakers; bakerId++) {
+		if (des.bakers[bakerId].state != DES_DONE) {
+			fprintf(stderr, "Baker %d never finished in the discrete-event engine\n", bakerId);
+		}
+	}
 
-	printf("%sBaker %d is looking to acquire as spoon\n%s", color, bakerId, resetColor);
-	tools[MIXER] = useResource(SPOON);
-	printf("%sBaker %d acquired a spoon\n%s", color, bakerId, resetColor);
+	free(des.bakers);
+	free(des.batches);
+	free(des.heap);
+	free(des.ready);
 
-	return 0;
+	return des.now;
 }
 
 /**
- * @brief Returns the mixing resources used by a baker.
- *
- * This function recovers the resources used for mixing, which include:
- * - Mixer
- * - Bowl
- * - Spoon
+ * @brief Creates every kitchen resource with its capacity through the selected backend.
  *
- * @param bakerId The ID of the baker returning the resources.
- * @return Always returns 0.
+ * The tools, storage areas and oven come first, followed by one semaphore per
+ * ingredient starting at semOffset. Capacities come from the kitchen table.
  */
-int returnMixingResources(int bakerId) {
-	recoverResource(MIXER);
-	recoverResource(BOWL);
-	recoverResource(SPOON);
+void initResources() {
+	settings.backend->init(resourceCount);
 
-	return 0;
+	for (int resource = 0; resource < resourceCount; resource++) {
+		initSemaphore(resource, kitchen.capacities[resource]);
+	}
 }
 
+const int benchmarkIterations = 100000;
+const int benchmarkThreadCounts[] = { 1, 4, 16 };
+
 /**
- * @brief Mixes ingredients using the specified tools.
+ * @brief Repeats the semaphore traffic of one baker step without any sleeps.
  *
- * This function simulates a baker mixing ingredients together. It first acquires
- * the necessary mixing resources, then prints messages indicating the mixing process,
- * and finally releases the mixing resources.
+ * Each iteration enters a storage area, takes and returns an ingredient, takes and
+ * returns the mixing tools as one composite resource, and uses the oven.
  *
- * @param bakerId The ID of the baker performing the mixing.
- * @param tools An array of integers representing the tools required for mixing.
- * @param size The number of tools in the tools array.
- * @param color A string representing the color code for the output text.
- * @param resetColor A string representing the reset color code for the output text.
- * @return Always returns 0.
+ * @param val A void pointer to an integer holding the worker's index.
+ * @return A void pointer, always returns NULL.
  */
-int mixIngredients(int bakerId, int* tools, int size, const char* color, const char* resetColor) {
-	getMixingResources(bakerId, tools, size, color, resetColor);
+void* runBackendBenchmark(void* val) {
+	int workerId = *(int*)val;
 
-	printf("%sBaker %d is mixing the ingredients together\n%s", color, bakerId, resetColor);
+	for (int i = 0; i < benchmarkIterations; i++) {
+		int ingredient = (workerId + i) % kitchen.ingredientCount;
+		int storage = getIngredientStorage(ingredient);
 
-	sleep(1);
+		useResource(storage);
+		useIngredient(ingredient);
+		recoverResource(storage);
+		settings.backend->release(semOffset + ingredient);
 
-	printf("%sBaker %d mixed all of the ingredients together\n%s", color, bakerId, resetColor);
+		useResources(kitchen.tools, kitchen.toolCount);
+		recoverResources(kitchen.tools, kitchen.toolCount);
 
-	returnMixingResources(bakerId);
+		useResource(kitchen.oven);
+		recoverResource(kitchen.oven);
+	}
 
-	return 0;
+	return NULL;
 }
 
 /**
- * @brief Cooks a recipe using the oven.
- *
- * This function simulates a baker using the oven to cook a specified recipe.
- * It prints messages to indicate the stages of the cooking process, including
- * looking to use the oven, using the oven, and finishing using the oven.
- * The function also simulates the time taken to cook the recipe by sleeping
- * for 3 seconds.
+ * @brief Compares the synchronization backends on the same workload.
  *
- * @param bakerId The ID of the baker who is cooking the recipe.
- * @param recipe The ID of the recipe to be cooked.
- * @param color The color code to be used for the printed messages.
- * @param resetColor The color code to reset the printed messages to default.
- * @return Always returns 0.
+ * For every backend and thread count, the workers run runBackendBenchmark against a
+ * freshly initialized kitchen. The table reports the cost of one backend operation
+ * and the number of context switches the run caused. Taking or returning the mixing
+ * tools counts as one operation.
  */
-int cookRecipe(int bakerId, int recipe, const char* color, const char* resetColor) {
-	printf("%sBaker %d is looking to use the oven to cook recipe %s%s\n", color, bakerId, getRecipeName(recipe), resetColor);
+void benchmarkBackends() {
+	int threadCountsLength = sizeof(benchmarkThreadCounts) / sizeof(benchmarkThreadCounts[0]);
 
-	useResource(OVEN);
+	printf("%-8s %8s %12s %10s %10s %14s %12s\n", "Backend", "Threads", "Operations", "Seconds", "ns/op", "ops/s", "Switches");
 
-	printf("%sBaker %d is using the oven to cook recipe %s%s\n", color, bakerId, getRecipeName(recipe), resetColor);
+	for (int b = 0; b < syncBackendCount; b++) {
+		settings.backend = syncBackends[b];
+		initResources();
 
-	sleep(3);
+		for (int t = 0; t < threadCountsLength; t++) {
+			int threadCount = benchmarkThreadCounts[t];
+			pthread_t threads[threadCount];
+			int workerIds[threadCount];
 
-	printf("%sBaker %d finished using the oven to cook recipe %s%s\n", color, bakerId, getRecipeName(recipe), resetColor);
+			struct rusage usageBefore, usageAfter;
+			struct timespec start, end;
+			getrusage(RUSAGE_SELF, &usageBefore);
+			clock_gettime(CLOCK_MONOTONIC, &start);
 
-	recoverResource(OVEN);
+			for (int i = 0; i < threadCount; i++) {
+				workerIds[i] = i;
+				pthread_create(&threads[i], NULL, runBackendBenchmark, &workerIds[i]);
+			}
 
-	return 0;
+			for (int i = 0; i < threadCount; i++) {
+				pthread_join(threads[i], NULL);
+			}
+
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			getrusage(RUSAGE_SELF, &usageAfter);
+
+			double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+			long operations = 8L * benchmarkIterations * threadCount;
+			long switches = (usageAfter.ru_nvcsw - usageBefore.ru_nvcsw) + (usageAfter.ru_nivcsw - usageBefore.ru_nivcsw);
+
+			printf("%-8s %8d %12ld %10.3f %10.1f %14.0f %12ld\n", settings.backend->name, threadCount, operations,
+				seconds, seconds * 1e9 / operations, operations / seconds, switches);
+		}
+
+		cleanupSemaphores();
+	}
 }
 
 /**
- * @brief Simulates the actions of a baker in a multi-threaded environment.
- *
- * This function represents the logic for a baker who is responsible for preparing
- * various recipes. Each baker works on a set of predefined recipes and uses a set
- * of tools to complete them. The function runs in a loop until all recipes are completed.
+ * @brief Prints the command line usage of the program.
  *
- * @param val A void pointer to an integer representing the baker's ID.
- * @return A void pointer, always returns NULL.
+ * @param name The name the program was invoked with.
+ */
+void printUsage(const char* name) {
+	printf("Usage: %s [options]\n", name);
+	printf("  -b, --batched          Gather all pantry and refrigerator ingredients of a recipe in one visit\n");
+	printf("  -s, --backend NAME     Synchronization backend for the threads engine: sysv (default), posix or futex\n");
+	printf("      --bench-backends   Compare the synchronization backends and exit\n");
+	printf("  -v, --verbosity LEVEL  Events to print: 0 none, 1 recipe progress only, 2 every step (default)\n");
+	printf("      --binary-log FILE  Write raw binary event records to FILE instead of text\n");
+	printf("  -d, --dilation FACTOR  Run simulated time FACTOR times faster than wall time (default 1)\n");
+	printf("      --duration SPEC    Set a duration in simulated seconds: OPERATION=SECONDS or\n");
+	printf("                         RECIPE:OPERATION=SECONDS, where OPERATION is mix, bake or return\n");
+	printf("      --service-time D   Service time distribution: fixed (default), exponential or uniform\n");
+	printf("      --seed N           Seed the service times and the ramsied choice\n");
+	printf("  -e, --engine NAME      Run rounds with one thread per baker (threads, default), with the\n");
+	printf("                         single-threaded discrete-event engine (des), or with every baker as\n");
+	printf("                         a coroutine on a pool of worker threads (coroutines)\n");
+	printf("  -w, --workers N        Worker threads for the coroutines engine (default: one per core)\n");
+	printf("      --oven-racks N     Bake up to N recipes with the same bake time in one oven cycle (default 1)\n");
+	printf("      --batch-window S   Simulated seconds the oven waits for a batch to fill (default 0.2)\n");
+	printf("  -k, --kitchen FILE     Load the ingredients, storage areas, tools, ovens and recipes from FILE\n");
+	printf("  -l, --latency          Report wait and hold time percentiles per resource and recipe times\n");
+	printf("                         (threads and coroutines engines)\n");
+	printf("      --live-stats       Publish live counters in shared memory for the kitchenstat monitor\n");
+	printf("  -n, --bakers N         Run every round with N bakers instead of asking (one round unless --rounds)\n");
+	printf("  -r, --rounds N         Exit after N rounds\n");
+	printf("      --summary          End each round with a one-line key=value summary\n");
+	printf("      --recipe-policy P  How bakers pick their next recipe: round-robin (default), or available\n");
+	printf("                         to probe the storage areas and ingredients and take the least blocked\n");
+	printf("      --gather-timeout S Give up on a storage area or ingredient after S simulated seconds (0: only\n");
+	printf("                         try) and move on to another recipe (threads and coroutines engines)\n");
+	printf("      --watchdog MS      Look for deadlocks and convoys every MS wall-clock milliseconds and report\n");
+	printf("                         them on stderr (threads and coroutines engines)\n");
+	printf("      --restockers N     Hand returned ingredients to N restocker threads instead of waiting out\n");
+	printf("                         the return (threads and coroutines engines)\n");
+	printf("      --supply SPEC      Inventory mode: recipes consume ingredients, each shelf starts with the\n");
+	printf("                         ingredient's capacity, and suppliers deliver UNITS/SECONDS of every\n");
+	printf("                         ingredient, or INGREDIENT=UNITS/SECONDS of one (threads and coroutines engines)\n");
+	printf("      --suppliers N      Supplier threads in inventory mode (default 1)\n");
+	printf("      --low-stock N      Wake bakers waiting on an empty shelf once it holds N units (default 1)\n");
+	printf("      --shelves N        Split each storage area into up to N shelves that are entered separately,\n");
+	printf("                         each with the storage area's capacity\n");
+	printf("      --storage-capacity STORAGE=N\n");
+	printf("                         Let N bakers into the storage area (or each of its shelves) at once\n");
+	printf("      --stash K          Let each baker keep up to K ingredient units between recipes instead of\n");
+	printf("                         returning them (threads and coroutines engines, not with --supply)\n");
+	printf("      --stash-recipes N  Give a stashed unit back after N recipes at most (default 3)\n");
+	printf("      --stash-seconds S  Give a stashed unit back after S simulated seconds at most (default 60)\n");
+	printf("      --prefetch N       Let N prefetcher threads gather each baker's next recipe while it bakes\n");
+	printf("                         (threads engine)\n");
+	printf("      --timeline N       Print the timeline of the first N bakers after each round\n");
+	printf("                         (threads and coroutines engines)\n");
+	printf("      --orders SOURCE    Order-stream mode: bake the orders read from SOURCE (a file, - for stdin,\n");
+	printf("                         or unix:PATH to listen on a socket until a client sends end), one\n");
+	printf("                         [SECONDS] RECIPE [deadline=S] [priority=0-%d] per line, in a single round\n", ORDER_PRIORITIES - 1);
+	printf("                         (threads and coroutines engines, needs --bakers)\n");
+	printf("      --order-queue N    Queue up to N orders, a power of two, and shed the rest (default %d)\n", ORDER_QUEUE_SIZE);
+	printf("      --order-deadline S Make orders without a deadline=S of their own due S simulated seconds\n");
+	printf("                         after they arrive (default: no deadline)\n");
+	printf("      --edf              Grant the tools and the oven earliest-deadline-first through wait queues\n");
+	printf("                         of their own instead of semaphore wakeups (threads and coroutines engines)\n");
+	printf("      --aging S          Treat a baker of priority class C waiting in an EDF queue as due after\n");
+	printf("                         (C + 1) * S simulated seconds at the latest (default 10)\n");
+	printf("  -h, --help             Show this message\n");
+}
+
+/**
+ * @brief Parses the command line into the global settings.
  *
- * The function performs the following steps:
- * 1. Initializes the recipes and tools.
- * 2. Iterates through each recipe, checking if it is completed.
- * 3. If a recipe is not completed, the baker attempts to gather the necessary ingredients.
- * 4. If the ingredients are available, the baker mixes and cooks the recipe.
- * 5. The process repeats until all recipes are completed.
- * 6. The function prints the status of the baker's progress and frees the memory allocated for the baker's ID.
+ * Unknown options print the usage and exit the program. Durations are applied after
+ * the kitchen file is loaded, so they can name the kitchen's recipes.
  *
- * Note: When this function terminates, it will reclaim memory from the thread.
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
  */
-void* simulateBaker(void* val) {
-	//Put all baker logic in here
-	//NOTE: When this function terminates, it will reclaim memory from the thread
-	int* bakerIdRef = (int*)val;
-	int bakerId = *bakerIdRef;
-
+void parseArguments(int argc, char* argv[]) {
+	static const struct option longOptions[] = {
+		{ "batched", no_argument, NULL, 'b' },
+		{ "backend", required_argument, NULL, 's' },
+		{ "bench-backends", no_argument, NULL, 'B' },
+		{ "verbosity", required_argument, NULL, 'v' },
+		{ "binary-log", required_argument, NULL, 'L' },
+		{ "dilation", required_argument, NULL, 'd' },
+		{ "duration", required_argument, NULL, 'D' },
+		{ "service-time", required_argument, NULL, 'T' },
+		{ "seed", required_argument, NULL, 'S' },
+		{ "engine", required_argument, NULL, 'e' },
+		{ "workers", required_argument, NULL, 'w' },
+		{ "oven-racks", required_argument, NULL, 'R' },
+		{ "batch-window", required_argument, NULL, 'W' },
+		{ "kitchen", required_argument, NULL, 'k' },
+		{ "latency", no_argument, NULL, 'l' },
+		{ "live-stats", no_argument, NULL, 'M' },
+		{ "bakers", required_argument, NULL, 'n' },
+		{ "rounds", required_argument, NULL, 'r' },
+		{ "summary", no_argument, NULL, 'U' },
+		{ "recipe-policy", required_argument, NULL, 'P' },
+		{ "gather-timeout", required_argument, NULL, 'G' },
+		{ "watchdog", required_argument, NULL, 'Y' },
+		{ "restockers", required_argument, NULL, 'K' },
+		{ "supply", required_argument, NULL, 'I' },
+		{ "suppliers", required_argument, NULL, 'J' },
+		{ "low-stock", required_argument, NULL, 'O' },
+		{ "shelves", required_argument, NULL, 'H' },
+		{ "storage-capacity", required_argument, NULL, 'C' },
+		{ "stash", required_argument, NULL, 'A' },
+		{ "stash-recipes", required_argument, NULL, 'Q' },
+		{ "stash-seconds", required_argument, NULL, 'X' },
+		{ "prefetch", required_argument, NULL, 'E' },
+		{ "timeline", required_argument, NULL, 'F' },
+		{ "orders", required_argument, NULL, 'N' },
+		{ "order-queue", required_argument, NULL, 'Z' },
+		{ "order-deadline", required_argument, NULL, 'y' },
+		{ "edf", no_argument, NULL, 'V' },
+		{ "aging", required_argument, NULL, 'x' },
+		{ "help", no_argument, NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	settings.backend = findSyncBackend("sysv");
+	settings.verbosity = LOG_ALL;
+	settings.dilation = 1;
+	settings.ovenRacks = 1;
+	settings.batchWindow = 0.2;
+	settings.gatherTimeout = -1;
+	settings.suppliers = 1;
+	settings.lowStock = 1;
+	settings.stashRecipes = 3;
+	settings.stashSeconds = 60;
+	settings.orderQueueSize = ORDER_QUEUE_SIZE;
+	settings.aging = 10;
+
+	const char* kitchenPath = NULL;
+	char* end;
+	int backendGiven = 0;
+	const char* durationSpecifications[argc];
+	int durationCount = 0;
+	const char* supplySpecifications[argc];
+	int supplyCount = 0;
+	const char* capacitySpecifications[argc];
+	int capacityCount = 0;
+
+	int option;
+	while ((option = getopt_long(argc, argv, "bs:v:d:e:w:k:ln:r:h", longOptions, NULL)) != -1) {
+		switch (option) {
+			case 'b':
+				settings.batchedGather = 1;
+				break;
+			case 's':
+				settings.backend = findSyncBackend(optarg);
+				if (settings.backend == NULL) {
+					fprintf(stderr, "Unknown synchronization backend %s\n", optarg);
+					exit(1);
+				}
+				backendGiven = 1;
+				break;
+			case 'B':
+				settings.benchmarkBackends = 1;
+				break;
+			case 'v':
+				settings.verbosity = atoi(optarg);
+				break;
+			case 'L':
+				settings.binaryLogPath = optarg;
+				break;
+			case 'd':
+				settings.dilation = atof(optarg);
+				if (settings.dilation <= 0) {
+					fprintf(stderr, "The dilation factor must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'D':
+				durationSpecifications[durationCount++] = optarg;
+				break;
+			case 'T':
+				settings.serviceTimeDistribution = findName(serviceTimeDistributionNames, 3, optarg);
+				if (settings.serviceTimeDistribution < 0) {
+					fprintf(stderr, "Unknown service time distribution %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'S':
+				settings.seed = strtoull(optarg, &end, 10);
+				if (optarg[0] == '\0' || optarg[0] == '-' || *end != '\0') {
+					fprintf(stderr, "The seed must be a non-negative integer\n");
+					exit(1);
+				}
+				settings.seeded = 1;
+				break;
+			case 'e':
+				settings.engine = findName(engineNames, 3, optarg);
+				if (settings.engine < 0) {
+					fprintf(stderr, "Unknown engine %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'w':
+				settings.workers = atoi(optarg);
+				if (settings.workers <= 0) {
+					fprintf(stderr, "The number of workers must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'R':
+				settings.ovenRacks = atoi(optarg);
+				if (settings.ovenRacks <= 0) {
+					fprintf(stderr, "The number of oven racks must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'W':
+				settings.batchWindow = atof(optarg);
+				if (settings.batchWindow < 0) {
+					fprintf(stderr, "The batch window cannot be negative\n");
+					exit(1);
+				}
+				break;
+			case 'k':
+				kitchenPath = optarg;
+				break;
+			case 'l':
+				if (!LATENCY_STATS) {
+					fprintf(stderr, "Latency statistics were compiled out (LATENCY_STATS=0)\n");
+					exit(1);
+				}
+				settings.latencyStats = 1;
+				break;
+			case 'M':
+				settings.liveStats = 1;
+				break;
+			case 'n':
+				settings.bakers = atoi(optarg);
+				if (settings.bakers <= 0) {
+					fprintf(stderr, "The number of bakers must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'r':
+				settings.rounds = atoi(optarg);
+				if (settings.rounds <= 0) {
+					fprintf(stderr, "The number of rounds must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'U':
+				settings.summary = 1;
+				break;
+			case 'P':
+				settings.recipePolicy = findName(recipePolicyNames, 2, optarg);
+				if (settings.recipePolicy < 0) {
+					fprintf(stderr, "Unknown recipe policy %s\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'G':
+				settings.gatherTimeout = atof(optarg);
+				if (settings.gatherTimeout < 0) {
+					fprintf(stderr, "The gather timeout must not be negative\n");
+					exit(1);
+				}
+				break;
+			case 'Y':
+				settings.watchdogPeriod = atof(optarg);
+				if (settings.watchdogPeriod <= 0) {
+					fprintf(stderr, "The watchdog period must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'K':
+				settings.restockers = atoi(optarg);
+				if (settings.restockers < 0) {
+					fprintf(stderr, "The number of restockers must not be negative\n");
+					exit(1);
+				}
+				break;
+			case 'I':
+				supplySpecifications[supplyCount++] = optarg;
+				settings.inventory = 1;
+				break;
+			case 'J':
+				settings.suppliers = atoi(optarg);
+				if (settings.suppliers <= 0) {
+					fprintf(stderr, "The number of suppliers must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'H':
+				settings.shelves = atoi(optarg);
+				if (settings.shelves <= 0) {
+					fprintf(stderr, "The number of shelves must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'C':
+				capacitySpecifications[capacityCount++] = optarg;
+				break;
+			case 'A':
+				settings.stashSize = atoi(optarg);
+				if (settings.stashSize < 0) {
+					fprintf(stderr, "The stash size must not be negative\n");
+					exit(1);
+				}
+				break;
+			case 'Q':
+				settings.stashRecipes = atoi(optarg);
+				if (settings.stashRecipes <= 0) {
+					fprintf(stderr, "The number of recipes must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'E':
+				settings.prefetchers = atoi(optarg);
+				if (settings.prefetchers < 0) {
+					fprintf(stderr, "The number of prefetchers must not be negative\n");
+					exit(1);
+				}
+				break;
+			case 'F':
+				settings.timeline = atoi(optarg);
+				if (settings.timeline < 0) {
+					fprintf(stderr, "The number of bakers on the timeline must not be negative\n");
+					exit(1);
+				}
+				break;
+			case 'N':
+				settings.ordersSource = optarg;
+				break;
+			case 'Z':
+				settings.orderQueueSize = atoi(optarg);
+				if (settings.orderQueueSize <= 0 || (settings.orderQueueSize & (settings.orderQueueSize - 1)) != 0) {
+					fprintf(stderr, "The order queue size must be a power of two\n");
+					exit(1);
+				}
+				break;
+			case 'y':
+				settings.orderDeadline = atof(optarg);
+				if (settings.orderDeadline <= 0) {
+					fprintf(stderr, "The order deadline must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'V':
+				settings.edf = 1;
+				break;
+			case 'x':
+				settings.aging = atof(optarg);
+				if (settings.aging <= 0) {
+					fprintf(stderr, "The aging time must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'X':
+				settings.stashSeconds = atof(optarg);
+				if (settings.stashSeconds <= 0) {
+					fprintf(stderr, "The stash time must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'O':
+				settings.lowStock = atoi(optarg);
+				if (settings.lowStock <= 0) {
+					fprintf(stderr, "The low-stock threshold must be positive\n");
+					exit(1);
+				}
+				break;
+			case 'h':
+				printUsage(argv[0]);
+				exit(0);
+			default:
+				printUsage(argv[0]);
+				exit(1);
+		}
+	}
 
-	// Select color based on bakerId
-	const char* color = colors[bakerId % 7];
-	const char* resetColor = "\033[0m";
+	if (kitchenPath != NULL) {
+		loadKitchen(kitchenPath);
+	}
 
+	for (int i = 0; i < durationCount; i++) {
+		if (parseDuration(durationSpecifications[i]) == -1) {
+			fprintf(stderr, "Not a valid duration: %s\n", durationSpecifications[i]);
+			exit(1);
+		}
+	}
 
-	//Setup recipes
-	int cookieArray[9] = {};
-	int pancakeArray[9];
-	int pizzaDoughArray[9];
-	int softPretzelArray[9];
-	int cinnamonRollArray[9];
+	for (int i = 0; i < capacityCount; i++) {
+		if (parseStorageCapacity(capacitySpecifications[i]) == -1) {
+			fprintf(stderr, "Not a valid storage capacity: %s\n", capacitySpecifications[i]);
+			exit(1);
+		}
+	}
 
-	int* cookie = initRecipes(COOKIE, cookieArray);
-	int* pancake = initRecipes(PANCAKE, pancakeArray);
-	int* pizzaDough = initRecipes(PIZZA, pizzaDoughArray);
-	int* softPretzel = initRecipes(PRETZEL, softPretzelArray);
-	int* cinnamonRoll = initRecipes(CINROLL, cinnamonRollArray);
+	if (settings.shelves > 0) {
+		stripeStorages(settings.shelves);
+	}
 
-	int recipesRemaining[] = { 1, 1, 1, 1, 1 };
+	for (int i = 0; i < supplyCount; i++) {
+		if (parseSupply(supplySpecifications[i]) == -1) {
+			fprintf(stderr, "Not a valid supply: %s\n", supplySpecifications[i]);
+			exit(1);
+		}
+	}
 
-	//Setup tools
-	int tools[3];
-	tools[MIXER] = 1;
-	tools[BOWL] = 1;
-	tools[SPOON] = 1;
+	for (int recipe = 0; settings.inventory && recipe < kitchen.recipeCount; recipe++) {
+		for (uint32_t rest = kitchen.recipeIngredients[recipe]; rest != 0; rest &= rest - 1) {
+			if (inventory.shelves[__builtin_ctz(rest)].units == 0) {
+				fprintf(stderr, "%s is not supplied; give it a schedule with --supply\n", getIngredientName(__builtin_ctz(rest)));
+				exit(1);
+			}
+		}
+	}
 
-	key_t key = ftok(programPath, ramsiedSharedMemoryID);
-	struct sharedMem sharedMemory;
-	int failure = initSharedMemory(&sharedMemory, key, 2 * sizeof(int), 1);
-	if (failure) {
-		perror("Unable to get ramsied information");
+	if (settings.workers == 0) {
+		settings.workers = sysconf(_SC_NPROCESSORS_ONLN);
 	}
 
-	int ramsiedBakerId = sharedMemory.address[0];
-	int ramsiedRecipeId = sharedMemory.address[1];
-	int hasBeenRamsied = sharedMemory.address[2];
+	if (settings.bakers > 0 && settings.rounds == 0) {
+		settings.rounds = 1;
+	}
 
-	//Iterate through each of the recipes.
-	int i = 0;
+	if (backendGiven && settings.engine == ENGINE_COROUTINES) {
+		fprintf(stderr, "--backend is not available with the coroutines engine, which brings its own\n");
+		exit(1);
+	}
 
-	while (isARecipeRemaining(recipesRemaining, 5)) {
+	if (settings.engine == ENGINE_COROUTINES) {
+		settings.backend = &coroutineBackend;
+	}
 
-		if (!recipesRemaining[i]) {
-			i++;
-			i = i % 5;
-			continue;
-		}
+	if (backendGiven && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--backend is not available with the des engine, which never blocks on a semaphore\n");
+		exit(1);
+	}
 
-		int* currentRecipe = NULL;
-		if (i == COOKIE) {
-			currentRecipe = cookie;
-			printf("%sBaker %d is working on making Cookies%s\n", color, bakerId, resetColor);
-		}
+	if (settings.latencyStats && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--latency measures real waits and is not available with the des engine\n");
+		exit(1);
+	}
 
-		if (i == PANCAKE) {
-			currentRecipe = pancake;
-			printf("%sBaker %d is working on making Pancakes%s\n", color, bakerId, resetColor);
-		}
+	if (settings.gatherTimeout >= 0 && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--gather-timeout is not available with the des engine\n");
+		exit(1);
+	}
 
-		if (i == PIZZA) {
-			currentRecipe = pizzaDough;
-			printf("%sBaker %d is working on making Pizza Dough%s\n", color, bakerId, resetColor);
-		}
+	if (settings.watchdogPeriod > 0 && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--watchdog watches real waits and is not available with the des engine\n");
+		exit(1);
+	}
 
-		if (i == PRETZEL) {
-			currentRecipe = softPretzel;
-			printf("%sBaker %d is working on making Soft Pretzels%s\n", color, bakerId, resetColor);
-		}
+	if (settings.restockers > 0 && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--restockers is not available with the des engine\n");
+		exit(1);
+	}
 
-		if (i == CINROLL) {
-			currentRecipe = cinnamonRoll;
-			printf("%sBaker %d is working on making Cinnamon Rolls%s\n", color, bakerId, resetColor);
-		}
+	if (settings.inventory && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--supply is not available with the des engine\n");
+		exit(1);
+	}
 
-		if (currentRecipe == NULL) {
-			printf("Invalid index for recipe found within simulateBaker\n");
-		}
+	if (settings.stashSize > 0 && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--stash is not available with the des engine\n");
+		exit(1);
+	}
 
-		int isRecipeComplete = getAvailableIngredients(bakerId, currentRecipe, color, resetColor);
-		recipesRemaining[i] = !isRecipeComplete;
+	if (settings.prefetchers > 0 && settings.engine != ENGINE_THREADS) {
+		fprintf(stderr, "--prefetch is only available with the threads engine\n");
+		exit(1);
+	}
 
-		if (isRecipeComplete) {
-			if (bakerId == ramsiedBakerId && i == ramsiedRecipeId && hasBeenRamsied == 1) {
-				printf("%sBaker %d has been %sramsied%s on recipe %s%s\n", color, bakerId, resetColor, color, getRecipeName(i), resetColor);
-				recipesRemaining[i] = 1;
-				hasBeenRamsied = 0;
-				initRecipes(i, currentRecipe);
-			} else {
-				mixIngredients(bakerId, tools, 3, color, resetColor);
+	if (settings.prefetchers > 0 && settings.watchdogPeriod > 0) {
+		fprintf(stderr, "--prefetch waits on behalf of bakers that are at the oven and is not available with --watchdog\n");
+		exit(1);
+	}
 
-				cookRecipe(bakerId, i, color, resetColor);
+	if (settings.timeline > 0 && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--timeline records wall time and is not available with the des engine\n");
+		exit(1);
+	}
 
-				printf("%sBaker %d finished recipe %s%s\n", color, bakerId, getRecipeName(i), resetColor);
-			}
-		}
+	if (settings.stashSize > 0 && settings.inventory) {
+		fprintf(stderr, "--stash keeps borrowed ingredients and is not available with --supply, where they are consumed\n");
+		exit(1);
+	}
 
-		i++;
-		i = i % 5;
+	if (settings.ordersSource != NULL && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--orders takes orders in wall time and is not available with the des engine\n");
+		exit(1);
+	}
 
+	if (settings.ordersSource != NULL && (settings.bakers == 0 || settings.rounds != 1)) {
+		fprintf(stderr, "--orders reads one stream in a single round and needs --bakers\n");
+		exit(1);
 	}
 
-	printf("%sBaker %d has%s finished\n", color, bakerId, resetColor);
+	if (settings.edf && settings.engine == ENGINE_DISCRETE_EVENT) {
+		fprintf(stderr, "--edf is not available with the des engine, which queues bakers itself\n");
+		exit(1);
+	}
 
-	free(bakerIdRef);
-	return NULL;
+	if (settings.ordersSource != NULL && settings.prefetchers > 0) {
+		fprintf(stderr, "--prefetch needs a baker's next recipe, which an order stream does not tell, and is not available with --orders\n");
+		exit(1);
+	}
 }
 
 /**
- * @brief Spawns a new thread to simulate a baker.
+ * @brief Asks how many bakers the next round should have.
  *
- * This function allocates memory for the baker's ID, initializes it, and creates a new thread
- * to run the `simulateBaker` function. If the thread creation fails, an error message is printed
- * and the program exits.
+ * Input that is not a number is skipped and asked for again.
  *
- * @param thread A pointer to a pthread_t variable where the thread ID will be stored.
- * @param bakerId An integer representing the ID of the baker.
+ * @return The number of bakers, or -1 at the end of the input.
  */
-void spawnThread(pthread_t* thread, int bakerId) {
-
-	int* id = malloc(sizeof(int));
-	*id = bakerId;
+int promptForBakers() {
+	int bakers = 0;
 
-	printf("Initializing baker %d\n", *id);
+	while (bakers < 1) {
+		printf("How many bakers would you like\n");
+		fflush(stdout);
 
-	int threadStatus = pthread_create(thread, NULL, simulateBaker, id);
+		int matched = scanf("%d", &bakers);
+		if (matched == EOF) {
+			return -1;
+		}
 
-	if (threadStatus != 0) {
-		fprintf(stderr, "Thread create error %d: %s\n", threadStatus, strerror(threadStatus));
+		if (matched == 0) {
+			scanf("%*s");
+		}
 
-		exit(1);
+		if (bakers < 1) {
+			printf("Please provide a valid number of bakers.\n");
+		}
 	}
 
-	//	pthread_detach(*thread);
+	return bakers;
 }
 
 /**
- * @brief Spawns a specified number of threads.
+ * @brief Prints the round's results as a single line of key=value pairs for scripts.
  *
- * This function initializes and spawns the given number of threads, each representing a baker.
- * It prints the number of bakers being initialized and then creates each thread by calling the
- * spawnThread function.
+ * The backend is reported as none for the discrete-event engine, which uses no semaphores.
+ * The recipe latency percentiles, in simulated seconds over every recipe of the round,
+ * and the total and p99 wait for storage areas and shelves are only present with --latency.
+ * The time spent blocked on resources is present when it was measured: always in the
+ * discrete-event engine, otherwise with --latency. The number of timed-out and busy acquires
+ * is present with --gather-timeout, the restock queue depth and lag with --restockers, the
+ * supply rate, the units consumed and the stockouts with --supply, the number of shelves
+ * per storage area with --shelves, the stash hit rate, the storage visits saved and
+ * the units the rebalancer reclaimed with --stash, and the gathering time hidden behind
+ * the oven and still waited for with --prefetch.
  *
- * @param threads A pointer to an array of pthread_t where the thread identifiers will be stored.
- * @param n The number of threads (bakers) to be spawned.
+ * @param bakers The number of bakers in the round.
+ * @param wallSeconds The wall time the round took.
+ * @param simulatedSeconds The simulated time the round took.
+ * @param blockedSeconds The simulated time bakers spent waiting for resources, or a
+ * negative value if it was not measured.
  */
-void spawnThreads(pthread_t* threads, int n) {
-	printf("Initializing %d bakers\n", n);
-	//for(int bakerId = 1; bakerId <= n; bakerId++) {
-	for (int bakerId = 0; bakerId < n; bakerId++) {
-		spawnThread(&threads[bakerId], bakerId);
+void printSummary(int bakers, double wallSeconds, double simulatedSeconds, double blockedSeconds) {
+	long long completed = 0;
+	for (int i = 0; i < kitchen.recipeCount; i++) {
+		completed += atomic_load(&roundStats.recipesCompleted[i]);
+	}
+
+	printf("summary engine=%s backend=%s policy=%s bakers=%d recipes=%lld ramsied=%lld wall_s=%.6f simulated_s=%.6f throughput=%.6f",
+		engineNames[settings.engine], settings.engine == ENGINE_DISCRETE_EVENT ? "none" : settings.backend->name, recipePolicyNames[settings.recipePolicy], bakers, completed, (long long)atomic_load(&roundStats.recipesRamsied),
+		wallSeconds, simulatedSeconds, simulatedSeconds > 0 ? completed / simulatedSeconds : 0.0);
+
+	if (blockedSeconds >= 0) {
+		printf(" blocked_s=%.6f", blockedSeconds);
+	}
+
+	if (settings.restockers > 0) {
+		long long restocks = atomic_load(&roundStats.restocks);
+
+		printf(" restock_depth_max=%d restock_lag_mean_ms=%.6f restock_lag_max_ms=%.6f", atomic_load(&roundStats.restockQueuedMax),
+			restocks > 0 ? atomic_load(&roundStats.restockLagTotal) / 1e6 / restocks : 0.0, atomic_load(&roundStats.restockLagMax) / 1e6);
+	}
+
+	if (settings.inventory) {
+		long long consumed = 0;
+		long long stockouts = 0;
+		for (int i = 0; i < kitchen.ingredientCount; i++) {
+			consumed += atomic_load(&roundStats.consumed[i]);
+			stockouts += atomic_load(&roundStats.stockouts[i]);
+		}
+
+		printf(" supply_per_s=%.6f consumed=%lld stockouts=%lld", getSupplyRate(), consumed, stockouts);
+	}
+
+	if (settings.shelves > 0) {
+		printf(" shelves=%d", settings.shelves);
+	}
+
+	if (settings.prefetchers > 0) {
+		printf(" prefetch_hidden_s=%.6f prefetch_exposed_s=%.6f",
+			atomic_load(&roundStats.prefetchHiddenNanoseconds) / 1e9 * settings.dilation,
+			atomic_load(&roundStats.prefetchExposedNanoseconds) / 1e9 * settings.dilation);
+	}
+
+	if (settings.stashSize > 0) {
+		long long lookups = atomic_load(&roundStats.stashLookups);
+
+		printf(" stash_hit_rate=%.6f storage_visits_saved=%lld stash_reclaimed=%lld",
+			lookups > 0 ? (double)atomic_load(&roundStats.stashHits) / lookups : 0.0,
+			(long long)atomic_load(&roundStats.storageVisitsSaved), (long long)atomic_load(&roundStats.stashReclaimed));
+	}
+
+	if (settings.ordersSource != NULL) {
+		LatencyHistogram none = { 0 };
+		LatencyHistogram total = { 0 };
+		const LatencyHistogram* queueing = orders.queueing != NULL ? orders.queueing : &none;
+		const LatencyHistogram* endToEnd = &total;
+		double secondsPerNanosecond = settings.dilation / 1e9;
+
+		mergeOrderLatency(&total);
+
+		printf(" orders=%lld orders_shed=%lld orders_per_s=%.6f order_queue_p50=%.6f order_queue_p99=%.6f",
+			(long long)atomic_load(&roundStats.ordersReceived), (long long)atomic_load(&roundStats.ordersShed),
+			sustainedOrderThroughput(), latencyPercentile(queueing, 0.5) * secondsPerNanosecond,
+			latencyPercentile(queueing, 0.99) * secondsPerNanosecond);
+		printf(" order_p50=%.6f order_p99=%.6f order_p999=%.6f order_max=%.6f",
+			latencyPercentile(endToEnd, 0.5) * secondsPerNanosecond, latencyPercentile(endToEnd, 0.99) * secondsPerNanosecond,
+			latencyPercentile(endToEnd, 0.999) * secondsPerNanosecond, endToEnd->max * secondsPerNanosecond);
+		printf(" deadline_miss_rate=%.6f", deadlineMissRate(-1));
+
+		for (int i = 0; i < ORDER_PRIORITIES; i++) {
+			if (orders.endToEnd[i] != NULL) {
+				printf(" order_p99_priority%d=%.6f deadline_miss_rate_priority%d=%.6f", i,
+					latencyPercentile(orders.endToEnd[i], 0.99) * secondsPerNanosecond, i, deadlineMissRate(i));
+			}
+		}
+	}
+
+	if (settings.gatherTimeout >= 0) {
+		long long timeouts = 0;
+		long long busy = 0;
+		for (int i = 0; i < resourceCount; i++) {
+			timeouts += atomic_load(&roundStats.resourceTimeouts[i]);
+			busy += atomic_load(&roundStats.resourceBusy[i]);
+		}
+
+		printf(" timeouts=%lld busy=%lld", timeouts, busy);
+	}
+
+	if (LATENCY_ENABLED) {
+		LatencyHistogram recipes = { 0 };
+		for (int i = 0; i < kitchen.recipeCount; i++) {
+			mergeLatencyHistogram(&recipes, &latency.recipes[i]);
+		}
+
+		double secondsPerTick = latencySecondsPerTick();
+		LatencyHistogram storageWaits = { 0 };
+		for (int i = 0; i < resourceCount; i++) {
+			if (isStorageResource(i)) {
+				mergeLatencyHistogram(&storageWaits, &latency.wait[i]);
+			}
+		}
+
+		printf(" storage_wait_s=%.6f storage_wait_p99=%.6f", storageWaits.total * secondsPerTick,
+			latencyPercentile(&storageWaits, 0.99) * secondsPerTick);
+		printf(" recipe_p50=%.6f recipe_p99=%.6f recipe_p999=%.6f recipe_max=%.6f",
+			latencyPercentile(&recipes, 0.5) * secondsPerTick, latencyPercentile(&recipes, 0.99) * secondsPerTick,
+			latencyPercentile(&recipes, 0.999) * secondsPerTick, recipes.max * secondsPerTick);
 	}
 
+	printf("\n");
 }
 
 /**
- * @brief Waits for all threads in the given array to complete.
- *
- * This function iterates over an array of pthread_t threads and calls
- * pthread_join on each one, ensuring that the main thread waits for
- * each thread to complete before continuing.
- *
- * @param threads An array of pthread_t representing the threads to wait for.
- * @param size The number of threads in the array.
+ * @brief Wraps up a round once every baker has finished: waits for the restockers to
+ * give back every return, stops the deliveries and the rebalancer, writes out the remaining events and
+ * marks the round as over in the live statistics.
  */
-void waitForThreads(pthread_t* threads, int size) {
-	for (int i = 0; i < size; i++) {
-		pthread_join(threads[i], NULL);
+void finishRound() {
+	if (restock.threadCount > 0) {
+		drainRestockers();
+	}
+
+	if (settings.inventory) {
+		finishInventoryRound();
+	}
+
+	if (settings.stashSize > 0) {
+		finishStashRound();
+	}
+
+	flushEventLog();
+
+	if (liveStats != NULL) {
+		finishLiveStatsRound();
+	}
+
+	if (watchdog.bakers != NULL) {
+		finishWatchdogRound();
 	}
 }
 
@@ -1293,70 +10596,192 @@ void waitForThreads(pthread_t* threads, int size) {
  *
  * The program initializes several semaphores to manage access to kitchen resources such as mixers, pantry, refrigerator, bowls, spoons, and ovens.
  * It also initializes semaphores for various ingredients like flour, sugar, yeast, baking soda, salt, cinnamon, eggs, milk, and butter.
+ * The semaphores come from the synchronization backend chosen with --backend (sysv, posix or futex), and the kitchen
+ * itself is compiled in from X-macro tables or loaded with --kitchen.
+ *
+ * Each round runs the bakers as threads, as coroutines on a worker pool, or in the single-threaded discrete-event
+ * engine (--engine). Operations take simulated time (--dilation, --duration, --service-time). Bakers record events
+ * into per-thread rings that a background thread writes out, and --latency, --live-stats (read by kitchenstat.c)
+ * and --watchdog report on the run without the bakers printing.
+ *
+ * The other options change how bakers share the kitchen: oven batches, recipe choice, gather timeouts, restockers,
+ * inventory mode, storage shelves, per-baker stashes, prefetchers, an order stream instead of fixed recipes, and
+ * earliest-deadline-first grants of the tools and the oven. printUsage lists them.
  *
- * The program uses shared memory to store the number of bakers and a randomly selected recipe.
- * It then creates a specified number of threads, each representing a baker, and waits for all threads to complete their tasks.
+ * With --bakers the program asks nothing: it runs --rounds rounds (one by default) and exits, and --summary ends each
+ * round with a key=value line that kitchen_bench.c (gcc kitchen_bench.c -o kitchen_bench -lm) collects.
  *
  * @note The program handles the SIGINT signal to ensure proper cleanup of resources.
+ * @note Build with: gcc program.c -o program -lpthread -lm
  *
  * @authors Steven Streasick, Zaydrian Price
  * @date 2024
  *
  * @return int: Returns 0 on successful execution.
  */
-int main() {
+int main(int argc, char* argv[]) {
+	parseArguments(argc, argv);
+
+	if (settings.benchmarkBackends) {
+		benchmarkBackends();
+		return 0;
+	}
+
 	signal(SIGINT, sigHandler);
 
-	mixerSemID = initSemaphore(MIXER, 2);
-	pantrySemID = initSemaphore(PANTRY, 1);
-	refrigeratorSemID = initSemaphore(REFRIGERATOR, 2);
-	bowlSemID = initSemaphore(BOWL, 3);
-	spoonSemID = initSemaphore(SPOON, 5);
-	ovenSemID = initSemaphore(OVEN, 1);
-
-	flourSemId = initSemaphore(semOffset + FLOUR, 1);
-	sugarSemId = initSemaphore(semOffset + SUGAR, 1);
-	yeastSemId = initSemaphore(semOffset + YEAST, 1);
-	bakingSodaSemId = initSemaphore(semOffset + BAKING_SODA, 1);
-	saltSemId = initSemaphore(semOffset + SALT, 1);
-	cinnamonSemId = initSemaphore(semOffset + CINNAMON, 1);
-	eggsSemId = initSemaphore(semOffset + EGGS, 2);
-	milkSemId = initSemaphore(semOffset + MILK, 2);
-	butterSemId = initSemaphore(semOffset + BUTTER, 2);
+	key_t key = getSharedMemoryKey(ramsiedSharedMemoryID);
 
-	//Write to shared memory the baker and the recipe to get ramsied.
-	struct sharedMem sharedMemory;
-	key_t key = ftok(programPath, ramsiedSharedMemoryID);
+	initResources();
+	startEventLog(settings.binaryLogPath);
 
-	initSharedMemory(&sharedMemory, key, 3 * sizeof(int), 0);
+	if (settings.liveStats) {
+		initLiveStats();
+	}
 
+	if (settings.watchdogPeriod > 0) {
+		initWatchdog();
+	}
 
-	while (1) {
-		int bakers = -1;
+	if (settings.restockers > 0) {
+		initRestockers(settings.restockers);
+	}
 
-		while (bakers < 0) {
-			printf("How many bakers would you like\n");
+	if (settings.inventory) {
+		initInventory(settings.suppliers);
+	}
 
-			scanf("%d", &bakers);
-			if (bakers < 0) {
-				printf("Please provide a valid number of bakers.");
-			}
+	if (settings.stashSize > 0) {
+		initStash();
+	}
+
+	if (settings.prefetchers > 0) {
+		initPrefetchers(settings.prefetchers);
+	}
+
+	if (settings.ordersSource != NULL) {
+		initOrders();
+	}
+
+	if (settings.edf) {
+		initEdf();
+	}
+
+	//Write to shared memory the baker and the recipe to get ramsied.
+	initSharedMemory(&ramsiedMemory, key, 3 * sizeof(*ramsiedMemory.address), 0);
+
+
+	for (int round = 0; settings.rounds == 0 || round < settings.rounds; round++) {
+		int bakers = settings.bakers > 0 ? settings.bakers : promptForBakers();
+
+		if (bakers < 0) {
+			break;
 		}
 
 		//Create n threads, with each one representing a baker.
-		srand(time(NULL));
+		srand(settings.seeded ? settings.seed : time(NULL));
+
+		ramsiedMemory.address[0] = rand() % bakers;
+		ramsiedMemory.address[1] = rand() % kitchen.recipeCount;
+		ramsiedMemory.address[2] = 1;
+
+		startRoundStats();
+
+		if (liveStats != NULL) {
+			startLiveStatsRound(bakers);
+		}
+
+		if (watchdog.bakers != NULL) {
+			startWatchdogRound(bakers);
+		}
+
+		if (settings.inventory) {
+			startInventoryRound();
+		}
+
+		if (settings.stashSize > 0) {
+			startStashRound(bakers);
+		}
 
-		sharedMemory.address[0] = rand() % bakers;
-		sharedMemory.address[1] = rand() % 5;
-		sharedMemory.address[2] = 1;
+		if (settings.prefetchers > 0) {
+			startPrefetchRound(bakers);
+		}
+
+		if (settings.timeline > 0) {
+			startTimelineRound(bakers);
+		}
+
+		if (settings.edf) {
+			startEdfRound(bakers);
+		}
+
+		if (settings.ordersSource != NULL) {
+			startOrderRound();
+		}
+
+		double desSimulatedSeconds = 0;
 
-		pthread_t threads[bakers];
-		spawnThreads(threads, bakers);
+		if (settings.engine == ENGINE_DISCRETE_EVENT) {
+			desSimulatedSeconds = runDiscreteEventRound(bakers, ramsiedMemory.address[0], ramsiedMemory.address[1]);
+		}
+		else if (settings.engine == ENGINE_COROUTINES) {
+			runCoroutineRound(bakers);
+		}
+		else {
+			runThreadRound(bakers);
+		}
+
+		finishRound();
+
+		double wallSeconds = roundWallSeconds();
+		double simulatedSeconds = settings.engine == ENGINE_DISCRETE_EVENT ? desSimulatedSeconds : wallSeconds * settings.dilation;
+		double blockedSeconds = -1;
+
+		if (settings.engine == ENGINE_DISCRETE_EVENT) {
+			blockedSeconds = des.blockedTime;
+		}
+		else if (LATENCY_ENABLED) {
+			mergeLatencyStats();
+			blockedSeconds = latency.blockedTicks * latencySecondsPerTick();
+		}
 
-		waitForThreads(threads, bakers);
 		printf("All bakers have finished\n");
+		printRoundStats(wallSeconds, simulatedSeconds, blockedSeconds);
+
+		if (settings.engine == ENGINE_DISCRETE_EVENT) {
+			printf("  Discrete-event engine processed %llu timed events\n", (unsigned long long)des.events);
+		}
+
+		if (settings.inventory) {
+			printInventoryStats(simulatedSeconds);
+		}
+
+		if (settings.ordersSource != NULL) {
+			printOrderStats();
+		}
+
+		if (settings.timeline > 0) {
+			printTimeline(wallSeconds);
+		}
+
+		if (watchdog.bakers != NULL) {
+			printf("  Watchdog: %lld deadlocks, %lld convoys reported\n",
+				(long long)atomic_load(&watchdog.deadlocks), (long long)atomic_load(&watchdog.convoys));
+		}
+
+		if (LATENCY_ENABLED) {
+			printLatencyStats();
+		}
+
+		if (settings.summary) {
+			printSummary(bakers, wallSeconds, simulatedSeconds, blockedSeconds);
+		}
+
+		fflush(stdout);
 	}
 
+	cleanupSemaphores();
+	cleanupSharedMemory();
+
 	return 0;
 
 }